@@ -1,27 +1,24 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 // Licensed under the MIT License.
 
-#include <cmath>
 #include <algorithm>
 #include <chrono>
+#include <fstream>
 #include <iostream>
-#include <numeric>
 #include <stdexcept>
 #include <string>
-#include <string_view>
 #include <vector>
 
 #include "ort_genai.h"
 
 #include "options.h"
 #include "resource_utils.h"
+#include "results.h"
 
 namespace {
 
-using Clock = std::chrono::steady_clock;
-
-using Duration = Clock::duration;
-using DurationFp = std::chrono::duration<float, Duration::period>;
+using benchmark::Clock;
+using benchmark::Duration;
 
 class Timing {
  public:
@@ -42,76 +39,6 @@ class Timing {
   const Clock::time_point start_;
 };
 
-struct Statistics {
-  DurationFp average{};
-  DurationFp stddev{};
-  DurationFp p50{};
-  DurationFp p90{};
-  DurationFp p99{};
-  size_t n{};
-};
-
-Statistics ComputeStats(const std::vector<Duration>& measurements) {
-  Statistics stats{};
-  if (measurements.empty()) {
-    return stats;
-  }
-
-  stats.n = measurements.size();
-
-  const auto sum = std::accumulate(measurements.begin(), measurements.end(), Duration{0});
-  stats.average = DurationFp{sum} / stats.n;
-
-  std::vector<Duration> sorted = measurements;
-  std::sort(sorted.begin(), sorted.end());
-
-  stats.p50 = sorted[static_cast<size_t>(stats.n * 0.5)];
-  stats.p90 = sorted[static_cast<size_t>(stats.n * 0.9)];
-  stats.p99 = sorted[static_cast<size_t>(stats.n * 0.99)];
-
-  if (stats.n > 1) {
-    const float variance =
-        std::accumulate(
-            measurements.begin(), measurements.end(),
-            0.0f,
-            [mean = stats.average.count()](float accumulator, const Duration& m) -> float {
-              const float distance_from_mean = m.count() - mean;
-              return accumulator + distance_from_mean * distance_from_mean;
-            }) /
-        (stats.n - 1);
-
-    const float stddev = std::sqrt(variance);
-    stats.stddev = DurationFp{stddev};
-  }
-
-  return stats;
-}
-
-void WritePerTokenStats(std::string_view label,
-                        const Statistics& stats,
-                        const size_t tokens_per_measurement) {
-  using MicrosecondsFp = std::chrono::duration<float, std::chrono::microseconds::period>;
-  const auto avg_us = MicrosecondsFp{stats.average};
-  std::cout << label << ":"
-            << "\n\tavg (us):       " << avg_us.count()
-            << "\n\tavg (tokens/s): " << 1.0e6f / avg_us.count() * tokens_per_measurement
-            << "\n\tp50 (us):       " << MicrosecondsFp{stats.p50}.count()
-            << "\n\tstddev (us):    " << MicrosecondsFp{stats.stddev}.count()
-            << "\n\tn:              " << stats.n << " * " << tokens_per_measurement << " token(s)"
-            << "\n";
-}
-
-void WriteE2EStats(std::string_view label,
-                   const Statistics& stats) {
-  using MillisecondsFp = std::chrono::duration<float, std::chrono::milliseconds::period>;
-  std::cout << label << ":"
-            << "\n\tavg (ms):       " << MillisecondsFp{stats.average}.count()
-            << "\n\tp50 (ms):       " << MillisecondsFp{stats.p50}.count()
-            << "\n\tstddev (ms):    " << MillisecondsFp{stats.stddev}.count()
-            << "\n\tn:              " << stats.n
-            << "\n";
-}
-
 std::string GeneratePrompt(size_t num_prompt_tokens, const OgaModel& model, const OgaTokenizer& tokenizer) {
   const char* const base_prompt = "A";
   auto base_prompt_sequences = OgaSequences::Create();
@@ -129,45 +56,58 @@ std::string GeneratePrompt(size_t num_prompt_tokens, const OgaModel& model, cons
   return std::string{tokenizer.Decode(output_sequence_data, output_sequence_length)};
 }
 
-void RunBenchmark(const benchmark::Options& opts) {
-  auto model = OgaModel::Create(opts.model_path.c_str());
-  auto tokenizer = OgaTokenizer::Create(*model);
-
-  const std::string prompt = GeneratePrompt(opts.num_prompt_tokens, *model, *tokenizer);
-  auto prompt_sequences = OgaSequences::Create();
-
-  if (opts.batch_size < 1) {
-    throw std::runtime_error("Batch size must be at least 1.");
+void SetSamplingOptions(OgaGeneratorParams& params, benchmark::Sampling sampling, const benchmark::Options& opts) {
+  switch (sampling) {
+    case benchmark::Sampling::Greedy:
+      params.SetSearchOptionBool("do_sample", false);
+      break;
+    case benchmark::Sampling::TopK:
+      params.SetSearchOptionBool("do_sample", true);
+      params.SetSearchOption("top_k", static_cast<double>(opts.top_k));
+      params.SetSearchOption("top_p", 1.0);
+      break;
+    case benchmark::Sampling::TopP:
+      params.SetSearchOptionBool("do_sample", true);
+      params.SetSearchOption("top_k", 0.0);
+      params.SetSearchOption("top_p", static_cast<double>(opts.top_p));
+      break;
+    case benchmark::Sampling::Beam:
+      params.SetSearchOptionBool("do_sample", false);
+      params.SetSearchOption("num_beams", static_cast<double>(opts.num_beams));
+      params.SetSearchOption("num_return_sequences", 1.0);
+      break;
   }
+}
+
+benchmark::Result RunConfiguration(const benchmark::Options& opts, OgaModel& model, OgaTokenizer& tokenizer,
+                                   const std::string& prompt, size_t batch_size, benchmark::Sampling sampling) {
+  const bool peak_working_set_per_configuration = benchmark::utils::ResetPeakWorkingSetSize();
 
-  for (size_t i = 0; i < opts.batch_size; ++i) {
-    tokenizer->Encode(prompt.c_str(), *prompt_sequences);
+  auto prompt_sequences = OgaSequences::Create();
+  for (size_t i = 0; i < batch_size; ++i) {
+    tokenizer.Encode(prompt.c_str(), *prompt_sequences);
   }
 
   const size_t num_prompt_tokens = prompt_sequences->SequenceCount(0);
   const size_t num_tokens = num_prompt_tokens + opts.num_tokens_to_generate;
 
-  auto make_generator_params = [&] {
-    auto params = OgaGeneratorParams::Create(*model);
-    params->SetSearchOption("max_length", static_cast<double>(num_tokens));
-    params->SetSearchOption("min_length", static_cast<double>(num_tokens));
-    params->SetInputSequences(*prompt_sequences);
-    return params;
-  };
-
-  const auto generator_params = make_generator_params();
+  auto generator_params = OgaGeneratorParams::Create(model);
+  generator_params->SetSearchOption("max_length", static_cast<double>(num_tokens));
+  generator_params->SetSearchOption("min_length", static_cast<double>(num_tokens));
+  SetSamplingOptions(*generator_params, sampling, opts);
+  generator_params->SetInputSequences(*prompt_sequences);
 
   // warmup
   if (opts.verbose) std::cout << "Running warmup iterations (" << opts.num_warmup_iterations << ")...\n";
   for (size_t i = 0; i < opts.num_warmup_iterations; ++i) {
-    auto output_sequences = model->Generate(*generator_params);
+    auto output_sequences = model.Generate(*generator_params);
 
     if (opts.verbose && i == 0) {
       // show prompt and output on first iteration
       std::cout << "Prompt:\n\t" << prompt << "\n";
       const auto output_sequence_length = output_sequences->SequenceCount(0);
       const auto* output_sequence_data = output_sequences->SequenceData(0);
-      const auto output = tokenizer->Decode(output_sequence_data, output_sequence_length);
+      const auto output = tokenizer.Decode(output_sequence_data, output_sequence_length);
       std::cout << "Output:\n\t" << output << "\n";
     }
   }
@@ -179,9 +119,11 @@ void RunBenchmark(const benchmark::Options& opts) {
   token_gen_times.reserve(opts.num_iterations * (opts.num_tokens_to_generate - 1));
   sampling_times.reserve(opts.num_iterations * opts.num_tokens_to_generate);
 
+  size_t peak_generator_bytes = 0;
+
   if (opts.verbose) std::cout << "Running iterations (" << opts.num_iterations << ")...\n";
   for (size_t i = 0; i < opts.num_iterations; ++i) {
-    auto generator = OgaGenerator::Create(*model, *generator_params);
+    auto generator = OgaGenerator::Create(model, *generator_params);
 
     {
       Timing e2e_gen_timing{e2e_gen_times};
@@ -208,27 +150,68 @@ void RunBenchmark(const benchmark::Options& opts) {
         }
       }
     }
+
+    size_t current_bytes{}, peak_bytes{};
+    generator->GetMemoryUsage(nullptr, current_bytes, peak_bytes);
+    peak_generator_bytes = std::max(peak_generator_bytes, peak_bytes);
   }
 
-  {
-    std::cout << "Batch size: " << opts.batch_size
-              << ", prompt tokens: " << num_prompt_tokens
-              << ", tokens to generate: " << opts.num_tokens_to_generate
-              << "\n";
+  benchmark::Result result{};
+  result.batch_size = batch_size;
+  result.num_prompt_tokens = num_prompt_tokens;
+  result.num_tokens_to_generate = opts.num_tokens_to_generate;
+  result.sampling = sampling;
+  result.prompt_processing = benchmark::ComputeStats(prompt_processing_times);
+  result.token_generation = benchmark::ComputeStats(token_gen_times);
+  result.token_sampling = benchmark::ComputeStats(sampling_times);
+  result.e2e_generation = benchmark::ComputeStats(e2e_gen_times);
+  result.peak_working_set_bytes = benchmark::utils::GetPeakWorkingSetSizeInBytes();
+  result.peak_working_set_per_configuration = peak_working_set_per_configuration;
+  result.peak_generator_bytes = peak_generator_bytes;
+  return result;
+}
+
+// Returns the number of regressions compared to the baseline, 0 without one
+size_t RunBenchmark(const benchmark::Options& opts) {
+  auto model = OgaModel::Create(opts.model_path.c_str());
+  auto tokenizer = OgaTokenizer::Create(*model);
+
+  std::vector<benchmark::Result> results;
+  for (const auto num_prompt_tokens : opts.num_prompt_tokens) {
+    const std::string prompt = GeneratePrompt(num_prompt_tokens, *model, *tokenizer);
 
-    const auto e2e_gen_stats = ComputeStats(e2e_gen_times);
-    const auto prompt_processing_stats = ComputeStats(prompt_processing_times);
-    const auto token_gen_stats = ComputeStats(token_gen_times);
-    const auto sampling_stats = ComputeStats(sampling_times);
+    for (const auto batch_size : opts.batch_sizes) {
+      for (const auto sampling : opts.samplings) {
+        if (opts.verbose) {
+          std::cout << "Benchmarking batch size " << batch_size << ", prompt tokens " << num_prompt_tokens
+                    << ", sampling " << benchmark::ToString(sampling) << "...\n";
+        }
+        results.push_back(RunConfiguration(opts, *model, *tokenizer, prompt, batch_size, sampling));
 
-    WritePerTokenStats("Prompt processing (time to first token)",
-                       prompt_processing_stats, opts.batch_size * num_prompt_tokens);
-    WritePerTokenStats("Token generation", token_gen_stats, opts.batch_size);
-    WritePerTokenStats("Token sampling", sampling_stats, opts.batch_size);
-    WriteE2EStats("E2E generation (entire generation loop)", e2e_gen_stats);
+        // Text output is written as we go, so a long sweep shows progress
+        if (opts.output_format == benchmark::OutputFormat::Text && opts.output_path.empty()) {
+          benchmark::WriteResults(std::cout, {results.back()}, opts.output_format);
+        }
+      }
+    }
+  }
 
-    std::cout << "Peak working set size (bytes): " << benchmark::utils::GetPeakWorkingSetSizeInBytes() << "\n";
+  if (!opts.output_path.empty()) {
+    std::ofstream output{opts.output_path};
+    if (!output) {
+      throw std::runtime_error("Unable to open output file: " + opts.output_path);
+    }
+    benchmark::WriteResults(output, results, opts.output_format);
+  } else if (opts.output_format != benchmark::OutputFormat::Text) {
+    benchmark::WriteResults(std::cout, results, opts.output_format);
   }
+
+  if (opts.baseline_path.empty()) {
+    return 0;
+  }
+  // Keep stdout clean for machine readable output
+  auto& report = opts.output_path.empty() && opts.output_format != benchmark::OutputFormat::Text ? std::cerr : std::cout;
+  return benchmark::CompareWithBaseline(report, results, opts.baseline_path, opts.max_regression_percent);
 }
 
 }  // namespace
@@ -237,8 +220,8 @@ int main(int argc, char** argv) {
   OgaHandle handle;
   try {
     const auto opts = benchmark::ParseOptionsFromCommandLine(argc, argv);
-    RunBenchmark(opts);
-    return 0;
+    const size_t regressions = RunBenchmark(opts);
+    return regressions == 0 ? 0 : 2;
   } catch (const std::exception& e) {
     std::cerr << "Exception: " << e.what() << "\n";
     return 1;
@@ -11,6 +11,7 @@
 #include <string>
 #include <string_view>
 #include <system_error>
+#include <type_traits>
 
 namespace benchmark {
 
@@ -24,16 +25,34 @@ namespace {
     << "  Options:\n"
     << "    -i,--input_folder <path>\n"
     << "      Path to the ONNX model directory to benchmark, compatible with onnxruntime-genai.\n"
-    << "    -b,--batch_size <number>\n"
-    << "      Number of sequences to generate in parallel. Default: " << defaults.batch_size << "\n"
-    << "    -l,--prompt_length <number>\n"
-    << "      Number of tokens in the prompt. Default: " << defaults.num_prompt_tokens << "\n"
+    << "    -b,--batch_size <number>[,<number>...]\n"
+    << "      Number of sequences to generate in parallel. Default: " << defaults.batch_sizes.front() << "\n"
+    << "    -l,--prompt_length <number>[,<number>...]\n"
+    << "      Number of tokens in the prompt. Default: " << defaults.num_prompt_tokens.front() << "\n"
     << "    -g,--generation_length <number>\n"
     << "      Number of tokens to generate. Default: " << defaults.num_tokens_to_generate << "\n"
     << "    -r,--repetitions <number>\n"
     << "      Number of times to repeat the benchmark. Default: " << defaults.num_iterations << "\n"
     << "    -w,--warmup <number>\n"
     << "      Number of warmup runs before benchmarking. Default: " << defaults.num_warmup_iterations << "\n"
+    << "    -s,--sampling <greedy|top_k|top_p|beam>[,...]\n"
+    << "      Search/sampling configurations to benchmark. Default: " << ToString(defaults.samplings.front()) << "\n"
+    << "    --top_k <number>\n"
+    << "      top_k used by the top_k sampling configuration. Default: " << defaults.top_k << "\n"
+    << "    --top_p <number>\n"
+    << "      top_p used by the top_p sampling configuration. Default: " << defaults.top_p << "\n"
+    << "    --num_beams <number>\n"
+    << "      Number of beams used by the beam configuration. Default: " << defaults.num_beams << "\n"
+    << "      Every combination of the batch sizes, prompt lengths and sampling configurations is benchmarked.\n"
+    << "    -f,--output_format <text|csv|json>\n"
+    << "      Format of the results. Default: text\n"
+    << "    -o,--output <path>\n"
+    << "      File to write the results to. Default: standard output\n"
+    << "    --baseline <path>\n"
+    << "      CSV results of an earlier run. Configurations that got slower by more than --max_regression are\n"
+    << "      reported and make the program exit with a non-zero code.\n"
+    << "    --max_regression <percent>\n"
+    << "      Allowed slowdown compared to the baseline. Default: " << defaults.max_regression_percent << "\n"
     << "    -v,--verbose\n"
     << "      Show more informational output.\n"
     << "    -h,--help\n"
@@ -46,22 +65,84 @@ namespace {
 template <typename T>
 T ParseNumber(std::string_view s) {
   T n;
-  const auto *s_begin = s.data(), *s_end = s.data() + s.size();
-  const auto [ptr, ec] = std::from_chars(s_begin, s_end, n);
-  if (ec != std::errc{} || ptr != s_end) {
-    throw std::runtime_error(std::string{"Failed to parse option value as number: "}.append(s));
+  if constexpr (std::is_floating_point_v<T>) {
+    // std::from_chars for floating point isn't available on every platform we build on
+    const std::string str{s};
+    char* end{};
+    n = static_cast<T>(std::strtod(str.c_str(), &end));
+    if (str.empty() || end != str.c_str() + str.size()) {
+      throw std::runtime_error(std::string{"Failed to parse option value as number: "}.append(s));
+    }
+  } else {
+    const auto *s_begin = s.data(), *s_end = s.data() + s.size();
+    const auto [ptr, ec] = std::from_chars(s_begin, s_end, n);
+    if (ec != std::errc{} || ptr != s_end) {
+      throw std::runtime_error(std::string{"Failed to parse option value as number: "}.append(s));
+    }
   }
   return n;
 }
 
+template <typename T, typename ParseFn>
+std::vector<T> ParseList(std::string_view s, ParseFn&& parse) {
+  std::vector<T> values;
+  while (true) {
+    const auto comma = s.find(',');
+    values.push_back(parse(s.substr(0, comma)));
+    if (comma == std::string_view::npos) {
+      return values;
+    }
+    s.remove_prefix(comma + 1);
+  }
+}
+
+std::vector<size_t> ParseNumberList(std::string_view s) {
+  return ParseList<size_t>(s, ParseNumber<size_t>);
+}
+
+Sampling ParseSampling(std::string_view s) {
+  for (auto sampling : {Sampling::Greedy, Sampling::TopK, Sampling::TopP, Sampling::Beam}) {
+    if (s == ToString(sampling)) {
+      return sampling;
+    }
+  }
+  throw std::runtime_error(std::string{"Unknown sampling configuration: "}.append(s));
+}
+
+OutputFormat ParseOutputFormat(std::string_view s) {
+  if (s == "text") return OutputFormat::Text;
+  if (s == "csv") return OutputFormat::Csv;
+  if (s == "json") return OutputFormat::Json;
+  throw std::runtime_error(std::string{"Unknown output format: "}.append(s));
+}
+
 void VerifyOptions(const Options& opts) {
   if (opts.model_path.empty()) {
     throw std::runtime_error("ONNX model directory path must be provided.");
   }
+  for (const auto batch_size : opts.batch_sizes) {
+    if (batch_size < 1) {
+      throw std::runtime_error("Batch size must be at least 1.");
+    }
+  }
 }
 
 }  // namespace
 
+const char* ToString(Sampling sampling) {
+  switch (sampling) {
+    case Sampling::Greedy:
+      return "greedy";
+    case Sampling::TopK:
+      return "top_k";
+    case Sampling::TopP:
+      return "top_p";
+    case Sampling::Beam:
+      return "beam";
+  }
+  return "unknown";
+}
+
 Options ParseOptionsFromCommandLine(int argc, const char* const* argv) {
   const char* const program_name = argc > 0 ? argv[0] : "model_benchmark";
   try {
@@ -80,15 +161,31 @@ Options ParseOptionsFromCommandLine(int argc, const char* const* argv) {
       if (arg == "-i" || arg == "--input_folder") {
         opts.model_path = next_arg(i);
       } else if (arg == "-b" || arg == "--batch_size") {
-        opts.batch_size = ParseNumber<size_t>(next_arg(i));
+        opts.batch_sizes = ParseNumberList(next_arg(i));
       } else if (arg == "-l" || arg == "--prompt_length") {
-        opts.num_prompt_tokens = ParseNumber<size_t>(next_arg(i));
+        opts.num_prompt_tokens = ParseNumberList(next_arg(i));
       } else if (arg == "-g" || arg == "--generation_length") {
         opts.num_tokens_to_generate = ParseNumber<size_t>(next_arg(i));
       } else if (arg == "-r" || arg == "--repetitions") {
         opts.num_iterations = ParseNumber<size_t>(next_arg(i));
       } else if (arg == "-w" || arg == "--warmup") {
         opts.num_warmup_iterations = ParseNumber<size_t>(next_arg(i));
+      } else if (arg == "-s" || arg == "--sampling") {
+        opts.samplings = ParseList<Sampling>(next_arg(i), ParseSampling);
+      } else if (arg == "--top_k") {
+        opts.top_k = ParseNumber<int>(next_arg(i));
+      } else if (arg == "--top_p") {
+        opts.top_p = ParseNumber<float>(next_arg(i));
+      } else if (arg == "--num_beams") {
+        opts.num_beams = ParseNumber<int>(next_arg(i));
+      } else if (arg == "-f" || arg == "--output_format") {
+        opts.output_format = ParseOutputFormat(next_arg(i));
+      } else if (arg == "-o" || arg == "--output") {
+        opts.output_path = next_arg(i);
+      } else if (arg == "--baseline") {
+        opts.baseline_path = next_arg(i);
+      } else if (arg == "--max_regression") {
+        opts.max_regression_percent = ParseNumber<float>(next_arg(i));
       } else if (arg == "-v" || arg == "--verbose") {
         opts.verbose = true;
       } else if (arg == "-h" || arg == "--help") {
@@ -4,16 +4,41 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 namespace benchmark {
 
+enum class Sampling {
+  Greedy,
+  TopK,
+  TopP,
+  Beam,
+};
+
+const char* ToString(Sampling sampling);
+
+enum class OutputFormat {
+  Text,
+  Csv,
+  Json,
+};
+
 struct Options {
   std::string model_path{};
-  size_t num_prompt_tokens{16};
+  // Every combination of the values in these lists is benchmarked
+  std::vector<size_t> num_prompt_tokens{16};
+  std::vector<size_t> batch_sizes{1};
+  std::vector<Sampling> samplings{Sampling::Greedy};
   size_t num_tokens_to_generate{128};
-  size_t batch_size{1};
   size_t num_iterations{5};
   size_t num_warmup_iterations{1};
+  int top_k{50};
+  float top_p{0.9f};
+  int num_beams{4};
+  OutputFormat output_format{OutputFormat::Text};
+  std::string output_path{};    // Standard output when empty
+  std::string baseline_path{};  // CSV output of an earlier run to compare against
+  float max_regression_percent{10.0f};
   bool verbose{false};
 };
 
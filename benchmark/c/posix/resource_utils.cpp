@@ -6,12 +6,24 @@
 #include <sys/resource.h>
 
 #include <cerrno>
+#include <fstream>
 #include <stdexcept>
 #include <string>
 
 namespace benchmark::utils {
 
 size_t GetPeakWorkingSetSizeInBytes() {
+#if defined(__linux__)
+  // Unlike ru_maxrss, VmHWM goes back to the current size when ResetPeakWorkingSetSize is called
+  std::ifstream status{"/proc/self/status"};
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.rfind("VmHWM:", 0) == 0) {
+      return static_cast<size_t>(std::stoull(line.substr(6))) * 1024;  // In kB
+    }
+  }
+#endif
+
   struct rusage rusage;
   if (getrusage(RUSAGE_SELF, &rusage) != 0) {
     throw std::runtime_error("getrusage failed with error code " + std::to_string(errno));
@@ -26,4 +38,16 @@ size_t GetPeakWorkingSetSizeInBytes() {
   return static_cast<size_t>(rusage.ru_maxrss) * kBytesPerMaxRssUnit;
 }
 
+bool ResetPeakWorkingSetSize() {
+#if defined(__linux__)
+  // See "clear_refs" in proc(5), 5 resets the peak resident set size
+  std::ofstream clear_refs{"/proc/self/clear_refs"};
+  clear_refs << "5";
+  clear_refs.flush();
+  return static_cast<bool>(clear_refs);
+#else
+  return false;
+#endif
+}
+
 }  // namespace benchmark::utils
@@ -9,4 +9,8 @@ namespace benchmark::utils {
 
 size_t GetPeakWorkingSetSizeInBytes();
 
+// Starts measuring the peak working set size again from the current working set size. Returns false where the platform
+// can't do that (only Linux can), the peak is then that of the whole process so far.
+bool ResetPeakWorkingSetSize();
+
 }  // namespace benchmark::utils
@@ -0,0 +1,256 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "results.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+
+namespace benchmark {
+
+namespace {
+
+using MicrosecondsFp = std::chrono::duration<float, std::chrono::microseconds::period>;
+using MillisecondsFp = std::chrono::duration<float, std::chrono::milliseconds::period>;
+
+float TokensPerSecond(const Statistics& stats, size_t tokens_per_measurement) {
+  return 1.0e6f / MicrosecondsFp{stats.average}.count() * tokens_per_measurement;
+}
+
+// A numeric column of the CSV and JSON output
+struct Column {
+  const char* name;
+  double (*value)(const Result&);
+  bool compare_with_baseline;  // Higher is a regression
+};
+
+const Column kColumns[] = {
+    {"prompt_avg_us", [](const Result& r) -> double { return MicrosecondsFp{r.prompt_processing.average}.count(); }, true},
+    {"prompt_p50_us", [](const Result& r) -> double { return MicrosecondsFp{r.prompt_processing.p50}.count(); }, false},
+    {"prompt_tokens_per_s", [](const Result& r) -> double { return TokensPerSecond(r.prompt_processing, r.batch_size * r.num_prompt_tokens); }, false},
+    {"token_gen_avg_us", [](const Result& r) -> double { return MicrosecondsFp{r.token_generation.average}.count(); }, true},
+    {"token_gen_p50_us", [](const Result& r) -> double { return MicrosecondsFp{r.token_generation.p50}.count(); }, false},
+    {"token_gen_p90_us", [](const Result& r) -> double { return MicrosecondsFp{r.token_generation.p90}.count(); }, false},
+    {"token_gen_tokens_per_s", [](const Result& r) -> double { return TokensPerSecond(r.token_generation, r.batch_size); }, false},
+    {"sampling_avg_us", [](const Result& r) -> double { return MicrosecondsFp{r.token_sampling.average}.count(); }, true},
+    {"sampling_p50_us", [](const Result& r) -> double { return MicrosecondsFp{r.token_sampling.p50}.count(); }, false},
+    {"e2e_avg_ms", [](const Result& r) -> double { return MillisecondsFp{r.e2e_generation.average}.count(); }, true},
+    {"e2e_p50_ms", [](const Result& r) -> double { return MillisecondsFp{r.e2e_generation.p50}.count(); }, false},
+    {"peak_working_set_bytes", [](const Result& r) -> double { return static_cast<double>(r.peak_working_set_bytes); }, false},
+    {"peak_working_set_per_configuration", [](const Result& r) -> double { return r.peak_working_set_per_configuration ? 1 : 0; }, false},
+    {"peak_generator_bytes", [](const Result& r) -> double { return static_cast<double>(r.peak_generator_bytes); }, false},
+};
+
+std::string ConfigurationKey(size_t batch_size, size_t num_prompt_tokens, size_t num_tokens_to_generate, std::string_view sampling) {
+  std::ostringstream s;
+  s << "batch_size=" << batch_size << " prompt_tokens=" << num_prompt_tokens
+    << " generation_tokens=" << num_tokens_to_generate << " sampling=" << sampling;
+  return s.str();
+}
+
+void WritePerTokenStats(std::ostream& os, std::string_view label,
+                        const Statistics& stats,
+                        const size_t tokens_per_measurement) {
+  const auto avg_us = MicrosecondsFp{stats.average};
+  os << label << ":"
+     << "\n\tavg (us):       " << avg_us.count()
+     << "\n\tavg (tokens/s): " << TokensPerSecond(stats, tokens_per_measurement)
+     << "\n\tp50 (us):       " << MicrosecondsFp{stats.p50}.count()
+     << "\n\tstddev (us):    " << MicrosecondsFp{stats.stddev}.count()
+     << "\n\tn:              " << stats.n << " * " << tokens_per_measurement << " token(s)"
+     << "\n";
+}
+
+void WriteE2EStats(std::ostream& os, std::string_view label,
+                   const Statistics& stats) {
+  os << label << ":"
+     << "\n\tavg (ms):       " << MillisecondsFp{stats.average}.count()
+     << "\n\tp50 (ms):       " << MillisecondsFp{stats.p50}.count()
+     << "\n\tstddev (ms):    " << MillisecondsFp{stats.stddev}.count()
+     << "\n\tn:              " << stats.n
+     << "\n";
+}
+
+void WriteText(std::ostream& os, const Result& result) {
+  os << "Batch size: " << result.batch_size
+     << ", prompt tokens: " << result.num_prompt_tokens
+     << ", tokens to generate: " << result.num_tokens_to_generate
+     << ", sampling: " << ToString(result.sampling)
+     << "\n";
+
+  WritePerTokenStats(os, "Prompt processing (time to first token)",
+                     result.prompt_processing, result.batch_size * result.num_prompt_tokens);
+  WritePerTokenStats(os, "Token generation", result.token_generation, result.batch_size);
+  WritePerTokenStats(os, "Token sampling", result.token_sampling, result.batch_size);
+  WriteE2EStats(os, "E2E generation (entire generation loop)", result.e2e_generation);
+
+  os << "Peak working set size (bytes): " << result.peak_working_set_bytes
+     << (result.peak_working_set_per_configuration ? "" : " (of the whole process so far)") << "\n";
+  os << "Peak generator buffers (bytes): " << result.peak_generator_bytes << "\n";
+}
+
+void WriteCsv(std::ostream& os, const std::vector<Result>& results) {
+  os << "batch_size,prompt_tokens,generation_tokens,sampling";
+  for (const auto& column : kColumns) {
+    os << ',' << column.name;
+  }
+  os << '\n';
+
+  for (const auto& result : results) {
+    os << result.batch_size << ',' << result.num_prompt_tokens << ',' << result.num_tokens_to_generate << ','
+       << ToString(result.sampling);
+    for (const auto& column : kColumns) {
+      os << ',' << column.value(result);
+    }
+    os << '\n';
+  }
+}
+
+void WriteJson(std::ostream& os, const std::vector<Result>& results) {
+  os << "[\n";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const auto& result = results[i];
+    os << "  {\"batch_size\": " << result.batch_size
+       << ", \"prompt_tokens\": " << result.num_prompt_tokens
+       << ", \"generation_tokens\": " << result.num_tokens_to_generate
+       << ", \"sampling\": \"" << ToString(result.sampling) << '"';
+    for (const auto& column : kColumns) {
+      os << ", \"" << column.name << "\": " << column.value(result);
+    }
+    os << (i + 1 < results.size() ? "},\n" : "}\n");
+  }
+  os << "]\n";
+}
+
+std::vector<std::string> SplitCsvLine(const std::string& line) {
+  std::vector<std::string> fields;
+  std::istringstream s{line};
+  std::string field;
+  while (std::getline(s, field, ',')) {
+    fields.push_back(field);
+  }
+  return fields;
+}
+
+}  // namespace
+
+Statistics ComputeStats(const std::vector<Duration>& measurements) {
+  Statistics stats{};
+  if (measurements.empty()) {
+    return stats;
+  }
+
+  stats.n = measurements.size();
+
+  const auto sum = std::accumulate(measurements.begin(), measurements.end(), Duration{0});
+  stats.average = DurationFp{sum} / stats.n;
+
+  std::vector<Duration> sorted = measurements;
+  std::sort(sorted.begin(), sorted.end());
+
+  stats.p50 = sorted[static_cast<size_t>(stats.n * 0.5)];
+  stats.p90 = sorted[static_cast<size_t>(stats.n * 0.9)];
+  stats.p99 = sorted[static_cast<size_t>(stats.n * 0.99)];
+
+  if (stats.n > 1) {
+    const float variance =
+        std::accumulate(
+            measurements.begin(), measurements.end(),
+            0.0f,
+            [mean = stats.average.count()](float accumulator, const Duration& m) -> float {
+              const float distance_from_mean = m.count() - mean;
+              return accumulator + distance_from_mean * distance_from_mean;
+            }) /
+        (stats.n - 1);
+
+    const float stddev = std::sqrt(variance);
+    stats.stddev = DurationFp{stddev};
+  }
+
+  return stats;
+}
+
+void WriteResults(std::ostream& os, const std::vector<Result>& results, OutputFormat format) {
+  switch (format) {
+    case OutputFormat::Text:
+      for (const auto& result : results) {
+        WriteText(os, result);
+      }
+      break;
+    case OutputFormat::Csv:
+      WriteCsv(os, results);
+      break;
+    case OutputFormat::Json:
+      WriteJson(os, results);
+      break;
+  }
+}
+
+size_t CompareWithBaseline(std::ostream& os, const std::vector<Result>& results, const std::string& baseline_path,
+                           float max_regression_percent) {
+  std::ifstream file{baseline_path};
+  if (!file) {
+    throw std::runtime_error("Unable to open baseline file: " + baseline_path);
+  }
+
+  std::string line;
+  if (!std::getline(file, line)) {
+    throw std::runtime_error("Baseline file is empty: " + baseline_path);
+  }
+  const auto header = SplitCsvLine(line);
+
+  // Configuration key -> column name -> value
+  std::map<std::string, std::map<std::string, double>> baseline;
+  while (std::getline(file, line)) {
+    const auto fields = SplitCsvLine(line);
+    if (fields.size() != header.size() || fields.size() < 4) {
+      continue;
+    }
+    auto& values = baseline[ConfigurationKey(std::stoul(fields[0]), std::stoul(fields[1]), std::stoul(fields[2]), fields[3])];
+    for (size_t i = 4; i < fields.size(); ++i) {
+      values[header[i]] = std::stod(fields[i]);
+    }
+  }
+
+  size_t regressions = 0;
+  for (const auto& result : results) {
+    const auto key = ConfigurationKey(result.batch_size, result.num_prompt_tokens, result.num_tokens_to_generate,
+                                      ToString(result.sampling));
+    const auto entry = baseline.find(key);
+    if (entry == baseline.end()) {
+      os << "Not in baseline: " << key << "\n";
+      continue;
+    }
+
+    for (const auto& column : kColumns) {
+      const auto baseline_value = entry->second.find(column.name);
+      if (!column.compare_with_baseline || baseline_value == entry->second.end() || baseline_value->second <= 0) {
+        continue;
+      }
+      const double value = column.value(result);
+      const double change_percent = (value / baseline_value->second - 1.0) * 100.0;
+      if (change_percent > max_regression_percent) {
+        os << "Regression: " << key << " " << column.name << " " << baseline_value->second << " -> " << value
+           << " (+" << change_percent << "%)\n";
+        ++regressions;
+      }
+    }
+    baseline.erase(entry);
+  }
+
+  for (const auto& [key, values] : baseline) {
+    os << "Not benchmarked: " << key << "\n";
+  }
+
+  os << regressions << " regression(s) compared to " << baseline_path << "\n";
+  return regressions;
+}
+
+}  // namespace benchmark
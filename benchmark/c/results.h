@@ -0,0 +1,56 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <chrono>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "options.h"
+
+namespace benchmark {
+
+using Clock = std::chrono::steady_clock;
+
+using Duration = Clock::duration;
+using DurationFp = std::chrono::duration<float, Duration::period>;
+
+struct Statistics {
+  DurationFp average{};
+  DurationFp stddev{};
+  DurationFp p50{};
+  DurationFp p90{};
+  DurationFp p99{};
+  size_t n{};
+};
+
+Statistics ComputeStats(const std::vector<Duration>& measurements);
+
+// The results of benchmarking one configuration
+struct Result {
+  size_t batch_size{};
+  size_t num_prompt_tokens{};
+  size_t num_tokens_to_generate{};
+  Sampling sampling{};
+
+  Statistics prompt_processing{};
+  Statistics token_generation{};
+  Statistics token_sampling{};
+  Statistics e2e_generation{};
+
+  size_t peak_working_set_bytes{};
+  bool peak_working_set_per_configuration{};  // Else the peak is of the whole process so far, see ResetPeakWorkingSetSize
+  size_t peak_generator_bytes{};    // KV cache, logits and search buffers of one generator, see OgaGenerator_GetMemoryUsage
+};
+
+void WriteResults(std::ostream& os, const std::vector<Result>& results, OutputFormat format);
+
+// Compares results against the CSV output of an earlier run. Prints the configurations whose average prompt processing,
+// token generation, sampling or end to end time got slower by more than max_regression_percent, and returns how many
+// there were. Configurations missing from either side are reported but don't count as regressions.
+size_t CompareWithBaseline(std::ostream& os, const std::vector<Result>& results, const std::string& baseline_path,
+                           float max_regression_percent);
+
+}  // namespace benchmark
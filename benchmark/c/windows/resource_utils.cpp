@@ -20,4 +20,8 @@ size_t GetPeakWorkingSetSizeInBytes() {
   return pmc.PeakWorkingSetSize;
 }
 
+bool ResetPeakWorkingSetSize() {
+  return false;  // Windows has no way to reset PeakWorkingSetSize
+}
+
 }  // namespace benchmark::utils
@@ -0,0 +1,427 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+// Microbenchmark of the CPU search and sampling kernels, run on synthetic logits so no model is needed.
+// See readme.md for usage.
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "generators.h"
+#include "search.h"
+#include "softmax.h"
+#include "models/utils.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using MicrosecondsFp = std::chrono::duration<double, std::micro>;
+
+struct Options {
+  std::vector<int> vocab_sizes{32000, 128256, 256000};
+  std::vector<int> batch_sizes{1, 8};
+  std::vector<std::string> kernels{};  // Empty runs all of them
+  size_t num_iterations{100};
+  size_t num_warmup_iterations{10};
+  int sequence_length{256};  // Tokens already in the sequences, what the repetition penalty looks at
+  int top_k{50};
+  float top_p{0.9f};
+  int num_beams{4};
+  bool csv{false};
+};
+
+[[noreturn]] void PrintHelpAndExit(const char* program_name, int exit_code) {
+  Options defaults{};
+  std::cerr << "Usage: " << program_name << " <options>\n"
+            << "  Options:\n"
+            << "    -v,--vocab_sizes <number>[,<number>...]   Default: 32000,128256,256000\n"
+            << "    -b,--batch_sizes <number>[,<number>...]   Default: 1,8\n"
+            << "    -k,--kernels <name>[,<name>...]           Default: all, see --list\n"
+            << "    -r,--repetitions <number>                 Default: " << defaults.num_iterations << "\n"
+            << "    -w,--warmup <number>                      Default: " << defaults.num_warmup_iterations << "\n"
+            << "    -l,--sequence_length <number>             Tokens already generated. Default: " << defaults.sequence_length << "\n"
+            << "    --top_k <number>                          Default: " << defaults.top_k << "\n"
+            << "    --top_p <number>                          Default: " << defaults.top_p << "\n"
+            << "    --num_beams <number>                      Default: " << defaults.num_beams << "\n"
+            << "    --csv                                     Write the results as CSV\n"
+            << "    --list                                    List the kernels and exit\n"
+            << "    -h,--help                                 Show this help message and exit\n";
+  std::exit(exit_code);
+}
+
+template <typename T>
+T ParseNumber(std::string_view s) {
+  T n{};
+  if constexpr (std::is_floating_point_v<T>) {
+    const std::string str{s};
+    char* end{};
+    n = static_cast<T>(std::strtod(str.c_str(), &end));
+    if (str.empty() || end != str.c_str() + str.size())
+      throw std::runtime_error(std::string{"Failed to parse option value as number: "}.append(s));
+  } else {
+    const auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), n);
+    if (ec != std::errc{} || ptr != s.data() + s.size())
+      throw std::runtime_error(std::string{"Failed to parse option value as number: "}.append(s));
+  }
+  return n;
+}
+
+std::vector<std::string> SplitList(std::string_view s) {
+  std::vector<std::string> values;
+  while (true) {
+    const auto comma = s.find(',');
+    values.emplace_back(s.substr(0, comma));
+    if (comma == std::string_view::npos)
+      return values;
+    s.remove_prefix(comma + 1);
+  }
+}
+
+std::vector<int> ParseNumberList(std::string_view s) {
+  std::vector<int> values;
+  for (const auto& value : SplitList(s))
+    values.push_back(ParseNumber<int>(value));
+  return values;
+}
+
+// Synthetic logits: mostly small noise, with a handful of strong candidates per row like a real model produces
+std::vector<float> CreateLogits(size_t rows, int vocab_size, std::mt19937& engine) {
+  std::vector<float> logits(rows * vocab_size);
+  std::normal_distribution<float> noise{0.0f, 2.0f};
+  std::uniform_int_distribution<int> token{0, vocab_size - 1};
+  for (size_t row = 0; row < rows; row++) {
+    auto* row_logits = logits.data() + row * vocab_size;
+    for (int i = 0; i < vocab_size; i++)
+      row_logits[i] = noise(engine);
+    for (int i = 0; i < 20; i++)
+      row_logits[token(engine)] = 15.0f + noise(engine);
+  }
+  return logits;
+}
+
+// One benchmark case: prepare() runs untimed before every run(), so run() always starts from the same inputs
+struct Case {
+  std::function<void()> prepare;
+  std::function<void()> run;
+  size_t elements_per_run;  // For the throughput column
+};
+
+struct Environment {
+  const Options& opts;
+  int vocab_size;
+  int batch_size;
+  std::mt19937& engine;
+};
+
+std::shared_ptr<Generators::GeneratorParams> CreateParams(const Environment& env, Generators::Config& config, int num_beams,
+                                                          std::vector<int32_t>& input_ids) {
+  config.model.vocab_size = env.vocab_size;
+  config.model.eos_token_id = -1;  // Never hit, so every step does the full amount of work
+  config.model.pad_token_id = 0;
+
+  std::uniform_int_distribution<int32_t> token{0, env.vocab_size - 1};
+  input_ids.resize(static_cast<size_t>(env.batch_size) * env.opts.sequence_length);
+  for (auto& id : input_ids)
+    id = token(env.engine);
+
+  auto params = Generators::CreateGeneratorParams(config);
+  params->batch_size = env.batch_size;
+  params->sequence_length = env.opts.sequence_length;
+  params->input_ids = input_ids;
+  params->search.num_beams = num_beams;
+  params->search.max_length = env.opts.sequence_length + static_cast<int>(env.opts.num_iterations + env.opts.num_warmup_iterations) + 1;
+  params->search.do_sample = num_beams == 1;
+  params->search.length_penalty = 1.0f;
+  params->search.early_stopping = false;
+  params->search.random_seed = 1234;
+  params->device_type = Generators::DeviceType::CPU;
+  return params;
+}
+
+// A search that is fed a fresh copy of the logits before every step
+template <typename SearchType>
+Case SearchCase(const Environment& env, int num_beams, std::function<void(Generators::Search&)> step) {
+  struct State {
+    Generators::Config config;
+    std::vector<int32_t> input_ids;
+    std::shared_ptr<Generators::GeneratorParams> params;
+    std::unique_ptr<Generators::Search> search;
+    std::vector<float> logits, scratch;
+  };
+  auto state = std::make_shared<State>();
+  state->params = CreateParams(env, state->config, num_beams, state->input_ids);
+  state->search = std::make_unique<SearchType>(*state->params);
+  state->logits = CreateLogits(static_cast<size_t>(env.batch_size) * num_beams, env.vocab_size, env.engine);
+  state->scratch.resize(state->logits.size());
+
+  return {[state] {
+            std::copy(state->logits.begin(), state->logits.end(), state->scratch.begin());
+            state->search->SetLogits(Generators::cpu_span<float>{state->scratch.data(), state->scratch.size()});
+          },
+          [state, step] { step(*state->search); },
+          state->logits.size()};
+}
+
+// Greedy search on fp16 logits, which the CPU search scores without converting them to fp32 first
+Case Greedy16Case(const Environment& env) {
+  struct State {
+    Generators::Config config;
+    std::vector<int32_t> input_ids;
+    std::shared_ptr<Generators::GeneratorParams> params;
+    std::unique_ptr<Generators::Search> search;
+    std::vector<uint16_t> logits, scratch;
+  };
+  auto state = std::make_shared<State>();
+  state->params = CreateParams(env, state->config, 1, state->input_ids);
+  state->params->search.do_sample = false;
+  state->search = std::make_unique<Generators::GreedySearch_Cpu>(*state->params);
+  const auto logits = CreateLogits(env.batch_size, env.vocab_size, env.engine);
+  state->logits.resize(logits.size());
+  Generators::ConvertFloat32ToFloat16(logits, state->logits);
+  state->scratch.resize(logits.size());
+
+  return {[state] {
+            std::copy(state->logits.begin(), state->logits.end(), state->scratch.begin());
+            state->search->SetLogits16(Generators::cpu_span<uint16_t>{state->scratch.data(), state->scratch.size()}, ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16);
+          },
+          [state] { state->search->SelectTop(); },
+          state->logits.size()};
+}
+
+Case SoftMaxCase(const Environment& env, bool log) {
+  auto logits = std::make_shared<std::vector<float>>(CreateLogits(env.batch_size, env.vocab_size, env.engine));
+  auto scratch = std::make_shared<std::vector<float>>(logits->size());
+  const size_t vocab_size = env.vocab_size;
+  return {[logits, scratch] { std::copy(logits->begin(), logits->end(), scratch->begin()); },
+          [scratch, vocab_size, log] {
+            for (size_t offset = 0; offset < scratch->size(); offset += vocab_size) {
+              std::span<float> row{scratch->data() + offset, vocab_size};
+              log ? Generators::LogSoftMax(row, 1.0f) : Generators::SoftMax(row, 1.0f);
+            }
+          },
+          logits->size()};
+}
+
+Case ConversionCase(const Environment& env, const Generators::Float16ConversionKernel& kernel, bool to_float32) {
+  const auto logits = CreateLogits(env.batch_size, env.vocab_size, env.engine);
+  auto fp32 = std::make_shared<std::vector<float>>(logits);
+  auto fp16 = std::make_shared<std::vector<uint16_t>>(logits.size());
+  Generators::ConvertFloat32ToFloat16(*fp32, *fp16);
+  return {[] {},
+          [fp32, fp16, kernel, to_float32] {
+            if (to_float32)
+              kernel.to_float32(fp16->data(), fp32->data(), fp16->size());
+            else
+              kernel.to_float16(fp32->data(), fp16->data(), fp32->size());
+          },
+          logits.size()};
+}
+
+Case BFloat16Case(const Environment& env) {
+  const auto logits = CreateLogits(env.batch_size, env.vocab_size, env.engine);
+  auto fp32 = std::make_shared<std::vector<float>>(logits.size());
+  auto bf16 = std::make_shared<std::vector<uint16_t>>(logits.size());
+  std::transform(logits.begin(), logits.end(), bf16->begin(), Generators::Float32ToBFloat16);
+  return {[] {}, [fp32, bf16] { Generators::ConvertBFloat16ToFloat32(*bf16, *fp32); }, logits.size()};
+}
+
+struct KernelFactory {
+  std::string name;
+  std::function<Case(const Environment&)> create;
+};
+
+std::vector<KernelFactory> GetKernels() {
+  using Generators::BeamSearch_Cpu;
+  using Generators::GreedySearch_Cpu;
+  using Generators::Search;
+
+  std::vector<KernelFactory> kernels{
+      {"softmax", [](const Environment& env) { return SoftMaxCase(env, false); }},
+      {"log_softmax", [](const Environment& env) { return SoftMaxCase(env, true); }},
+      {"greedy", [](const Environment& env) { return SearchCase<GreedySearch_Cpu>(env, 1, [](Search& s) { s.SelectTop(); }); }},
+      {"greedy_fp16", Greedy16Case},
+      {"top_k", [](const Environment& env) { return SearchCase<GreedySearch_Cpu>(env, 1, [k = env.opts.top_k](Search& s) { s.SampleTopK(k, 1.0f); }); }},
+      {"top_p", [](const Environment& env) { return SearchCase<GreedySearch_Cpu>(env, 1, [p = env.opts.top_p](Search& s) { s.SampleTopP(p, 1.0f); }); }},
+      {"top_k_top_p", [](const Environment& env) { return SearchCase<GreedySearch_Cpu>(env, 1, [k = env.opts.top_k, p = env.opts.top_p](Search& s) { s.SampleTopKTopP(k, p, 1.0f); }); }},
+      {"beam_select_top", [](const Environment& env) { return SearchCase<BeamSearch_Cpu>(env, env.opts.num_beams, [](Search& s) { s.SelectTop(); }); }},
+      {"repetition_penalty", [](const Environment& env) { return SearchCase<GreedySearch_Cpu>(env, 1, [](Search& s) { s.ApplyRepetitionPenalty(1.1f); }); }},
+      {"bf16_to_fp32", BFloat16Case},
+  };
+
+  // Every variant this CPU supports, so the dispatched one can be compared against the portable one
+  for (const auto& kernel : Generators::GetFloat16ConversionKernels()) {
+    kernels.push_back({std::string{"fp16_to_fp32_"} + kernel.name, [kernel](const Environment& env) { return ConversionCase(env, kernel, true); }});
+    kernels.push_back({std::string{"fp32_to_fp16_"} + kernel.name, [kernel](const Environment& env) { return ConversionCase(env, kernel, false); }});
+  }
+  return kernels;
+}
+
+struct Statistics {
+  double average_us{}, stddev_us{}, min_us{}, p50_us{}, p90_us{}, p99_us{};
+};
+
+Statistics ComputeStats(std::vector<double> samples_us) {
+  Statistics stats{};
+  if (samples_us.empty())
+    return stats;
+  std::sort(samples_us.begin(), samples_us.end());
+  const size_t n = samples_us.size();
+  stats.average_us = std::accumulate(samples_us.begin(), samples_us.end(), 0.0) / n;
+  stats.min_us = samples_us.front();
+  stats.p50_us = samples_us[static_cast<size_t>(n * 0.5)];
+  stats.p90_us = samples_us[static_cast<size_t>(n * 0.9)];
+  stats.p99_us = samples_us[static_cast<size_t>(n * 0.99)];
+  if (n > 1) {
+    double variance = 0.0;
+    for (double sample : samples_us)
+      variance += (sample - stats.average_us) * (sample - stats.average_us);
+    stats.stddev_us = std::sqrt(variance / (n - 1));
+  }
+  return stats;
+}
+
+Statistics Measure(Case& benchmark_case, const Options& opts) {
+  std::vector<double> samples_us;
+  samples_us.reserve(opts.num_iterations);
+  for (size_t i = 0; i < opts.num_warmup_iterations + opts.num_iterations; i++) {
+    benchmark_case.prepare();
+    const auto start = Clock::now();
+    benchmark_case.run();
+    const auto duration = Clock::now() - start;
+    if (i >= opts.num_warmup_iterations)
+      samples_us.push_back(MicrosecondsFp{duration}.count());
+  }
+  return ComputeStats(std::move(samples_us));
+}
+
+void Run(const Options& opts) {
+  const auto kernels = GetKernels();
+  for (const auto& name : opts.kernels) {
+    if (std::none_of(kernels.begin(), kernels.end(), [&](const auto& kernel) { return kernel.name == name; }))
+      throw std::runtime_error("Unknown kernel: " + name);
+  }
+
+  if (opts.csv)
+    std::cout << "kernel,vocab_size,batch_size,avg_us,stddev_us,min_us,p50_us,p90_us,p99_us,melements_per_s\n";
+  else
+    std::cout << "fp16 conversion kernel in use: " << Generators::GetFloat16ConversionKernels().front().name << "\n";
+
+  std::mt19937 engine{1234};  // Fixed, so every run benchmarks the same logits
+  for (const auto& kernel : kernels) {
+    if (!opts.kernels.empty() && std::find(opts.kernels.begin(), opts.kernels.end(), kernel.name) == opts.kernels.end())
+      continue;
+
+    for (const auto vocab_size : opts.vocab_sizes) {
+      for (const auto batch_size : opts.batch_sizes) {
+        Environment env{opts, vocab_size, batch_size, engine};
+        auto benchmark_case = kernel.create(env);
+        const auto stats = Measure(benchmark_case, opts);
+        const double melements_per_s = benchmark_case.elements_per_run / stats.average_us;
+
+        if (opts.csv) {
+          std::cout << kernel.name << ',' << vocab_size << ',' << batch_size << ',' << stats.average_us << ','
+                    << stats.stddev_us << ',' << stats.min_us << ',' << stats.p50_us << ',' << stats.p90_us << ','
+                    << stats.p99_us << ',' << melements_per_s << '\n';
+        } else {
+          std::cout << kernel.name << " vocab " << vocab_size << " batch " << batch_size << ":"
+                    << "\n\tavg (us):       " << stats.average_us
+                    << "\n\tstddev (us):    " << stats.stddev_us
+                    << "\n\tmin (us):       " << stats.min_us
+                    << "\n\tp50 (us):       " << stats.p50_us
+                    << "\n\tp90 (us):       " << stats.p90_us
+                    << "\n\tp99 (us):       " << stats.p99_us
+                    << "\n\tM elements/s:   " << melements_per_s
+                    << "\n";
+        }
+      }
+    }
+  }
+}
+
+Options ParseOptionsFromCommandLine(int argc, const char* const* argv) {
+  const char* const program_name = argc > 0 ? argv[0] : "sampling_benchmark";
+  try {
+    Options opts{};
+
+    auto next_arg = [argc, argv](int& idx) {
+      if (idx + 1 >= argc)
+        throw std::runtime_error("Option value not provided.");
+      return std::string_view{argv[++idx]};
+    };
+
+    for (int i = 1; i < argc; ++i) {
+      std::string_view arg{argv[i]};
+
+      if (arg == "-v" || arg == "--vocab_sizes") {
+        opts.vocab_sizes = ParseNumberList(next_arg(i));
+      } else if (arg == "-b" || arg == "--batch_sizes") {
+        opts.batch_sizes = ParseNumberList(next_arg(i));
+      } else if (arg == "-k" || arg == "--kernels") {
+        opts.kernels = SplitList(next_arg(i));
+      } else if (arg == "-r" || arg == "--repetitions") {
+        opts.num_iterations = ParseNumber<size_t>(next_arg(i));
+      } else if (arg == "-w" || arg == "--warmup") {
+        opts.num_warmup_iterations = ParseNumber<size_t>(next_arg(i));
+      } else if (arg == "-l" || arg == "--sequence_length") {
+        opts.sequence_length = ParseNumber<int>(next_arg(i));
+      } else if (arg == "--top_k") {
+        opts.top_k = ParseNumber<int>(next_arg(i));
+      } else if (arg == "--top_p") {
+        opts.top_p = ParseNumber<float>(next_arg(i));
+      } else if (arg == "--num_beams") {
+        opts.num_beams = ParseNumber<int>(next_arg(i));
+      } else if (arg == "--csv") {
+        opts.csv = true;
+      } else if (arg == "--list") {
+        for (const auto& kernel : GetKernels())
+          std::cout << kernel.name << "\n";
+        std::exit(0);
+      } else if (arg == "-h" || arg == "--help") {
+        PrintHelpAndExit(program_name, 0);
+      } else {
+        throw std::runtime_error(std::string{"Unknown option: "}.append(arg));
+      }
+    }
+
+    for (auto value : opts.vocab_sizes) {
+      if (value < 1)
+        throw std::runtime_error("Vocab sizes must be at least 1.");
+    }
+    for (auto value : opts.batch_sizes) {
+      if (value < 1)
+        throw std::runtime_error("Batch sizes must be at least 1.");
+    }
+    if (opts.sequence_length < 1 || opts.num_iterations < 1 || opts.num_beams < 2)
+      throw std::runtime_error("sequence_length and repetitions must be at least 1, num_beams at least 2.");
+
+    return opts;
+  } catch (const std::exception& e) {
+    std::cerr << "Error: " << e.what() << "\n";
+    PrintHelpAndExit(program_name, 1);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  try {
+    Run(ParseOptionsFromCommandLine(argc, argv));
+    return 0;
+  } catch (const std::exception& e) {
+    std::cerr << "Exception: " << e.what() << "\n";
+    return 1;
+  }
+}
@@ -0,0 +1,90 @@
+# Copyright (c) Microsoft Corporation. All rights reserved.
+# Licensed under the MIT License
+
+import argparse
+import wave
+
+import numpy as np
+import onnxruntime_genai as og
+
+
+def read_chunks(audio_path: str, chunk_seconds: float):
+    """Yields a 16kHz mono 16-bit wav file as float32 chunks, like audio arriving from a microphone"""
+    with wave.open(audio_path, "rb") as audio:
+        if audio.getframerate() != 16000 or audio.getnchannels() != 1 or audio.getsampwidth() != 2:
+            raise ValueError("Expected a 16kHz mono 16-bit wav file.")
+        chunk_samples = int(chunk_seconds * 16000)
+        while True:
+            data = audio.readframes(chunk_samples)
+            if not data:
+                return
+            yield np.frombuffer(data, dtype=np.int16).astype(np.float32) / 32768.0
+
+
+def transcribe(model, tokenizer, window, previous_tokens):
+    # Whisper takes the text of the previous windows after <|startofprev|>, at most half of its 448 token context
+    prompt = [tokenizer.to_token_id("<|startofprev|>")] + previous_tokens[-223:] if previous_tokens else []
+    prompt += [tokenizer.to_token_id(token) for token in ["<|startoftranscript|>", "<|en|>", "<|transcribe|>", "<|notimestamps|>"]]
+
+    params = og.GeneratorParams(model)
+    params.set_search_options(do_sample=False, max_length=len(prompt) + 224)
+    params.set_inputs(window)
+    params.input_ids = [prompt]
+
+    generator = og.Generator(model, params)
+    while not generator.is_done():
+        generator.compute_logits()
+        generator.generate_next_token()
+
+    end_of_text = tokenizer.to_token_id("<|endoftext|>")
+    return [token for token in generator.get_sequence(0)[len(prompt):] if token != end_of_text]
+
+
+def run(args: argparse.Namespace):
+    model = og.Model(args.model_path)
+    processor = model.create_multimodal_processor()
+    tokenizer = og.Tokenizer(model)
+    stream = processor.create_audio_stream(
+        num_mels=args.num_mels, window_frames=args.window_frames, overlap_frames=args.overlap_frames
+    )
+
+    previous_tokens = []
+
+    def drain():
+        while True:
+            start = stream.next_window_start
+            window = stream.next_window()
+            if window is None:
+                return
+            tokens = transcribe(model, tokenizer, window, previous_tokens)
+            previous_tokens.extend(tokens)
+            print(f"[{start:7.2f}s] {processor.decode(tokens)}", flush=True)
+
+    # Windows are transcribed as soon as they are complete, while the rest of the audio is still coming in
+    for chunk in read_chunks(args.audio_path, args.chunk_seconds):
+        stream.append(chunk)
+        drain()
+    stream.flush()
+    drain()
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser()
+    parser.add_argument("-m", "--model_path", type=str, required=True, help="Path to the model")
+    parser.add_argument("-a", "--audio_path", type=str, required=True, help="16kHz mono 16-bit wav file to stream")
+    parser.add_argument("--chunk_seconds", type=float, default=1.0, help="Seconds of audio appended at a time")
+    parser.add_argument("--num_mels", type=int, default=80, help="Mel bins of the model, 128 for large-v3")
+    parser.add_argument(
+        "--window_frames",
+        type=int,
+        default=3000,
+        help="Log-mel frames per encoder window (100 per second). Stock exports only take 3000",
+    )
+    parser.add_argument(
+        "--overlap_frames",
+        type=int,
+        default=0,
+        help="Frames each window shares with the previous one. Words in the overlap can be transcribed twice",
+    )
+    args = parser.parse_args()
+    run(args)
@@ -70,6 +70,8 @@ BeamSearchScorer::BeamSearchScorer(const GeneratorParams& parameters)
   size_t const per_beam = (max_length_ * (max_length_ + 1) - (parameters.sequence_length - 1) * parameters.sequence_length) / 2;
   hypothesis_buffer_ptr_ = device.Allocate<int32_t>(batch_beam_size * per_beam, true);
   hypothesis_buffer_ = hypothesis_buffer_ptr_->CpuSpan();
+  memory_.Set(batch_beam_size * (sizeof(HypothesisScore) + sizeof(float) + 2 * sizeof(int32_t)) +
+              batch_size_ * sizeof(BeamHypotheses) + hypothesis_buffer_.size_bytes());
 
   memset(next_beam_scores_.data(), 0, next_beam_scores_.size_bytes());
 
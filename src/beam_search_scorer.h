@@ -73,6 +73,8 @@ struct BeamSearchScorer {
   std::unique_ptr<HypothesisScore[]> hypothesis_scores_ptr_;  // num_beams_ * batch_size_, divided into num_beams_ chunks per BeamHypothesis in beam_hyps_
   std::unique_ptr<BeamHypotheses[]> beam_hyps_ptr_;
   std::span<BeamHypotheses> beam_hyps_;  // Shape is batch_size_
+
+  TrackedMemory memory_{MemoryCategory::Search};
 };
 
 }  // namespace Generators
\ No newline at end of file
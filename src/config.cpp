@@ -74,6 +74,12 @@ struct SessionOptions_Element : JSON::Element {
       v_.ep_context_embed_mode = value;
     else if (name == "ep_context_file_path")
       v_.ep_context_file_path = value;
+    else if (name == "graph_optimization_level")
+      v_.graph_optimization_level = value;
+    else if (name == "optimized_model_cache_dir")
+      v_.optimized_model_cache_dir = value;
+    else if (name == "cpu_cores")
+      v_.cpu_cores = value;
     else
       throw JSON::unknown_value_error{};
   }
@@ -85,6 +91,12 @@ struct SessionOptions_Element : JSON::Element {
       v_.inter_op_num_threads = static_cast<int>(value);
     else if (name == "log_severity_level")
       v_.log_severity_level = static_cast<int>(value);
+    else if (name == "numa_node")
+      v_.numa_node = static_cast<int>(value);
+    else if (name == "replica_count")
+      v_.replica_count = static_cast<int>(value);
+    else if (name == "replica_index")
+      v_.replica_index = static_cast<int>(value);
     else
       throw JSON::unknown_value_error{};
   }
@@ -378,6 +390,20 @@ struct Vision_Element : JSON::Element {
       throw JSON::unknown_value_error{};
   }
 
+  void OnBool(std::string_view name, bool value) override {
+    if (name == "lazy_load") {
+      v_.lazy_load = value;
+    } else
+      throw JSON::unknown_value_error{};
+  }
+
+  void OnNumber(std::string_view name, double value) override {
+    if (name == "idle_unload_seconds") {
+      v_.idle_unload_seconds = static_cast<int>(value);
+    } else
+      throw JSON::unknown_value_error{};
+  }
+
   Element& OnObject(std::string_view name) override {
     if (name == "inputs") {
       return inputs_;
@@ -574,6 +600,10 @@ struct Search_Element : JSON::Element {
       v_.do_sample = value;
     } else if (name == "past_present_share_buffer") {
       v_.past_present_share_buffer = value;
+    } else if (name == "kv_cache_int8") {
+      v_.kv_cache_int8 = value;
+    } else if (name == "drop_finished_rows") {
+      v_.drop_finished_rows = value;
     } else if (name == "early_stopping") {
       v_.early_stopping = value;
     } else
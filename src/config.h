@@ -42,6 +42,15 @@ struct Config {
     std::optional<std::string> log_id;
     std::optional<int> log_severity_level;
     std::optional<std::string> enable_profiling;
+    std::optional<std::string> graph_optimization_level;   // ORT_DISABLE_ALL, ORT_ENABLE_BASIC, ORT_ENABLE_EXTENDED or ORT_ENABLE_ALL (the default)
+    std::optional<std::string> optimized_model_cache_dir;  // Cache optimized CPU graphs in this directory (relative to the config directory)
+
+    // Pin the session's intra-op threads, and the weights it loads, to a set of logical processors. The first of these
+    // that is set wins. Without intra_op_num_threads the pool gets one thread per processor.
+    std::optional<std::string> cpu_cores;  // Linux style cpu list, e.g. "0-15,32-47"
+    std::optional<int> numa_node;          // The processors of this NUMA node (Linux only)
+    std::optional<int> replica_count;      // Split the host's processors, ordered by NUMA node, into this many replicas
+    int replica_index{};                   // and use the processors of this one
     // TODO(baijumeswani): Sharing env allocators across sessions leads to crashes on windows and iOS.
     //                     Identify the reason for the crash to enable allocator sharing by default.
     bool use_env_allocators{false};
@@ -85,6 +94,8 @@ struct Config {
 
     struct Vision {
       std::string filename;
+      bool lazy_load{};           // Create the vision session on the first request with images instead of when the model loads
+      int idle_unload_seconds{};  // With lazy_load, release the vision session after it has been unused this long (0 = never)
 
       struct Inputs {
         std::string pixel_values{Defaults::PixelValuesName};
@@ -157,6 +168,8 @@ struct Config {
     float diversity_penalty{};
     float length_penalty{1.0f};        // Exponential penalty to the length that is used with beam-based generation. length_penalty > 0.0 promotes longer sequences, while length_penalty < 0.0 encourages shorter sequences.
     bool past_present_share_buffer{};  // The past/present kv tensors are shared and allocated once to max_length (cuda only)
+    bool kv_cache_int8{};              // Keep the kv cache as int8 between steps (cpu greedy search only). Saves memory for idle generators only, it raises the peak, see KV_Cache::Quantize
+    bool drop_finished_rows{};         // Stop running finished sequences through the model (cpu greedy search only). Rules out AppendTokens, RewindTo and SaveState once a row was dropped
     int random_seed{-1};               // -1 = Seed with random device, otherwise use value to seed RNG
   } search;
 
@@ -40,6 +40,31 @@ namespace Microsoft.ML.OnnxRuntimeGenAI
             }
         }
 
+        /// <summary>
+        /// Returns the last tokens of the sequence at the given index, oldest first, without copying them.
+        /// Fewer than count tokens are returned if the sequence is shorter.
+        /// </summary>
+        public ReadOnlySpan<int> GetLastTokens(ulong index, int count)
+        {
+            var sequence = GetSequence(index);
+            return sequence.Slice(Math.Max(sequence.Length - count, 0));
+        }
+
+        /// <summary>
+        /// Returns the tokens the last GenerateNextToken call generated, one per sequence (batch size * number of beams).
+        /// The span aliases native memory owned by the generator and is only valid until the next call to
+        /// GenerateNextToken or GetNextTokens.
+        /// Throw on error
+        /// </summary>
+        public ReadOnlySpan<int> GetNextTokens()
+        {
+            Result.VerifySuccess(NativeMethods.OgaGenerator_GetNextTokens(_generatorHandle, out IntPtr tokensPtr, out UIntPtr count));
+            unsafe
+            {
+                return new ReadOnlySpan<int>(tokensPtr.ToPointer(), (int)count.ToUInt64());
+            }
+        }
+
         /// <summary>
         /// Fetches and returns the output tensor with the given name.
         /// Throw on error
@@ -120,6 +120,14 @@ namespace Microsoft.ML.OnnxRuntimeGenAI
         public static extern IntPtr /* const in32_t* */ OgaGenerator_GetSequenceData(IntPtr /* const OgaGenerator* */ generator,
                                                                                      UIntPtr /* size_t */ index);
 
+        // This function returns the tokens the last OgaGenerator_GenerateNextToken call generated, one per sequence.
+        // The returned pointer is owned by the OgaGenerator object and is valid until the next call to
+        // OgaGenerator_GenerateNextToken or OgaGenerator_GetNextTokens.
+        [DllImport(NativeLib.DllName, CallingConvention = CallingConvention.Winapi)]
+        public static extern IntPtr /* OgaResult* */ OgaGenerator_GetNextTokens(IntPtr /* const OgaGenerator* */ generator,
+                                                                                out IntPtr /* const int32_t** */ tokens,
+                                                                                out UIntPtr /* size_t* */ count);
+
         [DllImport(NativeLib.DllName, CallingConvention = CallingConvention.Winapi)]
         public static extern IntPtr /* OgaResult* */ OgaGenerator_GetOutput(IntPtr /* cosnt OgaGenerator* */ generator,
                                                      byte[] outputName, out IntPtr tensor);
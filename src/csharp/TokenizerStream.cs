@@ -24,6 +24,23 @@ namespace Microsoft.ML.OnnxRuntimeGenAI
             return StringUtils.FromUtf8(decodedStr);
         }
 
+        /// <summary>
+        /// Decodes a token like Decode, but returns the UTF-8 bytes of the text without creating a string.
+        /// The span aliases native memory owned by the stream and is only valid until the next decode call.
+        /// Throw on error
+        /// </summary>
+        public ReadOnlySpan<byte> DecodeToUtf8(int token)
+        {
+            IntPtr decodedStr = IntPtr.Zero;
+            Result.VerifySuccess(NativeMethods.OgaTokenizerStreamDecode(_tokenizerStreamHandle, token, out decodedStr));
+            unsafe
+            {
+                int len = 0;
+                while (*(byte*)(decodedStr + len) != 0) ++len;
+                return new ReadOnlySpan<byte>(decodedStr.ToPointer(), len);
+            }
+        }
+
         ~TokenizerStream()
         {
             Dispose(false);
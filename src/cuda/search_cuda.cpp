@@ -76,6 +76,20 @@ RoamingArray<int32_t> GreedySearch_Cuda::GetNextTokens() {
   return next_tokens_;
 }
 
+void GreedySearch_Cuda::FinishRow(size_t batch_id) {
+  // CheckForEOS pads the row from the next token on. It only sets done_cpu_ on the next step, so when this was the last
+  // unfinished row the host has to see it now, or IsDone() would lag one step behind
+  static const bool finished = true;
+  cudaMemcpyAsync(eos_meet_.data() + batch_id, &finished, sizeof(bool), cudaMemcpyHostToDevice, params_->cuda_stream);
+
+  if (!eos_meet_cpu_)
+    eos_meet_cpu_ = CudaMallocHostArray<bool>(eos_meet_.size());
+  cudaMemcpyAsync(eos_meet_cpu_.get(), eos_meet_.data(), eos_meet_.size_bytes(), cudaMemcpyDeviceToHost, params_->cuda_stream);
+  CudaCheck() == cudaStreamSynchronize(params_->cuda_stream);
+  if (std::all_of(eos_meet_cpu_.get(), eos_meet_cpu_.get() + eos_meet_.size(), [](bool done) { return done; }))
+    *done_cpu_ = true;
+}
+
 RoamingArray<int32_t> BeamSearch_Cuda::GetNextTokens() {
   return beam_scorer_->GetNextTokens();
 }
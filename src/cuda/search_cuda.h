@@ -50,6 +50,8 @@ struct GreedySearch_Cuda : Search_Cuda {
   RoamingArray<int32_t> GetNextTokens() override;
   RoamingArray<int32_t> GetNextIndices() override { return gpu_span<int32_t>{}; }
 
+  void FinishRow(size_t batch_id) override;
+
   void SelectTop() override;
   void SampleTopK(int k, float t) override;
   void SampleTopP(float p, float t) override;
@@ -60,6 +62,7 @@ struct GreedySearch_Cuda : Search_Cuda {
   void AppendNextTokensToSequences();
 
   cuda_unique_ptr<int32_t> next_tokens_buffer_;
+  cuda_host_unique_ptr<bool> eos_meet_cpu_;  // Only allocated once FinishRow is used
   std::unique_ptr<cuda::ArgMaxData> argmaxdata_;
   std::unique_ptr<cuda::SamplingData> samplingdata_;
 };
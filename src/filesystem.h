@@ -19,6 +19,7 @@
 
 #include <sys/stat.h>
 
+#include <cstdio>
 #include <string>
 #include <fstream>
 
@@ -107,6 +108,34 @@ class path {
 #endif
   }
 
+  // Creates the directory if it doesn't already exist (the parent must exist). Returns true if the directory exists.
+  bool create_directory() const {
+#ifdef _WIN32
+    CreateDirectoryW(wpath_.c_str(), nullptr);
+#else
+    mkdir(path_.c_str(), 0755);
+#endif
+    return is_directory();
+  }
+
+  // Renames the file, replacing 'to' if it exists. Returns false on failure.
+  bool rename(const path& to) const {
+#ifdef _WIN32
+    return MoveFileExW(wpath_.c_str(), to.wpath_.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return std::rename(path_.c_str(), to.path_.c_str()) == 0;
+#endif
+  }
+
+  // Deletes the file. Returns false on failure.
+  bool remove() const {
+#ifdef _WIN32
+    return DeleteFileW(wpath_.c_str()) != 0;
+#else
+    return std::remove(path_.c_str()) == 0;
+#endif
+  }
+
  private:
   std::string path_;
 
@@ -5,7 +5,11 @@
 #include "sequences.h"
 #include "models/model.h"
 #include "search.h"
+#include "stop_sequences.h"
 #include "cuda/interface.h"
+#include <mutex>
+#include <numeric>
+#include <thread>
 #if USE_CUDA
 #include "cuda/search_cuda.h"
 #include "models/kernels.h"
@@ -39,30 +43,81 @@ void OnCudaError(cudaError_t error) { assert(false); }
 
 static bool _ = (Ort::InitApi(), false);
 
-OrtGlobals::OrtGlobals()
-    : env_{OrtEnv::Create(OrtLoggingLevel::ORT_LOGGING_LEVEL_ERROR)} {
+static std::optional<int> g_global_thread_pool_request;  // Set by SetGlobalThreadPool
+static std::atomic<bool> g_ort_globals_created{};  // Between creating the OrtGlobals and Shutdown
+
+void SetGlobalThreadPool(int thread_count) {
+  if (g_ort_globals_created)
+    throw std::runtime_error("SetGlobalThreadPool must be called before the first model is created");
+  g_global_thread_pool_request = thread_count;
+}
+
+OrtGlobals::OrtGlobals() {
+  g_ort_globals_created = true;
+
+  // SetGlobalThreadPool(<threads>), or ORTGENAI_GLOBAL_THREAD_POOL=<threads>, has every session share one intra-op thread
+  // pool instead of each model oversubscribing the cores with its own (0 = onnxruntime's default size, one thread per
+  // physical core)
+  std::optional<int> global_threads = g_global_thread_pool_request;
+  if (auto value = GetEnvironmentVariable("ORTGENAI_GLOBAL_THREAD_POOL"); !global_threads && !value.empty()) {
+    try {
+      global_threads = std::stoi(value);
+    } catch (const std::logic_error&) {
+      throw std::invalid_argument("Invalid value for environment variable ORTGENAI_GLOBAL_THREAD_POOL: " + value);
+    }
+  }
+
+  // The library's own CPU work (ParallelFor) runs on one thread per core, or within the global pool's budget when there
+  // is one. onnxruntime doesn't let callers queue work on its global pool, so this is a pool of the same size
+  size_t thread_count = std::max(1U, std::thread::hardware_concurrency());
+  if (global_threads) {
+    auto threading_options = OrtThreadingOptions::Create();
+    threading_options->SetGlobalIntraOpNumThreads(std::max(*global_threads, 0));
+    env_ = OrtEnv::Create(threading_options.get(), OrtLoggingLevel::ORT_LOGGING_LEVEL_ERROR);
+    global_thread_pool_ = true;
+    thread_count = *global_threads > 0 ? *global_threads : std::max(1U, std::thread::hardware_concurrency() / 2);
+  } else
+    env_ = OrtEnv::Create(OrtLoggingLevel::ORT_LOGGING_LEVEL_ERROR);
+
   auto arena_config = OrtArenaCfg::Create(0, -1, -1, -1);
   Ort::Allocator& allocator_cpu{Ort::Allocator::GetWithDefaultOptions()};
   env_->CreateAndRegisterAllocator(allocator_cpu.GetInfo(), *arena_config);
+
+  thread_pool_ = std::make_unique<ThreadPool>(thread_count - 1);  // The thread calling ParallelFor is the last one
 }
 
+OrtGlobals::~OrtGlobals() = default;
+
 // Ensure Shutdown() has been called before process exit
 struct ValidateShutdown {
   ~ValidateShutdown() {
-    if (GetOrtGlobals()) {
+    if (g_ort_globals_created) {
       std::cerr << "OGA Error: Shutdown must be called before process exit, please check the documentation for the proper API to call to ensure clean shutdown." << std::endl;
       std::abort();
     }
   }
 };
 
-std::unique_ptr<OrtGlobals>&
-GetOrtGlobals() {
+static std::unique_ptr<OrtGlobals>& OrtGlobalsStorage() {
   static auto globals = std::make_unique<OrtGlobals>();
   static auto validate = std::make_unique<ValidateShutdown>();  // Must be after the above line so the destructor runs before the above destructor
   return globals;
 }
 
+std::unique_ptr<OrtGlobals>&
+GetOrtGlobals() {
+  auto& globals = OrtGlobalsStorage();
+  // After Shutdown the next use starts over with new globals, e.g. for a host that unloads and reloads the library's
+  // users. Nothing may still be using the old ones by then, so only the recreation itself needs the lock.
+  if (!globals) {
+    static std::mutex mutex;
+    std::lock_guard<std::mutex> lock{mutex};
+    if (!globals)
+      globals = std::make_unique<OrtGlobals>();
+  }
+  return globals;
+}
+
 // Used by Shutdown() to display the counts and types of any leaked objects
 template <typename... Types>
 bool LeakTypeList<Types...>::Dump() {
@@ -76,7 +131,9 @@ void Shutdown() {
     std::abort();
   }
 
-  GetOrtGlobals().reset();  // Delete now because on process exit is too late
+  OrtGlobalsStorage().reset();  // Delete now because on process exit is too late
+  g_global_thread_pool_request.reset();
+  g_ort_globals_created = false;
 }
 
 OrtEnv& GetOrtEnv() {
@@ -279,21 +336,50 @@ Generator::Generator(const Model& model, const GeneratorParams& params) : model_
   if (params.input_ids.empty() || params.input_ids.data() == nullptr)
     throw std::runtime_error("input_ids not set in GeneratorParams");
 
+  if ((!params.stop_token_sequences.empty() || !params.stop_strings.empty()) && params.search.num_beams > 1)
+    throw std::runtime_error("Stop sequences are not supported with beam search");
+
+  MemoryUsageScope memory_usage_scope{memory_usage_, model.memory_usage_};
   search_ = CreateSearch(params);
   state_ = model.CreateState(search_->GetSequenceLengths(), params);
+  if (!params.stop_token_sequences.empty() || !params.stop_strings.empty())
+    stop_sequences_ = std::make_unique<StopSequences>(model, params);
+  generated_from_ = search_->GetSequenceLength();
 }
 
+Generator::~Generator() = default;
+
 void Generator::ComputeLogits() {
   if (computed_logits_)
     throw std::runtime_error("ComputeLogits called again without calling GenerateNextToken first");
 
-  auto logits = state_->Run(search_->GetSequenceLength(), search_->GetNextTokens(), search_->GetNextIndices());
+  TraceSpan span{"compute_logits"};
+  MetricsScope metrics_scope{metrics_, *model_->metrics_};
+  MemoryUsageScope memory_usage_scope{memory_usage_, model_->memory_usage_};  // Some states create their buffers on the first run
+  PhaseTimer timer{prompt_processed_ ? Phase::Decode : Phase::Prefill};
+
+  // Rows that finished don't need to run through the model anymore, their sequences are only padded from here on
+  if (prompt_processed_ && search_->params_->search.drop_finished_rows && state_->CanRemoveRows()) {
+    std::vector<int32_t> rows_to_keep;
+    if (search_->RemoveFinishedRows(rows_to_keep))
+      state_->RemoveRows(rows_to_keep);
+  }
+  prompt_processed_ = true;
+
+  state_->logits_16bit_ = {};
+  auto logits = state_->Run(search_->GetSequenceLength(), search_->GetLiveNextTokens(), search_->GetNextIndices());
+  {
+    PhaseTimer set_logits_timer{Phase::SearchSetLogits};
+    if (!state_->logits_16bit_.empty())
+      search_->SetLogits16(state_->logits_16bit_, state_->logits_16bit_type_);
+    else
+      search_->SetLiveLogits(logits);
+  }
   if (g_log.enabled && g_log.model_logits) {
     auto& stream = Log("model_logits");
-    DumpSpan(stream, logits.GetCPU());
+    DumpSpan(stream, search_->GetLogits().GetCPU());
     stream << std::endl;
   }
-  search_->SetLogits(logits);
   computed_logits_ = true;
 
   auto& search = search_->params_->search;
@@ -329,8 +415,15 @@ void Generator::GenerateNextToken() {
            << std::endl;
   }
 
+  TraceSpan span{"generate_next_token"};
+  MetricsScope metrics_scope{metrics_, *model_->metrics_};
+
   if (!search.do_sample || search.top_k == 1) {
-    search_->SelectTop();
+    {
+      PhaseTimer timer{Phase::SelectTop};
+      search_->SelectTop();
+    }
+    CheckStopSequences();
     return;
   }
 
@@ -345,19 +438,159 @@ void Generator::GenerateNextToken() {
     throw std::runtime_error("top_k must be 0 or greater");
 
   if (search.top_p > 0.0f && search.top_p < 1.0f && search.top_k > 1) {
+    PhaseTimer timer{Phase::SampleTopKTopP};
     search_->SampleTopKTopP(search.top_k, search.top_p, search.temperature);
   } else if (search.top_k > 1) {
+    PhaseTimer timer{Phase::SampleTopK};
     search_->SampleTopK(search.top_k, search.temperature);
   } else {
     assert(search.top_k == 0);
+    PhaseTimer timer{Phase::SampleTopP};
     search_->SampleTopP(search.top_p, search.temperature);
   }
+  CheckStopSequences();
+}
+
+void Generator::AppendTokens(std::span<const int32_t> tokens) {
+  if (computed_logits_)
+    throw std::runtime_error("AppendTokens can't be called between ComputeLogits and GenerateNextToken");
+  if (!prompt_processed_)
+    throw std::runtime_error("AppendTokens can only be called once ComputeLogits processed the prompt (or the previously appended tokens)");
+  if (search_->params_->search.num_beams > 1)
+    throw std::runtime_error("AppendTokens is not supported with beam search");
+
+  const auto batch_beam_size = static_cast<size_t>(search_->params_->BatchBeamSize());
+  if (tokens.empty() || tokens.size() % batch_beam_size != 0)
+    throw std::runtime_error("AppendTokens needs the same number of tokens (at least one) for every sequence");
+  const auto token_count = tokens.size() / batch_beam_size;
+  if (search_->GetSequenceLength() + token_count >= static_cast<size_t>(search_->params_->search.max_length))
+    throw std::runtime_error("Appending " + std::to_string(token_count) + " tokens leaves no room to generate within max_length (" + std::to_string(search_->params_->search.max_length) + ")");
+
+  TraceSpan span{"append_tokens"};
+  state_->AppendTokens(tokens);
+  search_->AppendTokens(tokens);
+  generated_from_ = search_->GetSequenceLength();
+  if (stop_sequences_)
+    stop_sequences_->Reset();
+  prompt_processed_ = false;  // The next ComputeLogits is a prefill again
+}
+
+void Generator::RewindTo(size_t new_length) {
+  if (computed_logits_)
+    throw std::runtime_error("RewindTo can't be called between ComputeLogits and GenerateNextToken");
+  if (!prompt_processed_)
+    throw std::runtime_error("RewindTo can only be called once ComputeLogits processed the prompt (or the appended tokens)");
+  if (search_->params_->search.num_beams > 1)
+    throw std::runtime_error("RewindTo is not supported with beam search");
+
+  const auto current_length = static_cast<size_t>(search_->GetSequenceLength());
+  // The last kept token runs through the model again, on top of a KV cache of the tokens before it
+  if (new_length < 2 || new_length > current_length)
+    throw std::runtime_error("RewindTo needs a length between 2 and the current sequence length (" + std::to_string(current_length) + "), got " + std::to_string(new_length));
+  if (new_length == current_length)
+    return;
+
+  TraceSpan span{"rewind_to"};
+  state_->RewindTo(static_cast<int>(current_length), static_cast<int>(new_length));
+  search_->RewindTo(new_length);
+
+  generated_from_ = std::min(generated_from_, new_length);
+  RestartStopSequences();
+}
+
+namespace {
+constexpr uint32_t c_snapshot_magic = 0x5341474f;  // "OGAS"
+constexpr uint32_t c_snapshot_version = 2;  // 2 added the model identity
+}  // namespace
+
+std::vector<uint8_t> Generator::SaveState(bool kv_fp16) const {
+  if (computed_logits_)
+    throw std::runtime_error("SaveState can't be called between ComputeLogits and GenerateNextToken");
+  if (!prompt_processed_)
+    throw std::runtime_error("SaveState can only be called once ComputeLogits processed the prompt (or the appended tokens)");
+  if (search_->params_->search.num_beams > 1)
+    throw std::runtime_error("SaveState is not supported with beam search");
+
+  TraceSpan span{"save_state"};
+  SnapshotWriter writer;
+  writer.Write(c_snapshot_magic);
+  writer.Write(c_snapshot_version);
+  writer.Write(model_->Identity());
+  writer.Write(static_cast<uint64_t>(generated_from_));
+  search_->SaveState(writer);
+  state_->SaveState(writer, search_->GetSequenceLength(), kv_fp16);
+  return std::move(writer.data_);
+}
+
+void Generator::LoadState(std::span<const uint8_t> snapshot) {
+  if (prompt_processed_ || computed_logits_)
+    throw std::runtime_error("LoadState needs a generator that hasn't run yet");
+  if (search_->params_->search.num_beams > 1)
+    throw std::runtime_error("LoadState is not supported with beam search");
+
+  TraceSpan span{"load_state"};
+  MemoryUsageScope memory_usage_scope{memory_usage_, model_->memory_usage_};
+  SnapshotReader reader{snapshot};
+  if (reader.Read<uint32_t>() != c_snapshot_magic)
+    throw std::runtime_error("Not a generator snapshot");
+  if (const auto version = reader.Read<uint32_t>(); version != c_snapshot_version)
+    throw std::runtime_error("Unsupported generator snapshot version " + std::to_string(version));
+  if (reader.Read<uint64_t>() != model_->Identity())
+    throw std::runtime_error("Generator snapshot was saved by a different model");
+  const auto generated_from = reader.Read<uint64_t>();
+
+  // Loaded into a new search and state, so a snapshot that turns out to be truncated or not to match leaves this
+  // generator as it was
+  auto& params = *search_->params_;
+  auto search = CreateSearch(params);
+  auto state = model_->CreateState(search->GetSequenceLengths(), params);
+  search->LoadState(reader);
+  state->LoadState(reader, search->GetSequenceLength());
+  reader.ExpectEnd();
+  if (generated_from > static_cast<uint64_t>(search->GetSequenceLength()))
+    throw std::runtime_error("Generator snapshot is corrupt");
+
+  state_ = std::move(state);
+  search_ = std::move(search);
+  generated_from_ = static_cast<size_t>(generated_from);
+  prompt_processed_ = true;  // The next ComputeLogits continues from the last saved token
+  RestartStopSequences();
+}
+
+void Generator::RestartStopSequences() {
+  if (!stop_sequences_)
+    return;
+
+  const size_t length = search_->GetSequenceLength();
+  for (size_t batch_id = 0; batch_id < static_cast<size_t>(search_->params_->BatchBeamSize()); batch_id++) {
+    auto sequence = search_->GetSequence(batch_id).CpuSpan();
+    stop_sequences_->Restart(batch_id, sequence.subspan(generated_from_, length - generated_from_));
+  }
+}
+
+void Generator::CheckStopSequences() {
+  if (!stop_sequences_)
+    return;
+
+  auto next_tokens = GetNextTokens();
+  for (size_t batch_id = 0; batch_id < next_tokens.size(); batch_id++) {
+    if (!stop_sequences_->Append(batch_id, next_tokens[batch_id]))
+      continue;
+    if (g_log.enabled && g_log.hit_eos)
+      Log("hit_eos", "Stop sequence seen on batch " + std::to_string(batch_id));
+    search_->FinishRow(batch_id);
+  }
 }
 
 DeviceMemorySpan<int32_t> Generator::GetSequence(size_t index) const {
   return search_->GetSequence(index);
 }
 
+cpu_span<int32_t> Generator::GetNextTokens() const {
+  next_tokens_.Assign(search_->GetNextTokens());
+  return next_tokens_.GetCPU();
+}
+
 TokenSequences Generate(const Model& model, const GeneratorParams& params) {
   auto generator = CreateGenerator(model, params);
 
@@ -378,6 +611,76 @@ TokenSequences Generate(const Model& model, const GeneratorParams& params) {
   return result;
 }
 
+TokenSequences GenerateRagged(const Model& model, const GeneratorParams& params, std::span<const std::span<const int32_t>> prompts) {
+  // Prompts are only batched together while the padding that adds stays within this share of the batch's prompt tokens
+  constexpr size_t max_padding_percent = 10;
+
+  if (!params.extra_inputs.empty())
+    throw std::runtime_error("GenerateRagged doesn't support extra model inputs, they can't be split between batches");
+  for (auto& prompt : prompts) {
+    if (prompt.empty())
+      throw std::runtime_error("GenerateRagged prompts can't be empty");
+  }
+
+  std::vector<size_t> order(prompts.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return prompts[a].size() < prompts[b].size(); });
+
+  const auto num_return_sequences = static_cast<size_t>(params.search.num_return_sequences);
+  const bool stop_sequences = !params.stop_token_sequences.empty() || !params.stop_strings.empty();
+  TokenSequences result(prompts.size() * num_return_sequences);
+
+  for (size_t begin = 0; begin < order.size();) {
+    // Prompts are sorted by length, so the batch is grown with the next longer prompt until it would pad too much
+    size_t end = begin + 1;
+    size_t prompt_tokens = prompts[order[begin]].size();
+    while (end < order.size() && (params.max_batch_size == 0 || end - begin < static_cast<size_t>(params.max_batch_size))) {
+      const size_t longest = prompts[order[end]].size();
+      const size_t padded_tokens = longest * (end - begin + 1);
+      if ((padded_tokens - prompt_tokens - longest) * 100 > padded_tokens * max_padding_percent)
+        break;
+      prompt_tokens += longest;
+      end++;
+    }
+
+    std::vector<std::span<const int32_t>> batch_prompts;
+    for (size_t i = begin; i < end; i++)
+      batch_prompts.push_back(prompts[order[i]]);
+
+    auto batch_params = std::make_shared<GeneratorParams>(model);
+    batch_params->search = params.search;
+    batch_params->max_batch_size = params.max_batch_size;
+    batch_params->use_cuda_graph = params.use_cuda_graph;
+    batch_params->stop_token_sequences = params.stop_token_sequences;
+    batch_params->stop_strings = params.stop_strings;
+    batch_params->input_ids_owner = PadInputs(batch_prompts, params.config.model.pad_token_id);
+    batch_params->batch_size = static_cast<int>(batch_prompts.size());
+    batch_params->sequence_length = static_cast<int>(batch_params->input_ids_owner.size() / batch_prompts.size());
+    batch_params->input_ids = batch_params->input_ids_owner;
+
+    auto sequences = Generate(model, *batch_params);
+
+    // Prompts are padded on the right, so drop the padding between each prompt and its generated tokens, and after EOS
+    for (size_t i = 0; i < batch_prompts.size(); i++) {
+      for (size_t j = 0; j < num_return_sequences; j++) {
+        auto generated = std::span<const int32_t>{sequences[i * num_return_sequences + j]}.subspan(batch_params->sequence_length);
+        auto eos = std::find(generated.begin(), generated.end(), params.config.model.eos_token_id);
+        auto end_of_sequence = eos == generated.end() ? eos : eos + 1;
+        // Sequences that ended on a stop sequence are padded until the rest of their batch is done
+        if (stop_sequences)
+          while (end_of_sequence != generated.begin() && *(end_of_sequence - 1) == params.config.model.pad_token_id)
+            --end_of_sequence;
+
+        auto& sequence = result[order[begin + i] * num_return_sequences + j];
+        sequence.assign(batch_prompts[i].begin(), batch_prompts[i].end());
+        sequence.insert(sequence.end(), generated.begin(), end_of_sequence);
+      }
+    }
+    begin = end;
+  }
+  return result;
+}
+
 }  // namespace Generators
 
 #if USE_CUDA
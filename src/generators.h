@@ -37,13 +37,18 @@ using cudaStream_t = void*;
 #include "models/debugging.h"
 #include "config.h"
 #include "logging.h"
+#include "memory_usage.h"
+#include "metrics.h"
+#include "trace.h"
 #include "runtime_settings.h"
 #include "tensor.h"
+#include "snapshot.h"
 
 namespace Generators {
 struct Model;
 struct State;
 struct Search;
+struct StopSequences;
 struct Tokenizer;
 
 // OgaSequences are a vector of int32 vectors
@@ -96,6 +101,10 @@ struct GeneratorParams : std::enable_shared_from_this<GeneratorParams>, LeakChec
   // A list of extra model inputs that will be matched at runtime based on name
   std::vector<Input> extra_inputs;
 
+  // A sequence is done once it ends with any of these, see stop_sequences.h. Like EOS, the stop sequence is kept
+  std::vector<std::vector<int32_t>> stop_token_sequences;
+  std::vector<std::string> stop_strings;  // Matched on the detokenized output
+
   void TryGraphCapture(int max_bs);
 
   void SetInputs(const NamedTensors& inputs);
@@ -106,23 +115,59 @@ struct GeneratorParams : std::enable_shared_from_this<GeneratorParams>, LeakChec
 
 struct Generator : LeakChecked<Generator> {
   Generator(const Model& model, const GeneratorParams& params);
+  ~Generator();
 
   bool IsDone() const;
   void ComputeLogits();
   void GenerateNextToken();
 
+  // Continues the sequences with tokens that weren't generated, like the next user turn of a chat. tokens holds the same
+  // number of tokens for every sequence ([batch_size, token_count]). The next ComputeLogits runs them through the model in
+  // one prefill on top of the existing KV cache, instead of processing the whole conversation again.
+  // Sequences that already finished continue too. The pad tokens they got after finishing stay in their KV cache and
+  // the attention mask keeps attending to them, the same as every step after EOS does.
+  void AppendTokens(std::span<const int32_t> tokens);
+
+  // Rolls the sequences back to their first new_length tokens, to backtrack or to edit the end of a conversation. The
+  // KV cache is cut to match instead of being recomputed, and generation continues from the last token that is kept
+  void RewindTo(size_t new_length);
+
+  // Snapshot of everything needed to continue generating later: the sequences, the KV cache and the other model inputs
+  // that carry over between steps. kv_fp16 stores an fp32 KV cache as fp16, halving the snapshot at some precision.
+  // LoadState restores a snapshot into a generator that hasn't run yet, created for the same model and batch size (its
+  // input_ids are replaced), so a session can be evicted from memory or moved to another process without a new prefill.
+  // Snapshots of a different model are rejected, see Model::Identity.
+  std::vector<uint8_t> SaveState(bool kv_fp16) const;
+  void LoadState(std::span<const uint8_t> snapshot);
+
   DeviceMemorySpan<int32_t> GetSequence(size_t index) const;
+  cpu_span<int32_t> GetNextTokens() const;  // The tokens the last GenerateNextToken appended, one per sequence
 
   std::shared_ptr<const Model> model_;
   std::unique_ptr<State> state_;
   std::unique_ptr<Search> search_;
+  Metrics metrics_;         // Latency of this generator's phases, the model keeps the totals over all its generators
+  std::shared_ptr<MemoryUsage> memory_usage_{std::make_shared<MemoryUsage>()};  // Buffers held by this generator, see memory_usage.h
+  bool prompt_processed_{};  // Set after the first ComputeLogits, to tell prefill and decode apart
   bool computed_logits_{};  // Set to true in ComputeLogits() and false after appending a token to ensure a 1 to 1 call ratio
+  mutable RoamingArray<int32_t> next_tokens_;  // Owns the CPU copy GetNextTokens returns when the search runs on the GPU
+  std::unique_ptr<StopSequences> stop_sequences_;  // Only when the params have stop sequences
+  size_t generated_from_{};  // Sequence length where the generated tokens start, after the prompt or the last appended tokens
+
+ private:
+  void CheckStopSequences();
+  void RestartStopSequences();  // Matches the generated tokens again, a stop sequence may have started within them
 };
 
+struct ThreadPool;
+
 struct OrtGlobals {
   OrtGlobals();
+  ~OrtGlobals();
 
   std::unique_ptr<OrtEnv> env_;
+  bool global_thread_pool_{};  // Sessions share the env's intra-op thread pool instead of each creating their own
+  std::unique_ptr<ThreadPool> thread_pool_;  // Runs the library's own CPU work, see ParallelFor
 #if USE_CUDA
   std::unique_ptr<OrtMemoryInfo> memory_info_cuda_;
   std::unique_ptr<Ort::Allocator> allocator_cuda_;
@@ -133,14 +178,22 @@ struct OrtGlobals {
 };
 
 std::unique_ptr<OrtGlobals>& GetOrtGlobals();
-void Shutdown();  // Do this once at exit, Ort code will fail after this call
+void Shutdown();  // Do this at exit. Objects created before it must not be used after it, new ones start over with fresh globals
 OrtEnv& GetOrtEnv();
+// Has every session share one onnxruntime intra-op thread pool of thread_count threads (0 = onnxruntime's default size),
+// like the ORTGENAI_GLOBAL_THREAD_POOL environment variable. Must be called before the first model is created
+void SetGlobalThreadPool(int thread_count);
 
 std::shared_ptr<Model> CreateModel(OrtEnv& ort_env, const char* config_path, const RuntimeSettings* settings = nullptr);
 std::shared_ptr<GeneratorParams> CreateGeneratorParams(const Model& model);
 std::shared_ptr<GeneratorParams> CreateGeneratorParams(const Config& config);  // For benchmarking purposes only
 std::unique_ptr<Generator> CreateGenerator(const Model& model, const GeneratorParams& params);
 std::vector<std::vector<int32_t>> Generate(const Model& model, const GeneratorParams& params);  // Uses CreateGenerator and a simple loop to return the entire sequence
+// Generate for prompts of different lengths, ignoring params.input_ids. Instead of padding every prompt to the longest one,
+// prompts of similar length are batched together and each batch stops as soon as its own rows are done. Returns each
+// prompt followed by its generated tokens (num_return_sequences per prompt, in prompt order) without any padding.
+// search.max_length counts the padded prompt length of the batch a prompt ended up in.
+TokenSequences GenerateRagged(const Model& model, const GeneratorParams& params, std::span<const std::span<const int32_t>> prompts);
 
 float Float16ToFloat32(uint16_t v);  // v is a IEEE 752-2008 binary16 format, 1 sign bit, 5 bit exponent, 10 bit fraction
 void top_k_indices(std::span<int32_t> top_k, std::span<const float> inputs);
@@ -3,6 +3,10 @@
  */
 package ai.onnxruntime.genai;
 
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.IntBuffer;
+
 /**
  * The Generator class generates output using a model and generator parameters.
  *
@@ -13,7 +17,8 @@ package ai.onnxruntime.genai;
  * TokenizerStream.Decode.
  *
  * <p>After the generation process is done, GetSequence can be used to retrieve the complete
- * generated sequence if needed.
+ * generated sequence if needed. While streaming, use getNextTokens or getLastTokens instead, as
+ * GetSequence copies the whole sequence on every call.
  */
 public final class Generator implements AutoCloseable, Iterable<Integer> {
   private long nativeHandle = 0;
@@ -117,6 +122,49 @@ public final class Generator implements AutoCloseable, Iterable<Integer> {
     return getSequenceLastToken(nativeHandle, sequenceIndex);
   }
 
+  /**
+   * Retrieves the last tokens of the sequence at the specified index. Only those tokens are copied,
+   * so this is cheap to call after every generated token.
+   *
+   * @param sequenceIndex The index of the sequence.
+   * @param count The number of tokens to return. Fewer are returned if the sequence is shorter.
+   * @return An array with the last token ids of the sequence, oldest first.
+   * @throws GenAIException If the call to the GenAI native API fails.
+   */
+  public int[] getLastTokens(long sequenceIndex, int count) throws GenAIException {
+    if (nativeHandle == 0) {
+      throw new IllegalStateException("Instance has been freed and is invalid");
+    }
+
+    if (count < 0) {
+      throw new IllegalArgumentException("count must not be negative");
+    }
+
+    return getLastTokensNative(nativeHandle, sequenceIndex, count);
+  }
+
+  /**
+   * Retrieves the tokens the last call to generateNextToken generated, one per sequence (batch size
+   * times the number of beams), without copying them.
+   *
+   * <p>The returned buffer is a read only view of native memory owned by the Generator. It is only
+   * valid until the next call to generateNextToken or getNextTokens, or until the Generator is
+   * closed.
+   *
+   * @return A buffer with one token id per sequence.
+   * @throws GenAIException If the call to the GenAI native API fails.
+   */
+  public IntBuffer getNextTokens() throws GenAIException {
+    if (nativeHandle == 0) {
+      throw new IllegalStateException("Instance has been freed and is invalid");
+    }
+
+    return getNextTokensNative(nativeHandle)
+        .order(ByteOrder.nativeOrder())
+        .asIntBuffer()
+        .asReadOnlyBuffer();
+  }
+
   /** Closes the Generator and releases any associated resources. */
   @Override
   public void close() {
@@ -169,4 +217,9 @@ public final class Generator implements AutoCloseable, Iterable<Integer> {
 
   private native int getSequenceLastToken(long nativeHandle, long sequenceIndex)
       throws GenAIException;
+
+  private native int[] getLastTokensNative(long nativeHandle, long sequenceIndex, int count)
+      throws GenAIException;
+
+  private native ByteBuffer getNextTokensNative(long nativeHandle) throws GenAIException;
 }
@@ -3,6 +3,8 @@
  */
 package ai.onnxruntime.genai;
 
+import java.nio.ByteBuffer;
+
 /**
  * A TokenizerStream is used to convert individual tokens when using Generator.generateNextToken.
  */
@@ -23,6 +25,23 @@ public class TokenizerStream implements AutoCloseable {
     return tokenizerStreamDecode(nativeHandle, token);
   }
 
+  /**
+   * Decodes a token like decode, but returns the UTF-8 bytes of the decoded text without creating a
+   * String. The returned buffer is a read only view of native memory owned by the TokenizerStream
+   * and is only valid until the next decode call or until the TokenizerStream is closed.
+   *
+   * @param token The token to decode.
+   * @return The UTF-8 bytes of the text the token completed, empty if it didn't complete any.
+   * @throws GenAIException If the call to the GenAI native API fails.
+   */
+  public ByteBuffer decodeToBuffer(int token) throws GenAIException {
+    if (nativeHandle == 0) {
+      throw new IllegalStateException("Instance has been freed and is invalid");
+    }
+
+    return tokenizerStreamDecodeToBuffer(nativeHandle, token).asReadOnlyBuffer();
+  }
+
   @Override
   public void close() {
     if (nativeHandle != 0) {
@@ -42,5 +61,8 @@ public class TokenizerStream implements AutoCloseable {
   private native String tokenizerStreamDecode(long tokenizerStreamHandle, int token)
       throws GenAIException;
 
+  private native ByteBuffer tokenizerStreamDecodeToBuffer(long tokenizerStreamHandle, int token)
+      throws GenAIException;
+
   private native void destroyTokenizerStream(long tokenizerStreamHandle);
 }
@@ -4,6 +4,8 @@
  */
 #include "ai_onnxruntime_genai_Generator.h"
 
+#include <algorithm>
+
 #include "ort_genai_c.h"
 #include "utils.h"
 
@@ -78,3 +80,33 @@ Java_ai_onnxruntime_genai_Generator_getSequenceLastToken(JNIEnv* env, jobject th
 
   return jint(tokens[num_tokens - 1]);
 }
+
+JNIEXPORT jintArray JNICALL
+Java_ai_onnxruntime_genai_Generator_getLastTokensNative(JNIEnv* env, jobject thiz, jlong generator, jlong index,
+                                                        jint count) {
+  const OgaGenerator* oga_generator = reinterpret_cast<const OgaGenerator*>(generator);
+
+  size_t num_tokens = OgaGenerator_GetSequenceCount(oga_generator, index);
+  const int32_t* tokens = OgaGenerator_GetSequenceData(oga_generator, index);
+
+  // Only the requested tail is copied, so streaming clients do constant work per token
+  size_t num_last_tokens = std::min(num_tokens, static_cast<size_t>(count));
+  jintArray java_int_array = env->NewIntArray(num_last_tokens);
+  env->SetIntArrayRegion(java_int_array, 0, num_last_tokens,
+                         reinterpret_cast<const jint*>(tokens + num_tokens - num_last_tokens));
+
+  return java_int_array;
+}
+
+JNIEXPORT jobject JNICALL
+Java_ai_onnxruntime_genai_Generator_getNextTokensNative(JNIEnv* env, jobject thiz, jlong generator) {
+  const OgaGenerator* oga_generator = reinterpret_cast<const OgaGenerator*>(generator);
+  const int32_t* tokens = nullptr;
+  size_t num_tokens = 0;
+  if (ThrowIfError(env, OgaGenerator_GetNextTokens(oga_generator, &tokens, &num_tokens))) {
+    return nullptr;
+  }
+
+  // Wraps the generator's memory without copying. The Java side makes the buffer read only.
+  return env->NewDirectByteBuffer(const_cast<int32_t*>(tokens), num_tokens * sizeof(int32_t));
+}
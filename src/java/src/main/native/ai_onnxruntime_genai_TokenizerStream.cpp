@@ -4,6 +4,8 @@
  */
 #include "ai_onnxruntime_genai_TokenizerStream.h"
 
+#include <cstring>
+
 #include "ort_genai_c.h"
 #include "utils.h"
 
@@ -26,6 +28,21 @@ Java_ai_onnxruntime_genai_TokenizerStream_tokenizerStreamDecode(JNIEnv* env, job
   return result;
 }
 
+JNIEXPORT jobject JNICALL
+Java_ai_onnxruntime_genai_TokenizerStream_tokenizerStreamDecodeToBuffer(JNIEnv* env, jobject thiz,
+                                                                        jlong tokenizer_stream_handle, jint token) {
+  OgaTokenizerStream* tokenizer_stream = reinterpret_cast<OgaTokenizerStream*>(tokenizer_stream_handle);
+  const char* decoded_text = nullptr;
+
+  // As above, decoded_text is owned by the tokenizer stream. The buffer wraps it without copying and is only valid until
+  // the next decode.
+  if (ThrowIfError(env, OgaTokenizerStreamDecode(tokenizer_stream, token, &decoded_text))) {
+    return nullptr;
+  }
+
+  return env->NewDirectByteBuffer(const_cast<char*>(decoded_text), strlen(decoded_text));
+}
+
 JNIEXPORT void JNICALL
 Java_ai_onnxruntime_genai_TokenizerStream_destroyTokenizerStream(JNIEnv* env, jobject thiz,
                                                                  jlong tokenizer_stream_handle) {
@@ -100,4 +100,45 @@ public class GenerationTest {
       }
     }
   }
+
+  @Test
+  public void testStreamingTokens() throws GenAIException {
+    Model model = new Model(TestUtils.testModelPath());
+    GeneratorParams params = new GeneratorParams(model);
+    int batchSize = 2;
+    int sequenceLength = 4;
+    int maxLength = 10;
+    int[] inputIDs =
+        new int[] {
+          0, 0, 0, 52,
+          0, 0, 195, 731
+        };
+
+    params.setInput(inputIDs, sequenceLength, batchSize);
+    params.setSearchOption("max_length", maxLength);
+
+    int[] expectedOutput =
+        new int[] {
+          0, 0, 0, 52, 204, 204, 204, 204, 204, 204,
+          0, 0, 195, 731, 731, 114, 114, 114, 114, 114
+        };
+
+    try (Generator generator = new Generator(model, params)) {
+      for (int length = sequenceLength + 1; !generator.isDone(); length++) {
+        generator.computeLogits();
+        generator.generateNextToken();
+
+        java.nio.IntBuffer nextTokens = generator.getNextTokens();
+        assertEquals(batchSize, nextTokens.remaining());
+        for (int i = 0; i < batchSize; i++) {
+          assertEquals(expectedOutput[i * maxLength + length - 1], nextTokens.get(i));
+
+          int[] lastTokens = generator.getLastTokens(i, 2);
+          assertEquals(2, lastTokens.length);
+          assertEquals(expectedOutput[i * maxLength + length - 2], lastTokens[0]);
+          assertEquals(expectedOutput[i * maxLength + length - 1], lastTokens[1]);
+        }
+      }
+    }
+  }
 }
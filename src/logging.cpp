@@ -38,6 +38,8 @@ void SetLogBool(std::string_view name, bool value) {
     g_log.model_logits = value;
   else if (name == "ort_lib")
     g_log.ort_lib = value;
+  else if (name == "model_load")
+    g_log.model_load = value;
   else
     throw JSON::unknown_value_error{};
 }
@@ -43,6 +43,7 @@ struct LogItems {
   bool model_output_values{};  // After the model runs the output tensor values can be displayed
   bool model_logits{};         // Same as model_output_values but only for the logits
   bool ort_lib{};              // Log the onnxruntime library loading and api calls.
+  bool model_load{};           // Log how long each model session took to create
 };
 
 extern LogItems g_log;
@@ -0,0 +1,93 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#include "generators.h"
+#include "models/utils.h"
+
+namespace Generators {
+
+namespace {
+thread_local MemoryUsageScope* tl_memory_usage_scope{};
+
+void UpdatePeak(std::atomic<size_t>& peak, size_t value) {
+  auto previous = peak.load(std::memory_order_relaxed);
+  while (value > previous && !peak.compare_exchange_weak(previous, value, std::memory_order_relaxed)) {
+  }
+}
+}  // namespace
+
+const char* to_string(MemoryCategory category) {
+  switch (category) {
+    case MemoryCategory::KvCache:
+      return "kv_cache";
+    case MemoryCategory::Logits:
+      return "logits";
+    case MemoryCategory::Sequences:
+      return "sequences";
+    case MemoryCategory::Search:
+      return "search";
+    case MemoryCategory::StaticBuffers:
+      return "static_buffers";
+    default:
+      return "unknown";
+  }
+}
+
+MemoryCategory MemoryCategoryFromString(std::string_view name) {
+  for (size_t i = 0; i < static_cast<size_t>(MemoryCategory::Count); i++) {
+    if (name == to_string(static_cast<MemoryCategory>(i)))
+      return static_cast<MemoryCategory>(i);
+  }
+  throw std::runtime_error("Unknown memory category: " + std::string{name});
+}
+
+void MemoryUsage::Add(MemoryCategory category, int64_t bytes) {
+  auto& current = current_[static_cast<size_t>(category)];
+  // Unsigned wrap around makes adding a negative amount a subtraction
+  UpdatePeak(peak_[static_cast<size_t>(category)], current.fetch_add(static_cast<size_t>(bytes), std::memory_order_relaxed) + bytes);
+  UpdatePeak(peak_total_, current_total_.fetch_add(static_cast<size_t>(bytes), std::memory_order_relaxed) + bytes);
+}
+
+MemoryUsageScope::MemoryUsageScope(const std::shared_ptr<MemoryUsage>& generator, const std::shared_ptr<MemoryUsage>& model)
+    : generator_{generator}, model_{model}, previous_{tl_memory_usage_scope} {
+  tl_memory_usage_scope = this;
+}
+
+MemoryUsageScope::~MemoryUsageScope() {
+  tl_memory_usage_scope = previous_;
+}
+
+TrackedMemory::TrackedMemory(MemoryCategory category) : category_{category} {
+  if (auto* scope = tl_memory_usage_scope) {
+    // Static buffers outlive the generator that first used them
+    if (category != MemoryCategory::StaticBuffers)
+      generator_ = scope->generator_;
+    model_ = scope->model_;
+  }
+}
+
+void TrackedMemory::Set(size_t bytes) {
+  if (bytes == bytes_)
+    return;
+  auto delta = static_cast<int64_t>(bytes) - static_cast<int64_t>(bytes_);
+  bytes_ = bytes;
+  if (generator_)
+    generator_->Add(category_, delta);
+  if (model_)
+    model_->Add(category_, delta);
+}
+
+size_t GetTensorBytes(const OrtValue* value) {
+  if (!value)
+    return 0;
+  auto info = value->GetTensorTypeAndShapeInfo();
+  return info->GetElementCount() * SizeOf(info->GetElementType());
+}
+
+size_t GetTensorBytes(const std::vector<std::unique_ptr<OrtValue>>& values) {
+  size_t bytes = 0;
+  for (auto& value : values)
+    bytes += GetTensorBytes(value.get());
+  return bytes;
+}
+
+}  // namespace Generators
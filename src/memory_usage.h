@@ -0,0 +1,86 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#pragma once
+/*
+ * Byte accounting of the buffers generation allocates, by category, with peak tracking
+ *
+ * Every Generator and every Model own a MemoryUsage. The code allocating the buffers (KV_Cache, Logits, Sequences, the
+ * searches) owns a TrackedMemory per category and sets it to the bytes it currently holds whenever it (re)allocates.
+ * Like MetricsScope, the Generator sets up a MemoryUsageScope while it creates its state, which is where every
+ * TrackedMemory picks up the generator and model it reports to.
+ *
+ * Static buffers are reused by later generators (see CapturedGraphPool), so they're only counted against the model.
+ * Only buffers owned by genai are counted, not the session weights or onnxruntime's own arenas.
+ */
+#include <array>
+#include <atomic>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+struct OrtValue;
+
+namespace Generators {
+
+enum struct MemoryCategory {
+  KvCache,        // KV_Cache pasts/presents and the cross attention cache
+  Logits,         // Model logits output and the last token logits copied out of it
+  Sequences,      // Sequences (and their double buffer for beam search)
+  Search,         // Search scratch buffers, including the beam search hypotheses
+  StaticBuffers,  // StaticBuffers of captured graphs, counted against the model only
+  Count
+};
+
+const char* to_string(MemoryCategory category);
+MemoryCategory MemoryCategoryFromString(std::string_view name);  // The inverse of to_string, throws for unknown names
+
+struct MemoryUsage {
+  void Add(MemoryCategory category, int64_t bytes);  // bytes is negative when memory is released
+
+  size_t CurrentBytes(MemoryCategory category) const { return current_[static_cast<size_t>(category)].load(std::memory_order_relaxed); }
+  size_t PeakBytes(MemoryCategory category) const { return peak_[static_cast<size_t>(category)].load(std::memory_order_relaxed); }
+  size_t CurrentTotalBytes() const { return current_total_.load(std::memory_order_relaxed); }
+  size_t PeakTotalBytes() const { return peak_total_.load(std::memory_order_relaxed); }
+
+ private:
+  std::array<std::atomic<size_t>, static_cast<size_t>(MemoryCategory::Count)> current_{}, peak_{};
+  std::atomic<size_t> current_total_{}, peak_total_{};
+};
+
+// While alive, TrackedMemory created on this thread reports to generator and model
+struct MemoryUsageScope {
+  MemoryUsageScope(const std::shared_ptr<MemoryUsage>& generator, const std::shared_ptr<MemoryUsage>& model);
+  ~MemoryUsageScope();
+
+  MemoryUsageScope(const MemoryUsageScope&) = delete;
+  MemoryUsageScope& operator=(const MemoryUsageScope&) = delete;
+
+ private:
+  const std::shared_ptr<MemoryUsage>& generator_;
+  const std::shared_ptr<MemoryUsage>& model_;
+  MemoryUsageScope* previous_;
+
+  friend struct TrackedMemory;
+};
+
+// The bytes one owner holds in one category. Reports to the MemoryUsageScope current at construction, if any.
+struct TrackedMemory {
+  TrackedMemory(MemoryCategory category);
+  ~TrackedMemory() { Set(0); }
+
+  TrackedMemory(const TrackedMemory&) = delete;
+  TrackedMemory& operator=(const TrackedMemory&) = delete;
+
+  void Set(size_t bytes);
+
+ private:
+  MemoryCategory category_;
+  std::shared_ptr<MemoryUsage> generator_, model_;
+  size_t bytes_{};
+};
+
+// Size of the tensor data, 0 for nullptr
+size_t GetTensorBytes(const OrtValue* value);
+size_t GetTensorBytes(const std::vector<std::unique_ptr<OrtValue>>& values);
+
+}  // namespace Generators
@@ -0,0 +1,203 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include "metrics.h"
+#include "trace.h"
+
+namespace Generators {
+
+namespace {
+thread_local MetricsScope* tl_metrics_scope{};
+
+// Label values are quoted, so backslashes, quotes and newlines in them (as in a model directory name) must be escaped
+void AppendLabelValue(std::ostringstream& stream, std::string_view value) {
+  for (char c : value) {
+    if (c == '\\' || c == '"')
+      stream << '\\' << c;
+    else if (c == '\n')
+      stream << "\\n";
+    else
+      stream << c;
+  }
+}
+
+void AppendLabels(std::ostringstream& stream, const char* name, std::string_view scope, std::string_view model) {
+  stream << name << "{scope=\"" << scope << "\",model=\"";
+  AppendLabelValue(stream, model);
+  stream << '"';
+}
+
+void AppendPhaseLabels(std::ostringstream& stream, const char* name, std::string_view scope, std::string_view model, Phase phase, const char* le) {
+  AppendLabels(stream, name, scope, model);
+  stream << ",phase=\"" << to_string(phase) << '"';
+  if (le)
+    stream << ",le=\"" << le << '"';
+  stream << "} ";
+}
+
+// Seconds, with enough digits to round trip
+void AppendSample(std::ostringstream& stream, const char* name, std::string_view scope, std::string_view model, Phase phase, const char* le, double value) {
+  AppendPhaseLabels(stream, name, scope, model, phase, le);
+  stream << std::setprecision(std::numeric_limits<double>::max_digits10) << value << '\n';
+}
+
+// Bucket and total counts, always printed as integers
+void AppendSample(std::ostringstream& stream, const char* name, std::string_view scope, std::string_view model, Phase phase, const char* le, uint64_t value) {
+  AppendPhaseLabels(stream, name, scope, model, phase, le);
+  stream << value << '\n';
+}
+}  // namespace
+
+const char* to_string(Phase phase) {
+  switch (phase) {
+    case Phase::Prefill:
+      return "prefill";
+    case Phase::Decode:
+      return "decode";
+    case Phase::StateRun:
+      return "state_run";
+    case Phase::KvCacheUpdate:
+      return "kv_cache_update";
+    case Phase::LogitsGet:
+      return "logits_get";
+    case Phase::SearchSetLogits:
+      return "search_set_logits";
+    case Phase::SelectTop:
+      return "select_top";
+    case Phase::SampleTopK:
+      return "sample_top_k";
+    case Phase::SampleTopP:
+      return "sample_top_p";
+    case Phase::SampleTopKTopP:
+      return "sample_top_k_top_p";
+    case Phase::TokenizerEncode:
+      return "tokenizer_encode";
+    case Phase::TokenizerDecode:
+      return "tokenizer_decode";
+    case Phase::TokenizerStreamDecode:
+      return "tokenizer_stream_decode";
+    case Phase::SessionLoad:
+      return "session_load";
+    default:
+      return "unknown";
+  }
+}
+
+Phase PhaseFromString(std::string_view name) {
+  for (size_t i = 0; i < static_cast<size_t>(Phase::Count); i++) {
+    if (name == to_string(static_cast<Phase>(i)))
+      return static_cast<Phase>(i);
+  }
+  throw std::runtime_error("Unknown phase: " + std::string{name});
+}
+
+void LatencyHistogram::Record(std::chrono::nanoseconds duration) {
+  const uint64_t ns = static_cast<uint64_t>(std::max<int64_t>(duration.count(), 0));
+  count_.fetch_add(1, std::memory_order_relaxed);
+  total_ns_.fetch_add(ns, std::memory_order_relaxed);
+
+  auto max = max_ns_.load(std::memory_order_relaxed);
+  while (ns > max && !max_ns_.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {
+  }
+
+  const double seconds = ns * 1e-9;
+  size_t bucket = 0;
+  while (bucket < bucket_bounds.size() && seconds > bucket_bounds[bucket])
+    bucket++;
+  buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::RecordSessionLoad(const std::string& session, std::chrono::nanoseconds duration) {
+  Record(Phase::SessionLoad, duration);
+
+  const double seconds = duration.count() * 1e-9;
+  std::lock_guard<std::mutex> lock{session_loads_mutex_};
+  auto it = std::find_if(session_loads_.begin(), session_loads_.end(), [&](const auto& load) { return load.first == session; });
+  if (it != session_loads_.end())
+    it->second = seconds;
+  else
+    session_loads_.emplace_back(session, seconds);
+}
+
+std::vector<std::pair<std::string, double>> Metrics::SessionLoadSeconds() const {
+  std::lock_guard<std::mutex> lock{session_loads_mutex_};
+  return session_loads_;
+}
+
+std::string Metrics::ToPrometheus(std::string_view scope, std::string_view model) const {
+  std::ostringstream stream;
+  stream << "# HELP genai_phase_seconds Time spent in each phase of generation\n"
+         << "# TYPE genai_phase_seconds histogram\n";
+
+  for (size_t i = 0; i < histograms_.size(); i++) {
+    auto phase = static_cast<Phase>(i);
+    auto& histogram = histograms_[i];
+    auto count = histogram.Count();
+    if (count == 0)
+      continue;
+
+    uint64_t cumulative = 0;
+    for (size_t bucket = 0; bucket < LatencyHistogram::bucket_bounds.size(); bucket++) {
+      cumulative += histogram.BucketCount(bucket);
+      std::ostringstream le;
+      le << LatencyHistogram::bucket_bounds[bucket];
+      AppendSample(stream, "genai_phase_seconds_bucket", scope, model, phase, le.str().c_str(), cumulative);
+    }
+    // Another thread may have recorded since Count() was read, keep +Inf and _count consistent with the buckets
+    AppendSample(stream, "genai_phase_seconds_bucket", scope, model, phase, "+Inf", std::max(count, cumulative));
+    AppendSample(stream, "genai_phase_seconds_sum", scope, model, phase, nullptr, histogram.TotalSeconds());
+    AppendSample(stream, "genai_phase_seconds_count", scope, model, phase, nullptr, std::max(count, cumulative));
+  }
+
+  stream << "# HELP genai_phase_max_seconds Longest single occurrence of each phase of generation\n"
+         << "# TYPE genai_phase_max_seconds gauge\n";
+  for (size_t i = 0; i < histograms_.size(); i++) {
+    if (histograms_[i].Count() != 0)
+      AppendSample(stream, "genai_phase_max_seconds", scope, model, static_cast<Phase>(i), nullptr, histograms_[i].MaxSeconds());
+  }
+
+  auto session_loads = SessionLoadSeconds();
+  if (!session_loads.empty()) {
+    stream << "# HELP genai_session_load_seconds Time it took to create each onnxruntime session of the model\n"
+           << "# TYPE genai_session_load_seconds gauge\n";
+    for (const auto& [session, seconds] : session_loads) {
+      AppendLabels(stream, "genai_session_load_seconds", scope, model);
+      stream << ",session=\"";
+      AppendLabelValue(stream, session);
+      stream << "\"} " << std::setprecision(std::numeric_limits<double>::max_digits10) << seconds << '\n';
+    }
+  }
+
+  return stream.str();
+}
+
+MetricsScope::MetricsScope(Metrics& generator, Metrics& model)
+    : generator_{&generator}, model_{&model}, previous_{tl_metrics_scope} {
+  tl_metrics_scope = this;
+}
+
+MetricsScope::~MetricsScope() {
+  tl_metrics_scope = previous_;
+}
+
+PhaseTimer::PhaseTimer(Phase phase, Metrics* metrics) : phase_{phase}, metrics_{metrics} {}
+
+PhaseTimer::~PhaseTimer() {
+  auto end = std::chrono::steady_clock::now();
+  if (g_trace_enabled.load(std::memory_order_relaxed))
+    RecordTraceSpan(to_string(phase_), "phase", start_, end);
+
+  auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start_);
+  if (metrics_) {
+    metrics_->Record(phase_, duration);
+  } else if (auto* scope = tl_metrics_scope) {
+    scope->generator_->Record(phase_, duration);
+    scope->model_->Record(phase_, duration);
+  }
+}
+
+}  // namespace Generators
@@ -0,0 +1,116 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#pragma once
+/*
+ * Always-on latency statistics for the phases of generation
+ *
+ * Every Generator and every Model own a Metrics object. Timing a phase is a PhaseTimer on the stack, recording it costs
+ * a handful of relaxed atomic adds so the counters can stay enabled in production.
+ *
+ * The code being timed (State::Run, KV_Cache::Update, Logits::Get, ...) doesn't know which generator it is working for,
+ * so Generator sets up a MetricsScope on the calling thread and the phase timers record into the metrics of the
+ * innermost scope. Tokenizer calls aren't tied to a generator and record into their model's metrics directly.
+ *
+ * ToPrometheus() formats the statistics in the Prometheus text exposition format.
+ */
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace Generators {
+
+enum struct Phase {
+  Prefill,                // Generator::ComputeLogits on the prompt
+  Decode,                 // Generator::ComputeLogits for each generated token
+  StateRun,               // State::Run, a single onnxruntime session run
+  KvCacheUpdate,          // KV_Cache::Update
+  LogitsGet,              // Logits::Get
+  SearchSetLogits,        // Search::SetLogits
+  SelectTop,              // Greedy or beam search step
+  SampleTopK,             // Search::SampleTopK
+  SampleTopP,             // Search::SampleTopP
+  SampleTopKTopP,         // Search::SampleTopKTopP
+  TokenizerEncode,        // Tokenizer::Encode, once per string for EncodeBatch
+  TokenizerDecode,        // Tokenizer::Decode, once per sequence for DecodeBatch
+  TokenizerStreamDecode,  // TokenizerStream::Decode
+  SessionLoad,            // Creating one onnxruntime session while loading the model, see Model::CreateSessions
+  Count
+};
+
+const char* to_string(Phase phase);
+Phase PhaseFromString(std::string_view name);  // The inverse of to_string, throws for unknown names
+
+struct LatencyHistogram {
+  // Upper bounds of the buckets in seconds, the last bucket is everything above the last bound
+  static constexpr std::array<double, 12> bucket_bounds{1e-5, 5e-5, 1e-4, 5e-4, 1e-3, 5e-3, 1e-2, 5e-2, 1e-1, 5e-1, 1, 5};
+
+  void Record(std::chrono::nanoseconds duration);
+
+  uint64_t Count() const { return count_.load(std::memory_order_relaxed); }
+  double TotalSeconds() const { return total_ns_.load(std::memory_order_relaxed) * 1e-9; }
+  double MaxSeconds() const { return max_ns_.load(std::memory_order_relaxed) * 1e-9; }
+  uint64_t BucketCount(size_t index) const { return buckets_[index].load(std::memory_order_relaxed); }  // Not cumulative
+
+ private:
+  std::atomic<uint64_t> count_{}, total_ns_{}, max_ns_{};
+  std::array<std::atomic<uint64_t>, bucket_bounds.size() + 1> buckets_{};
+};
+
+struct Metrics {
+  void Record(Phase phase, std::chrono::nanoseconds duration) { histograms_[static_cast<size_t>(phase)].Record(duration); }
+
+  const LatencyHistogram& operator[](Phase phase) const { return histograms_[static_cast<size_t>(phase)]; }
+
+  // Records Phase::SessionLoad and keeps the load time of each session by its file name. A session that is loaded
+  // again (a lazily loaded vision session after an idle unload) keeps only its latest load time.
+  void RecordSessionLoad(const std::string& session, std::chrono::nanoseconds duration);
+  std::vector<std::pair<std::string, double>> SessionLoadSeconds() const;  // In the order the sessions first loaded
+
+  // Phases that were never recorded are left out. scope ("model" or "generator") and model, the name of the model's
+  // directory, become labels on every sample so several models can be scraped from one process.
+  std::string ToPrometheus(std::string_view scope, std::string_view model) const;
+
+ private:
+  std::array<LatencyHistogram, static_cast<size_t>(Phase::Count)> histograms_;
+
+  mutable std::mutex session_loads_mutex_;
+  std::vector<std::pair<std::string, double>> session_loads_;
+};
+
+// While alive, phases timed on this thread are recorded into generator and model
+struct MetricsScope {
+  MetricsScope(Metrics& generator, Metrics& model);
+  ~MetricsScope();
+
+  MetricsScope(const MetricsScope&) = delete;
+  MetricsScope& operator=(const MetricsScope&) = delete;
+
+ private:
+  Metrics* generator_;
+  Metrics* model_;
+  MetricsScope* previous_;
+
+  friend struct PhaseTimer;
+};
+
+// Times its own lifetime. Records into 'metrics' when given, otherwise into the current MetricsScope (if any).
+// While tracing (see trace.h) it is also recorded as a span named after the phase.
+struct PhaseTimer {
+  PhaseTimer(Phase phase, Metrics* metrics = nullptr);
+  ~PhaseTimer();
+
+  PhaseTimer(const PhaseTimer&) = delete;
+  PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+ private:
+  Phase phase_;
+  Metrics* metrics_;
+  std::chrono::steady_clock::time_point start_{std::chrono::steady_clock::now()};
+};
+
+}  // namespace Generators
@@ -3,37 +3,19 @@
 
 #include "../generators.h"
 #include "model.h"
+#include <map>
 
 namespace Generators {
 
 namespace {
 
-std::unique_ptr<OrtValue> ProcessMel(ort_extensions::OrtxObjectPtr<OrtxTensor>& mel,
-                                     ONNXTensorElementDataType expected_type, Ort::Allocator& allocator) {
-  if (!(expected_type == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT || expected_type == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16)) {
-    throw std::runtime_error("Expected input_features to be of type float or float16. Actual: " + std::to_string(expected_type));
-  }
-
-  const float* mel_data{};
-  const int64_t* shape{};
-  size_t num_dims;
-  CheckResult(OrtxGetTensorData(mel.get(), reinterpret_cast<const void**>(&mel_data), &shape, &num_dims));
-  std::span<const int64_t> shape_span(shape, num_dims);
-  auto input_features_value = expected_type == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT
-                                  ? OrtValue::CreateTensor<float>(allocator, shape_span)
-                                  : OrtValue::CreateTensor<Ort::Float16_t>(allocator, shape_span);
+// Writes the fp32 log-mel features of one clip into its rows of the batched input_features buffer
+void CopyMel(std::span<const float> mel, ONNXTensorElementDataType expected_type, void* input_features_data, size_t offset) {
   if (expected_type == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT) {
-    std::copy(mel_data, mel_data + input_features_value->GetTensorTypeAndShapeInfo()->GetElementCount(),
-              input_features_value->GetTensorMutableData<float>());
+    std::copy(mel.begin(), mel.end(), static_cast<float*>(input_features_data) + offset);
   } else {
-    auto input_features_fp32 = OrtValue::CreateTensor<float>(
-        allocator.GetInfo(),
-        std::span<float>(const_cast<float*>(mel_data), input_features_value->GetTensorTypeAndShapeInfo()->GetElementCount()),
-        shape_span);
-    ConvertFp32ToFp16(allocator, *input_features_fp32, input_features_value, DeviceType::CPU, nullptr);
+    ConvertFloat32ToFloat16(mel, std::span<uint16_t>(static_cast<uint16_t*>(input_features_data) + offset, mel.size()));
   }
-
-  return input_features_value;
 }
 
 }  // namespace
@@ -44,39 +26,169 @@ std::unique_ptr<Audios> LoadAudios(const std::span<const char* const>& audio_pat
       throw std::runtime_error("Audio path does not exist: " + std::string(audio_path));
     }
   }
-  ort_extensions::OrtxObjectPtr<OrtxRawAudios> audios;
-  CheckResult(OrtxLoadAudios(ort_extensions::ptr(audios), audio_paths.data(), audio_paths.size()));
 
-  return std::make_unique<Audios>(std::move(audios), audio_paths.size());
+  // Decode each clip separately (and in parallel) so that feature extraction can also be spread across cores
+  std::vector<ort_extensions::OrtxObjectPtr<OrtxRawAudios>> audios(audio_paths.size());
+  ParallelFor(audio_paths.size(), [&](size_t i) {
+    CheckResult(OrtxLoadAudios(ort_extensions::ptr(audios[i]), &audio_paths[i], 1));
+  });
+
+  return std::make_unique<Audios>(std::move(audios));
 }
 
 AudioProcessor::AudioProcessor(Config& config, const SessionInfo& session_info)
     : input_features_type_{session_info.GetInputDataType(config.model.encoder_decoder_init.inputs.input_features)} {
   const std::string default_processor_file_name = "audio_processor_config.json";
-  auto processor_config = (config.config_path / fs::path(default_processor_file_name)).string();
-  processor_ = ort_extensions::OrtxObjectPtr<OrtxFeatureExtractor>(OrtxCreateSpeechFeatureExtractor, processor_config.c_str());
+  processor_config_ = (config.config_path / fs::path(default_processor_file_name)).string();
+  idle_processors_.emplace_back(OrtxCreateSpeechFeatureExtractor, processor_config_.c_str());
 
   config.AddMapping(std::string(Config::Defaults::InputFeaturesName), config.model.encoder_decoder_init.inputs.input_features);
 }
 
-std::unique_ptr<NamedTensors> AudioProcessor::Process(const Audios* audios) const {
-  if (!audios || !audios->audios_) {
+AudioProcessor::~AudioProcessor() = default;
+
+// The feature extractor isn't documented to be thread safe, so every thread computing a log-mel takes its own. They're
+// kept for reuse, so at most one extractor per thread that ever ran at the same time is created
+ort_extensions::OrtxObjectPtr<OrtxFeatureExtractor> AudioProcessor::TakeProcessor() const {
+  {
+    std::lock_guard<std::mutex> lock{processors_mutex_};
+    if (!idle_processors_.empty()) {
+      auto processor = std::move(idle_processors_.back());
+      idle_processors_.pop_back();
+      return processor;
+    }
+  }
+  return ort_extensions::OrtxObjectPtr<OrtxFeatureExtractor>(OrtxCreateSpeechFeatureExtractor, processor_config_.c_str());
+}
+
+void AudioProcessor::ReturnProcessor(ort_extensions::OrtxObjectPtr<OrtxFeatureExtractor> processor) const {
+  std::lock_guard<std::mutex> lock{processors_mutex_};
+  idle_processors_.push_back(std::move(processor));
+}
+
+struct AudioProcessor::LogMels {
+  std::vector<ort_extensions::OrtxObjectPtr<OrtxTensorResult>> results;
+  std::vector<ort_extensions::OrtxObjectPtr<OrtxTensor>> mels;
+  std::vector<std::span<const float>> datas;
+  std::vector<std::vector<int64_t>> shapes;  // [1, number_of_mels, number_of_frames] per clip
+};
+
+std::shared_ptr<AudioProcessor::LogMels> AudioProcessor::ComputeLogMels(const Audios* audios) const {
+  if (!audios || audios->audios_.empty()) {
     throw std::runtime_error("No audios provided to process.");
   }
 
-  Ort::Allocator& allocator{Ort::Allocator::GetWithDefaultOptions()};
+  if (!(input_features_type_ == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT || input_features_type_ == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16)) {
+    throw std::runtime_error("Expected input_features to be of type float or float16. Actual: " + std::to_string(input_features_type_));
+  }
+
+  // Compute the log-mel features of every clip on the worker pool, as this dominates preprocessing time for many short clips
+  const size_t num_audios = audios->audios_.size();
+  auto log_mels = std::make_shared<LogMels>();
+  log_mels->results.resize(num_audios);
+  log_mels->mels.resize(num_audios);
+  log_mels->datas.resize(num_audios);
+  log_mels->shapes.resize(num_audios);
+  ParallelFor(num_audios, [&](size_t i) {
+    auto processor = TakeProcessor();
+    auto status = OrtxSpeechLogMel(processor.get(), audios->audios_[i].get(), ort_extensions::ptr(log_mels->results[i]));
+    ReturnProcessor(std::move(processor));
+    CheckResult(status);
+    CheckResult(OrtxTensorResultGetAt(log_mels->results[i].get(), 0, ort_extensions::ptr(log_mels->mels[i])));
+
+    const float* mel_data{};
+    const int64_t* shape{};
+    size_t num_dims;
+    CheckResult(OrtxGetTensorData(log_mels->mels[i].get(), reinterpret_cast<const void**>(&mel_data), &shape, &num_dims));
+    auto& clip_shape = log_mels->shapes[i];
+    clip_shape.assign(shape, shape + num_dims);
+    if (clip_shape.size() != 3 || clip_shape[0] != 1) {
+      throw std::runtime_error("Expected the log-mel of each audio to have shape [1, number_of_mels, number_of_frames].");
+    }
+    log_mels->datas[i] = std::span<const float>(mel_data, std::accumulate(clip_shape.begin(), clip_shape.end(), int64_t{1}, std::multiplies<int64_t>()));
+  });
+  return log_mels;
+}
+
+// Stacks the given clips, which must all have the same shape, into a single [batch, number_of_mels, number_of_frames] input
+std::unique_ptr<NamedTensors> AudioProcessor::Stack(std::shared_ptr<LogMels> log_mels, std::span<const size_t> clips) const {
+  auto batch_shape = log_mels->shapes[clips[0]];
+  batch_shape[0] = static_cast<int64_t>(clips.size());
   auto named_tensors = std::make_unique<NamedTensors>();
 
-  ort_extensions::OrtxObjectPtr<OrtxTensorResult> result;
-  CheckResult(OrtxSpeechLogMel(processor_.get(), audios->audios_.get(), ort_extensions::ptr(result)));
+  // A single fp32 clip is already laid out exactly like the model input, so adopt the extractor's buffer instead of copying it
+  Ort::Allocator& allocator{Ort::Allocator::GetWithDefaultOptions()};
+  if (clips.size() == 1 && input_features_type_ == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT) {
+    auto mel = log_mels->datas[clips[0]];
+    auto input_features = std::make_shared<Tensor>(OrtValue::CreateTensor<float>(
+        allocator.GetInfo(), std::span<float>(const_cast<float*>(mel.data()), mel.size()), batch_shape));
+    input_features->buffer_owner_ = std::move(log_mels);
+    named_tensors->emplace(std::string(Config::Defaults::InputFeaturesName), std::move(input_features));
+    return named_tensors;
+  }
 
-  ort_extensions::OrtxObjectPtr<OrtxTensor> mel;
-  CheckResult(OrtxTensorResultGetAt(result.get(), 0, ort_extensions::ptr(mel)));
+  auto input_features_value = OrtValue::CreateTensor(allocator, batch_shape, input_features_type_);
+  auto* input_features_data = input_features_value->GetTensorMutableRawData();
+  const size_t clip_size = log_mels->datas[clips[0]].size();
+  ParallelFor(clips.size(), [&](size_t i) {
+    CopyMel(log_mels->datas[clips[i]], input_features_type_, input_features_data, i * clip_size);
+  });
 
   named_tensors->emplace(std::string(Config::Defaults::InputFeaturesName),
-                         std::make_shared<Tensor>(ProcessMel(mel, input_features_type_, allocator)));
-
+                         std::make_shared<Tensor>(std::move(input_features_value)));
   return named_tensors;
 }
 
+std::unique_ptr<NamedTensors> AudioProcessor::Process(const Audios* audios) const {
+  auto log_mels = ComputeLogMels(audios);
+  for (const auto& shape : log_mels->shapes) {
+    if (shape != log_mels->shapes[0]) {
+      throw std::runtime_error("All audios in a batch must produce the same number of log-mel frames. Process audios of different lengths in separate batches, see ProcessBatches.");
+    }
+  }
+
+  std::vector<size_t> clips(log_mels->shapes.size());
+  std::iota(clips.begin(), clips.end(), size_t{0});
+  return Stack(std::move(log_mels), clips);
+}
+
+std::vector<std::vector<size_t>> GroupClipsIntoBatches(std::span<const std::vector<int64_t>> shapes, size_t max_batch_size) {
+  if (max_batch_size == 0) {
+    throw std::runtime_error("max_batch_size must be at least 1.");
+  }
+
+  // Clips with the same log-mel shape go in the same bucket, the buckets are in order of increasing length
+  std::map<std::vector<int64_t>, std::vector<size_t>> buckets;
+  for (size_t i = 0; i < shapes.size(); i++)
+    buckets[{shapes[i][2], shapes[i][1]}].push_back(i);
+
+  std::vector<std::vector<size_t>> batches;
+  for (const auto& [shape, clips] : buckets) {
+    for (size_t first = 0; first < clips.size(); first += max_batch_size)
+      batches.emplace_back(clips.begin() + first, clips.begin() + std::min(first + max_batch_size, clips.size()));
+  }
+  return batches;
+}
+
+std::vector<AudioBatch> AudioProcessor::ProcessBatches(const Audios* audios, size_t max_batch_size) const {
+  if (max_batch_size == 0) {
+    throw std::runtime_error("max_batch_size must be at least 1.");
+  }
+
+  auto log_mels = ComputeLogMels(audios);
+
+  std::vector<AudioBatch> batches;
+  for (auto& clips : GroupClipsIntoBatches(log_mels->shapes, max_batch_size)) {
+    AudioBatch batch;
+    batch.clip_indices = std::move(clips);
+    batch.inputs = Stack(log_mels, batch.clip_indices);
+    batches.push_back(std::move(batch));
+  }
+  return batches;
+}
+
+std::unique_ptr<AudioStream> AudioProcessor::CreateStream(int64_t num_mels, int64_t window_frames, int64_t overlap_frames) const {
+  return std::make_unique<AudioStream>(num_mels, window_frames, overlap_frames, input_features_type_);
+}
+
 }  // namespace Generators
@@ -7,31 +7,61 @@
 
 namespace Generators {
 
+struct AudioStream;
+
 struct Audios {
-  Audios(ort_extensions::OrtxObjectPtr<OrtxRawAudios> audios, size_t num_audios)
-      : audios_(std::move(audios)), num_audios_{num_audios} {}
+  Audios(std::vector<ort_extensions::OrtxObjectPtr<OrtxRawAudios>> audios)
+      : audios_(std::move(audios)), num_audios_{audios_.size()} {}
 
   Audios() = delete;
   Audios(const Audios&) = delete;
   Audios& operator=(const Audios&) = delete;
 
-  ort_extensions::OrtxObjectPtr<OrtxRawAudios> audios_;
+  std::vector<ort_extensions::OrtxObjectPtr<OrtxRawAudios>> audios_;  // One entry per clip so clips can be decoded and processed in parallel
   size_t num_audios_{};
 };
 
 std::unique_ptr<Audios> LoadAudios(const std::span<const char* const>& audio_paths);
 
+// One encoder batch of ProcessBatches: the clips it holds and their stacked input_features
+struct AudioBatch {
+  std::vector<size_t> clip_indices;  // Positions of the clips in the Audios that were processed, in batch order
+  std::unique_ptr<NamedTensors> inputs;
+};
+
+// Groups clips with the same log-mel shape ([1, number_of_mels, number_of_frames] each) into batches of at most
+// max_batch_size clips. Shorter clips come first and clips keep their order within a batch.
+std::vector<std::vector<size_t>> GroupClipsIntoBatches(std::span<const std::vector<int64_t>> shapes, size_t max_batch_size);
+
 struct AudioProcessor {
   AudioProcessor(Config& config, const SessionInfo& session_info);
+  ~AudioProcessor();
 
   AudioProcessor() = delete;
   AudioProcessor(const AudioProcessor&) = delete;
   AudioProcessor& operator=(const AudioProcessor&) = delete;
 
+  // Every clip has to produce the same number of log-mel frames
   std::unique_ptr<NamedTensors> Process(const Audios* audios) const;
 
+  // For bulk transcription: buckets the clips by their number of log-mel frames and splits every bucket into batches of
+  // at most max_batch_size clips, shortest bucket first. Each batch can then go through its own generator.
+  std::vector<AudioBatch> ProcessBatches(const Audios* audios, size_t max_batch_size) const;
+
+  // For audio that arrives in chunks instead of as whole files, see AudioStream
+  std::unique_ptr<AudioStream> CreateStream(int64_t num_mels, int64_t window_frames, int64_t overlap_frames) const;
+
  private:
-  ort_extensions::OrtxObjectPtr<OrtxFeatureExtractor> processor_;
+  struct LogMels;
+  std::shared_ptr<LogMels> ComputeLogMels(const Audios* audios) const;
+  std::unique_ptr<NamedTensors> Stack(std::shared_ptr<LogMels> log_mels, std::span<const size_t> clips) const;
+
+  ort_extensions::OrtxObjectPtr<OrtxFeatureExtractor> TakeProcessor() const;
+  void ReturnProcessor(ort_extensions::OrtxObjectPtr<OrtxFeatureExtractor> processor) const;
+
+  std::string processor_config_;
+  mutable std::mutex processors_mutex_;
+  mutable std::vector<ort_extensions::OrtxObjectPtr<OrtxFeatureExtractor>> idle_processors_;  // See TakeProcessor
   ONNXTensorElementDataType input_features_type_;
 };
 
@@ -0,0 +1,183 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "../generators.h"
+#include "model.h"
+
+namespace Generators {
+
+namespace {
+
+// Slaney mel scale, as used by librosa and so by Whisper: linear below 1kHz, logarithmic above
+double HzToMel(double hz) {
+  constexpr double min_log_hz = 1000.0, min_log_mel = 15.0;
+  const double log_step = std::log(6.4) / 27.0;
+  return hz < min_log_hz ? hz * 3.0 / 200.0 : min_log_mel + std::log(hz / min_log_hz) / log_step;
+}
+
+double MelToHz(double mel) {
+  constexpr double min_log_hz = 1000.0, min_log_mel = 15.0;
+  const double log_step = std::log(6.4) / 27.0;
+  return mel < min_log_mel ? mel * 200.0 / 3.0 : min_log_hz * std::exp(log_step * (mel - min_log_mel));
+}
+
+// Triangular, area normalized filters from 0 to the Nyquist frequency, [num_mels, frequency_bins]
+std::vector<float> CreateMelFilters(int64_t num_mels, int frequency_bins, int sample_rate) {
+  const double max_hz = sample_rate / 2.0;
+  std::vector<double> mel_hz(num_mels + 2);
+  for (size_t i = 0; i < mel_hz.size(); i++)
+    mel_hz[i] = MelToHz(HzToMel(max_hz) * static_cast<double>(i) / static_cast<double>(num_mels + 1));
+
+  std::vector<float> filters(num_mels * frequency_bins);
+  for (int64_t m = 0; m < num_mels; m++) {
+    const double norm = 2.0 / (mel_hz[m + 2] - mel_hz[m]);
+    for (int k = 0; k < frequency_bins; k++) {
+      const double hz = max_hz * k / (frequency_bins - 1);
+      const double lower = (hz - mel_hz[m]) / (mel_hz[m + 1] - mel_hz[m]);
+      const double upper = (mel_hz[m + 2] - hz) / (mel_hz[m + 2] - mel_hz[m + 1]);
+      filters[m * frequency_bins + k] = static_cast<float>(std::max(0.0, std::min(lower, upper)) * norm);
+    }
+  }
+  return filters;
+}
+
+}  // namespace
+
+AudioStream::AudioStream(int64_t num_mels, int64_t window_frames, int64_t overlap_frames, ONNXTensorElementDataType input_features_type)
+    : num_mels_{num_mels}, window_frames_{window_frames}, overlap_frames_{overlap_frames}, input_features_type_{input_features_type} {
+  if (num_mels_ <= 0 || window_frames_ <= 0)
+    throw std::runtime_error("num_mels and window_frames must be positive.");
+  if (overlap_frames_ < 0 || overlap_frames_ >= window_frames_)
+    throw std::runtime_error("overlap_frames must be at least 0 and less than window_frames.");
+  if (!(input_features_type_ == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT || input_features_type_ == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16))
+    throw std::runtime_error("Expected input_features to be of type float or float16. Actual: " + std::to_string(input_features_type_));
+
+  constexpr double pi = 3.14159265358979323846;
+  hann_window_.resize(c_fft_size);
+  for (int n = 0; n < c_fft_size; n++)
+    hann_window_[n] = static_cast<float>(0.5 - 0.5 * std::cos(2.0 * pi * n / c_fft_size));  // Periodic, like torch.hann_window
+
+  // A frame is only 400 samples, not a power of two, so a precomputed DFT is simple and fast enough for real time
+  dft_cos_.resize(c_frequency_bins * c_fft_size);
+  dft_sin_.resize(c_frequency_bins * c_fft_size);
+  for (int k = 0; k < c_frequency_bins; k++) {
+    for (int n = 0; n < c_fft_size; n++) {
+      const double angle = 2.0 * pi * ((static_cast<int64_t>(k) * n) % c_fft_size) / c_fft_size;
+      dft_cos_[k * c_fft_size + n] = static_cast<float>(std::cos(angle));
+      dft_sin_[k * c_fft_size + n] = static_cast<float>(std::sin(angle));
+    }
+  }
+
+  mel_filters_ = CreateMelFilters(num_mels_, c_frequency_bins, c_sample_rate);
+}
+
+void AudioStream::Append(std::span<const float> samples) {
+  if (audio_frame_count_ >= 0)
+    throw std::runtime_error("Cannot append audio to a stream that was flushed.");
+  samples_.insert(samples_.end(), samples.begin(), samples.end());
+  sample_count_ += static_cast<int64_t>(samples.size());
+  ComputeFrames();
+}
+
+void AudioStream::Flush() {
+  if (audio_frame_count_ >= 0)
+    return;
+  audio_frame_count_ = (sample_count_ + c_hop_length - 1) / c_hop_length;
+  if (!HasAudio(window_start_))
+    return;
+
+  // Find the last window that still holds audio no earlier window returned, and pad the audio with silence to its end
+  int64_t last_window_start = window_start_;
+  while (audio_frame_count_ > last_window_start + window_frames_)
+    last_window_start += window_frames_ - overlap_frames_;
+  const int64_t needed_samples = (last_window_start + window_frames_ - 1) * c_hop_length + c_fft_size / 2 + 1;
+  if (needed_samples > sample_count_) {
+    samples_.resize(samples_.size() + static_cast<size_t>(needed_samples - sample_count_), 0.0f);
+    sample_count_ = needed_samples;
+  }
+  ComputeFrames();
+}
+
+// Frames are centered on multiples of the hop length with the start of the audio reflected, as in Whisper's STFT.
+// A frame is computed once the sample after its end has arrived, which is also enough for the reflection.
+void AudioStream::ComputeFrames() {
+  std::vector<float> frame(c_fft_size);
+  std::vector<float> power(c_frequency_bins);
+  for (;; frame_count_++) {
+    const int64_t first_sample = frame_count_ * c_hop_length - c_fft_size / 2;
+    if (first_sample + c_fft_size >= sample_count_)
+      break;
+
+    for (int n = 0; n < c_fft_size; n++) {
+      const int64_t position = first_sample + n;
+      frame[n] = hann_window_[n] * samples_[position < 0 ? -position : position - samples_start_];
+    }
+
+    for (int k = 0; k < c_frequency_bins; k++) {
+      const float* cos_row = dft_cos_.data() + k * c_fft_size;
+      const float* sin_row = dft_sin_.data() + k * c_fft_size;
+      float real = 0.0f, imaginary = 0.0f;
+      for (int n = 0; n < c_fft_size; n++) {
+        real += cos_row[n] * frame[n];
+        imaginary += sin_row[n] * frame[n];
+      }
+      power[k] = real * real + imaginary * imaginary;
+    }
+
+    for (int64_t m = 0; m < num_mels_; m++) {
+      const float* filter = mel_filters_.data() + m * c_frequency_bins;
+      float mel = 0.0f;
+      for (int k = 0; k < c_frequency_bins; k++)
+        mel += filter[k] * power[k];
+      log_mels_.push_back(std::log10(std::max(mel, 1e-10f)));
+    }
+  }
+
+  // Only keep the audio that frames not computed yet will read
+  const int64_t keep_from = std::max<int64_t>(0, frame_count_ * c_hop_length - c_fft_size / 2);
+  if (keep_from > samples_start_) {
+    samples_.erase(samples_.begin(), samples_.begin() + static_cast<ptrdiff_t>(keep_from - samples_start_));
+    samples_start_ = keep_from;
+  }
+}
+
+// Once flushed, the windows after the one holding the end of the audio would only be padding
+bool AudioStream::HasAudio(int64_t window_start) const {
+  if (audio_frame_count_ < 0)
+    return true;
+  return audio_frame_count_ > window_start + (window_start > 0 ? overlap_frames_ : 0);
+}
+
+std::unique_ptr<NamedTensors> AudioStream::NextWindow() {
+  if (frame_count_ < window_start_ + window_frames_)
+    return nullptr;
+  if (!HasAudio(window_start_))
+    return nullptr;
+
+  // Same normalization as Whisper: clamp to 8 (log10) below the loudest frame of the window, then scale
+  const size_t window_size = static_cast<size_t>(window_frames_ * num_mels_);
+  const float max_log_mel = *std::max_element(log_mels_.begin(), log_mels_.begin() + window_size);
+  std::vector<float> features(window_size);
+  for (int64_t t = 0; t < window_frames_; t++) {
+    for (int64_t m = 0; m < num_mels_; m++)
+      features[m * window_frames_ + t] = (std::max(log_mels_[t * num_mels_ + m], max_log_mel - 8.0f) + 4.0f) / 4.0f;
+  }
+
+  const std::vector<int64_t> shape{1, num_mels_, window_frames_};
+  Ort::Allocator& allocator{Ort::Allocator::GetWithDefaultOptions()};
+  auto input_features = OrtValue::CreateTensor(allocator, shape, input_features_type_);
+  if (input_features_type_ == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT)
+    std::copy(features.begin(), features.end(), input_features->GetTensorMutableData<float>());
+  else
+    ConvertFloat32ToFloat16(features, std::span<uint16_t>(input_features->GetTensorMutableData<uint16_t>(), window_size));
+
+  const int64_t step = window_frames_ - overlap_frames_;
+  log_mels_.erase(log_mels_.begin(), log_mels_.begin() + static_cast<ptrdiff_t>(step * num_mels_));
+  window_start_ += step;
+
+  auto named_tensors = std::make_unique<NamedTensors>();
+  named_tensors->emplace(std::string(Config::Defaults::InputFeaturesName), std::make_shared<Tensor>(std::move(input_features)));
+  return named_tensors;
+}
+
+}  // namespace Generators
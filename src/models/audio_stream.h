@@ -0,0 +1,52 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#pragma once
+
+namespace Generators {
+
+// Streaming Whisper preprocessing: takes 16kHz mono PCM as it arrives, computes the log-mel one frame at a time and cuts
+// it into encoder windows of window_frames that overlap by overlap_frames. Each window is normalized on its own, the way
+// a whole clip of that length would be, so it can go straight into a generator as input_features.
+struct AudioStream {
+  static constexpr int c_sample_rate = 16000;
+  static constexpr int c_fft_size = 400;     // 25ms
+  static constexpr int c_hop_length = 160;   // 10ms, so 100 log-mel frames per second
+  static constexpr int c_frequency_bins = c_fft_size / 2 + 1;
+
+  AudioStream(int64_t num_mels, int64_t window_frames, int64_t overlap_frames, ONNXTensorElementDataType input_features_type);
+
+  AudioStream(const AudioStream&) = delete;
+  AudioStream& operator=(const AudioStream&) = delete;
+
+  void Append(std::span<const float> samples);
+
+  // Ends the stream. The audio not yet returned in a window is padded with silence up to a whole window.
+  void Flush();
+
+  // Returns the next window as [1, num_mels, window_frames] input_features, or nullptr if it isn't complete yet
+  std::unique_ptr<NamedTensors> NextWindow();
+
+  // Where the window the next call to NextWindow returns starts, in seconds from the beginning of the stream
+  double NextWindowStart() const { return static_cast<double>(window_start_) * c_hop_length / c_sample_rate; }
+
+ private:
+  void ComputeFrames();
+  bool HasAudio(int64_t window_start) const;
+
+  int64_t num_mels_, window_frames_, overlap_frames_;
+  ONNXTensorElementDataType input_features_type_;
+
+  std::vector<float> hann_window_;        // [c_fft_size]
+  std::vector<float> dft_cos_, dft_sin_;  // [c_frequency_bins, c_fft_size]
+  std::vector<float> mel_filters_;        // [num_mels, c_frequency_bins]
+
+  std::vector<float> samples_;   // The audio still needed by frames not computed yet, starting at samples_start_
+  int64_t samples_start_{};      // Stream position of samples_[0], in samples
+  int64_t sample_count_{};       // Samples appended so far, including the silence added by Flush
+  std::vector<float> log_mels_;  // [frames, num_mels] log10 mel of the frames from window_start_ on
+  int64_t window_start_{};       // First frame of the next window
+  int64_t frame_count_{};        // Frames computed so far
+  int64_t audio_frame_count_{-1};  // Frames holding real audio, known once the stream is flushed
+};
+
+}  // namespace Generators
@@ -0,0 +1,192 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "cpu_affinity.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+
+#if _MSC_VER
+#include <Windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace Generators {
+
+namespace {
+
+#if defined(__linux__)
+bool ReadNumaNodeCpus(int node, std::vector<int>& cpus) {
+  std::ifstream file{"/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"};
+  std::string cpu_list;
+  if (!std::getline(file, cpu_list))
+    return false;
+  cpus = ParseCpuList(cpu_list);
+  return true;
+}
+
+// The ids of the NUMA nodes that are online, which need not be contiguous (e.g. "0,2" when node 1 has no memory)
+std::vector<int> ReadOnlineNumaNodes() {
+  std::ifstream file{"/sys/devices/system/node/online"};
+  std::string node_list;
+  if (!std::getline(file, node_list))
+    return {};
+  return ParseCpuList(node_list);
+}
+#endif
+
+std::string_view Trim(std::string_view text) {
+  while (!text.empty() && std::isspace(static_cast<unsigned char>(text.front())))
+    text.remove_prefix(1);
+  while (!text.empty() && std::isspace(static_cast<unsigned char>(text.back())))
+    text.remove_suffix(1);
+  return text;
+}
+
+// Unlike std::stoi on its own, rejects anything but plain decimal digits, e.g. "1x", "-1" or the "2-3" of "1-2-3"
+int ParseCpuId(std::string_view text) {
+  text = Trim(text);
+  if (text.empty() || !std::all_of(text.begin(), text.end(), [](char c) { return c >= '0' && c <= '9'; }))
+    throw std::invalid_argument("");
+  return std::stoi(std::string{text});
+}
+
+}  // namespace
+
+std::vector<int> ParseCpuList(std::string_view cpu_list) {
+  std::vector<int> cpus;
+  while (!cpu_list.empty()) {
+    auto comma = cpu_list.find(',');
+    auto range = cpu_list.substr(0, comma);
+    cpu_list = comma == std::string_view::npos ? std::string_view{} : cpu_list.substr(comma + 1);
+
+    range = Trim(range);
+    if (range.empty())
+      continue;
+
+    try {
+      auto dash = range.find('-');
+      int first = ParseCpuId(range.substr(0, dash));
+      int last = dash == std::string_view::npos ? first : ParseCpuId(range.substr(dash + 1));
+      if (last < first)
+        throw std::invalid_argument("");
+      for (int cpu = first; cpu <= last; cpu++)
+        cpus.push_back(cpu);
+    } catch (const std::logic_error&) {
+      throw std::runtime_error("Invalid cpu list entry: " + std::string{range});
+    }
+  }
+  return cpus;
+}
+
+std::vector<int> GetNumaNodeCpus(int node) {
+#if defined(__linux__)
+  std::vector<int> cpus;
+  if (!ReadNumaNodeCpus(node, cpus) || cpus.empty())
+    throw std::runtime_error("NUMA node " + std::to_string(node) + " was not found or has no processors");
+  return cpus;
+#else
+  throw std::runtime_error("numa_node is only supported on Linux, use cpu_cores instead");
+#endif
+}
+
+std::vector<int> GetReplicaCpus(int replica_count, int replica_index) {
+  std::vector<std::vector<int>> nodes;
+#if defined(__linux__)
+  for (int node : ReadOnlineNumaNodes()) {
+    std::vector<int> node_cpus;
+    if (ReadNumaNodeCpus(node, node_cpus))
+      nodes.push_back(std::move(node_cpus));
+  }
+#endif
+  return GetReplicaCpus(nodes, replica_count, replica_index);
+}
+
+std::vector<int> GetReplicaCpus(const std::vector<std::vector<int>>& node_cpus, int replica_count, int replica_index) {
+  if (replica_count <= 0 || replica_index < 0 || replica_index >= replica_count)
+    throw std::runtime_error("replica_index must be in the range [0, replica_count)");
+
+  std::vector<int> cpus;
+  for (const auto& node : node_cpus)
+    cpus.insert(cpus.end(), node.begin(), node.end());
+  if (cpus.empty()) {
+    cpus.resize(std::max(1U, std::thread::hardware_concurrency()));
+    for (size_t i = 0; i < cpus.size(); i++)
+      cpus[i] = static_cast<int>(i);
+  }
+
+  if (cpus.size() < static_cast<size_t>(replica_count))
+    throw std::runtime_error("replica_count is larger than the number of processors");
+
+  size_t begin = cpus.size() * replica_index / replica_count;
+  size_t end = cpus.size() * (replica_index + 1) / replica_count;
+  return {cpus.begin() + begin, cpus.begin() + end};
+}
+
+std::string FormatIntraOpThreadAffinities(const std::vector<int>& cpus, int thread_count) {
+  std::string affinities;
+  if (cpus.empty())
+    return affinities;
+  for (int thread = 1; thread < thread_count; thread++) {
+    if (!affinities.empty())
+      affinities += ';';
+    affinities += std::to_string(cpus[thread % cpus.size()] + 1);
+  }
+  return affinities;
+}
+
+ScopedThreadAffinity::ScopedThreadAffinity(const std::vector<int>& cpus) {
+  if (cpus.empty())
+    return;
+#if _MSC_VER
+  // Processor groups aren't handled, only the first 64 processors can be used here
+  DWORD_PTR mask{};
+  for (int cpu : cpus) {
+    if (cpu < static_cast<int>(sizeof(mask) * 8))
+      mask |= DWORD_PTR{1} << cpu;
+  }
+  if (DWORD_PTR previous = mask ? SetThreadAffinityMask(GetCurrentThread(), mask) : 0) {
+    previous_.resize(sizeof(previous));
+    std::memcpy(previous_.data(), &previous, sizeof(previous));
+    pinned_ = true;
+  }
+#elif defined(__linux__)
+  cpu_set_t previous;
+  if (pthread_getaffinity_np(pthread_self(), sizeof(previous), &previous) != 0)
+    return;
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : cpus) {
+    if (cpu < CPU_SETSIZE)
+      CPU_SET(cpu, &set);
+  }
+  if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0) {
+    previous_.resize(sizeof(previous));
+    std::memcpy(previous_.data(), &previous, sizeof(previous));
+    pinned_ = true;
+  }
+#endif
+}
+
+ScopedThreadAffinity::~ScopedThreadAffinity() {
+  if (!pinned_)
+    return;
+#if _MSC_VER
+  DWORD_PTR previous;
+  std::memcpy(&previous, previous_.data(), sizeof(previous));
+  SetThreadAffinityMask(GetCurrentThread(), previous);
+#elif defined(__linux__)
+  cpu_set_t previous;
+  std::memcpy(&previous, previous_.data(), sizeof(previous));
+  pthread_setaffinity_np(pthread_self(), sizeof(previous), &previous);
+#endif
+}
+
+}  // namespace Generators
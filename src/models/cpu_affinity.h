@@ -0,0 +1,44 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Generators {
+
+// Parses a Linux style cpu list such as "0-3,8,10-11" into the logical processor ids it names
+std::vector<int> ParseCpuList(std::string_view cpu_list);
+
+// Logical processors of a NUMA node. Only Linux exposes the topology, elsewhere this throws.
+std::vector<int> GetNumaNodeCpus(int node);
+
+// Splits the host's logical processors, ordered by NUMA node, into replica_count equal contiguous groups and returns
+// group replica_index. When the replica count is a multiple of the node count every replica stays on a single node.
+std::vector<int> GetReplicaCpus(int replica_count, int replica_index);
+
+// The same split for a given layout, node_cpus holding the processors of each NUMA node in order. Without any nodes
+// it falls back to all of the host's processors.
+std::vector<int> GetReplicaCpus(const std::vector<std::vector<int>>& node_cpus, int replica_count, int replica_index);
+
+// Formats cpus as the value of onnxruntime's "session.intra_op_thread_affinities" for a pool of thread_count threads.
+// Onnxruntime runs the first thread on the calling thread, so only the other thread_count - 1 threads are pinned, each
+// to one processor in turn. Processor ids in that setting are 1-based.
+std::string FormatIntraOpThreadAffinities(const std::vector<int>& cpus, int thread_count);
+
+// Restricts the calling thread to cpus for the lifetime of the object. Memory the thread touches first is then placed
+// on their NUMA node, which is how the weights of a session end up next to the cores that will use them.
+struct ScopedThreadAffinity {
+  ScopedThreadAffinity(const std::vector<int>& cpus);
+  ~ScopedThreadAffinity();
+
+  ScopedThreadAffinity(const ScopedThreadAffinity&) = delete;
+  ScopedThreadAffinity& operator=(const ScopedThreadAffinity&) = delete;
+
+ private:
+  bool pinned_{};
+  std::vector<unsigned char> previous_;  // Saved platform affinity mask
+};
+
+}  // namespace Generators
@@ -29,7 +29,7 @@ std::ostream& operator<<(std::ostream& stream, Ort::Float16_t v) {
 }
 
 std::ostream& operator<<(std::ostream& stream, Ort::BFloat16_t v) {
-  stream << "BF16:" << v.value;  // TODO: implement conversion when useful
+  stream << BFloat16ToFloat32(v.value);
   return stream;
 }
 
@@ -4,7 +4,7 @@
 namespace Generators {
 DecoderOnly_Model::DecoderOnly_Model(std::unique_ptr<Config> config, OrtEnv& ort_env)
     : Model{std::move(config)} {
-  session_decoder_ = OrtSession::Create(ort_env, (config_->config_path / fs::path(config_->model.decoder.filename)).c_str(), session_options_.get());
+  session_decoder_ = CreateSession(ort_env, config_->model.decoder.filename, session_options_.get());
 
   InitDeviceAllocator(*session_decoder_);
 }
@@ -32,11 +32,82 @@ RoamingArray<float> DecoderOnly_State::Run(int current_length, RoamingArray<int3
 
   int batch_size = static_cast<int>(input_ids_.GetShape()[0]);
   State::Run(*model_.session_decoder_, batch_size);
+  kv_cache_.Quantize();
 
   return logits_.Get();
 }
 
+bool DecoderOnly_State::CanRemoveRows() const {
+  // Rows are compacted with CPU copies. Captured graphs and shared past/present buffers are sized for a fixed batch,
+  // extra inputs are opaque to us and an int8 KV cache has no presents to compact between steps
+  return model_.device_type_ == DeviceType::CPU && !captured_graph_info_ &&
+         !params_->search.past_present_share_buffer && params_->extra_inputs.empty() && !kv_cache_.IsQuantized();
+}
+
+void DecoderOnly_State::RemoveRows(std::span<const int32_t> rows_to_keep) {
+  input_ids_.RemoveRows(rows_to_keep);
+  position_inputs_.RemoveRows(rows_to_keep);
+  kv_cache_.RemoveRows(rows_to_keep);
+  logits_.RemoveRows(rows_to_keep);
+}
+
+void DecoderOnly_State::AppendTokens(std::span<const int32_t> tokens) {
+  if (model_.device_type_ != DeviceType::CPU || captured_graph_info_ || params_->search.past_present_share_buffer)
+    throw std::runtime_error("AppendTokens is only supported on CPU, without graph capture or past_present_share_buffer");
+  if (input_ids_.GetShape()[0] != params_->BatchBeamSize())
+    throw std::runtime_error("AppendTokens can't be used once the drop_finished_rows search option dropped finished sequences from the batch");
+  appended_tokens_.assign(tokens.begin(), tokens.end());
+}
+
+void DecoderOnly_State::RewindTo(int current_length, int new_length) {
+  if (model_.device_type_ != DeviceType::CPU || captured_graph_info_)
+    throw std::runtime_error("RewindTo is only supported on CPU, without graph capture");
+  if (input_ids_.GetShape()[0] != params_->BatchBeamSize())
+    throw std::runtime_error("RewindTo can't be used once the drop_finished_rows search option dropped finished sequences from the batch");
+
+  input_ids_.Rewind(current_length - new_length);
+  position_inputs_.RewindTo(current_length, new_length);
+  kv_cache_.RewindTo(new_length - 1);
+}
+
+void DecoderOnly_State::SaveState(SnapshotWriter& writer, int current_length, bool kv_fp16) {
+  if (model_.device_type_ != DeviceType::CPU || captured_graph_info_)
+    throw std::runtime_error("SaveState is only supported on CPU, without graph capture");
+  if (input_ids_.GetShape()[0] != params_->BatchBeamSize())
+    throw std::runtime_error("SaveState can't be used once the drop_finished_rows search option dropped finished sequences from the batch");
+
+  input_ids_.Save(writer);
+  position_inputs_.Save(writer);
+  kv_cache_.Save(writer, current_length - 1, kv_fp16);
+}
+
+void DecoderOnly_State::LoadState(SnapshotReader& reader, int current_length) {
+  if (model_.device_type_ != DeviceType::CPU || captured_graph_info_)
+    throw std::runtime_error("LoadState is only supported on CPU, without graph capture");
+  if (!first_run_)
+    throw std::runtime_error("LoadState needs a generator that hasn't run yet");
+
+  input_ids_.Load(reader);
+  position_inputs_.Load(reader, current_length);
+  kv_cache_.Load(reader, current_length - 1);
+  logits_.UpdateChunk(1);  // The prompt was never run, so the logits still have its shape
+  first_run_ = false;
+}
+
 void DecoderOnly_State::UpdateInputsOutputs(const RoamingArray<int32_t>& next_tokens_unk, RoamingArray<int32_t> beam_indices, int current_length) {
+  if (!appended_tokens_.empty()) {
+    auto next_tokens = next_tokens_unk.GetCPU();
+    const int token_count = static_cast<int>(appended_tokens_.size() / next_tokens.size() + 1);
+    auto tokens = InterleaveAppendedTokens(next_tokens, appended_tokens_);
+    appended_tokens_.clear();
+
+    input_ids_.UpdateChunk(tokens, token_count);
+    position_inputs_.UpdateChunk(token_count, current_length);
+    kv_cache_.Update(beam_indices.GetCPU(), current_length);
+    logits_.UpdateChunk(token_count);
+    return;
+  }
+
   input_ids_.Update(next_tokens_unk);
   position_inputs_.Update(current_length);
   kv_cache_.Update(beam_indices.GetCPU(), current_length);
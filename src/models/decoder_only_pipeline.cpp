@@ -8,15 +8,19 @@ namespace Generators {
 
 DecoderOnlyPipelineModel::DecoderOnlyPipelineModel(std::unique_ptr<Config> config, OrtEnv& ort_env)
     : Model{std::move(config)} {
-  for (const auto& model : config_->model.decoder.pipeline) {
-    sessions_.emplace_back(OrtSession::Create(ort_env, (config_->config_path / fs::path(model.filename)).c_str(),
-                                              GetSessionOptions(model.model_id)));
+  const auto& pipeline = config_->model.decoder.pipeline;
 
-    if (!allocator_device_ && model.session_options.has_value()) {
-      const auto& provider_options = (*model.session_options).provider_options;
+  std::vector<std::pair<std::string, OrtSessionOptions*>> models;
+  for (const auto& model : pipeline)
+    models.emplace_back(model.filename, GetSessionOptions(model.model_id));
+  sessions_ = CreateSessions(ort_env, models);
+
+  for (size_t i = 0; i < pipeline.size() && !allocator_device_; i++) {
+    if (pipeline[i].session_options.has_value()) {
+      const auto& provider_options = (*pipeline[i].session_options).provider_options;
       if (std::any_of(provider_options.begin(), provider_options.end(),
                       [](const auto& elem) { return !elem.name.empty(); })) {
-        InitDeviceAllocator(*sessions_.back());
+        InitDeviceAllocator(*sessions_[i]);
       }
     }
   }
@@ -119,6 +123,9 @@ RoamingArray<float> DecoderOnlyPipelineState::Run(int current_length, RoamingArr
       continue;
     }
 
+    // Covers the input/output bookkeeping too, the session run itself shows up as the nested state_run span
+    TraceSpan span{model_.config_->model.decoder.pipeline[pipeline_state->id_].model_id, "pipeline"};
+
     // Clear the intermediate pipeline state outputs from the previous runs.
     // These outputs will be replaced by the outputs from the current run.
     for (const auto& output_name : pipeline_state->output_names_) {
@@ -5,7 +5,7 @@ namespace Generators {
 
 Gpt_Model::Gpt_Model(std::unique_ptr<Config> config, OrtEnv& ort_env)
     : Model{std::move(config)} {
-  session_decoder_ = OrtSession::Create(ort_env, (config_->config_path / fs::path(config_->model.decoder.filename)).c_str(), session_options_.get());
+  session_decoder_ = CreateSession(ort_env, config_->model.decoder.filename, session_options_.get());
   InitDeviceAllocator(*session_decoder_);
 }
 
@@ -32,10 +32,80 @@ RoamingArray<float> Gpt_State::Run(int current_length, RoamingArray<int32_t> nex
   }
 
   State::Run(*model_.session_decoder_, batch_size);
+  kv_cache_.Quantize();
   return logits_.Get();
 }
 
+bool Gpt_State::CanRemoveRows() const {
+  // Same limits as DecoderOnly_State::CanRemoveRows
+  return model_.device_type_ == DeviceType::CPU && !GetCapturedGraphInfo() &&
+         !params_->search.past_present_share_buffer && params_->extra_inputs.empty() && !kv_cache_.IsQuantized();
+}
+
+void Gpt_State::RemoveRows(std::span<const int32_t> rows_to_keep) {
+  input_ids_.RemoveRows(rows_to_keep);
+  position_inputs_.RemoveRows(rows_to_keep);
+  kv_cache_.RemoveRows(rows_to_keep);
+  logits_.RemoveRows(rows_to_keep);
+}
+
+void Gpt_State::AppendTokens(std::span<const int32_t> tokens) {
+  if (model_.device_type_ != DeviceType::CPU)
+    throw std::runtime_error("AppendTokens is only supported on CPU");
+  if (input_ids_.GetShape()[0] != params_->BatchBeamSize())
+    throw std::runtime_error("AppendTokens can't be used once the drop_finished_rows search option dropped finished sequences from the batch");
+  appended_tokens_.assign(tokens.begin(), tokens.end());
+}
+
+void Gpt_State::RewindTo(int current_length, int new_length) {
+  if (model_.device_type_ != DeviceType::CPU)
+    throw std::runtime_error("RewindTo is only supported on CPU");
+  if (input_ids_.GetShape()[0] != params_->BatchBeamSize())
+    throw std::runtime_error("RewindTo can't be used once the drop_finished_rows search option dropped finished sequences from the batch");
+
+  input_ids_.Rewind(current_length - new_length);
+  position_inputs_.RewindTo(current_length, new_length);
+  kv_cache_.RewindTo(new_length - 1);
+}
+
+void Gpt_State::SaveState(SnapshotWriter& writer, int current_length, bool kv_fp16) {
+  if (model_.device_type_ != DeviceType::CPU)
+    throw std::runtime_error("SaveState is only supported on CPU");
+  if (input_ids_.GetShape()[0] != params_->BatchBeamSize())
+    throw std::runtime_error("SaveState can't be used once the drop_finished_rows search option dropped finished sequences from the batch");
+
+  input_ids_.Save(writer);
+  position_inputs_.Save(writer);
+  kv_cache_.Save(writer, current_length - 1, kv_fp16);
+}
+
+void Gpt_State::LoadState(SnapshotReader& reader, int current_length) {
+  if (model_.device_type_ != DeviceType::CPU)
+    throw std::runtime_error("LoadState is only supported on CPU");
+  if (!first_run_)
+    throw std::runtime_error("LoadState needs a generator that hasn't run yet");
+
+  input_ids_.Load(reader);
+  position_inputs_.Load(reader, current_length);
+  kv_cache_.Load(reader, current_length - 1);
+  logits_.UpdateChunk(1);  // The prompt was never run, so the logits still have its shape
+  first_run_ = false;
+}
+
 void Gpt_State::UpdateInputsOutputs(const RoamingArray<int32_t>& next_tokens, RoamingArray<int32_t> beam_indices, int current_length) {
+  if (!appended_tokens_.empty()) {
+    auto next_tokens_cpu = next_tokens.GetCPU();
+    const int token_count = static_cast<int>(appended_tokens_.size() / next_tokens_cpu.size() + 1);
+    auto tokens = InterleaveAppendedTokens(next_tokens_cpu, appended_tokens_);
+    appended_tokens_.clear();
+
+    input_ids_.UpdateChunk(tokens, token_count);
+    position_inputs_.UpdateChunk(token_count, current_length);
+    kv_cache_.Update(beam_indices.GetCPU(), current_length);
+    logits_.UpdateChunk(token_count);
+    return;
+  }
+
   input_ids_.Update(next_tokens);
   position_inputs_.Update(current_length);
   kv_cache_.Update(beam_indices.GetCPU(), current_length);
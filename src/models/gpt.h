@@ -20,6 +20,13 @@ struct Gpt_State : State {
   Gpt_State(const Gpt_Model& model, RoamingArray<int32_t> sequence_lengths, const GeneratorParams& params);
   RoamingArray<float> Run(int current_length, RoamingArray<int32_t> next_tokens, RoamingArray<int32_t> next_indices) override;
 
+  bool CanRemoveRows() const override;
+  void RemoveRows(std::span<const int32_t> rows_to_keep) override;
+  void AppendTokens(std::span<const int32_t> tokens) override;
+  void RewindTo(int current_length, int new_length) override;
+  void SaveState(SnapshotWriter& writer, int current_length, bool kv_fp16) override;
+  void LoadState(SnapshotReader& reader, int current_length) override;
+
  private:
   void UpdateInputsOutputs(const RoamingArray<int32_t>& next_tokens, RoamingArray<int32_t> beam_indices, int current_length);
 
@@ -30,5 +37,7 @@ struct Gpt_State : State {
   KV_Cache_Combined kv_cache_{*this};
   PositionInputs position_inputs_;
   ExtraInputs extra_inputs_{*this};
+
+  std::vector<int32_t> appended_tokens_;  // Queued by AppendTokens for the next Run
 };
 }  // namespace Generators
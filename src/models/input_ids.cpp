@@ -170,4 +170,58 @@ void InputIDs::Update(RoamingArray<int32_t> next_tokens_unk) {
   }
 }
 
+void InputIDs::UpdateChunk(std::span<const int32_t> tokens, int64_t sequence_length) {
+  // Update reallocates a [batch, 1] tensor on the step after this
+  shape_[1] = sequence_length;
+  value_ = OrtValue::CreateTensor(*model_.allocator_device_, shape_, type_);
+  state_.inputs_[input_index_] = value_.get();
+
+  if (type_ == Ort::TypeToTensorType<int64_t>)
+    std::copy(tokens.begin(), tokens.end(), value_->GetTensorMutableData<int64_t>());
+  else
+    memcpy(value_->GetTensorMutableData<int32_t>(), tokens.data(), tokens.size_bytes());
+
+  if (current_sequence_length_ && past_sequence_length_) {
+    *current_sequence_length_->GetTensorMutableData<int32_t>() += static_cast<int32_t>(sequence_length);
+    *past_sequence_length_->GetTensorMutableData<int32_t>() += static_cast<int32_t>(sequence_length);
+  }
+}
+
+void InputIDs::Rewind(int token_count) {
+  // The values are overwritten by the next Update, only the running lengths need to go back
+  if (current_sequence_length_ && past_sequence_length_) {
+    *current_sequence_length_->GetTensorMutableData<int32_t>() -= token_count;
+    *past_sequence_length_->GetTensorMutableData<int32_t>() -= token_count;
+  }
+}
+
+void InputIDs::Save(SnapshotWriter& writer) {
+  // The tokens themselves are in the sequences, only the running lengths are extra
+  const bool has_lengths = current_sequence_length_ && past_sequence_length_;
+  writer.Write(has_lengths);
+  if (has_lengths) {
+    writer.Write(*current_sequence_length_->GetTensorData<int32_t>());
+    writer.Write(*past_sequence_length_->GetTensorData<int32_t>());
+  }
+}
+
+void InputIDs::Load(SnapshotReader& reader) {
+  const bool has_lengths = current_sequence_length_ && past_sequence_length_;
+  if (reader.Read<bool>() != has_lengths)
+    throw std::runtime_error("Generator snapshot was saved with a different model");
+  if (has_lengths) {
+    *current_sequence_length_->GetTensorMutableData<int32_t>() = reader.Read<int32_t>();
+    *past_sequence_length_->GetTensorMutableData<int32_t>() = reader.Read<int32_t>();
+  }
+}
+
+void InputIDs::RemoveRows(std::span<const int32_t> rows_to_keep) {
+  // Update overwrites every value with the next tokens, so only the shape has to shrink
+  shape_[0] = static_cast<int64_t>(rows_to_keep.size());
+  if (shape_[1] == 1) {
+    value_ = OrtValue::CreateTensor(*model_.allocator_device_, shape_, type_);
+    state_.inputs_[input_index_] = value_.get();
+  }
+}
+
 }  // namespace Generators
@@ -11,6 +11,11 @@ struct InputIDs {
 
   void Add();
   void Update(RoamingArray<int32_t> next_tokens);
+  void RemoveRows(std::span<const int32_t> rows_to_keep);  // See State::RemoveRows
+  void UpdateChunk(std::span<const int32_t> tokens, int64_t sequence_length);  // Several tokens per row, see State::AppendTokens
+  void Rewind(int token_count);                                                 // See State::RewindTo
+  void Save(SnapshotWriter& writer);                                            // See State::SaveState
+  void Load(SnapshotReader& reader);
 
   auto& GetShape() const { return shape_; }
   const char* name_;
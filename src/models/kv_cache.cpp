@@ -17,12 +17,113 @@ std::string ComposeKeyValueName(const std::string& template_string, int index) {
   return std::string(key_value_name);
 }
 
+// Symmetric int8 with one scale per block, a block being the key or value vector of one head for one token
+void QuantizeBlocks(std::span<const float> in, size_t block_size, int8_t* values, float* scales) {
+  for (size_t block = 0; block < in.size() / block_size; block++) {
+    const float* input = in.data() + block * block_size;
+    float max_abs = 0.0f;
+    for (size_t i = 0; i < block_size; i++)
+      max_abs = std::max(max_abs, std::abs(input[i]));
+
+    scales[block] = max_abs / 127.0f;
+    const float inverse_scale = max_abs != 0.0f ? 127.0f / max_abs : 0.0f;
+    for (size_t i = 0; i < block_size; i++)
+      values[block * block_size + i] = static_cast<int8_t>(std::lrint(input[i] * inverse_scale));
+  }
+}
+
+void DequantizeBlocks(const int8_t* values, const float* scales, size_t block_size, std::span<float> out) {
+  for (size_t block = 0; block < out.size() / block_size; block++) {
+    for (size_t i = 0; i < block_size; i++)
+      out[block * block_size + i] = values[block * block_size + i] * scales[block];
+  }
+}
+
+// Keeps the first new_length tokens of every head of a [head_count, length, token_bytes] buffer. Works in place
+void KeepTokenPrefix(const void* source, void* target, size_t head_count, size_t length, size_t new_length, size_t token_bytes) {
+  for (size_t head = 0; head < head_count; head++) {
+    memmove(static_cast<uint8_t*>(target) + head * new_length * token_bytes,
+            static_cast<const uint8_t*>(source) + head * length * token_bytes,
+            new_length * token_bytes);
+  }
+}
+
+// Splits a KV tensor shape into [heads, length, head_size], see QuantizedKvTensor
+std::array<size_t, 3> HeadsLengthHeadSize(const OrtValue& value) {
+  auto shape = value.GetTensorTypeAndShapeInfo()->GetShape();
+  size_t head_count = 1;
+  for (size_t i = 0; i + 2 < shape.size(); i++)
+    head_count *= shape[i];
+  return {head_count, static_cast<size_t>(shape[shape.size() - 2]), static_cast<size_t>(shape.back())};
+}
+
 }  // namespace
 
+void QuantizedKvTensor::Append(const OrtValue& present) {
+  const auto [head_count, length, head_size] = HeadsLengthHeadSize(present);
+  if (length <= length_)
+    return;
+
+  const size_t new_elements = (length - length_) * head_size;
+  const bool fp32 = present.GetTensorTypeAndShapeInfo()->GetElementType() == Ort::TypeToTensorType<float>;
+  std::vector<float> converted(fp32 ? 0 : new_elements);
+  values_.resize(length * head_count * head_size);
+  scales_.resize(length * head_count);
+  for (size_t head = 0; head < head_count; head++) {
+    // The new tokens of a head are contiguous in the present
+    const size_t offset = (head * length + length_) * head_size;
+    std::span<const float> tokens;
+    if (fp32) {
+      tokens = std::span<const float>{present.GetTensorData<float>() + offset, new_elements};
+    } else {
+      const auto* data = reinterpret_cast<const uint16_t*>(present.GetTensorRawData()) + offset;
+      ConvertFloat16ToFloat32(std::span<const uint16_t>{data, new_elements}, std::span<float>{converted.data(), converted.size()});
+      tokens = std::span<const float>{converted.data(), converted.size()};
+    }
+    for (size_t token = length_; token < length; token++) {
+      const size_t block = token * head_count + head;
+      QuantizeBlocks(tokens.subspan((token - length_) * head_size, head_size), head_size, values_.data() + block * head_size, scales_.data() + block);
+    }
+  }
+  length_ = length;
+}
+
+void QuantizedKvTensor::Dequantize(OrtValue& out) const {
+  const auto [head_count, length, head_size] = HeadsLengthHeadSize(out);
+  assert(length == length_);
+  const bool fp32 = out.GetTensorTypeAndShapeInfo()->GetElementType() == Ort::TypeToTensorType<float>;
+  std::vector<float> converted(fp32 ? 0 : length * head_size);
+  for (size_t head = 0; head < head_count; head++) {
+    std::span<float> tokens = fp32 ? std::span<float>{out.GetTensorMutableData<float>() + head * length * head_size, length * head_size}
+                                   : std::span<float>{converted.data(), converted.size()};
+    for (size_t token = 0; token < length; token++) {
+      const size_t block = token * head_count + head;
+      DequantizeBlocks(values_.data() + block * head_size, scales_.data() + block, head_size, tokens.subspan(token * head_size, head_size));
+    }
+    if (!fp32) {
+      auto* data = reinterpret_cast<uint16_t*>(out.GetTensorMutableRawData()) + head * length * head_size;
+      ConvertFloat32ToFloat16(std::span<const float>{converted.data(), converted.size()}, std::span<uint16_t>{data, converted.size()});
+    }
+  }
+}
+
+void QuantizedKvTensor::Truncate(size_t length) {
+  if (length >= length_)
+    return;
+  const size_t head_count = length_ ? scales_.size() / length_ : 0;
+  values_.resize(values_.size() / length_ * length);
+  scales_.resize(head_count * length);
+  length_ = length;
+}
+
 KV_Cache_Combined::KV_Cache_Combined(State& state)
     : state_{state},
       layer_count_{model_.config_->model.decoder.num_hidden_layers},
+      quantize_{state_.params_->search.kv_cache_int8 && state_.params_->search.num_beams == 1 && model_.device_type_ == DeviceType::CPU},
       shape_{2, state_.params_->BatchBeamSize(), model_.config_->model.decoder.num_key_value_heads, 0, model_.config_->model.decoder.head_size} {
+  if (g_log.enabled && g_log.warning && quantize_ != state_.params_->search.kv_cache_int8)
+    Log("warning", "kv_cache_int8 search option set to true, but has been disabled as it needs a greedy search on CPU");
+
   pasts_.resize(layer_count_);
   presents_.reserve(layer_count_);
 
@@ -40,6 +141,7 @@ KV_Cache_Combined::KV_Cache_Combined(State& state)
   for (int i = 0; i < layer_count_; ++i) {
     presents_.push_back(OrtValue::CreateTensor(*model_.allocator_kvcache_, shape_, type_));
   }
+  memory_.Set(GetTensorBytes(presents_));
 }
 
 void KV_Cache_Combined::Add() {
@@ -55,15 +157,19 @@ void KV_Cache_Combined::Add() {
 }
 
 void KV_Cache_Combined::Update(std::span<const int32_t> beam_indices, int current_length) {
+  PhaseTimer timer{Phase::KvCacheUpdate};
   assert(state_.params_->search.num_beams == 1 || !beam_indices.empty());  // We require beam_indices if we're a beam search
 
   for (int i = 0; i < layer_count_; i++) {
-    if (beam_indices.empty()) {
+    if (quantized_) {
+      pasts_[i] = Dequantize(i);
+    } else if (beam_indices.empty()) {
       pasts_[i] = std::move(presents_[i]);
     } else {
       PickPastState(beam_indices, i);
     }
   }
+  quantized_ = false;
 
   shape_[3] = current_length;
   for (int i = 0; i < layer_count_; i++) {
@@ -71,6 +177,282 @@ void KV_Cache_Combined::Update(std::span<const int32_t> beam_indices, int curren
     state_.inputs_[input_index_ + i] = pasts_[i].get();
     state_.outputs_[output_index_ + i] = presents_[i].get();
   }
+  UpdateMemoryUsage();
+}
+
+void KV_Cache_Combined::Quantize() {
+  if (!quantize_)
+    return;
+
+  PhaseTimer timer{Phase::KvCacheUpdate};
+  quantized_presents_.resize(layer_count_);
+  for (int i = 0; i < layer_count_; i++) {
+    quantized_presents_[i].Append(*presents_[i]);
+    UpdateMemoryUsage();  // The peak, while the layer is in the pasts, the presents and the int8 copy at once
+
+    // The run is over, so until the next Update the int8 copy is all that's needed
+    presents_[i].reset();
+    pasts_[i].reset();
+    state_.inputs_[input_index_ + i] = empty_past_.get();
+    state_.outputs_[output_index_ + i] = nullptr;
+  }
+  quantized_ = true;
+  UpdateMemoryUsage();
+}
+
+std::unique_ptr<OrtValue> KV_Cache_Combined::Dequantize(int index) const {
+  auto value = OrtValue::CreateTensor(*model_.allocator_kvcache_, shape_, type_);
+  quantized_presents_[index].Dequantize(*value);
+  return value;
+}
+
+void KV_Cache_Combined::UpdateMemoryUsage() {
+  size_t quantized_bytes = 0;
+  for (auto& quantized : quantized_presents_)
+    quantized_bytes += quantized.Bytes();
+  memory_.Set(GetTensorBytes(pasts_) + GetTensorBytes(presents_) + quantized_bytes);
+}
+
+void KV_Cache_Combined::RemoveRows(std::span<const int32_t> rows_to_keep) {
+  // The presents become the pasts on the next Update, so they are the only tensors worth compacting. The batch is the
+  // second dimension, so the keys and the values are compacted separately
+  auto shape = shape_;
+  shape[1] = static_cast<int64_t>(rows_to_keep.size());
+  const size_t row_bytes = shape_[2] * shape_[3] * shape_[4] * SizeOf(type_);
+  for (int i = 0; i < layer_count_; i++) {
+    auto present = OrtValue::CreateTensor(*model_.allocator_kvcache_, shape, type_);
+    const auto* source = reinterpret_cast<const uint8_t*>(presents_[i]->GetTensorRawData());
+    auto* target = reinterpret_cast<uint8_t*>(present->GetTensorMutableRawData());
+    for (int64_t half = 0; half < 2; half++) {
+      for (auto row : rows_to_keep) {
+        memcpy(target, source + (half * shape_[1] + row) * row_bytes, row_bytes);
+        target += row_bytes;
+      }
+    }
+    presents_[i] = std::move(present);
+    state_.outputs_[output_index_ + i] = presents_[i].get();
+  }
+  shape_ = shape;
+  UpdateMemoryUsage();
+}
+
+void KV_Cache_Combined::RewindTo(int length) {
+  // The presents become the pasts on the next Update, so only their prefix of every head has to be kept. Keys and values
+  // are laid out the same way, so they are all heads of one [2 * batch * heads, length, head_size] buffer
+  assert(length <= shape_[3]);
+  auto shape = shape_;
+  shape[3] = length;
+  const size_t head_count = shape_[0] * shape_[1] * shape_[2];
+  for (auto& quantized : quantized_presents_)
+    quantized.Truncate(length);
+  for (int i = 0; i < layer_count_ && !quantized_; i++) {
+    auto present = OrtValue::CreateTensor(*model_.allocator_kvcache_, shape, type_);
+    KeepTokenPrefix(presents_[i]->GetTensorRawData(), present->GetTensorMutableRawData(), head_count, shape_[3], length, shape_[4] * SizeOf(type_));
+    presents_[i] = std::move(present);
+    state_.outputs_[output_index_ + i] = presents_[i].get();
+  }
+  shape_ = shape;
+  UpdateMemoryUsage();
+}
+
+void KV_Cache_Combined::Save(SnapshotWriter& writer, int length, bool fp16) {
+  // The presents become the pasts on the next Update
+  assert(length == shape_[3]);
+  const bool convert = fp16 && type_ == Ort::TypeToTensorType<float>;
+  writer.Write<int32_t>(layer_count_);
+  writer.Write<int32_t>(convert ? Ort::TypeToTensorType<Ort::Float16_t> : type_);
+  writer.Write(shape_);
+
+  const size_t element_count = shape_[0] * shape_[1] * shape_[2] * shape_[3] * shape_[4];
+  std::vector<uint16_t> converted(convert ? element_count : 0);
+  for (int i = 0; i < layer_count_; i++) {
+    // An int8 cache is expanded back to the model's type one tensor at a time, the snapshot doesn't depend on the option
+    auto dequantized = quantized_ ? Dequantize(i) : nullptr;
+    const OrtValue& present = quantized_ ? *dequantized : *presents_[i];
+    if (convert) {
+      ConvertFloat32ToFloat16(std::span<const float>{present.GetTensorData<float>(), element_count}, std::span<uint16_t>{converted.data(), converted.size()});
+      writer.Write(converted.data(), element_count * sizeof(uint16_t));
+    } else {
+      writer.Write(present.GetTensorRawData(), element_count * SizeOf(type_));
+    }
+  }
+}
+
+void KV_Cache_Combined::Load(SnapshotReader& reader, int length) {
+  const auto layer_count = reader.Read<int32_t>();
+  const auto stored_type = static_cast<ONNXTensorElementDataType>(reader.Read<int32_t>());
+  const auto shape = reader.Read<std::array<int64_t, 5>>();
+  if (layer_count != layer_count_ || shape[0] != shape_[0] || shape[1] != shape_[1] || shape[2] != shape_[2] || shape[4] != shape_[4])
+    throw std::runtime_error("Generator snapshot KV cache doesn't match the model or the batch size");
+  if (shape[3] != length)
+    throw std::runtime_error("Generator snapshot KV cache length (" + std::to_string(shape[3]) + ") doesn't match its sequence length");
+  const bool convert = stored_type == Ort::TypeToTensorType<Ort::Float16_t> && type_ == Ort::TypeToTensorType<float>;
+  if (stored_type != type_ && !convert)
+    throw std::runtime_error("Generator snapshot KV cache data type doesn't match the model");
+
+  shape_ = shape;
+  quantized_presents_.clear();
+  quantized_ = false;
+  const size_t element_count = shape_[0] * shape_[1] * shape_[2] * shape_[3] * shape_[4];
+  std::vector<uint16_t> converted(convert ? element_count : 0);
+  for (int i = 0; i < layer_count_; i++) {
+    presents_[i] = OrtValue::CreateTensor(*model_.allocator_kvcache_, shape_, type_);
+    state_.outputs_[output_index_ + i] = presents_[i].get();
+    if (convert) {
+      reader.Read(converted.data(), element_count * sizeof(uint16_t));
+      ConvertFloat16ToFloat32(std::span<const uint16_t>{converted.data(), converted.size()}, std::span<float>{presents_[i]->GetTensorMutableData<float>(), element_count});
+    } else {
+      reader.Read(presents_[i]->GetTensorMutableRawData(), element_count * SizeOf(type_));
+    }
+  }
+  UpdateMemoryUsage();
+}
+
+void KV_Cache::RemoveRows(std::span<const int32_t> rows_to_keep) {
+  assert(!past_present_share_buffer_ && sb_kv_caches_.empty());
+
+  // The presents become the pasts on the next Update, so they are the only tensors worth compacting
+  for (int i = 0; i < layer_count_ * 2; i++) {
+    presents_[i] = KeepRows(*model_.allocator_kvcache_, *presents_[i], rows_to_keep);
+    state_.outputs_[output_index_ + i] = presents_[i].get();
+  }
+  shape_[0] = static_cast<int64_t>(rows_to_keep.size());
+  UpdateMemoryUsage();
+}
+
+void KV_Cache::RewindTo(int length) {
+  // Shared buffers are max_length long and the model only reads as far as the attention mask, so there is nothing to do
+  if (past_present_share_buffer_)
+    return;
+
+  // The presents become the pasts on the next Update, so only their prefix of every head has to be kept
+  assert(sb_kv_caches_.empty() && length <= shape_[2]);
+  const size_t head_count = shape_[0] * shape_[1];
+  for (auto& quantized : quantized_presents_)
+    quantized.Truncate(length);
+  if (!quantized_) {
+    auto shape = shape_;
+    shape[2] = length;
+    for (int i = 0; i < layer_count_ * 2; i++) {
+      auto present = OrtValue::CreateTensor(*model_.allocator_kvcache_, shape, type_);
+      KeepTokenPrefix(presents_[i]->GetTensorRawData(), present->GetTensorMutableRawData(), head_count, shape_[2], length, shape_[3] * SizeOf(type_));
+      presents_[i] = std::move(present);
+      state_.outputs_[output_index_ + i] = presents_[i].get();
+    }
+  }
+  shape_[2] = length;
+  UpdateMemoryUsage();
+}
+
+void KV_Cache::Quantize() {
+  if (!quantize_)
+    return;
+
+  PhaseTimer timer{Phase::KvCacheUpdate};
+  quantized_presents_.resize(layer_count_ * 2);
+  for (int i = 0; i < layer_count_ * 2; i++) {
+    quantized_presents_[i].Append(*presents_[i]);
+    UpdateMemoryUsage();  // The peak, while the layer is in the pasts, the presents and the int8 copy at once
+
+    // The run is over, so until the next Update the int8 copy is all that's needed
+    presents_[i].reset();
+    pasts_[i].reset();
+    state_.inputs_[input_index_ + i] = empty_past_.get();
+    state_.outputs_[output_index_ + i] = nullptr;
+  }
+  quantized_ = true;
+  UpdateMemoryUsage();
+}
+
+std::unique_ptr<OrtValue> KV_Cache::Dequantize(int index) const {
+  auto value = OrtValue::CreateTensor(*model_.allocator_kvcache_, shape_, type_);
+  quantized_presents_[index].Dequantize(*value);
+  return value;
+}
+
+void KV_Cache::UpdateMemoryUsage() {
+  size_t quantized_bytes = 0;
+  for (auto& quantized : quantized_presents_)
+    quantized_bytes += quantized.Bytes();
+  memory_.Set(GetTensorBytes(pasts_) + GetTensorBytes(presents_) + quantized_bytes);
+}
+
+void KV_Cache::Save(SnapshotWriter& writer, int length, bool fp16) {
+  // The presents become the pasts on the next Update. Shared buffers are max_length long, so only the first length
+  // entries of each head are written
+  assert(length <= shape_[2]);
+  const bool convert = fp16 && type_ == Ort::TypeToTensorType<float>;
+  const auto stored_type = convert ? Ort::TypeToTensorType<Ort::Float16_t> : type_;
+  writer.Write<int32_t>(layer_count_ * 2);
+  writer.Write<int32_t>(stored_type);
+  writer.Write(std::array<int64_t, 4>{shape_[0], shape_[1], length, shape_[3]});
+
+  const size_t head_count = shape_[0] * shape_[1];
+  const size_t head_elements = length * shape_[3];
+  const size_t head_stride = shape_[2] * shape_[3];
+  const size_t element_size = SizeOf(type_);
+  std::vector<uint16_t> converted(convert ? head_elements : 0);
+  for (int i = 0; i < layer_count_ * 2; i++) {
+    // An int8 cache is expanded back to the model's type one tensor at a time, the snapshot doesn't depend on the option
+    std::unique_ptr<OrtValue> dequantized;
+    if (quantized_)
+      dequantized = Dequantize(i);
+    const auto* data = reinterpret_cast<const uint8_t*>((quantized_ ? dequantized : presents_[i])->GetTensorRawData());
+    for (size_t head = 0; head < head_count; head++) {
+      const auto* head_data = data + head * head_stride * element_size;
+      if (convert) {
+        ConvertFloat32ToFloat16(std::span<const float>{reinterpret_cast<const float*>(head_data), head_elements}, std::span<uint16_t>{converted.data(), converted.size()});
+        writer.Write(converted.data(), head_elements * sizeof(uint16_t));
+      } else {
+        writer.Write(head_data, head_elements * element_size);
+      }
+    }
+  }
+}
+
+void KV_Cache::Load(SnapshotReader& reader, int length) {
+  assert(sb_kv_caches_.empty());
+  const auto tensor_count = reader.Read<int32_t>();
+  const auto stored_type = static_cast<ONNXTensorElementDataType>(reader.Read<int32_t>());
+  const auto shape = reader.Read<std::array<int64_t, 4>>();
+  if (tensor_count != layer_count_ * 2 || shape[0] != shape_[0] || shape[1] != shape_[1] || shape[3] != shape_[3])
+    throw std::runtime_error("Generator snapshot KV cache doesn't match the model or the batch size");
+  if (shape[2] != length)
+    throw std::runtime_error("Generator snapshot KV cache length (" + std::to_string(shape[2]) + ") doesn't match its sequence length");
+  const bool convert = stored_type == Ort::TypeToTensorType<Ort::Float16_t> && type_ == Ort::TypeToTensorType<float>;
+  if (stored_type != type_ && !convert)
+    throw std::runtime_error("Generator snapshot KV cache data type doesn't match the model");
+
+  // Shared buffers are filled in place, otherwise the presents are replaced by tensors of the saved length
+  quantized_presents_.clear();
+  quantized_ = false;
+  if (!past_present_share_buffer_)
+    shape_[2] = length;
+  else if (length >= shape_[2])
+    throw std::runtime_error("Generator snapshot KV cache length (" + std::to_string(length) + ") leaves no room within max_length");
+
+  const size_t head_count = shape_[0] * shape_[1];
+  const size_t head_elements = length * shape_[3];
+  const size_t head_stride = shape_[2] * shape_[3];
+  const size_t element_size = SizeOf(type_);
+  std::vector<uint16_t> converted(convert ? head_elements : 0);
+  for (int i = 0; i < layer_count_ * 2; i++) {
+    if (!past_present_share_buffer_) {
+      presents_[i] = OrtValue::CreateTensor(*model_.allocator_kvcache_, shape_, type_);
+      state_.outputs_[output_index_ + i] = presents_[i].get();
+    }
+    auto* data = reinterpret_cast<uint8_t*>(presents_[i]->GetTensorMutableRawData());
+    for (size_t head = 0; head < head_count; head++) {
+      auto* head_data = data + head * head_stride * element_size;
+      if (convert) {
+        reader.Read(converted.data(), head_elements * sizeof(uint16_t));
+        ConvertFloat16ToFloat32(std::span<const uint16_t>{converted.data(), converted.size()}, std::span<float>{reinterpret_cast<float*>(head_data), head_elements});
+      } else {
+        reader.Read(head_data, head_elements * element_size);
+      }
+    }
+  }
+  UpdateMemoryUsage();
 }
 
 // Copy present state to past state reordered by the beam_indices
@@ -131,9 +513,13 @@ KV_Cache::KV_Cache(State& state)
     : state_{state},
       layer_count_{model_.config_->model.decoder.num_hidden_layers},
       past_present_share_buffer_{state_.params_->search.past_present_share_buffer && (state_.params_->search.num_beams == 1 || model_.config_->model.type == "whisper")},
+      quantize_{state_.params_->search.kv_cache_int8 && state_.params_->search.num_beams == 1 && model_.device_type_ == DeviceType::CPU &&
+                !past_present_share_buffer_ && !state_.GetCapturedGraphInfo()},
       shape_{state_.params_->BatchBeamSize(), model_.config_->model.decoder.num_key_value_heads, 0, model_.config_->model.decoder.head_size} {
   if (g_log.enabled && g_log.warning && past_present_share_buffer_ != state_.params_->search.past_present_share_buffer)
     Log("warning", "past_present_share_buffer search option set to true, but has been disabled due to the current configuration. See https://aka.ms/generate_config for details");
+  if (g_log.enabled && g_log.warning && quantize_ != state_.params_->search.kv_cache_int8)
+    Log("warning", "kv_cache_int8 search option set to true, but has been disabled as it needs a greedy search on CPU without past_present_share_buffer or graph capture");
 
   pasts_.resize(layer_count_ * 2);
   presents_.reserve(layer_count_ * 2);
@@ -170,6 +556,8 @@ KV_Cache::KV_Cache(State& state)
         sb_kv_caches_.empty() ? OrtValue::CreateTensor(*model_.allocator_kvcache_, shape_, type_)
                               : sb_kv_caches_[i]->CreateTensorOnStaticBuffer(shape_, type_));
   }
+  if (sb_kv_caches_.empty())
+    memory_.Set(GetTensorBytes(presents_));
 }
 
 void KV_Cache::AddEncoder() {
@@ -201,24 +589,29 @@ void KV_Cache::Add() {
 }
 
 void KV_Cache::Update(std::span<const int32_t> beam_indices, int current_length) {
+  PhaseTimer timer{Phase::KvCacheUpdate};
   // If we're sharing past & present buffers there is nothing to do here, so early exit
   if (past_present_share_buffer_)
     return;
 
   for (int i = 0; i < layer_count_ * 2; i++) {
-    if (beam_indices.empty()) {
+    if (quantized_) {
+      pasts_[i] = Dequantize(i);
+    } else if (beam_indices.empty()) {
       pasts_[i] = std::move(presents_[i]);
     } else {
       PickPastState(beam_indices, i);
     }
     state_.inputs_[input_index_ + i] = pasts_[i].get();
   }
+  quantized_ = false;
 
   shape_[2] = current_length;
   for (int i = 0; i < layer_count_ * 2; i++) {
     presents_[i] = OrtValue::CreateTensor(*model_.allocator_kvcache_, shape_, type_);
     state_.outputs_[output_index_ + i] = presents_[i].get();
   }
+  UpdateMemoryUsage();
 }
 
 // Copy present state to past state reordered by the beam_indices
@@ -262,10 +655,10 @@ void KV_Cache::PickPastState(std::span<const int32_t> beam_indices, int index) {
   }
 }
 
-Cross_Cache::Cross_Cache(State& state)
+Cross_Cache::Cross_Cache(State& state, int64_t encoder_sequence_length)
     : state_{state},
       layer_count_{model_.config_->model.decoder.num_hidden_layers},
-      shape_{state_.params_->BatchBeamSize(), model_.config_->model.decoder.num_key_value_heads, 1500, model_.config_->model.decoder.head_size} {
+      shape_{state_.params_->BatchBeamSize(), model_.config_->model.decoder.num_key_value_heads, encoder_sequence_length, model_.config_->model.decoder.head_size} {
   values_.reserve(layer_count_ * 2);
 
   for (int i = 0; i < layer_count_; ++i) {
@@ -283,6 +676,7 @@ Cross_Cache::Cross_Cache(State& state)
     values_.push_back(OrtValue::CreateTensor(*model_.allocator_kvcache_, shape_, type_));
     values_.push_back(OrtValue::CreateTensor(*model_.allocator_kvcache_, shape_, type_));
   }
+  memory_.Set(GetTensorBytes(values_));
 }
 
 void Cross_Cache::AddOutputs() {
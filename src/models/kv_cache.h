@@ -4,28 +4,58 @@
 
 namespace Generators {
 
+// Int8 copy of a KV tensor for the kv_cache_int8 search option, with one scale per head and token. The tensor is seen as
+// [heads, length, head_size], the heads being all of its leading dimensions. The copy is stored token major, so the
+// tokens of a new run are appended without touching the older ones
+struct QuantizedKvTensor {
+  void Append(const OrtValue& present);  // Quantizes the tokens of present after the first length()
+  void Dequantize(OrtValue& out) const;  // out has the present's shape with a length of length()
+  void Truncate(size_t length);
+
+  size_t length() const { return length_; }
+  size_t Bytes() const { return values_.capacity() + scales_.capacity() * sizeof(float); }
+
+ private:
+  std::vector<int8_t> values_;  // [length, head_count, head_size]
+  std::vector<float> scales_;   // [length, head_count]
+  size_t length_{};
+};
+
 struct KV_Cache_Combined {
   KV_Cache_Combined(State& state);
 
   void Add();  // Add to state inputs/outputs
   void Update(std::span<const int32_t> beam_indices, int current_length);
+  void RemoveRows(std::span<const int32_t> rows_to_keep);  // See State::RemoveRows
+  void RewindTo(int length);                               // Keeps the first length entries, see State::RewindTo
+  void Save(SnapshotWriter& writer, int length, bool fp16);  // The first length entries, see State::SaveState
+  void Load(SnapshotReader& reader, int length);
+  void Quantize();  // See KV_Cache::Quantize
+  bool IsQuantized() const { return quantize_; }
 
   template <typename ScoreType>
   void PickPastState(std::span<const int32_t> beam_indices, int index);
   void PickPastState(std::span<const int32_t> beam_indices, int index);
 
  private:
+  std::unique_ptr<OrtValue> Dequantize(int index) const;  // quantized_presents_[index] as a tensor of type_
+  void UpdateMemoryUsage();
+
   State& state_;
   const Model& model_{state_.model_};
   int layer_count_;
   size_t input_index_{~0U}, output_index_{~0U};
+  bool quantize_;     // True if search.kv_cache_int8 is set, and we're using cpu greedy search
+  bool quantized_{};  // The presents are in quantized_presents_ until the next Update
 
-  std::array<int64_t, 5> shape_;
+  std::array<int64_t, 5> shape_;  // [key/value, batch, heads, length, head_size]
   ONNXTensorElementDataType type_;
 
   std::unique_ptr<OrtValue> empty_past_;
   std::vector<std::unique_ptr<OrtValue>> pasts_, presents_;
+  std::vector<QuantizedKvTensor> quantized_presents_;
   std::vector<std::string> input_name_strings_, output_name_strings_;
+  TrackedMemory memory_{MemoryCategory::KvCache};
 };
 
 struct KV_Cache {
@@ -36,29 +66,49 @@ struct KV_Cache {
   void AddEncoder();  // If model has an initial encoder step, this is used
   void Add();
   void Update(std::span<const int32_t> beam_indices, int current_length);
+  void RemoveRows(std::span<const int32_t> rows_to_keep);  // See State::RemoveRows
+  void RewindTo(int length);                               // Keeps the first length entries, see State::RewindTo
+  void Save(SnapshotWriter& writer, int length, bool fp16);  // The first length entries, see State::SaveState
+  void Load(SnapshotReader& reader, int length);
+
+  // With the kv_cache_int8 search option, called after each run to replace the fp32/fp16 presents with an int8 copy.
+  // Only the tokens of that run are quantized, the older ones are already in the copy. The next Update expands it back
+  // into the pasts, so the full precision cache only exists while the model runs.
+  // This only saves memory while the generator is idle between steps. During a step the pasts, the presents and the int8
+  // copy all exist, so the peak is that of a full precision cache plus the int8 copy, and every Update dequantizes the
+  // whole context again
+  void Quantize();
+  bool IsQuantized() const { return quantize_; }
   template <typename ScoreType>
   void PickPastState(std::span<const int32_t> beam_indices, int index);
   void PickPastState(std::span<const int32_t> beam_indices, int index);
 
  private:
+  std::unique_ptr<OrtValue> Dequantize(int index) const;  // quantized_presents_[index] as a tensor of type_
+  void UpdateMemoryUsage();
+
   State& state_;
   const Model& model_{state_.model_};
   int layer_count_;
   size_t input_index_{~0U}, output_index_{~0U};
   bool past_present_share_buffer_;  // True if model.decoder.past_present_share_buffer is set to true, and we're using cuda, and not beam search
+  bool quantize_;                   // True if search.kv_cache_int8 is set, and we're using cpu greedy search without shared buffers
+  bool quantized_{};                // The presents are in quantized_presents_ until the next Update
 
   std::array<int64_t, 4> shape_;
   ONNXTensorElementDataType type_;
 
   std::unique_ptr<OrtValue> empty_past_;
   std::vector<std::unique_ptr<OrtValue>> pasts_, presents_;
+  std::vector<QuantizedKvTensor> quantized_presents_;
   std::vector<std::string> input_name_strings_, output_name_strings_;
   std::vector<StaticBuffer*> sb_kv_caches_;
+  TrackedMemory memory_{MemoryCategory::KvCache};  // Not counting the static buffers, the model counts those
 };
 
 // Very similar to the KV_Cache, but is only created once at the encoder step, then used without modification for every decoder step
 struct Cross_Cache {
-  Cross_Cache(State& state);
+  Cross_Cache(State& state, int64_t encoder_sequence_length);
 
   void AddOutputs();
   void AddInputs();
@@ -73,5 +123,6 @@ struct Cross_Cache {
 
   std::vector<std::unique_ptr<OrtValue>> values_;
   std::vector<std::string> input_name_strings_, output_name_strings_;
+  TrackedMemory memory_{MemoryCategory::KvCache};
 };
 }  // namespace Generators
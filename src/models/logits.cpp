@@ -15,6 +15,10 @@ Logits::Logits(State& state)
       type_{model_.session_info_->GetOutputDataType(model_.config_->model.decoder.outputs.logits)} {
   output_raw_ = OrtValue::CreateTensor(*model_.allocator_device_, shape_, type_);
 
+  score_16bit_ = model_.device_type_ == DeviceType::CPU && state_.params_->device_type == DeviceType::CPU &&
+                 state_.params_->search.num_beams == 1 &&
+                 (type_ == Ort::TypeToTensorType<Ort::Float16_t> || type_ == Ort::TypeToTensorType<Ort::BFloat16_t>);
+
   if (state_.GetCapturedGraphInfo()) {
     if (type_ == Ort::TypeToTensorType<float>) {
       sb_logits32_ = state_.GetCapturedGraphInfo()->sb_logits32_.get();
@@ -31,12 +35,24 @@ Logits::Logits(State& state)
     cudaMemcpyAsync(cuda_eos_token_ids_.data(), cpu_ids.data(), cpu_ids.size() * sizeof(int32_t), ::cudaMemcpyHostToDevice, model_.cuda_stream_);
   }
 #endif
+
+  UpdateMemoryUsage();
+}
+
+void Logits::UpdateMemoryUsage() {
+  size_t bytes = output_raw_on_static_buffer_ ? 0 : GetTensorBytes(output_raw_.get());
+  bytes += GetTensorBytes(output_last_tokens_.get()) + GetTensorBytes(output_fp32_.get());
+#if USE_DML
+  bytes += GetTensorBytes(logits_of_last_token_fp32_.get()) + GetTensorBytes(value32_cpu_.get());
+#endif
+  memory_.Set(bytes);
 }
 
 #pragma warning(push)
 #pragma warning(disable : 4189)  // local variable is initialized but not referenced
 
 RoamingArray<float> Logits::Get() {
+  PhaseTimer timer{Phase::LogitsGet};
   size_t element_count = shape_[0] * shape_[1] * shape_[2];
 
   // First iteration? Then copy the logits over to a {batch_beams, 1, vocab_size} tensor
@@ -54,7 +70,7 @@ RoamingArray<float> Logits::Get() {
     output_last_tokens_ = OrtValue::CreateTensor(*model_.allocator_device_, shape_, type_);
 
 #if USE_DML
-    if (type_ == Ort::TypeToTensorType<Ort::Float16_t>) {
+    if (type_ == Ort::TypeToTensorType<Ort::Float16_t> || type_ == Ort::TypeToTensorType<Ort::BFloat16_t>) {
       logits_of_last_token_fp32_ = OrtValue::CreateTensor(*model_.allocator_device_, shape_, ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT);
     }
 #endif
@@ -66,10 +82,10 @@ RoamingArray<float> Logits::Get() {
 
     const auto* input_ids = state_.params_->input_ids.data();
     for (int batch_index = 0; batch_index < state_.params_->batch_size; batch_index++) {
-      // Find the first non pad token from the end
+      // Find the first non pad token from the end, a chunk's last token is always the one
       size_t token_index = seq_length;
       while (token_index-- > 0) {
-        if (input_ids[token_index] != model_.config_->model.pad_token_id)
+        if (chunk_ || input_ids[token_index] != model_.config_->model.pad_token_id)
           break;
       }
 
@@ -118,14 +134,24 @@ RoamingArray<float> Logits::Get() {
         vocab_index += vocab_size;
       }
 
-      input_ids += seq_length;
+      if (!chunk_)
+        input_ids += seq_length;
     }
 
+    chunk_ = false;
     element_count = shape_[0] * shape_[2];  // shape_[1] is now 1, so the element count must be updated
   }
 
-  // Convert from float16 to float32 if necessary
-  if (type_ == Ort::TypeToTensorType<Ort::Float16_t>) {
+  if (score_16bit_) {
+    auto batched_logits_16bit = cpu_span<uint16_t>{logits_of_last_token->GetTensorMutableData<uint16_t>(), element_count};
+    HandleEOSArray(batched_logits_16bit);
+    state_.logits_16bit_ = batched_logits_16bit;
+    state_.logits_16bit_type_ = type_;
+    return {};
+  }
+
+  // Convert from float16/bfloat16 to float32 if necessary
+  if (type_ == Ort::TypeToTensorType<Ort::Float16_t> || type_ == Ort::TypeToTensorType<Ort::BFloat16_t>) {
 #if USE_DML
     if (model_.device_type_ == DeviceType::DML) {
       DmlHelpers::DmlCastInputToOutput(
@@ -141,10 +167,8 @@ RoamingArray<float> Logits::Get() {
     } else
 #endif
     {
-      std::unique_ptr<OrtValue> logits_of_last_token_fp32;
-      ConvertFp16ToFp32(*model_.allocator_device_, *logits_of_last_token, logits_of_last_token_fp32, model_.device_type_, model_.cuda_stream_);
-      output_last_tokens_ = std::move(logits_of_last_token_fp32);  // use output_last_tokens_ to hold the fp32 logits
-      logits_of_last_token = output_last_tokens_.get();
+      ConvertFp16ToFp32(*model_.allocator_device_, *logits_of_last_token, output_fp32_, model_.device_type_, model_.cuda_stream_);
+      logits_of_last_token = output_fp32_.get();
     }
   }
 
@@ -156,6 +180,7 @@ RoamingArray<float> Logits::Get() {
 #endif
 
   assert(shape_[1] == 1);
+  UpdateMemoryUsage();
 
 #if USE_CUDA
   if (model_.device_type_ == DeviceType::CUDA) {
@@ -207,7 +232,28 @@ void Logits::Update() {
   StaticBuffer* sb_logits = type_ == Ort::TypeToTensorType<Ort::Float16_t> ? sb_logits16_ : sb_logits32_;
   output_raw_ = !sb_logits ? OrtValue::CreateTensor(*model_.allocator_device_, shape_, type_)
                            : sb_logits->CreateTensorOnStaticBuffer(shape_, type_);
+  output_raw_on_static_buffer_ = sb_logits != nullptr;
+  state_.outputs_[output_index_] = output_raw_.get();
+  UpdateMemoryUsage();
+}
+
+void Logits::UpdateChunk(int token_count) {
+  shape_[1] = token_count;
+  output_raw_ = OrtValue::CreateTensor(*model_.allocator_device_, shape_, type_);
+  output_raw_on_static_buffer_ = false;
+  state_.outputs_[output_index_] = output_raw_.get();
+  chunk_ = token_count > 1;
+  UpdateMemoryUsage();
+}
+
+void Logits::RemoveRows(std::span<const int32_t> rows_to_keep) {
+  // Only called between steps, so the logits have already been read and there is nothing to keep
+  assert(shape_[1] == 1);
+  shape_[0] = static_cast<int64_t>(rows_to_keep.size());
+  output_raw_ = OrtValue::CreateTensor(*model_.allocator_device_, shape_, type_);
+  output_last_tokens_ = {};
   state_.outputs_[output_index_] = output_raw_.get();
+  UpdateMemoryUsage();
 }
 
 void Logits::HandleEOSArray(cpu_span<float> batched_logits) {
@@ -230,6 +276,31 @@ void Logits::HandleEOSArray(cpu_span<float> batched_logits) {
   }
 }
 
+void Logits::HandleEOSArray(cpu_span<uint16_t> batched_logits) {
+  if (model_.config_->model.eos_token_ids.empty())
+    return;
+
+  const bool is_bf16 = type_ == Ort::TypeToTensorType<Ort::BFloat16_t>;
+  const uint16_t lowest = is_bf16 ? 0xFF7F : 0xFBFF;
+  auto to_float = [is_bf16](uint16_t v) { return is_bf16 ? BFloat16ToFloat32(v) : FastFloat16ToFloat32(v); };
+
+  const size_t vocab_size = shape_[2];
+  size_t vocab_index = 0;  // Simpler math to have this index go up by vocab_size for every logit chunk we process
+
+  for (int index = 0; index < shape_[0]; index++) {
+    auto logits = batched_logits.subspan(vocab_index, vocab_size);
+    uint16_t max = lowest;
+    for (auto id : model_.config_->model.eos_token_ids) {
+      if (to_float(logits[id]) > to_float(max))
+        max = logits[id];
+      logits[id] = lowest;  // Set all EOS token options to never happen (the first will get the max of all)
+    }
+
+    logits[model_.config_->model.eos_token_id] = max;  // Set the score of the primary EOS token to the highest of any of the EOS tokens
+    vocab_index += vocab_size;
+  }
+}
+
 void Logits::Add() {
   output_index_ = state_.outputs_.size();
 
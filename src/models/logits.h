@@ -13,9 +13,13 @@ struct Logits {
   RoamingArray<float> Get();
 
   void Update();
+  void RemoveRows(std::span<const int32_t> rows_to_keep);  // See State::RemoveRows
+  void UpdateChunk(int token_count);                        // token_count tokens per row on the next run, see State::AppendTokens
 
  private:
   void HandleEOSArray(cpu_span<float> logits);
+  void HandleEOSArray(cpu_span<uint16_t> logits);  // fp16/bf16 logits, see score_16bit_
+  void UpdateMemoryUsage();
 
   State& state_;
   const Model& model_{state_.model_};
@@ -23,17 +27,22 @@ struct Logits {
 
   std::array<int64_t, 3> shape_{};
   ONNXTensorElementDataType type_;
+  bool score_16bit_{};  // Hand fp16/bf16 logits to the CPU greedy search as is, instead of converting them to fp32
+  bool chunk_{};        // The last run was an UpdateChunk, whose tokens have no padding
 
-  // Tensor to keep the logits of the last tokens. It is used in the 2 cases below. Otherwhise, it is not used.
-  // 1. prompt: store the last tokens logits from output_raw_
-  // 2. token gen: store the converted fp32 logits if output_raw_ is fp16.
+  // Tensor to keep the logits of the last tokens from output_raw_ on the prompt. Otherwise, it is not used.
   std::unique_ptr<OrtValue> output_last_tokens_;
 
   std::unique_ptr<OrtValue> output_raw_;  // Raw logits output from model
 
+  std::unique_ptr<OrtValue> output_fp32_;  // fp16/bf16 logits converted to fp32, reused across steps to avoid a per token allocation
+
   // Used for decoding runs with cuda graphs.
   StaticBuffer* sb_logits32_{};
   StaticBuffer* sb_logits16_{};
+  bool output_raw_on_static_buffer_{};  // Counted with the static buffers instead
+
+  TrackedMemory memory_{MemoryCategory::Logits};
 
 #if USE_CUDA
   cuda_unique_ptr<int32_t> cuda_eos_token_ids_ptr_;  // eos_token_ids from params, but in cuda accessible memory
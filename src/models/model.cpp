@@ -3,6 +3,7 @@
 //
 // Modifications Copyright(C) 2024 Advanced Micro Devices, Inc. All rights reserved
 #include <algorithm>
+#include <chrono>
 #include <thread>
 
 #include "../generators.h"
@@ -14,6 +15,7 @@
 #include "kernels.h"
 #include "multi_modal_vision_model.h"
 #include "decoder_only_pipeline.h"
+#include "cpu_affinity.h"
 #if USE_DML
 #include <wil/wrl.h>
 #include "dml_provider_factory.h"
@@ -24,12 +26,81 @@ std::string CurrentModulePath();
 
 namespace Generators {
 
+namespace {
+
+GraphOptimizationLevel ParseGraphOptimizationLevel(const std::string& level) {
+  if (level == "ORT_DISABLE_ALL")
+    return ORT_DISABLE_ALL;
+  if (level == "ORT_ENABLE_BASIC")
+    return ORT_ENABLE_BASIC;
+  if (level == "ORT_ENABLE_EXTENDED")
+    return ORT_ENABLE_EXTENDED;
+  if (level == "ORT_ENABLE_ALL")
+    return ORT_ENABLE_ALL;
+  throw std::runtime_error("Unknown graph_optimization_level: " + level);
+}
+
+// 64-bit FNV-1a of the model type and shapes, genai_config.json as written and the size, start and end of the decoder
+// file. The decoder is only sampled so that loading a large model doesn't read all of its weights twice.
+uint64_t ComputeIdentity(const Config& config) {
+  uint64_t value = 0xcbf29ce484222325ULL;
+  auto add = [&](const void* data, size_t size) {
+    auto* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+      value ^= bytes[i];
+      value *= 0x100000001b3ULL;
+    }
+  };
+  auto add_string = [&](std::string_view text) {
+    add(text.data(), text.size());
+    add("\0", 1);
+  };
+  auto add_file = [&](const fs::path& path, bool sampled) {
+    auto file = path.open(std::ios::binary | std::ios::ate);
+    if (!file) {
+      add_string("<missing>");
+      return;
+    }
+    const auto size = static_cast<uint64_t>(file.tellg());
+    add(&size, sizeof(size));
+    constexpr uint64_t c_sample_size = 1 << 20;
+    std::vector<char> buffer;
+    auto add_range = [&](uint64_t offset, uint64_t count) {
+      buffer.resize(static_cast<size_t>(count));
+      file.seekg(static_cast<std::streamoff>(offset));
+      file.read(buffer.data(), buffer.size());
+      add(buffer.data(), static_cast<size_t>(file.gcount()));
+    };
+    if (!sampled || size <= 2 * c_sample_size) {
+      add_range(0, size);
+    } else {
+      add_range(0, c_sample_size);
+      add_range(size - c_sample_size, c_sample_size);
+    }
+  };
+
+  const auto& model = config.model;
+  add_string(model.type);
+  const int shapes[] = {model.vocab_size, model.context_length, model.decoder.hidden_size, model.decoder.num_attention_heads,
+                        model.decoder.num_key_value_heads, model.decoder.num_hidden_layers, model.decoder.head_size};
+  add(shapes, sizeof(shapes));
+  add_file(config.config_path / "genai_config.json", false);
+  if (!model.decoder.filename.empty()) {
+    add_string(model.decoder.filename);
+    add_file(config.config_path / model.decoder.filename, true);
+  }
+  return value;
+}
+
+}  // namespace
+
 State::State(const GeneratorParams& params, const Model& model)
     : model_{model},
       params_{params.shared_from_this()},
       run_options_{OrtRunOptions::Create()} {}
 
 void State::Run(OrtSession& session, int new_batch_size) {
+  PhaseTimer timer{Phase::StateRun};
   auto captured_graph_info = GetCapturedGraphInfo();
 
   if (first_run_) {
@@ -77,6 +148,10 @@ OrtValue* State::GetInput(const char* name) {
 OrtValue* State::GetOutput(const char* name) {
   for (size_t i = 0; i < output_names_.size(); i++) {
     if (std::strcmp(output_names_[i], name) == 0) {
+      // The kv_cache_int8 search option frees the presents after each run, only their int8 copy is kept
+      if (!outputs_[i])
+        throw std::runtime_error(std::string("Output ") + name + " has no value between steps" +
+                                 (params_->search.kv_cache_int8 ? " with the kv_cache_int8 search option" : ""));
       return outputs_[i];
     }
   }
@@ -150,6 +225,7 @@ TokenizerStream::TokenizerStream(const Tokenizer& tokenizer)
 }
 
 const std::string& TokenizerStream::Decode(int32_t token) {
+  PhaseTimer timer{Phase::TokenizerStreamDecode, tokenizer_->metrics_.get()};
   const char* string;
   CheckResult(OrtxDetokenizeCached(tokenizer_->tokenizer_, cache_, token, &string));
   chunk_ = string;
@@ -165,6 +241,7 @@ std::unique_ptr<TokenizerStream> Tokenizer::CreateStream() const {
 }
 
 std::vector<int32_t> Tokenizer::Encode(const char* text) const {
+  PhaseTimer timer{Phase::TokenizerEncode, metrics_.get()};
   OrtxPtr<OrtxTokenId2DArray> ids;
   CheckResult(OrtxTokenize(tokenizer_, &text, 1, ids.Address()));
 
@@ -175,6 +252,7 @@ std::vector<int32_t> Tokenizer::Encode(const char* text) const {
 }
 
 std::string Tokenizer::Decode(std::span<const int32_t> tokens) const {
+  PhaseTimer timer{Phase::TokenizerDecode, metrics_.get()};
   OrtxPtr<OrtxStringArray> ortx_string_array;
   CheckResult(OrtxDetokenize1D(tokenizer_, reinterpret_cast<const uint32_t*>(tokens.data()), tokens.size(), ortx_string_array.Address()));
 
@@ -248,6 +326,14 @@ void SessionInfo::Add(OrtSession& session) {
   }
 }
 
+void SessionInfo::AddInput(const std::string& name, ONNXTensorElementDataType type) {
+  inputs_.emplace(name, type);
+}
+
+void SessionInfo::AddOutput(const std::string& name, ONNXTensorElementDataType type) {
+  outputs_.emplace(name, type);
+}
+
 bool SessionInfo::HasInput(const std::string& name) const {
   return inputs_.find(name) != inputs_.end();
 }
@@ -270,7 +356,7 @@ ONNXTensorElementDataType SessionInfo::GetOutputDataType(const std::string& name
   return result->second;
 }
 
-Model::Model(std::unique_ptr<Config> config) : config_{std::move(config)} {
+Model::Model(std::unique_ptr<Config> config) : config_{std::move(config)}, identity_{ComputeIdentity(*config_)} {
   CreateSessionOptions();
 }
 
@@ -303,6 +389,48 @@ void Model::InitDeviceAllocator([[maybe_unused]] OrtSession& session) {
   captured_graph_pool_ = std::make_shared<CapturedGraphPool>(config_.get(), session_info_.get(), allocator_device_);
 }
 
+std::vector<std::unique_ptr<OrtSession>> Model::CreateSessions(OrtEnv& ort_env, const std::vector<std::pair<std::string, OrtSessionOptions*>>& models) const {
+  std::vector<std::unique_ptr<OrtSession>> sessions(models.size());
+  std::vector<std::chrono::steady_clock::duration> load_times(models.size());
+
+  auto create_session = [&](size_t i) {
+    auto start = std::chrono::steady_clock::now();
+    auto model_path = config_->config_path / fs::path(models[i].first);
+    auto cpus = session_cpus_.find(models[i].second);
+    ScopedThreadAffinity affinity{cpus != session_cpus_.end() ? cpus->second : std::vector<int>{}};
+    auto cache = optimized_model_caches_.find(models[i].second);
+    if (cache != optimized_model_caches_.end())
+      sessions[i] = cache->second->CreateSession(ort_env, model_path, *models[i].second);
+    else
+      sessions[i] = OrtSession::Create(ort_env, model_path.c_str(), models[i].second);
+    load_times[i] = std::chrono::steady_clock::now() - start;
+  };
+
+  // DirectML expects its device to be driven from a single thread, and QNN sessions share their EP contexts
+  // (ep.share_ep_contexts), so their sessions are still created one at a time
+  if (device_type_ == DeviceType::DML || share_ep_contexts_) {
+    for (size_t i = 0; i < models.size(); i++)
+      create_session(i);
+  } else
+    ParallelFor(models.size(), create_session);
+
+  for (size_t i = 0; i < models.size(); i++)
+    metrics_->RecordSessionLoad(models[i].first, std::chrono::duration_cast<std::chrono::nanoseconds>(load_times[i]));
+
+  if (g_log.enabled && g_log.model_load) {
+    for (size_t i = 0; i < models.size(); i++) {
+      auto milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(load_times[i]).count();
+      Log("model_load", models[i].first + ": " + std::to_string(milliseconds) + " ms");
+    }
+  }
+
+  return sessions;
+}
+
+std::unique_ptr<OrtSession> Model::CreateSession(OrtEnv& ort_env, const std::string& filename, OrtSessionOptions* session_options) const {
+  return std::move(CreateSessions(ort_env, {{filename, session_options}}).front());
+}
+
 void Model::CreateSessionOptionsFromConfig(const Config::SessionOptions& config_session_options,
                                            OrtSessionOptions& session_options,
                                            bool is_primary_session_options,
@@ -311,16 +439,48 @@ void Model::CreateSessionOptionsFromConfig(const Config::SessionOptions& config_
   constexpr int min_thread_nums = 1;
   constexpr int max_thread_nums = 16;
   int num_of_cores = std::max(min_thread_nums, static_cast<int>(std::thread::hardware_concurrency() / 2));
-  session_options.SetIntraOpNumThreads(std::min(num_of_cores, max_thread_nums));
+  int intra_op_thread_count = std::min(num_of_cores, max_thread_nums);
+  session_options.SetIntraOpNumThreads(intra_op_thread_count);
 
   if (config_session_options.intra_op_num_threads.has_value()) {
     session_options.SetIntraOpNumThreads(config_session_options.intra_op_num_threads.value());
+    // 0 is onnxruntime's default of one thread per physical core
+    intra_op_thread_count = config_session_options.intra_op_num_threads.value() > 0 ? config_session_options.intra_op_num_threads.value() : num_of_cores;
   }
 
   if (config_session_options.inter_op_num_threads.has_value()) {
     session_options.SetInterOpNumThreads(config_session_options.inter_op_num_threads.value());
   }
 
+  // With the env's global thread pool the thread settings below only affect which processors the session loads on
+  if (GetOrtGlobals()->global_thread_pool_) {
+    session_options.DisablePerSessionThreads();
+    intra_op_thread_count = static_cast<int>(GetOrtGlobals()->thread_pool_->WorkerCount()) + 1;  // Sized like the global pool
+  }
+
+  std::vector<int> cpus;
+  if (config_session_options.cpu_cores.has_value())
+    cpus = ParseCpuList(*config_session_options.cpu_cores);
+  else if (config_session_options.numa_node.has_value())
+    cpus = GetNumaNodeCpus(*config_session_options.numa_node);
+  else if (config_session_options.replica_count.has_value())
+    cpus = GetReplicaCpus(*config_session_options.replica_count, config_session_options.replica_index);
+
+  // The global pool's threads aren't the session's to place, only the thread loading the session is pinned then
+  if (!cpus.empty() && !GetOrtGlobals()->global_thread_pool_) {
+    int thread_count = config_session_options.intra_op_num_threads.value_or(0);
+    if (thread_count <= 0)
+      thread_count = static_cast<int>(cpus.size());
+    session_options.SetIntraOpNumThreads(thread_count);
+    intra_op_thread_count = thread_count;
+    if (thread_count > 1)
+      session_options.AddConfigEntry("session.intra_op_thread_affinities", FormatIntraOpThreadAffinities(cpus, thread_count).c_str());
+  }
+  if (!cpus.empty())
+    session_cpus_[&session_options] = std::move(cpus);
+  if (is_primary_session_options)
+    intra_op_thread_count_ = intra_op_thread_count;
+
   if (config_session_options.enable_cpu_mem_arena.has_value()) {
     if (config_session_options.enable_cpu_mem_arena.value())
       session_options.EnableCpuMemArena();
@@ -387,6 +547,23 @@ void Model::CreateSessionOptionsFromConfig(const Config::SessionOptions& config_
     session_options.AddConfigEntry("session.use_env_allocators", "1");
   }
 
+  GraphOptimizationLevel graph_optimization_level{ORT_ENABLE_ALL};
+  if (config_session_options.graph_optimization_level.has_value()) {
+    graph_optimization_level = ParseGraphOptimizationLevel(*config_session_options.graph_optimization_level);
+    session_options.SetGraphOptimizationLevel(graph_optimization_level);
+  }
+
+  if (config_session_options.optimized_model_cache_dir.has_value()) {
+    // Other execution providers can compile nodes into forms that can't be saved, so only CPU sessions are cached
+    if (!config_session_options.provider_options.empty()) {
+      if (g_log.enabled && g_log.warning)
+        Log("warning", "optimized_model_cache_dir only applies to sessions that run on the CPU, ignoring it");
+    } else {
+      optimized_model_caches_[&session_options] = std::make_unique<OptimizedModelCache>(
+          config_->config_path / fs::path(*config_session_options.optimized_model_cache_dir), SessionOptionsKey(config_session_options), graph_optimization_level);
+    }
+  }
+
   for (auto& provider_options : config_session_options.provider_options) {
     if (provider_options.name == "cuda") {
       auto ort_provider_options = OrtCUDAProviderOptionsV2::Create();
@@ -466,6 +643,7 @@ void Model::CreateSessionOptionsFromConfig(const Config::SessionOptions& config_
 #endif
     } else if (provider_options.name == "qnn") {
       session_options.AddConfigEntry("ep.share_ep_contexts", "1");
+      share_ep_contexts_ = true;
       std::unordered_map<std::string, std::string> opts;
       for (auto& option : provider_options.options) {
         opts.emplace(option.first, option.second);
@@ -506,11 +684,23 @@ OrtSessionOptions* Model::GetSessionOptions(const std::string& model_id) const {
 }
 
 std::shared_ptr<Tokenizer> Model::CreateTokenizer() const {
-  return std::make_shared<Tokenizer>(*config_);
+  auto tokenizer = std::make_shared<Tokenizer>(*config_);
+  tokenizer->metrics_ = metrics_;
+  return tokenizer;
+}
+
+std::string Model::Name() const {
+  std::string path = config_->config_path.string();
+  while (!path.empty() && (path.back() == '/' || path.back() == '\\'))
+    path.pop_back();
+  auto separator = path.find_last_of("/\\");
+  return separator == std::string::npos ? path : path.substr(separator + 1);
 }
 
 std::shared_ptr<MultiModalProcessor> Model::CreateMultiModalProcessor() const {
-  return std::make_shared<MultiModalProcessor>(*config_, *session_info_);
+  auto processor = std::make_shared<MultiModalProcessor>(*config_, *session_info_);
+  processor->tokenizer_->metrics_ = metrics_;
+  return processor;
 }
 
 std::shared_ptr<Model> CreateModel(OrtEnv& ort_env, const char* config_path, const RuntimeSettings* settings /*= nullptr*/) {
@@ -546,7 +736,8 @@ std::shared_ptr<GeneratorParams> CreateGeneratorParams(const Config& config) {
 void ConvertFp16ToFp32(OrtAllocator& allocator, OrtValue& in, std::unique_ptr<OrtValue>& p_out, DeviceType device_type, cudaStream_t stream) {
   auto shape_info = in.GetTensorTypeAndShapeInfo();
   auto shape = shape_info->GetShape();
-  assert(shape_info->GetElementType() == Ort::TypeToTensorType<Ort::Float16_t>);
+  const auto type = shape_info->GetElementType();
+  assert(type == Ort::TypeToTensorType<Ort::Float16_t> || type == Ort::TypeToTensorType<Ort::BFloat16_t>);
 
   bool allocate_p_out = p_out == nullptr;
   if (p_out) {
@@ -567,12 +758,16 @@ void ConvertFp16ToFp32(OrtAllocator& allocator, OrtValue& in, std::unique_ptr<Or
     case DeviceType::DML:
       // DML, WebGpu doesn't currently support on-device scoring, so we fall back to the CPU
     case DeviceType::CPU:
-      for (int i = 0; i < count; i++)
-        fp32[i] = FastFloat16ToFloat32(fp16[i]);
+      if (type == Ort::TypeToTensorType<Ort::BFloat16_t>)
+        ConvertBFloat16ToFloat32(std::span<const uint16_t>(fp16, count), std::span<float>(fp32, count));
+      else
+        ConvertFloat16ToFloat32(std::span<const uint16_t>(fp16, count), std::span<float>(fp32, count));
       break;
 
 #if USE_CUDA
     case DeviceType::CUDA:
+      if (type == Ort::TypeToTensorType<Ort::BFloat16_t>)
+        throw std::runtime_error("ConvertFp16ToFp32 - bfloat16 is not supported on CUDA");
       cuda::LaunchFp16ToFp32(fp16, fp32, count, stream);
       break;
 #endif
@@ -596,7 +791,7 @@ void ConvertFp32ToFp16(OrtAllocator& allocator, OrtValue& in, std::unique_ptr<Or
   }
 
   if (allocate_p_out)
-    p_out = OrtValue::CreateTensor<float>(allocator, shape);
+    p_out = OrtValue::CreateTensor<Ort::Float16_t>(allocator, shape);
 
   int count = static_cast<int>(shape_info->GetElementCount());
   auto* fp32 = in.GetTensorData<float>();
@@ -605,13 +800,13 @@ void ConvertFp32ToFp16(OrtAllocator& allocator, OrtValue& in, std::unique_ptr<Or
   switch (device_type) {
     case DeviceType::DML:
     case DeviceType::CPU:
-      for (int i = 0; i < count; i++)
-        fp16[i] = FastFloat32ToFloat16(fp32[i]);
+      ConvertFloat32ToFloat16(std::span<const float>(fp32, count), std::span<uint16_t>(fp16, count));
       break;
 
 #if USE_CUDA
     case DeviceType::CUDA:
       cuda::LaunchFp32ToFp16(fp32, fp16, count, stream);
+      break;
 #endif
 
     default:
@@ -619,6 +814,35 @@ void ConvertFp32ToFp16(OrtAllocator& allocator, OrtValue& in, std::unique_ptr<Or
   }
 }
 
+std::unique_ptr<OrtValue> KeepRows(OrtAllocator& allocator, OrtValue& in, std::span<const int32_t> rows) {
+  auto type_info = in.GetTensorTypeAndShapeInfo();
+  auto element_type = type_info->GetElementType();
+  auto shape = type_info->GetShape();
+  const size_t row_bytes = shape[0] ? type_info->GetElementCount() * SizeOf(element_type) / shape[0] : 0;
+
+  shape[0] = static_cast<int64_t>(rows.size());
+  auto out = OrtValue::CreateTensor(allocator, shape, element_type);
+  const auto* source = reinterpret_cast<const uint8_t*>(in.GetTensorRawData());
+  auto* target = reinterpret_cast<uint8_t*>(out->GetTensorMutableRawData());
+  for (auto row : rows) {
+    memcpy(target, source + row * row_bytes, row_bytes);
+    target += row_bytes;
+  }
+  return out;
+}
+
+std::vector<int32_t> InterleaveAppendedTokens(std::span<const int32_t> next_tokens, std::span<const int32_t> appended_tokens) {
+  // The pending next token of each row hasn't been through the model yet, so it goes first
+  const size_t appended_count = appended_tokens.size() / next_tokens.size();
+  std::vector<int32_t> tokens;
+  tokens.reserve(next_tokens.size() + appended_tokens.size());
+  for (size_t i = 0; i < next_tokens.size(); i++) {
+    tokens.push_back(next_tokens[i]);
+    tokens.insert(tokens.end(), appended_tokens.begin() + i * appended_count, appended_tokens.begin() + (i + 1) * appended_count);
+  }
+  return tokens;
+}
+
 std::unique_ptr<OrtValue> Model::ExpandInputs(std::unique_ptr<OrtValue>& input, int num_beams) const {
   // Input shape (batch_size, sequence_length). The input is required with data type T.
   // Output shape (batch_size * num_beams, sequence_length)
@@ -6,7 +6,9 @@
 #include "utils.h"
 #include "prompt_image_processor.h"
 #include "audio_processor.h"
+#include "audio_stream.h"
 #include "adapters.h"
+#include "optimized_model_cache.h"
 
 #if USE_DML
 #include "dml_provider_factory.h"
@@ -24,6 +26,12 @@ void ConvertFp16ToFp32(OrtAllocator& allocator, OrtValue& in, std::unique_ptr<Or
 
 void ConvertFp32ToFp16(OrtAllocator& allocator, OrtValue& in, std::unique_ptr<OrtValue>& p_out, DeviceType device_type, cudaStream_t stream);
 
+// Returns a copy of a CPU tensor holding only the given rows (indices into its first dimension, in the order given)
+std::unique_ptr<OrtValue> KeepRows(OrtAllocator& allocator, OrtValue& in, std::span<const int32_t> rows);
+
+// The tokens of a chunk run after AppendTokens: each row's pending next token followed by its appended tokens
+std::vector<int32_t> InterleaveAppendedTokens(std::span<const int32_t> next_tokens, std::span<const int32_t> appended_tokens);
+
 void CheckResult(extError_t error);
 
 struct State {
@@ -34,6 +42,24 @@ struct State {
   virtual const CapturedGraphInfo* GetCapturedGraphInfo() const { return nullptr; }
   virtual void Finalize() {}
 
+  // Lets a search drop finished rows from the batch so they no longer run through the model. rows_to_keep are indices
+  // into the current batch. Only called between steps, and only when CanRemoveRows() returns true
+  virtual bool CanRemoveRows() const { return false; }
+  virtual void RemoveRows(std::span<const int32_t> /*rows_to_keep*/) { throw std::runtime_error("RemoveRows is not supported by this model"); }
+
+  // Queues tokens ([batch_beam_size, token_count]) to run through the model on the next Run, in one prefill together with
+  // the pending next tokens. See Generator::AppendTokens
+  virtual void AppendTokens(std::span<const int32_t> /*tokens*/) { throw std::runtime_error("AppendTokens is not supported by this model"); }
+
+  // Forgets the processed tokens past new_length - 1, the token at new_length - 1 is passed to the next Run again.
+  // current_length is the sequence length before rewinding. See Generator::RewindTo
+  virtual void RewindTo(int /*current_length*/, int /*new_length*/) { throw std::runtime_error("RewindTo is not supported by this model"); }
+
+  // The model inputs that carry over between steps (KV cache, positions, ...), see Generator::SaveState. LoadState is
+  // called instead of the first Run, and continues from the pending token at current_length - 1
+  virtual void SaveState(SnapshotWriter& /*writer*/, int /*current_length*/, bool /*kv_fp16*/) { throw std::runtime_error("SaveState is not supported by this model"); }
+  virtual void LoadState(SnapshotReader& /*reader*/, int /*current_length*/) { throw std::runtime_error("LoadState is not supported by this model"); }
+
   OrtValue* GetInput(const char* name);
 
   virtual OrtValue* GetOutput(const char* name);
@@ -50,6 +76,10 @@ struct State {
   std::vector<std::string> adapter_names_;
   std::vector<OrtValue*> inputs_, outputs_;
 
+  // Set by Logits::Get (which then returns no fp32 logits) when a CPU greedy search scores the fp16/bf16 logits directly
+  cpu_span<uint16_t> logits_16bit_;
+  ONNXTensorElementDataType logits_16bit_type_{};
+
  protected:
   void Run(OrtSession& session, int new_batch_size);  // Uses the inputs below to run
   bool first_run_{true};
@@ -90,6 +120,7 @@ struct Tokenizer : std::enable_shared_from_this<Tokenizer>, LeakChecked<Tokenize
   int32_t TokenToTokenId(const char* token) const;
 
   OrtxPtr<OrtxTokenizer> tokenizer_;
+  std::shared_ptr<Metrics> metrics_;  // The metrics of the model the tokenizer was created from
   std::shared_ptr<Tokenizer> external_owner_;  // Set to 'this' when created by the C API to preserve lifetime
 
  private:
@@ -111,6 +142,10 @@ struct SessionInfo {
 
   void Add(OrtSession& session);
 
+  // Records the type of an input/output of a session that will only be created later
+  void AddInput(const std::string& name, ONNXTensorElementDataType type);
+  void AddOutput(const std::string& name, ONNXTensorElementDataType type);
+
   bool HasInput(const std::string& name) const;
   bool HasOutput(const std::string& name) const;
 
@@ -127,6 +162,13 @@ struct Model : std::enable_shared_from_this<Model>, LeakChecked<Model> {
 
   std::shared_ptr<Tokenizer> CreateTokenizer() const;
 
+  std::string Name() const;  // Name of the config directory, labels the metrics of the model
+
+  // Hash of the model type and shapes, genai_config.json and a sample of the decoder file. Generator snapshots carry it,
+  // so one can't be loaded into another model even when the shapes match. Models that differ only in decoder weights
+  // outside the sampled start and end of the file get the same identity.
+  uint64_t Identity() const { return identity_; }
+
   std::shared_ptr<MultiModalProcessor> CreateMultiModalProcessor() const;
 
   virtual std::unique_ptr<State> CreateState(RoamingArray<int32_t> sequence_lengths, const GeneratorParams& params) const = 0;
@@ -138,6 +180,7 @@ struct Model : std::enable_shared_from_this<Model>, LeakChecked<Model> {
   OrtSessionOptions* GetSessionOptions(const std::string& model_id) const;
 
   std::unique_ptr<Config> config_;
+  uint64_t identity_;
   std::unique_ptr<OrtSessionOptions> session_options_;
 
   cuda_stream_holder cuda_stream_;
@@ -148,8 +191,13 @@ struct Model : std::enable_shared_from_this<Model>, LeakChecked<Model> {
 
   std::unique_ptr<SessionInfo> session_info_;
 
+  std::shared_ptr<Metrics> metrics_{std::make_shared<Metrics>()};  // Latency totals of all generators and tokenizers of this model
+  std::shared_ptr<MemoryUsage> memory_usage_{std::make_shared<MemoryUsage>()};  // Buffers of all generators of this model and its static buffers
+
   std::shared_ptr<Model> external_owner_;  // Set to 'this' when created by the C API to preserve lifetime
 
+  int intra_op_thread_count_{1};  // Threads a run of the decoder session uses, to size how many generators run at once
+
 #if USE_DML
   DmlExecutionContext* GetDmlExecutionContext() const { return dml_execution_context_.get(); }
   DmlReadbackHeap* GetDmlReadbackHeap() const { return dml_readback_heap_.get(); }
@@ -163,11 +211,18 @@ struct Model : std::enable_shared_from_this<Model>, LeakChecked<Model> {
   void InitDeviceAllocator(OrtSession& session);
   void CreateSessionOptions();
 
+  // Creates one session per (filename relative to the config path, session options) pair concurrently, since graph
+  // optimization and weight prepacking dominate model load time. Sessions are returned in the same order.
+  std::vector<std::unique_ptr<OrtSession>> CreateSessions(OrtEnv& ort_env, const std::vector<std::pair<std::string, OrtSessionOptions*>>& models) const;
+  std::unique_ptr<OrtSession> CreateSession(OrtEnv& ort_env, const std::string& filename, OrtSessionOptions* session_options) const;
+
   void CreateSessionOptionsFromConfig(const Config::SessionOptions& config_session_options,
                                       OrtSessionOptions& session_options,
                                       bool is_primary_session_options,
                                       bool disable_graph_capture);
 
+  bool share_ep_contexts_{};  // Sessions share their execution provider contexts, so CreateSessions can't run them concurrently
+
 #if USE_DML
   mutable DmlObjects dml_objects_;
   const OrtDmlApi* p_dml_api_{};
@@ -186,6 +241,8 @@ struct Model : std::enable_shared_from_this<Model>, LeakChecked<Model> {
 #endif
   std::shared_ptr<CapturedGraphPool> captured_graph_pool_;
   std::map<std::string, std::unique_ptr<OrtSessionOptions>> pipeline_session_options_;
+  std::unordered_map<const OrtSessionOptions*, std::unique_ptr<OptimizedModelCache>> optimized_model_caches_;  // Session options that opted into the cache
+  std::unordered_map<const OrtSessionOptions*, std::vector<int>> session_cpus_;                                // Processors the session options are pinned to
 };
 
 }  // namespace Generators
@@ -55,24 +55,87 @@ int64_t GetNumImageTokens(const std::vector<GeneratorParams::Input>& extra_input
 }  // namespace
 
 MultiModalVisionModel::MultiModalVisionModel(std::unique_ptr<Config> config, OrtEnv& ort_env)
-    : Model{std::move(config)} {
+    : Model{std::move(config)}, ort_env_{ort_env} {
   // The embedding and vision models don't support graph capture because of control flow nodes, so disable graph capture for them
-  auto vision_session_options = OrtSessionOptions::Create();
-  CreateSessionOptionsFromConfig(config_->model.decoder.session_options, *vision_session_options, true, true);
+  vision_session_options_ = OrtSessionOptions::Create();
+  CreateSessionOptionsFromConfig(config_->model.decoder.session_options, *vision_session_options_, true, true);
 
   auto embedding_session_options = OrtSessionOptions::Create();
   CreateSessionOptionsFromConfig(config_->model.decoder.session_options, *embedding_session_options, true, true);
 
-  embedding_session_ = OrtSession::Create(
-      ort_env, (config_->config_path / fs::path(config_->model.embedding.filename)).c_str(), embedding_session_options.get());
-  vision_session_ = OrtSession::Create(
-      ort_env, (config_->config_path / fs::path(config_->model.vision.filename)).c_str(), vision_session_options.get());
-  decoder_session_ = OrtSession::Create(
-      ort_env, (config_->config_path / fs::path(config_->model.decoder.filename)).c_str(), session_options_.get());
+  std::vector<std::pair<std::string, OrtSessionOptions*>> models{
+      {config_->model.embedding.filename, embedding_session_options.get()},
+      {config_->model.decoder.filename, session_options_.get()},
+  };
+  if (!config_->model.vision.lazy_load)
+    models.emplace_back(config_->model.vision.filename, vision_session_options_.get());
+
+  auto sessions = CreateSessions(ort_env, models);
+  embedding_session_ = std::move(sessions[0]);
+  decoder_session_ = std::move(sessions[1]);
 
   InitDeviceAllocator(*decoder_session_);
   session_info_->Add(*embedding_session_);
-  session_info_->Add(*vision_session_);
+
+  if (!config_->model.vision.lazy_load) {
+    vision_session_ = std::move(sessions[2]);
+    session_info_->Add(*vision_session_);
+    vision_loaded_ = true;
+  } else {
+    // Until the vision session exists, assume its pixel_values and image_features match the type the embedding model
+    // takes the image features in. CreateVisionSession checks this once the session is created.
+    auto type = session_info_->GetInputDataType(config_->model.embedding.inputs.image_features);
+    session_info_->AddInput(config_->model.vision.inputs.pixel_values, type);
+    session_info_->AddOutput(config_->model.vision.outputs.image_features, type);
+  }
+}
+
+std::shared_ptr<OrtSession> MultiModalVisionModel::CreateVisionSession() const {
+  std::shared_ptr<OrtSession> session = CreateSession(ort_env_, config_->model.vision.filename, vision_session_options_.get());
+
+  SessionInfo vision_info{*session};
+  const auto& pixel_values = config_->model.vision.inputs.pixel_values;
+  const auto& image_features = config_->model.vision.outputs.image_features;
+  if (vision_info.GetInputDataType(pixel_values) != session_info_->GetInputDataType(pixel_values) ||
+      vision_info.GetOutputDataType(image_features) != session_info_->GetOutputDataType(image_features))
+    throw std::runtime_error("The vision model's " + pixel_values + " and " + image_features + " types must match the embedding model's " +
+                             config_->model.embedding.inputs.image_features + " type to use lazy_load");
+  return session;
+}
+
+std::shared_ptr<OrtSession> MultiModalVisionModel::GetVisionSession() const {
+  const auto& vision = config_->model.vision;
+  const bool can_unload = vision.lazy_load && vision.idle_unload_seconds > 0;
+  // Without unloading, a published session never changes again and can be shared without the lock
+  if (!can_unload && vision_loaded_.load(std::memory_order_acquire))
+    return vision_session_;
+
+  std::lock_guard<std::mutex> lock{vision_mutex_};
+  if (!vision_session_) {
+    vision_session_ = CreateVisionSession();
+    vision_loaded_.store(true, std::memory_order_release);
+  }
+  vision_last_used_ = std::chrono::steady_clock::now().time_since_epoch().count();
+  return vision_session_;
+}
+
+void MultiModalVisionModel::UnloadIdleVisionSession() const {
+  const auto& vision = config_->model.vision;
+  if (!vision.lazy_load || vision.idle_unload_seconds <= 0 || !vision_loaded_)
+    return;
+
+  const auto idle_ticks = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::seconds(vision.idle_unload_seconds)).count();
+  if (std::chrono::steady_clock::now().time_since_epoch().count() - vision_last_used_ < idle_ticks)
+    return;
+
+  std::lock_guard<std::mutex> lock{vision_mutex_};
+  if (vision_session_ && vision_session_.use_count() == 1 &&
+      std::chrono::steady_clock::now().time_since_epoch().count() - vision_last_used_ >= idle_ticks) {
+    vision_loaded_ = false;
+    vision_session_.reset();
+    if (g_log.enabled && g_log.model_load)
+      Log("model_load", "Unloaded idle " + vision.filename);
+  }
 }
 
 std::unique_ptr<State> MultiModalVisionModel::CreateState(RoamingArray<int32_t> sequence_lengths, const GeneratorParams& params) const {
@@ -110,7 +173,8 @@ VisionState::VisionState(const MultiModalVisionModel& model, const GeneratorPara
 
 RoamingArray<float> VisionState::Run(int current_length, RoamingArray<int32_t> next_tokens, RoamingArray<int32_t> next_indices) {
   const int num_images = static_cast<int>(inputs_[0]->GetTensorTypeAndShapeInfo()->GetShape()[0]);
-  State::Run(*model_.vision_session_, num_images);
+  auto vision_session = model_.GetVisionSession();
+  State::Run(*vision_session, num_images);
 
   return MakeDummy();
 }
@@ -146,6 +210,8 @@ MultiModalPipelineState::MultiModalPipelineState(const MultiModalVisionModel& mo
       model_{model},
       num_image_tokens_{GetNumImageTokens(params_->extra_inputs, model_.config_->model.vision.inputs.pixel_values, model_.config_->model.vision.inputs.image_sizes)},
       captured_graph_info_{model.GetCapturedGraphPool()->ReserveCapturedGraph(model, params)} {
+  model_.UnloadIdleVisionSession();
+
   embedding_state_ = std::make_unique<EmbeddingState>(model, params, num_image_tokens_);
   vision_state_ = std::make_unique<VisionState>(model_, params, num_image_tokens_);
   decoder_state_ = std::make_unique<DecoderState>(model_, sequence_lengths_unk, params, captured_graph_info_.get());
@@ -170,6 +236,8 @@ RoamingArray<float> MultiModalPipelineState::Run(int current_length, RoamingArra
     embedding_state_->Run(current_length, next_tokens, next_indices);
 
     auto logits = decoder_state_->Run(current_length, next_tokens, next_indices);
+    logits_16bit_ = decoder_state_->logits_16bit_;
+    logits_16bit_type_ = decoder_state_->logits_16bit_type_;
 
     is_prompt_ = false;
     vision_state_.reset();  // The vision state is no longer needed in generation stage
@@ -177,13 +245,18 @@ RoamingArray<float> MultiModalPipelineState::Run(int current_length, RoamingArra
     return logits;
   }
 
+  model_.UnloadIdleVisionSession();  // Long running generators would otherwise keep an idle session loaded
+
   embedding_state_->UpdateInputsAndOutputs(next_tokens);
   decoder_state_->UpdateInputsAndOutputs(current_length, next_indices);
 
   embedding_state_->inputs_embeds_.ReuseEmbeddingsBuffer(decoder_state_->inputs_embeds_);
   embedding_state_->Run(current_length, next_tokens, next_indices);
 
-  return decoder_state_->Run(current_length, next_tokens, next_indices);
+  auto logits = decoder_state_->Run(current_length, next_tokens, next_indices);
+  logits_16bit_ = decoder_state_->logits_16bit_;
+  logits_16bit_type_ = decoder_state_->logits_16bit_type_;
+  return logits;
 }
 
 }  // namespace Generators
@@ -2,6 +2,9 @@
 // Licensed under the MIT License.
 
 #pragma once
+#include <atomic>
+#include <chrono>
+#include <mutex>
 #include "model.h"
 #include "input_ids.h"
 #include "image_features.h"
@@ -21,9 +24,28 @@ struct MultiModalVisionModel : Model {
   std::unique_ptr<State> CreateState(RoamingArray<int32_t> sequence_lengths,
                                      const GeneratorParams& params) const override;
 
-  std::unique_ptr<OrtSession> vision_session_;     // pixel_values, image_sizes -> image_features
+  // Returns the vision session, creating it first if it was deferred by lazy_load or released for being idle
+  std::shared_ptr<OrtSession> GetVisionSession() const;
+
+  // Releases a lazily loaded vision session that nobody is using and that has been idle for idle_unload_seconds. Called
+  // from every generator step, so it only takes the lock once the session is loaded and has been idle long enough
+  void UnloadIdleVisionSession() const;
+
+  bool IsVisionSessionLoaded() const { return vision_loaded_; }
+
   std::unique_ptr<OrtSession> embedding_session_;  // input_ids, image_features -> inputs_embeds
   std::unique_ptr<OrtSession> decoder_session_;    // inputs_embeds, attention_mask, kv_cache -> logits
+
+ private:
+  std::shared_ptr<OrtSession> CreateVisionSession() const;
+
+  OrtEnv& ort_env_;
+  std::unique_ptr<OrtSessionOptions> vision_session_options_;
+
+  mutable std::mutex vision_mutex_;                     // Guards changes to vision_session_
+  mutable std::shared_ptr<OrtSession> vision_session_;  // pixel_values, image_sizes -> image_features
+  mutable std::atomic<bool> vision_loaded_{};           // Set once vision_session_ is published, cleared before it is released
+  mutable std::atomic<std::chrono::steady_clock::rep> vision_last_used_{};  // steady_clock ticks
 };
 
 struct EmbeddingState : State {
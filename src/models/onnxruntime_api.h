@@ -119,6 +119,7 @@ using OrtApiBaseFn = const OrtApiBase* (*)(void);
 
 /// Before using this C++ wrapper API, you MUST call Ort::InitApi to set the below 'api' variable
 inline const OrtApi* api{};
+inline const char* version_string{};  // Version of the onnxruntime library that 'api' came from
 
 #if defined(__linux__) || defined(MACOS_USE_DLOPEN)
 inline std::string GetCurrentModuleDir() {
@@ -178,6 +179,7 @@ inline void InitApiWithDynamicFn(OrtApiBaseFn ort_api_base_fn) {
     api = ort_api_base->GetApi(i);
     if (api) {
       LOG_INFO("ORT API Version %d was found.", i);
+      version_string = ort_api_base->GetVersionString();
       break;
     }
   }
@@ -265,6 +267,7 @@ inline void InitApi() {
   api = OrtGetApiBase()->GetApi(ORT_API_VERSION);
   if (!api)
     throw std::runtime_error("Onnxruntime is installed but is too old, please install a newer version");
+  version_string = OrtGetApiBase()->GetVersionString();
 #endif  // defined(__linux__) || defined(MACOS_USE_DLOPEN)
 }
 
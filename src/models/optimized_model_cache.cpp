@@ -0,0 +1,405 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#include <iomanip>
+#include <random>
+#include <sstream>
+
+#include "../generators.h"
+#include "optimized_model_cache.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <errno.h>
+#include <unistd.h>
+#endif
+
+namespace Generators {
+
+namespace {
+
+// 64-bit FNV-1a, only used to name cache entries
+struct Hasher {
+  void Add(const void* data, size_t size) {
+    auto* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+      value_ ^= bytes[i];
+      value_ *= 0x100000001b3ULL;
+    }
+  }
+
+  void Add(std::string_view text) {
+    Add(text.data(), text.size());
+    Add("\0", 1);  // Keep "ab" + "c" and "a" + "bc" apart
+  }
+
+  std::string Hex() const {
+    std::ostringstream stream;
+    stream << std::hex << std::setw(16) << std::setfill('0') << value_;
+    return stream.str();
+  }
+
+ private:
+  uint64_t value_{0xcbf29ce484222325ULL};
+};
+
+std::string FileName(const fs::path& path) {
+  const auto& string = path.string();
+  return string.substr(string.find_last_of("/\\") + 1);
+}
+
+fs::path Sibling(const fs::path& path, const std::string& name) {
+  const auto& string = path.string();
+  auto separator = string.find_last_of("/\\");
+  return separator == std::string::npos ? fs::path{name} : fs::path{string.substr(0, separator + 1) + name};
+}
+
+// Size and modification time of a file, the cheap stand-in for its contents. Empty if the file is missing.
+std::string FileStamp(const fs::path& path) {
+#ifdef _WIN32
+  WIN32_FILE_ATTRIBUTE_DATA data;
+  if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &data))
+    return {};
+  const uint64_t size = (static_cast<uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+  const uint64_t time = (static_cast<uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+#else
+  struct stat info;
+  if (stat(path.c_str(), &info) != 0)
+    return {};
+  const uint64_t size = static_cast<uint64_t>(info.st_size);
+#if defined(__APPLE__)
+  const uint64_t time = static_cast<uint64_t>(info.st_mtimespec.tv_sec) * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+  const uint64_t time = static_cast<uint64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+#endif
+  return std::to_string(size) + " " + std::to_string(time);
+}
+
+std::vector<std::string> ListDirectory(const fs::path& directory) {
+  std::vector<std::string> names;
+#ifdef _WIN32
+  WIN32_FIND_DATAW data;
+  HANDLE find = FindFirstFileW((directory / "*").c_str(), &data);
+  if (find == INVALID_HANDLE_VALUE)
+    return names;
+  do {
+    int size = WideCharToMultiByte(CP_UTF8, 0, data.cFileName, -1, nullptr, 0, nullptr, nullptr);
+    std::string name(size > 0 ? size - 1 : 0, '\0');
+    WideCharToMultiByte(CP_UTF8, 0, data.cFileName, -1, name.data(), size, nullptr, nullptr);
+    names.push_back(std::move(name));
+  } while (FindNextFileW(find, &data));
+  FindClose(find);
+#else
+  if (DIR* dir = opendir(directory.c_str())) {
+    while (dirent* entry = readdir(dir))
+      names.emplace_back(entry->d_name);
+    closedir(dir);
+  }
+#endif
+  return names;
+}
+
+// Moves 'from' to 'to' unless 'to' already exists, so an entry another process already published is never replaced
+bool RenameNoReplace(const fs::path& from, const fs::path& to) {
+#ifdef _WIN32
+  return MoveFileExW(from.c_str(), to.c_str(), 0) != 0;
+#else
+  if (link(from.c_str(), to.c_str()) == 0) {
+    from.remove();
+    return true;
+  }
+  if (errno == EEXIST)
+    return false;
+  return !to.exists() && from.rename(to);  // The file system doesn't support hard links
+#endif
+}
+
+bool StartsWith(std::string_view text, std::string_view prefix) {
+  return text.substr(0, prefix.size()) == prefix;
+}
+
+bool EndsWith(std::string_view text, std::string_view suffix) {
+  return text.size() >= suffix.size() && text.substr(text.size() - suffix.size()) == suffix;
+}
+
+// Graphs optimized with ORT_ENABLE_ALL contain layout transformations for the CPU they were optimized on
+std::string CpuIdentity() {
+#if defined(_M_X64) || defined(__x86_64__)
+  char brand[49]{};
+  for (unsigned int leaf = 0; leaf < 3; leaf++) {
+    unsigned int regs[4]{};
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, static_cast<int>(0x80000002 + leaf));
+    for (int i = 0; i < 4; i++)
+      regs[i] = static_cast<unsigned int>(info[i]);
+#else
+    __get_cpuid(0x80000002 + leaf, &regs[0], &regs[1], &regs[2], &regs[3]);
+#endif
+    std::memcpy(brand + leaf * 16, regs, sizeof(regs));
+  }
+  return std::string{"x64 "} + brand;
+#elif defined(__linux__)
+  // The feature flags and part number decide which kernels onnxruntime picks, the rest of cpuinfo can change at runtime
+  std::string identity{"linux"};
+  std::ifstream cpuinfo{"/proc/cpuinfo"};
+  bool features{}, part{};
+  for (std::string line; std::getline(cpuinfo, line) && !(features && part);) {
+    if (!features && StartsWith(line, "Features")) {
+      identity += "\n" + line;
+      features = true;
+    } else if (!part && StartsWith(line, "CPU part")) {
+      identity += "\n" + line;
+      part = true;
+    }
+  }
+  return identity;
+#else
+  return "unknown";
+#endif
+}
+
+const char* ToString(GraphOptimizationLevel level) {
+  switch (level) {
+    case ORT_DISABLE_ALL:
+      return "disable_all";
+    case ORT_ENABLE_BASIC:
+      return "basic";
+    case ORT_ENABLE_EXTENDED:
+      return "extended";
+    default:
+      return "all";
+  }
+}
+
+// Hashes the model and the external data files it refers to. The model is scanned for the "location" entries of
+// external tensors while it is being hashed, so every weights file is covered and not only <model>.data.
+void HashModelFiles(const fs::path& model_path, Hasher& hasher, std::vector<fs::path>& files) {
+  auto hash_file = [&](const fs::path& path, std::set<std::string>* locations) {
+    files.push_back(path);
+    auto file = path.open(std::ios::binary);
+    if (!file) {
+      hasher.Add("<missing>");
+      return;
+    }
+
+    // StringStringEntryProto{key = "location", value = <file name>}: field 1 "location", then the tag of field 2
+    constexpr std::string_view location_key{"\x0a\x08location\x12", 11};
+    constexpr size_t carry_size = 1024;  // Longer than any location entry, so none is missed at a buffer boundary
+    std::string window;
+    std::vector<char> buffer(1 << 20);
+    while (file) {
+      file.read(buffer.data(), buffer.size());
+      const auto count = static_cast<size_t>(file.gcount());
+      hasher.Add(buffer.data(), count);
+      if (!locations)
+        continue;
+
+      window.append(buffer.data(), count);
+      for (auto position = window.find(location_key); position != std::string::npos; position = window.find(location_key, position + 1)) {
+        const size_t length_offset = position + location_key.size();
+        if (length_offset >= window.size())
+          break;
+        const auto length = static_cast<uint8_t>(window[length_offset]);
+        if (length == 0 || length >= 0x80 || length_offset + 1 + length > window.size())
+          continue;
+        locations->insert(window.substr(length_offset + 1, length));
+      }
+      if (window.size() > carry_size)
+        window.erase(0, window.size() - carry_size);
+    }
+  };
+
+  std::set<std::string> locations;
+  hash_file(model_path, &locations);
+  for (const auto& location : locations) {
+    hasher.Add(location);
+    hash_file(Sibling(model_path, location), nullptr);
+  }
+}
+
+// Strings are length prefixed so no value can be mistaken for a separator
+void AppendKey(std::string& key, std::string_view name, std::string_view value) {
+  key += name;
+  key += '=';
+  key += std::to_string(value.size());
+  key += ':';
+  key += value;
+  key += ';';
+}
+
+// Unset options are "-", set ones start with "1" so an empty string is still told apart from unset
+void AppendOptionalKey(std::string& key, std::string_view name, const std::optional<std::string>& value) {
+  AppendKey(key, name, value.has_value() ? "1" + *value : std::string{"-"});
+}
+
+template <typename T>
+void AppendOptionalKey(std::string& key, std::string_view name, const std::optional<T>& value) {
+  AppendKey(key, name, value.has_value() ? "1" + std::to_string(*value) : std::string{"-"});
+}
+
+}  // namespace
+
+std::string SessionOptionsKey(const Config::SessionOptions& options) {
+  std::string key;
+  AppendOptionalKey(key, "intra_op_num_threads", options.intra_op_num_threads);
+  AppendOptionalKey(key, "inter_op_num_threads", options.inter_op_num_threads);
+  AppendOptionalKey(key, "enable_cpu_mem_arena", options.enable_cpu_mem_arena);
+  AppendOptionalKey(key, "enable_mem_pattern", options.enable_mem_pattern);
+  AppendOptionalKey(key, "disable_cpu_ep_fallback", options.disable_cpu_ep_fallback);
+  AppendOptionalKey(key, "disable_quant_qdq", options.disable_quant_qdq);
+  AppendOptionalKey(key, "enable_quant_qdq_cleanup", options.enable_quant_qdq_cleanup);
+  AppendOptionalKey(key, "ep_context_enable", options.ep_context_enable);
+  AppendOptionalKey(key, "ep_context_embed_mode", options.ep_context_embed_mode);
+  AppendOptionalKey(key, "ep_context_file_path", options.ep_context_file_path);
+  AppendOptionalKey(key, "log_id", options.log_id);
+  AppendOptionalKey(key, "log_severity_level", options.log_severity_level);
+  AppendOptionalKey(key, "enable_profiling", options.enable_profiling);
+  AppendOptionalKey(key, "graph_optimization_level", options.graph_optimization_level);
+  AppendOptionalKey(key, "optimized_model_cache_dir", options.optimized_model_cache_dir);
+  AppendOptionalKey(key, "cpu_cores", options.cpu_cores);
+  AppendOptionalKey(key, "numa_node", options.numa_node);
+  AppendOptionalKey(key, "replica_count", options.replica_count);
+  AppendKey(key, "replica_index", std::to_string(options.replica_index));
+  AppendKey(key, "use_env_allocators", options.use_env_allocators ? "1" : "0");
+  AppendKey(key, "provider_options", std::to_string(options.provider_options.size()));
+  for (const auto& provider : options.provider_options) {
+    AppendKey(key, "provider", provider.name);
+    AppendKey(key, "options", std::to_string(provider.options.size()));
+    for (const auto& [name, value] : provider.options)
+      AppendKey(key, name, value);
+  }
+  return key;
+}
+
+OptimizedModelCache::OptimizedModelCache(const fs::path& directory, std::string options_key, GraphOptimizationLevel level)
+    : directory_{directory}, options_key_{std::move(options_key)}, level_{level} {
+  if (!directory_.create_directory())
+    throw std::runtime_error("Unable to create the optimized model cache directory: " + directory_.string());
+
+  options_key_ += std::string{";level="} + ToString(level_);
+  if (level_ == ORT_ENABLE_ALL)
+    options_key_ += ";cpu=" + CpuIdentity();
+}
+
+void OptimizedModelCache::RemoveEntries(std::string_view prefix, std::string_view keep) const {
+  for (const auto& name : ListDirectory(directory_)) {
+    if (!StartsWith(name, prefix) || (!keep.empty() && StartsWith(name, keep)))
+      continue;
+    // In progress writes (.tmp) are left to the process that owns them
+    if (EndsWith(name, ".onnx") || EndsWith(name, ".onnx.data"))
+      (directory_ / name).remove();
+  }
+}
+
+std::unique_ptr<OrtSession> OptimizedModelCache::CreateSession(OrtEnv& ort_env, const fs::path& model_path, const OrtSessionOptions& session_options) const {
+  // Every path + options combination has one slot in the cache. Its index file records which entry the model files
+  // hashed to, along with their sizes and modification times, so a load only has to stat the files to find its entry
+  Hasher slot_hasher;
+  slot_hasher.Add(model_path.string());
+  slot_hasher.Add(Ort::version_string ? Ort::version_string : "");
+  slot_hasher.Add(options_key_);
+  const auto slot_name = FileName(model_path) + "." + slot_hasher.Hex();
+  const auto index_path = directory_ / (slot_name + ".index");
+
+  std::string entry_name;
+  {
+    auto index = index_path.open();
+    std::string content_hash;
+    if (index && std::getline(index, content_hash)) {
+      bool unchanged = true;
+      for (std::string line; unchanged && std::getline(index, line);) {
+        auto separator = line.find('\t');
+        unchanged = separator != std::string::npos && FileStamp(fs::path{line.substr(separator + 1)}) == line.substr(0, separator);
+      }
+      if (unchanged)
+        entry_name = slot_name + "." + content_hash;
+    }
+  }
+
+  // The files changed, or were never seen with these options. Only now are they hashed, which is what finds an entry
+  // again after the files were copied (new modification times, same contents)
+  if (entry_name.empty()) {
+    Hasher content_hasher;
+    std::vector<fs::path> files;
+    HashModelFiles(model_path, content_hasher, files);
+    entry_name = slot_name + "." + content_hasher.Hex();
+
+    std::ostringstream unique;
+    unique << std::hex << std::random_device{}() << std::random_device{}();
+    const auto temp_index_path = directory_ / (slot_name + "." + unique.str() + ".index.tmp");
+    {
+      auto index = temp_index_path.open_for_write();
+      index << content_hasher.Hex() << '\n';
+      for (const auto& file : files)
+        index << FileStamp(file) << '\t' << file.string() << '\n';
+    }
+    if (!temp_index_path.rename(index_path))
+      temp_index_path.remove();
+  }
+
+  const auto cached_path = directory_ / (entry_name + ".onnx");
+
+  // The cached graph is already optimized, so only loading it is left to do
+  if (cached_path.exists()) {
+    try {
+      auto options = session_options.Clone();
+      options->SetGraphOptimizationLevel(ORT_DISABLE_ALL);
+      auto session = OrtSession::Create(ort_env, cached_path.c_str(), options.get());
+      if (g_log.enabled && g_log.model_load)
+        Log("model_load", "Loaded " + FileName(model_path) + " from the optimized model cache");
+      return session;
+    } catch (const std::exception& e) {
+      if (g_log.enabled && g_log.warning)
+        Log("warning", "Discarding unusable optimized model cache entry " + cached_path.string() + ": " + e.what());
+      cached_path.remove();
+      RemoveEntries(entry_name + ".", {});
+    }
+  }
+
+  // Every writer uses its own file names and the graph is moved into place last, so readers never see a partially
+  // written entry. The weights file the graph refers to is never rewritten once the graph is visible.
+  std::ostringstream unique;
+  unique << std::hex << std::random_device{}() << std::random_device{}();
+  const auto weights_name = entry_name + "." + unique.str() + ".onnx.data";
+  const auto temp_path = directory_ / (entry_name + "." + unique.str() + ".onnx.tmp");
+  const auto weights_path = directory_ / weights_name;
+
+  auto options = session_options.Clone();
+  options->SetGraphOptimizationLevel(level_);
+  options->SetOptimizedModelFilePath(temp_path.c_str());
+  options->AddConfigEntry("session.optimized_model_external_initializers_file_name", weights_name.c_str());
+  options->AddConfigEntry("session.optimized_model_external_initializers_min_size_in_bytes", "1024");
+
+  std::unique_ptr<OrtSession> session;
+  try {
+    session = OrtSession::Create(ort_env, model_path.c_str(), options.get());
+  } catch (const std::exception& e) {
+    temp_path.remove();
+    weights_path.remove();
+    if (g_log.enabled && g_log.warning)
+      Log("warning", "Unable to add " + FileName(model_path) + " to the optimized model cache: " + e.what());
+    return OrtSession::Create(ort_env, model_path.c_str(), &session_options);
+  }
+
+  if (RenameNoReplace(temp_path, cached_path)) {
+    // Entries of older versions of the model files can't be hit anymore
+    RemoveEntries(slot_name + ".", entry_name + ".");
+  } else {
+    // Another process added the same entry while we were optimizing, keep theirs
+    temp_path.remove();
+    weights_path.remove();
+  }
+
+  return session;
+}
+
+}  // namespace Generators
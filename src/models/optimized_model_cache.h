@@ -0,0 +1,32 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#pragma once
+
+namespace Generators {
+
+// Serializes every field of the session options, so that configs that differ in any option get different cache entries
+std::string SessionOptionsKey(const Config::SessionOptions& options);
+
+// Opt-in on-disk cache of the graphs onnxruntime produces when optimizing a model, enabled through the
+// "optimized_model_cache_dir" session option. Entries are keyed by a hash of the model files (the model and every
+// external data file it refers to), the onnxruntime version, all of the session options (see SessionOptionsKey) and, for
+// ORT_ENABLE_ALL, the CPU. Anything that changes the result produces a new entry rather than reusing a stale one.
+struct OptimizedModelCache {
+  OptimizedModelCache(const fs::path& directory, std::string options_key, GraphOptimizationLevel level);
+
+  // Loads the cached optimized graph of the model at model_path if there is one, otherwise optimizes the model at the
+  // cache's optimization level and adds the result to the cache. Once the model files were hashed, later loads only
+  // compare their sizes and modification times. Adding an entry removes the older entries of the same model path.
+  // Safe to call from multiple threads and processes at once.
+  std::unique_ptr<OrtSession> CreateSession(OrtEnv& ort_env, const fs::path& model_path, const OrtSessionOptions& session_options) const;
+
+ private:
+  // Deletes the graphs and weights files whose names start with prefix, except those that start with keep
+  void RemoveEntries(std::string_view prefix, std::string_view keep) const;
+
+  fs::path directory_;
+  std::string options_key_;
+  GraphOptimizationLevel level_;
+};
+
+}  // namespace Generators
@@ -323,6 +323,53 @@ void PositionInputs::UpdateAttentionMask(int current_length) {
   is_first_mask_update_ = false;
 }
 
+void PositionInputs::UpdateChunk(int token_count, int current_length) {
+  if (type_ == Ort::TypeToTensorType<int32_t>)
+    UpdateChunkImpl<int32_t>(token_count, current_length);
+  else
+    UpdateChunkImpl<int64_t>(token_count, current_length);
+}
+
+void PositionInputs::RewindTo(int current_length, int new_length) {
+  if (type_ == Ort::TypeToTensorType<int32_t>)
+    RewindToImpl<int32_t>(current_length, new_length);
+  else
+    RewindToImpl<int64_t>(current_length, new_length);
+}
+
+void PositionInputs::Save(SnapshotWriter& writer) {
+  if (type_ == Ort::TypeToTensorType<int32_t>)
+    SaveImpl<int32_t>(writer);
+  else
+    SaveImpl<int64_t>(writer);
+}
+
+void PositionInputs::Load(SnapshotReader& reader, int current_length) {
+  if (type_ == Ort::TypeToTensorType<int32_t>)
+    LoadImpl<int32_t>(reader, current_length);
+  else
+    LoadImpl<int64_t>(reader, current_length);
+}
+
+void PositionInputs::RemoveRows(std::span<const int32_t> rows_to_keep) {
+  if (has_posid_input_) {
+    // Until the first update, the positions of the next token are waiting in position_ids_next_
+    if (is_first_posid_update_) {
+      position_ids_next_ = KeepRows(model_.allocator_cpu_, *position_ids_next_, rows_to_keep);
+    } else {
+      position_ids_ = KeepRows(model_.allocator_cpu_, *position_ids_, rows_to_keep);
+      state_.inputs_[posid_input_index_] = position_ids_.get();
+    }
+  }
+  position_ids_shape_[0] = static_cast<int64_t>(rows_to_keep.size());
+
+  if (has_mask_input_) {
+    attention_mask_ = KeepRows(*model_.allocator_device_, *attention_mask_, rows_to_keep);
+    state_.inputs_[mask_input_index_] = attention_mask_.get();
+  }
+  attention_mask_shape_[0] = static_cast<int64_t>(rows_to_keep.size());
+}
+
 template <typename T>
 void PositionInputs::InitializeTensors(std::array<int64_t, 2> shape, cpu_span<int32_t> sequence_lengths) {
   // Set attention mask to be 0 for pad tokens, and 1 for all other tokens.
@@ -353,6 +400,145 @@ void PositionInputs::InitializeTensors(std::array<int64_t, 2> shape, cpu_span<in
   }
 }
 
+template <typename T>
+void PositionInputs::UpdateChunkImpl(int token_count, int current_length) {
+  const int64_t batch_size = position_ids_shape_[0];
+
+  if (has_posid_input_) {
+    // Until the first update the position of the pending token is in position_ids_next_, after it is one past position_ids_
+    const T* pending = is_first_posid_update_ ? position_ids_next_->GetTensorData<T>() : position_ids_->GetTensorData<T>();
+    const T offset = is_first_posid_update_ ? 0 : 1;
+
+    position_ids_shape_[1] = token_count;
+    auto position_ids = OrtValue::CreateTensor(model_.allocator_cpu_, position_ids_shape_, type_);
+    auto position_ids_next = OrtValue::CreateTensor(model_.allocator_cpu_, std::array<int64_t, 2>{batch_size, 1}, type_);
+    auto* data = position_ids->GetTensorMutableData<T>();
+    auto* next_data = position_ids_next->GetTensorMutableData<T>();
+    for (int64_t i = 0; i < batch_size; i++) {
+      const T start = pending[i] + offset;
+      for (int j = 0; j < token_count; j++)
+        data[i * token_count + j] = start + j;
+      next_data[i] = start + token_count;
+    }
+
+    // The next update then switches back to single positions, like it does after the prompt
+    position_ids_ = std::move(position_ids);
+    position_ids_next_ = std::move(position_ids_next);
+    is_first_posid_update_ = true;
+    state_.inputs_[posid_input_index_] = position_ids_.get();
+  }
+
+  if (has_mask_input_) {
+    const int64_t old_length = attention_mask_shape_[1];
+    assert(old_length + token_count == current_length);
+    attention_mask_shape_[1] = current_length;
+    auto attention_mask = OrtValue::CreateTensor(*model_.allocator_device_, attention_mask_shape_, type_);
+    const auto* old_data = attention_mask_->GetTensorData<T>();
+    auto* data = attention_mask->GetTensorMutableData<T>();
+    for (int64_t i = 0; i < batch_size; i++) {
+      std::copy(old_data + i * old_length, old_data + (i + 1) * old_length, data + i * current_length);
+      std::fill(data + i * current_length + old_length, data + (i + 1) * current_length, T{1});
+    }
+    attention_mask_ = std::move(attention_mask);
+    state_.inputs_[mask_input_index_] = attention_mask_.get();
+  }
+}
+
+template <typename T>
+void PositionInputs::RewindToImpl(int current_length, int new_length) {
+  const int64_t batch_size = position_ids_shape_[0];
+  const T token_count = static_cast<T>(current_length - new_length);
+
+  if (has_posid_input_) {
+    // The pending token moves back by token_count positions, and is set up like the one after the prompt
+    const T* pending = is_first_posid_update_ ? position_ids_next_->GetTensorData<T>() : position_ids_->GetTensorData<T>();
+    const T offset = is_first_posid_update_ ? 0 : 1;
+
+    auto position_ids_next = OrtValue::CreateTensor(model_.allocator_cpu_, std::array<int64_t, 2>{batch_size, 1}, type_);
+    auto* next_data = position_ids_next->GetTensorMutableData<T>();
+    for (int64_t i = 0; i < batch_size; i++)
+      next_data[i] = pending[i] + offset - token_count;
+
+    position_ids_next_ = std::move(position_ids_next);
+    is_first_posid_update_ = true;
+  }
+
+  if (has_mask_input_) {
+    // Only covers the processed tokens, which is everything but the pending token
+    const int64_t old_length = attention_mask_shape_[1];
+    const int64_t length = new_length - 1;
+    assert(old_length == current_length - 1);
+    attention_mask_shape_[1] = length;
+    auto attention_mask = OrtValue::CreateTensor(*model_.allocator_device_, attention_mask_shape_, type_);
+    const auto* old_data = attention_mask_->GetTensorData<T>();
+    auto* data = attention_mask->GetTensorMutableData<T>();
+    for (int64_t i = 0; i < batch_size; i++)
+      std::copy(old_data + i * old_length, old_data + i * old_length + length, data + i * length);
+    attention_mask_ = std::move(attention_mask);
+    state_.inputs_[mask_input_index_] = attention_mask_.get();
+  }
+}
+
+template <typename T>
+void PositionInputs::SaveImpl(SnapshotWriter& writer) {
+  const int64_t batch_size = position_ids_shape_[0];
+  writer.Write(has_posid_input_);
+  writer.Write(has_mask_input_);
+
+  if (has_posid_input_) {
+    // Only the position of the pending token is needed to continue
+    const T* pending = is_first_posid_update_ ? position_ids_next_->GetTensorData<T>() : position_ids_->GetTensorData<T>();
+    const T offset = is_first_posid_update_ ? 0 : 1;
+    std::vector<int64_t> positions(batch_size);
+    for (int64_t i = 0; i < batch_size; i++)
+      positions[i] = pending[i] + offset;
+    writer.WriteSpan(std::span<const int64_t>{positions.data(), positions.size()});
+  }
+
+  if (has_mask_input_) {
+    // The mask is all zeros and ones, so a byte per value is plenty
+    const auto* data = attention_mask_->GetTensorData<T>();
+    std::vector<uint8_t> mask(batch_size * attention_mask_shape_[1]);
+    for (size_t i = 0; i < mask.size(); i++)
+      mask[i] = static_cast<uint8_t>(data[i]);
+    writer.WriteSpan(std::span<const uint8_t>{mask.data(), mask.size()});
+  }
+}
+
+template <typename T>
+void PositionInputs::LoadImpl(SnapshotReader& reader, int current_length) {
+  const int64_t batch_size = position_ids_shape_[0];
+  const bool has_posid_input = reader.Read<bool>();
+  const bool has_mask_input = reader.Read<bool>();
+  if (has_posid_input != has_posid_input_ || has_mask_input != has_mask_input_)
+    throw std::runtime_error("Generator snapshot was saved with a different model");
+
+  if (has_posid_input_) {
+    auto positions = reader.ReadVector<int64_t>();
+    if (static_cast<int64_t>(positions.size()) != batch_size)
+      throw std::runtime_error("Generator snapshot doesn't match the batch size");
+
+    // Set up like after the prompt, the next update moves the pending positions into position_ids_
+    position_ids_next_ = OrtValue::CreateTensor(model_.allocator_cpu_, std::array<int64_t, 2>{batch_size, 1}, type_);
+    auto* next_data = position_ids_next_->GetTensorMutableData<T>();
+    for (int64_t i = 0; i < batch_size; i++)
+      next_data[i] = static_cast<T>(positions[i]);
+    is_first_posid_update_ = true;
+  }
+
+  if (has_mask_input_) {
+    auto mask = reader.ReadVector<uint8_t>();
+    const int64_t length = current_length - 1;
+    if (static_cast<int64_t>(mask.size()) != batch_size * length)
+      throw std::runtime_error("Generator snapshot attention mask doesn't match the batch size and sequence length");
+
+    attention_mask_shape_[1] = length;
+    attention_mask_ = OrtValue::CreateTensor(*model_.allocator_device_, attention_mask_shape_, type_);
+    std::copy(mask.begin(), mask.end(), attention_mask_->GetTensorMutableData<T>());
+    state_.inputs_[mask_input_index_] = attention_mask_.get();
+  }
+}
+
 template <typename T>
 void PositionInputs::UpdatePositionIDsImpl() {
   // Increment position IDs
@@ -14,6 +14,11 @@ struct PositionInputs {
 
   void Add();
   void Update(int current_length);
+  void RemoveRows(std::span<const int32_t> rows_to_keep);  // See State::RemoveRows
+  void UpdateChunk(int token_count, int current_length);   // Several tokens per row, see State::AppendTokens
+  void RewindTo(int current_length, int new_length);       // See State::RewindTo
+  void Save(SnapshotWriter& writer);                       // See State::SaveState
+  void Load(SnapshotReader& reader, int current_length);
 
  private:
   void AddAttentionMask();
@@ -29,6 +34,14 @@ struct PositionInputs {
   void UpdatePositionIDsImpl();
   template <typename T>
   void UpdateAttentionMaskImpl(T* data, const T* old_data, int current_length);
+  template <typename T>
+  void UpdateChunkImpl(int token_count, int current_length);
+  template <typename T>
+  void RewindToImpl(int current_length, int new_length);
+  template <typename T>
+  void SaveImpl(SnapshotWriter& writer);
+  template <typename T>
+  void LoadImpl(SnapshotReader& reader, int current_length);
 
   const Model& model_;
   State& state_;
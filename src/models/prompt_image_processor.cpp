@@ -85,11 +85,9 @@ std::unique_ptr<OrtValue> ProcessPixelValues(ortc::Tensor<float>* pixel_values,
     std::copy(pixel_values->Data(), pixel_values->Data() + pixel_values->NumberOfElement(),
               pixel_values_value->GetTensorMutableData<float>());
   } else {
-    auto pixel_values_fp32 = OrtValue::CreateTensor<float>(
-        allocator.GetInfo(),
-        std::span<float>(const_cast<float*>(pixel_values->Data()), pixel_values->NumberOfElement()),
-        pixel_values->Shape());
-    ConvertFp32ToFp16(allocator, *pixel_values_fp32, pixel_values_value, DeviceType::CPU, nullptr);
+    const size_t count = pixel_values->NumberOfElement();
+    ConvertFloat32ToFloat16(std::span<const float>(pixel_values->Data(), count),
+                            std::span<uint16_t>(pixel_values_value->GetTensorMutableData<uint16_t>(), count));
   }
 
   return pixel_values_value;
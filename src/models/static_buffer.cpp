@@ -16,6 +16,7 @@ std::unique_ptr<OrtValue> StaticBuffer::CreateTensorOnStaticBuffer(std::span<con
     // Assuming the first dimension is the batch size
     bytes_ = new_bytes * (max_beam_batch_size_ / shape[0]);
     buffer_ = allocator_->Alloc(bytes_);
+    memory_.Set(bytes_);
     return OrtValue::CreateTensor(info_, buffer_, new_bytes, shape, type);
   }
   if (new_bytes > bytes_) {
@@ -5,6 +5,7 @@
 #include <memory>
 #include "onnxruntime_api.h"
 #include "../span.h"
+#include "../memory_usage.h"
 
 namespace Ort {
 struct Allocator;
@@ -30,6 +31,7 @@ struct StaticBuffer {
   void* buffer_{};
   size_t bytes_{};
   size_t max_beam_batch_size_{};
+  TrackedMemory memory_{MemoryCategory::StaticBuffers};
 };
 
 }  // namespace Generators
@@ -1,6 +1,18 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 // Licensed under the MIT License.
 #include "../generators.h"
+#include "utils.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 namespace Generators {
 
@@ -88,4 +100,273 @@ uint16_t FastFloat32ToFloat16(float v) {
   return static_cast<uint16_t>((b & 0x80000000) >> 16 | (e > 112) * ((((e - 112) << 10) & 0x7C00) | m >> 13) | ((e < 113) & (e > 101)) * ((((0x007FF000 + m) >> (125 - e)) + 1) >> 1) | (e > 143) * 0x7FFF);  // sign : normalized : denormalized : saturate
 }
 
-}  // namespace Generators
\ No newline at end of file
+namespace {
+
+void ConvertFloat16ToFloat32_Scalar(const uint16_t* in, float* out, size_t count) {
+  // Logits are masked with -inf, so Inf and NaN take the exact conversion like the hardware kernels do
+  for (size_t i = 0; i < count; i++)
+    out[i] = (in[i] & 0x7C00) == 0x7C00 ? Float16ToFloat32(in[i]) : FastFloat16ToFloat32(in[i]);
+}
+
+void ConvertFloat32ToFloat16_Scalar(const float* in, uint16_t* out, size_t count) {
+  for (size_t i = 0; i < count; i++)
+    out[i] = FastFloat32ToFloat16(in[i]);
+}
+
+#if defined(_M_X64) || defined(__x86_64__)
+#if defined(__GNUC__) || defined(__clang__)
+#define GENAI_TARGET_F16C __attribute__((target("avx,f16c")))
+#else
+#define GENAI_TARGET_F16C
+#endif
+
+bool CpuSupportsF16C() {
+  unsigned int regs[4]{};
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 1);
+  for (int i = 0; i < 4; i++)
+    regs[i] = static_cast<unsigned int>(info[i]);
+#else
+  if (!__get_cpuid(1, &regs[0], &regs[1], &regs[2], &regs[3]))
+    return false;
+#endif
+  const bool osxsave = (regs[2] & (1U << 27)) != 0;
+  const bool avx = (regs[2] & (1U << 28)) != 0;
+  const bool f16c = (regs[2] & (1U << 29)) != 0;
+  if (!osxsave || !avx || !f16c)
+    return false;
+
+  // The OS must also preserve the YMM registers across context switches
+#if defined(_MSC_VER)
+  const unsigned long long xcr0 = _xgetbv(0);
+#else
+  unsigned int eax, edx;
+  __asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  const unsigned long long xcr0 = (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+  return (xcr0 & 0x6) == 0x6;
+}
+
+GENAI_TARGET_F16C void ConvertFloat16ToFloat32_F16C(const uint16_t* in, float* out, size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8)
+    _mm256_storeu_ps(out + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i))));
+
+  if (i < count) {
+    alignas(16) uint16_t in_tail[8]{};
+    alignas(32) float out_tail[8];
+    std::copy(in + i, in + count, in_tail);
+    _mm256_store_ps(out_tail, _mm256_cvtph_ps(_mm_load_si128(reinterpret_cast<const __m128i*>(in_tail))));
+    std::copy(out_tail, out_tail + (count - i), out + i);
+  }
+}
+
+GENAI_TARGET_F16C void ConvertFloat32ToFloat16_F16C(const float* in, uint16_t* out, size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m128i fp16 = _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), fp16);
+  }
+
+  // Convert the tail through a padded buffer so every element is rounded the same way
+  if (i < count) {
+    alignas(32) float in_tail[8]{};
+    alignas(16) uint16_t out_tail[8];
+    std::copy(in + i, in + count, in_tail);
+    _mm_store_si128(reinterpret_cast<__m128i*>(out_tail), _mm256_cvtps_ph(_mm256_load_ps(in_tail), _MM_FROUND_TO_NEAREST_INT));
+    std::copy(out_tail, out_tail + (count - i), out + i);
+  }
+}
+#elif defined(__aarch64__)
+void ConvertFloat16ToFloat32_Neon(const uint16_t* in, float* out, size_t count) {
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4)
+    vst1q_f32(out + i, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(in + i))));
+
+  if (i < count) {
+    uint16_t in_tail[4]{};
+    float out_tail[4];
+    std::copy(in + i, in + count, in_tail);
+    vst1q_f32(out_tail, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(in_tail))));
+    std::copy(out_tail, out_tail + (count - i), out + i);
+  }
+}
+
+void ConvertFloat32ToFloat16_Neon(const float* in, uint16_t* out, size_t count) {
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4)
+    vst1_u16(out + i, vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(in + i))));
+
+  if (i < count) {
+    float in_tail[4]{};
+    uint16_t out_tail[4];
+    std::copy(in + i, in + count, in_tail);
+    vst1_u16(out_tail, vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(in_tail))));
+    std::copy(out_tail, out_tail + (count - i), out + i);
+  }
+}
+#endif
+
+using ConvertFloat16ToFloat32Fn = void (*)(const uint16_t*, float*, size_t);
+using ConvertFloat32ToFloat16Fn = void (*)(const float*, uint16_t*, size_t);
+
+ConvertFloat16ToFloat32Fn GetConvertFloat16ToFloat32() {
+#if defined(_M_X64) || defined(__x86_64__)
+  if (CpuSupportsF16C())
+    return ConvertFloat16ToFloat32_F16C;
+#elif defined(__aarch64__)
+  return ConvertFloat16ToFloat32_Neon;
+#endif
+  return ConvertFloat16ToFloat32_Scalar;
+}
+
+ConvertFloat32ToFloat16Fn GetConvertFloat32ToFloat16() {
+#if defined(_M_X64) || defined(__x86_64__)
+  if (CpuSupportsF16C())
+    return ConvertFloat32ToFloat16_F16C;
+#elif defined(__aarch64__)
+  return ConvertFloat32ToFloat16_Neon;
+#endif
+  return ConvertFloat32ToFloat16_Scalar;
+}
+
+}  // namespace
+
+void ConvertFloat16ToFloat32(std::span<const uint16_t> in, std::span<float> out) {
+  assert(out.size() >= in.size());
+  static const ConvertFloat16ToFloat32Fn convert = GetConvertFloat16ToFloat32();
+  convert(in.data(), out.data(), in.size());
+}
+
+void ConvertBFloat16ToFloat32(std::span<const uint16_t> in, std::span<float> out) {
+  assert(out.size() >= in.size());
+  // A plain shift, compilers auto-vectorize this loop on every target so no dispatch is needed
+  for (size_t i = 0; i < in.size(); i++)
+    out[i] = BFloat16ToFloat32(in[i]);
+}
+
+void ConvertFloat32ToFloat16(std::span<const float> in, std::span<uint16_t> out) {
+  assert(out.size() >= in.size());
+  static const ConvertFloat32ToFloat16Fn convert = GetConvertFloat32ToFloat16();
+  convert(in.data(), out.data(), in.size());
+}
+
+std::vector<Float16ConversionKernel> GetFloat16ConversionKernels() {
+  std::vector<Float16ConversionKernel> kernels;
+#if defined(_M_X64) || defined(__x86_64__)
+  if (CpuSupportsF16C())
+    kernels.push_back({"f16c", ConvertFloat16ToFloat32_F16C, ConvertFloat32ToFloat16_F16C});
+#elif defined(__aarch64__)
+  kernels.push_back({"neon", ConvertFloat16ToFloat32_Neon, ConvertFloat32ToFloat16_Neon});
+#endif
+  kernels.push_back({"scalar", ConvertFloat16ToFloat32_Scalar, ConvertFloat32ToFloat16_Scalar});
+  return kernels;
+}
+
+struct ThreadPool::Job {
+  const std::function<void(size_t)>& fn;
+  size_t count;
+  size_t helper_slots;  // How many more workers may join, guarded by ThreadPool::mutex_
+  std::atomic<size_t> next{};
+  std::atomic<size_t> finished{};
+
+  std::mutex mutex;  // Guards error and signals done
+  std::condition_variable done;
+  std::exception_ptr error;
+
+  Job(const std::function<void(size_t)>& fn, size_t count, size_t helper_slots) : fn{fn}, count{count}, helper_slots{helper_slots} {}
+
+  bool HasWork() const { return helper_slots != 0 && next < count; }
+
+  void RunItems() {
+    for (size_t i = next++; i < count; i = next++) {
+      try {
+        fn(i);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock{mutex};
+        if (!error)
+          error = std::current_exception();
+      }
+      if (++finished == count) {
+        std::lock_guard<std::mutex> lock{mutex};
+        done.notify_all();
+      }
+    }
+  }
+};
+
+ThreadPool::ThreadPool(size_t worker_count) : worker_count_{worker_count} {}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    stop_ = true;
+  }
+  work_available_.notify_all();
+  for (auto& thread : threads_)
+    thread.join();
+}
+
+void ThreadPool::WorkerLoop() {
+  std::unique_lock<std::mutex> lock{mutex_};
+  while (true) {
+    std::shared_ptr<Job> job;
+    work_available_.wait(lock, [&] {
+      for (auto& queued : jobs_) {
+        if (queued->HasWork()) {
+          job = queued;
+          return true;
+        }
+      }
+      return stop_;
+    });
+    if (!job)
+      return;
+
+    job->helper_slots--;
+    lock.unlock();
+    job->RunItems();
+    lock.lock();
+  }
+}
+
+void ThreadPool::Run(size_t count, size_t max_threads, const std::function<void(size_t)>& fn) {
+  size_t thread_count = std::min(count, worker_count_ + 1);
+  if (max_threads != 0)
+    thread_count = std::min(thread_count, max_threads);
+  if (thread_count <= 1) {
+    for (size_t i = 0; i < count; i++)
+      fn(i);
+    return;
+  }
+
+  auto job = std::make_shared<Job>(fn, count, thread_count - 1);
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    // Workers are started on first use, so processes that never run anything in parallel don't pay for idle threads
+    while (threads_.size() < worker_count_)
+      threads_.emplace_back([this] { WorkerLoop(); });
+    jobs_.push_back(job);
+  }
+  work_available_.notify_all();
+
+  job->RunItems();  // The calling thread does its share of the work too
+  {
+    std::unique_lock<std::mutex> lock{job->mutex};
+    job->done.wait(lock, [&] { return job->finished == count; });
+  }
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    jobs_.erase(std::find(jobs_.begin(), jobs_.end(), job));
+  }
+
+  if (job->error)
+    std::rethrow_exception(job->error);
+}
+
+void ParallelFor(size_t count, const std::function<void(size_t)>& fn) {
+  GetOrtGlobals()->thread_pool_->Run(count, 0, fn);
+}
+
+}  // namespace Generators
@@ -3,6 +3,10 @@
 #pragma once
 
 #include "ortx_utils.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 
 namespace Generators {
 
@@ -28,4 +32,69 @@ float Float16ToFloat32(uint16_t v);
 float FastFloat16ToFloat32(const uint16_t x);
 uint16_t FastFloat32ToFloat16(float v);
 
+// bf16 is the upper half of an fp32, so this conversion is exact (including NaN and Inf)
+inline float BFloat16ToFloat32(uint16_t v) {
+  uint32_t bits = static_cast<uint32_t>(v) << 16;
+  float result;
+  std::memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+// Round to nearest even fp32 -> bf16, NaN stays NaN
+inline uint16_t Float32ToBFloat16(float v) {
+  uint32_t bits;
+  std::memcpy(&bits, &v, sizeof(bits));
+  if ((bits & 0x7FFFFFFF) > 0x7F800000)
+    return static_cast<uint16_t>((bits >> 16) | 0x0040);
+  bits += 0x7FFF + ((bits >> 16) & 1);
+  return static_cast<uint16_t>(bits >> 16);
+}
+
+// Bulk fp16 -> fp32 conversion. Uses F16C on x86 and NEON on ARM64 when available (checked once at runtime),
+// otherwise falls back to FastFloat16ToFloat32. 'out' must be at least as large as 'in'.
+void ConvertFloat16ToFloat32(std::span<const uint16_t> in, std::span<float> out);
+
+// Bulk bf16 -> fp32 conversion. 'out' must be at least as large as 'in'.
+void ConvertBFloat16ToFloat32(std::span<const uint16_t> in, std::span<float> out);
+
+// Bulk fp32 -> fp16 conversion. Uses F16C on x86 and NEON on ARM64 when available (checked once at runtime),
+// otherwise falls back to FastFloat32ToFloat16. 'out' must be at least as large as 'in'.
+void ConvertFloat32ToFloat16(std::span<const float> in, std::span<uint16_t> out);
+
+// The fp16 conversion kernels this CPU can run, so benchmarks can compare them. The first one is the one
+// ConvertFloat16ToFloat32 and ConvertFloat32ToFloat16 use, the last one is always the portable scalar version.
+struct Float16ConversionKernel {
+  const char* name;
+  void (*to_float32)(const uint16_t* in, float* out, size_t count);
+  void (*to_float16)(const float* in, uint16_t* out, size_t count);
+};
+std::vector<Float16ConversionKernel> GetFloat16ConversionKernels();
+
+// Persistent worker threads for ParallelFor, owned by OrtGlobals so they are joined by Shutdown. The calling thread
+// always runs items too, so a ParallelFor nested inside another one finishes even when every worker is busy.
+struct ThreadPool {
+  ThreadPool(size_t worker_count);
+  ~ThreadPool();
+
+  size_t WorkerCount() const { return worker_count_; }
+
+  // Runs fn(0) .. fn(count - 1) on the caller and up to max_threads - 1 workers (0 = every worker)
+  void Run(size_t count, size_t max_threads, const std::function<void(size_t)>& fn);
+
+ private:
+  struct Job;
+  void WorkerLoop();
+
+  size_t worker_count_;
+  std::mutex mutex_;
+  std::condition_variable work_available_;
+  std::deque<std::shared_ptr<Job>> jobs_;
+  std::vector<std::thread> threads_;
+  bool stop_{};
+};
+
+// Runs fn(0) .. fn(count - 1) on the OrtGlobals thread pool and waits for all of them.
+// The first exception thrown by fn is rethrown on the calling thread once every item has finished.
+void ParallelFor(size_t count, const std::function<void(size_t)>& fn);
+
 }  // namespace Generators
\ No newline at end of file
@@ -7,13 +7,58 @@
 
 namespace Generators {
 
+namespace {
+
+std::unique_ptr<OrtValue>& GetInputFeatures(const GeneratorParams& params) {
+  for (const auto& [name, value] : params.extra_inputs) {
+    if (name == "encoder_input_ids") {
+      return value->ort_tensor_;
+    }
+  }
+
+  auto& inputs = const_cast<GeneratorParams::Whisper&>(std::get<GeneratorParams::Whisper>(params.inputs));
+  if (!inputs.input_features) {
+    throw std::runtime_error("encoder_input_ids must be provided in the extra inputs");
+  }
+  return inputs.input_features->ort_tensor_;
+}
+
+// The encoder's second convolution has stride 2, so it emits ceil(frames / 2) hidden states for the given log-mel frames
+int64_t GetEncoderSequenceLength(const Whisper_Model& model, const GeneratorParams& params) {
+  auto shape = GetInputFeatures(params)->GetTensorTypeAndShapeInfo()->GetShape();
+  if (shape.size() != 3) {
+    throw std::runtime_error("Expected input_features to have shape [batch_size, number_of_mels, number_of_frames]. Actual rank: " + std::to_string(shape.size()));
+  }
+  if (model.encoder_frame_count_ > 0 && shape[2] != model.encoder_frame_count_) {
+    throw std::runtime_error("This Whisper encoder only accepts " + std::to_string(model.encoder_frame_count_) +
+                             " log-mel frames, got " + std::to_string(shape[2]) + ". Pad the audio window to that length.");
+  }
+  return (shape[2] + 1) / 2;
+}
+
+}  // namespace
+
 Whisper_Model::Whisper_Model(std::unique_ptr<Config> config, OrtEnv& ort_env)
     : Model{std::move(config)} {
-  session_encoder_ = OrtSession::Create(ort_env, (config_->config_path / fs::path(config_->model.encoder_decoder_init.filename)).c_str(), session_options_.get());
-  session_decoder_ = OrtSession::Create(ort_env, (config_->config_path / fs::path(config_->model.decoder.filename)).c_str(), session_options_.get());
+  const std::vector<std::pair<std::string, OrtSessionOptions*>> models{
+      {config_->model.encoder_decoder_init.filename, session_options_.get()},
+      {config_->model.decoder.filename, session_options_.get()},
+  };
+  auto sessions = CreateSessions(ort_env, models);
+  session_encoder_ = std::move(sessions[0]);
+  session_decoder_ = std::move(sessions[1]);
 
   InitDeviceAllocator(*session_decoder_);
   session_info_->Add(*session_encoder_);
+
+  auto input_names = session_encoder_->GetInputNames();
+  for (size_t i = 0; i < input_names.size(); i++) {
+    if (input_names[i] == "encoder_input_ids") {
+      auto shape = session_encoder_->GetInputTypeInfo(i)->GetTensorTypeAndShapeInfo().GetShape();
+      if (shape.size() == 3)
+        encoder_frame_count_ = shape[2];
+    }
+  }
 }
 
 std::unique_ptr<State> Whisper_Model::CreateState(RoamingArray<int32_t> sequence_lengths, const GeneratorParams& params) const {
@@ -22,21 +67,11 @@ std::unique_ptr<State> Whisper_Model::CreateState(RoamingArray<int32_t> sequence
 
 Whisper_State::Whisper_State(const Whisper_Model& model, RoamingArray<int32_t> sequence_lengths_unk, const GeneratorParams& params)
     : State{params, model},
-      model_{model} {
+      model_{model},
+      encoder_sequence_length_{GetEncoderSequenceLength(model, params)} {
   auto& inputs = const_cast<GeneratorParams::Whisper&>(std::get<GeneratorParams::Whisper>(params.inputs));
 
-  for (const auto& [name, value] : params.extra_inputs) {
-    if (name == "encoder_input_ids") {
-      encoder_input_ids_ = model_.ExpandInputs(value->ort_tensor_, params_->search.num_beams);
-    }
-  }
-  if (encoder_input_ids_ == nullptr) {
-    encoder_input_ids_ = model_.ExpandInputs(inputs.input_features->ort_tensor_, params_->search.num_beams);
-  }
-
-  if (encoder_input_ids_ == nullptr) {
-    throw std::runtime_error("encoder_input_ids must be provided in the extra inputs");
-  }
+  encoder_input_ids_ = model_.ExpandInputs(GetInputFeatures(params), params_->search.num_beams);
 
   if (inputs.alignment_heads != nullptr) {
 #if USE_CUDA
@@ -52,7 +87,7 @@ Whisper_State::Whisper_State(const Whisper_Model& model, RoamingArray<int32_t> s
     cudaMemcpyAsync(alignment_heads_->GetTensorMutableRawData(), inputs.alignment_heads->ort_tensor_->GetTensorRawData(), alignment_heads_data_size, cudaMemcpyHostToDevice, model_.cuda_stream_);
 
     auto cross_qk_type = model_.session_info_->GetOutputDataType("output_cross_qk_0");
-    auto cross_qk_shape = std::array<int64_t, 4>{params_->BatchBeamSize(), alignment_heads_->GetTensorTypeAndShapeInfo()->GetShape()[0], params_->search.max_length, 1500};
+    auto cross_qk_shape = std::array<int64_t, 4>{params_->BatchBeamSize(), alignment_heads_->GetTensorTypeAndShapeInfo()->GetShape()[0], params_->search.max_length, encoder_sequence_length_};
     cross_qk_search_buffer_ = OrtValue::CreateTensor(*model_.allocator_device_, cross_qk_shape, cross_qk_type);
 
     // Allocate GPU buffer for storing output_cross_qk_{i} pointers
@@ -64,7 +99,7 @@ Whisper_State::Whisper_State(const Whisper_Model& model, RoamingArray<int32_t> s
   }
 
   auto hidden_states_type = model_.session_info_->GetOutputDataType("encoder_hidden_states");
-  auto encoder_hidden_states_shape = std::array<int64_t, 3>{decoder_input_ids_.GetShape()[0], 1500, static_cast<int64_t>(model_.config_->model.decoder.num_attention_heads) * model_.config_->model.decoder.head_size};
+  auto encoder_hidden_states_shape = std::array<int64_t, 3>{decoder_input_ids_.GetShape()[0], encoder_sequence_length_, static_cast<int64_t>(model_.config_->model.decoder.num_attention_heads) * model_.config_->model.decoder.head_size};
   encoder_hidden_states_ = OrtValue::CreateTensor(*model_.allocator_device_, encoder_hidden_states_shape, hidden_states_type);
 
   auto sequence_lengths = sequence_lengths_unk.GetCPU();
@@ -162,9 +197,9 @@ RoamingArray<float> Whisper_State::Run(int current_length, RoamingArray<int32_t>
       // and we need some extra memory to do so.
       //
       // Since the self attention K caches are of size (batch_size, num_heads, past_sequence_length, head_size) with type 'float16',
-      // the cross attention K caches are of size (batch_size, num_heads, 1500, head_size) with type 'float32', and
-      // past_sequence_length <= 448 < 1500, we will allocate a temporary buffer that is the
-      // size of a cross attention K cache. This lets us use the same temporary buffer for both
+      // the cross attention K caches are of size (batch_size, num_heads, encoder_sequence_length, head_size) with type 'float32',
+      // we will allocate a temporary buffer that is the size of the larger of the two (for a full 30s window,
+      // past_sequence_length <= 448 < 1500). This lets us use the same temporary buffer for both
       // the self attention and cross attention K caches.
 
       std::unique_ptr<OrtValue> temp_buffer;
@@ -173,6 +208,7 @@ RoamingArray<float> Whisper_State::Run(int current_length, RoamingArray<int32_t>
         auto cross_attn_shape_info = outputs_[outputs_.size() - 1]->GetTensorTypeAndShapeInfo();
         auto cross_attn_dims = cross_attn_shape_info->GetShape();
         auto cross_attn_kv_cache_element_type = cross_attn_shape_info->GetElementType();  // should be `float32` for this case
+        cross_attn_dims[2] = std::max(cross_attn_dims[2], dest_dims[2]);  // Shorter audio windows can have fewer frames than max_length
 
         temp_buffer = OrtValue::CreateTensor(*model_.allocator_device_, cross_attn_dims, cross_attn_kv_cache_element_type);
       }
@@ -284,7 +320,7 @@ RoamingArray<float> Whisper_State::Run(int current_length, RoamingArray<int32_t>
       if (model_.session_info_->HasOutput("output_cross_qk_0")) {
         auto layer_count = model_.config_->model.decoder.num_hidden_layers;
         auto type = model_.session_info_->GetOutputDataType("output_cross_qk_0");
-        std::array<int64_t, 4> shape{params_->BatchBeamSize(), model_.config_->model.decoder.num_attention_heads, 1, 1500};
+        std::array<int64_t, 4> shape{params_->BatchBeamSize(), model_.config_->model.decoder.num_attention_heads, 1, encoder_sequence_length_};
         for (int i = 0; i < layer_count; i++) {
           char string[64];
           snprintf(string, std::size(string), "output_cross_qk_%d", i);
@@ -396,7 +432,7 @@ void Whisper_State::Finalize() {
     // Instantiate final output for cross QKs
     auto num_alignment_heads = alignment_heads_->GetTensorTypeAndShapeInfo()->GetShape()[0];
     auto cross_qk_type = model_.session_info_->GetOutputDataType("output_cross_qk_0");
-    auto cross_qk_shape = std::array<int64_t, 5>{params_->batch_size, params_->search.num_return_sequences, num_alignment_heads, decoded_length, 1500};
+    auto cross_qk_shape = std::array<int64_t, 5>{params_->batch_size, params_->search.num_return_sequences, num_alignment_heads, decoded_length, encoder_sequence_length_};
     cross_qk_final_ = OrtValue::CreateTensor(*model_.allocator_device_, cross_qk_shape, cross_qk_type);
 
     cuda::LaunchFinalizeCrossQK(model_.cuda_stream_,
@@ -15,6 +15,10 @@ struct Whisper_Model : Model {
 
   std::unique_ptr<OrtSession> session_encoder_;  // encoder_decoder_init.onnx
   std::unique_ptr<OrtSession> session_decoder_;  // decoder.onnx
+
+  // Log-mel frames the encoder was exported for, or -1 if it takes any length. Stock exports have 1500 fixed positional
+  // embeddings, so they need the full 3000 frames of a 30s window
+  int64_t encoder_frame_count_{-1};
 };
 
 struct Whisper_State : State {
@@ -33,10 +37,14 @@ struct Whisper_State : State {
     Decoder,
   } run_state_{RunState::Encoder_Decoder_Init};
 
+  // Number of encoder output frames, derived from the input_features shape. Only encoders exported with a dynamic frame
+  // count accept windows shorter than 30s (3000 mel frames -> 1500 encoder frames), see Whisper_Model::encoder_frame_count_
+  int64_t encoder_sequence_length_;
+
   InputIDs decoder_input_ids_{*this};
   Logits logits_{*this};
   KV_Cache kv_cache_{*this};
-  Cross_Cache cross_cache_{*this};
+  Cross_Cache cross_cache_{*this, encoder_sequence_length_};
   std::unique_ptr<OrtValue> encoder_input_ids_;
   std::unique_ptr<OrtValue> encoder_hidden_states_;
 
@@ -49,7 +57,7 @@ struct Whisper_State : State {
   std::vector<OrtValue*> presents_;                       // The original present buffers we must resize init_presents_ into after the first run
 
   std::vector<std::string> output_cross_qk_names_;
-  std::vector<std::unique_ptr<OrtValue>> output_cross_qk_;  // { batch_size, num_heads, 1, 1500 }
+  std::vector<std::unique_ptr<OrtValue>> output_cross_qk_;  // { batch_size, num_heads, 1, encoder_sequence_length }
 
 #if USE_CUDA
   // Buffers for calculating word-level timestamps
@@ -57,8 +65,8 @@ struct Whisper_State : State {
   gpu_span<float*> output_cross_qk_ptrs_gpu_;     // To use for copying the CPU vector of float* pointers into
 #endif
   std::unique_ptr<OrtValue> alignment_heads_;         // { num_alignment_heads, 2 }
-  std::unique_ptr<OrtValue> cross_qk_search_buffer_;  // { batch_beam_size, num_alignment_heads, max_length, 1500 }
-  std::unique_ptr<OrtValue> cross_qk_final_;          // { batch_size, num_return_sequences, num_alignment_heads, decoded_length, 1500 }
+  std::unique_ptr<OrtValue> cross_qk_search_buffer_;  // { batch_beam_size, num_alignment_heads, max_length, encoder_sequence_length }
+  std::unique_ptr<OrtValue> cross_qk_final_;          // { batch_size, num_return_sequences, num_alignment_heads, decoded_length, encoder_sequence_length }
 
   size_t cache_indirection_index_{~0U};
 };
@@ -76,6 +76,15 @@ struct OgaRuntimeSettings : OgaAbstract {
   static void operator delete(void* p) { OgaDestroyRuntimeSettings(reinterpret_cast<OgaRuntimeSettings*>(p)); }
 };
 
+struct OgaString {
+  OgaString(const char* p) : p_{p} {}
+  ~OgaString() { OgaDestroyString(p_); }
+
+  operator const char*() const { return p_; }
+
+  const char* p_;
+};
+
 struct OgaModel : OgaAbstract {
   static std::unique_ptr<OgaModel> Create(const char* config_path) {
     OgaModel* p;
@@ -94,16 +103,28 @@ struct OgaModel : OgaAbstract {
     return std::unique_ptr<OgaSequences>(p);
   }
 
-  static void operator delete(void* p) { OgaDestroyModel(reinterpret_cast<OgaModel*>(p)); }
-};
+  std::unique_ptr<OgaSequences> GenerateRagged(const OgaGeneratorParams& params, const OgaSequences& prompts) const {
+    OgaSequences* p;
+    OgaCheckResult(OgaGenerateRagged(this, &params, &prompts, &p));
+    return std::unique_ptr<OgaSequences>(p);
+  }
 
-struct OgaString {
-  OgaString(const char* p) : p_{p} {}
-  ~OgaString() { OgaDestroyString(p_); }
+  OgaString GetMetrics() const {
+    const char* p;
+    OgaCheckResult(OgaModelGetMetrics(this, &p));
+    return p;
+  }
 
-  operator const char*() const { return p_; }
+  void GetPhaseLatency(const char* phase, size_t& count, double& total_seconds, double& max_seconds) const {
+    OgaCheckResult(OgaModelGetPhaseLatency(this, phase, &count, &total_seconds, &max_seconds));
+  }
 
-  const char* p_;
+  // category is nullptr for the total, see OgaModelGetMemoryUsage
+  void GetMemoryUsage(const char* category, size_t& current_bytes, size_t& peak_bytes) const {
+    OgaCheckResult(OgaModelGetMemoryUsage(this, category, &current_bytes, &peak_bytes));
+  }
+
+  static void operator delete(void* p) { OgaDestroyModel(reinterpret_cast<OgaModel*>(p)); }
 };
 
 struct OgaSequences : OgaAbstract {
@@ -244,6 +265,14 @@ struct OgaGeneratorParams : OgaAbstract {
     OgaCheckResult(OgaGeneratorParamsTryGraphCaptureWithMaxBatchSize(this, max_batch_size));
   }
 
+  void AddStopTokenSequence(const int32_t* tokens, size_t token_count) {
+    OgaCheckResult(OgaGeneratorParamsAddStopTokenSequence(this, tokens, token_count));
+  }
+
+  void AddStopString(const char* stop_string) {
+    OgaCheckResult(OgaGeneratorParamsAddStopString(this, stop_string));
+  }
+
   static void operator delete(void* p) { OgaDestroyGeneratorParams(reinterpret_cast<OgaGeneratorParams*>(p)); }
 };
 
@@ -266,6 +295,22 @@ struct OgaGenerator : OgaAbstract {
     OgaCheckResult(OgaGenerator_GenerateNextToken(this));
   }
 
+  void AppendTokens(const int32_t* tokens, size_t token_count) {
+    OgaCheckResult(OgaGenerator_AppendTokens(this, tokens, token_count));
+  }
+
+  void RewindTo(size_t new_length) {
+    OgaCheckResult(OgaGenerator_RewindTo(this, new_length));
+  }
+
+  void SaveState(const char* path, bool kv_fp16 = false) const {
+    OgaCheckResult(OgaGenerator_SaveState(this, path, kv_fp16));
+  }
+
+  void LoadState(const char* path) {
+    OgaCheckResult(OgaGenerator_LoadState(this, path));
+  }
+
   size_t GetSequenceCount(size_t index) const {
     return OgaGenerator_GetSequenceCount(this, index);
   }
@@ -274,6 +319,20 @@ struct OgaGenerator : OgaAbstract {
     return OgaGenerator_GetSequenceData(this, index);
   }
 
+  OgaString GetMetrics() const {
+    const char* p;
+    OgaCheckResult(OgaGenerator_GetMetrics(this, &p));
+    return p;
+  }
+
+  void GetPhaseLatency(const char* phase, size_t& count, double& total_seconds, double& max_seconds) const {
+    OgaCheckResult(OgaGenerator_GetPhaseLatency(this, phase, &count, &total_seconds, &max_seconds));
+  }
+
+  void GetMemoryUsage(const char* category, size_t& current_bytes, size_t& peak_bytes) const {
+    OgaCheckResult(OgaGenerator_GetMemoryUsage(this, category, &current_bytes, &peak_bytes));
+  }
+
   std::unique_ptr<OgaTensor> GetOutput(const char* name) {
     OgaTensor* out;
     OgaCheckResult(OgaGenerator_GetOutput(this, name, &out));
@@ -284,6 +343,13 @@ struct OgaGenerator : OgaAbstract {
   std::span<const int32_t> GetSequence(size_t index) const {
     return {GetSequenceData(index), GetSequenceCount(index)};
   }
+
+  std::span<const int32_t> GetNextTokens() const {
+    const int32_t* p;
+    size_t count;
+    OgaCheckResult(OgaGenerator_GetNextTokens(this, &p, &count));
+    return {p, count};
+  }
 #endif
 
   void SetActiveAdapter(OgaAdapters& adapters, const char* adapter_name) {
@@ -382,6 +448,31 @@ struct OgaNamedTensors : OgaAbstract {
   static void operator delete(void* p) { OgaDestroyNamedTensors(reinterpret_cast<OgaNamedTensors*>(p)); }
 };
 
+struct OgaAudioStream : OgaAbstract {
+  void Append(const float* samples, size_t sample_count) {
+    OgaCheckResult(OgaAudioStreamAppend(this, samples, sample_count));
+  }
+
+#if __cplusplus >= 202002L
+  void Append(std::span<const float> samples) {
+    OgaCheckResult(OgaAudioStreamAppend(this, samples.data(), samples.size()));
+  }
+#endif
+
+  void Flush() {
+    OgaCheckResult(OgaAudioStreamFlush(this));
+  }
+
+  // Returns null until a whole window has been appended
+  std::unique_ptr<OgaNamedTensors> NextWindow() {
+    OgaNamedTensors* p;
+    OgaCheckResult(OgaAudioStreamNextWindow(this, &p));
+    return std::unique_ptr<OgaNamedTensors>(p);
+  }
+
+  static void operator delete(void* p) { OgaDestroyAudioStream(reinterpret_cast<OgaAudioStream*>(p)); }
+};
+
 struct OgaMultiModalProcessor : OgaAbstract {
   static std::unique_ptr<OgaMultiModalProcessor> Create(const OgaModel& model) {
     OgaMultiModalProcessor* p;
@@ -401,6 +492,12 @@ struct OgaMultiModalProcessor : OgaAbstract {
     return std::unique_ptr<OgaNamedTensors>(p);
   }
 
+  std::unique_ptr<OgaAudioStream> CreateAudioStream(int64_t num_mels, int64_t window_frames, int64_t overlap_frames) const {
+    OgaAudioStream* p;
+    OgaCheckResult(OgaCreateAudioStream(this, num_mels, window_frames, overlap_frames, &p));
+    return std::unique_ptr<OgaAudioStream>(p);
+  }
+
   OgaString Decode(const int32_t* tokens_data, size_t tokens_length) const {
     const char* p;
     OgaCheckResult(OgaProcessorDecode(this, tokens_data, tokens_length, &p));
@@ -455,6 +552,18 @@ inline void SetLogString(const char* name, const char* value) {
   OgaCheckResult(OgaSetLogString(name, value));
 }
 
+inline void SetGlobalThreadPool(int thread_count) {
+  OgaCheckResult(OgaSetGlobalThreadPool(thread_count));
+}
+
+inline void SetTraceFile(const char* path) {
+  OgaCheckResult(OgaSetTraceFile(path));
+}
+
+inline void FlushTrace() {
+  OgaCheckResult(OgaFlushTrace());
+}
+
 inline void SetCurrentGpuDeviceId(int device_id) {
   OgaCheckResult(OgaSetCurrentGpuDeviceId(device_id));
 }
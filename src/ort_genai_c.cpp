@@ -4,6 +4,7 @@
 #include <stdexcept>
 #include <cstdint>
 #include <cstddef>
+#include <cstring>
 #include "span.h"
 #include "ort_genai_c.h"
 #include "generators.h"
@@ -18,6 +19,31 @@ struct Result {
   std::string what_;
 };
 
+// Copies string into a buffer the caller frees with OgaDestroyString
+const char* CopyToOgaString(const std::string& string) {
+  auto buffer = std::make_unique<char[]>(string.size() + 1);
+  std::memcpy(buffer.get(), string.c_str(), string.size() + 1);
+  return buffer.release();
+}
+
+void GetMemoryUsage(const MemoryUsage& memory_usage, const char* category, size_t* current_bytes, size_t* peak_bytes) {
+  if (!category) {
+    *current_bytes = memory_usage.CurrentTotalBytes();
+    *peak_bytes = memory_usage.PeakTotalBytes();
+    return;
+  }
+  auto memory_category = MemoryCategoryFromString(category);
+  *current_bytes = memory_usage.CurrentBytes(memory_category);
+  *peak_bytes = memory_usage.PeakBytes(memory_category);
+}
+
+void GetPhaseLatency(const Metrics& metrics, const char* phase, size_t* count, double* total_seconds, double* max_seconds) {
+  auto& histogram = metrics[PhaseFromString(phase)];
+  *count = static_cast<size_t>(histogram.Count());
+  *total_seconds = histogram.TotalSeconds();
+  *max_seconds = histogram.MaxSeconds();
+}
+
 }  // namespace Generators
 
 extern "C" {
@@ -52,6 +78,27 @@ OgaResult* OGA_API_CALL OgaSetLogString(const char* name, const char* value) {
   OGA_CATCH
 }
 
+OgaResult* OGA_API_CALL OgaSetGlobalThreadPool(int thread_count) {
+  OGA_TRY
+  Generators::SetGlobalThreadPool(thread_count);
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaSetTraceFile(const char* path) {
+  OGA_TRY
+  Generators::SetTraceFile(path ? path : std::string_view{});
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaFlushTrace() {
+  OGA_TRY
+  Generators::FlushTrace();
+  return nullptr;
+  OGA_CATCH
+}
+
 OgaResult* OGA_API_CALL OgaCreateSequences(OgaSequences** out) {
   OGA_TRY
   *out = reinterpret_cast<OgaSequences*>(std::make_unique<Generators::TokenSequences>().release());
@@ -206,6 +253,26 @@ OgaResult* OGA_API_CALL OgaGeneratorParamsSetInputIDs(OgaGeneratorParams* oga_pa
   OGA_CATCH
 }
 
+OgaResult* OGA_API_CALL OgaGeneratorParamsAddStopTokenSequence(OgaGeneratorParams* oga_params, const int32_t* tokens, size_t token_count) {
+  OGA_TRY
+  if (token_count == 0)
+    throw std::runtime_error("Stop sequences can't be empty");
+  auto& params = *reinterpret_cast<Generators::GeneratorParams*>(oga_params);
+  params.stop_token_sequences.emplace_back(tokens, tokens + token_count);
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaGeneratorParamsAddStopString(OgaGeneratorParams* oga_params, const char* stop_string) {
+  OGA_TRY
+  if (!stop_string || !*stop_string)
+    throw std::runtime_error("Stop strings can't be empty");
+  auto& params = *reinterpret_cast<Generators::GeneratorParams*>(oga_params);
+  params.stop_strings.emplace_back(stop_string);
+  return nullptr;
+  OGA_CATCH
+}
+
 OgaResult* OGA_API_CALL OgaGeneratorParamsSetInputSequences(OgaGeneratorParams* oga_params, const OgaSequences* p_sequences) {
   OGA_TRY
   auto& params = *reinterpret_cast<Generators::GeneratorParams*>(oga_params);
@@ -260,6 +327,16 @@ OgaResult* OGA_API_CALL OgaGenerate(const OgaModel* model, const OgaGeneratorPar
   OGA_CATCH
 }
 
+OgaResult* OGA_API_CALL OgaGenerateRagged(const OgaModel* model, const OgaGeneratorParams* generator_params, const OgaSequences* p_prompts, OgaSequences** out) {
+  OGA_TRY
+  auto& prompts = *reinterpret_cast<const Generators::TokenSequences*>(p_prompts);
+  std::vector<std::span<const int32_t>> span_prompts(prompts.begin(), prompts.end());
+  auto result = Generators::GenerateRagged(*reinterpret_cast<const Generators::Model*>(model), *reinterpret_cast<const Generators::GeneratorParams*>(generator_params), span_prompts);
+  *out = reinterpret_cast<OgaSequences*>(std::make_unique<Generators::TokenSequences>(std::move(result)).release());
+  return nullptr;
+  OGA_CATCH
+}
+
 OgaResult* OgaCreateGenerator(const OgaModel* model, const OgaGeneratorParams* generator_params, OgaGenerator** out) {
   OGA_TRY
   *out = reinterpret_cast<OgaGenerator*>(CreateGenerator(*reinterpret_cast<const Generators::Model*>(model), *reinterpret_cast<const Generators::GeneratorParams*>(generator_params)).release());
@@ -285,10 +362,54 @@ OgaResult* OGA_API_CALL OgaGenerator_GenerateNextToken(OgaGenerator* generator)
   OGA_CATCH
 }
 
+OgaResult* OGA_API_CALL OgaGenerator_AppendTokens(OgaGenerator* generator, const int32_t* tokens, size_t token_count) {
+  OGA_TRY
+  reinterpret_cast<Generators::Generator*>(generator)->AppendTokens(std::span<const int32_t>(tokens, token_count));
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaGenerator_RewindTo(OgaGenerator* generator, size_t new_length) {
+  OGA_TRY
+  reinterpret_cast<Generators::Generator*>(generator)->RewindTo(new_length);
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaGenerator_SaveState(const OgaGenerator* generator, const char* path, bool kv_fp16) {
+  OGA_TRY
+  auto snapshot = reinterpret_cast<const Generators::Generator*>(generator)->SaveState(kv_fp16);
+  std::ofstream file = fs::path(path).open_for_write(std::ios::binary);
+  if (!file.is_open())
+    throw std::runtime_error("Error opening " + std::string(path) + " for writing");
+  if (!file.write(reinterpret_cast<const char*>(snapshot.data()), snapshot.size()))
+    throw std::runtime_error("Error writing " + std::string(path));
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaGenerator_LoadState(OgaGenerator* generator, const char* path) {
+  OGA_TRY
+  std::ifstream file = fs::path(path).open(std::ios::binary | std::ios::ate);
+  if (!file.is_open())
+    throw std::runtime_error("Error opening " + std::string(path));
+  std::streamsize const size = file.tellg();
+  file.seekg(0, std::ios::beg);
+
+  std::vector<uint8_t> snapshot(size);
+  if (!file.read(reinterpret_cast<char*>(snapshot.data()), size))
+    throw std::runtime_error("Error reading " + std::string(path));
+  reinterpret_cast<Generators::Generator*>(generator)->LoadState(std::span<const uint8_t>{snapshot.data(), snapshot.size()});
+  return nullptr;
+  OGA_CATCH
+}
+
 OgaResult* OGA_API_CALL OgaGenerator_GetOutput(const OgaGenerator* oga_generator, const char* name, OgaTensor** out) {
   OGA_TRY
   auto& generator = *reinterpret_cast<const Generators::Generator*>(oga_generator);
   auto* ortvalue_output = generator.state_->GetOutput(name);
+  if (!ortvalue_output)
+    throw std::runtime_error(std::string("Output not found: ") + name);
   auto type_info = ortvalue_output->GetTensorTypeAndShapeInfo();
   std::unique_ptr<OrtValue> ortvalue_clone = OrtValue::CreateTensor(generator.model_->allocator_cpu_,
                                                                     type_info->GetShape(),
@@ -339,6 +460,60 @@ const int32_t* OGA_API_CALL OgaGenerator_GetSequenceData(const OgaGenerator* oga
   return generator.GetSequence(static_cast<int>(index)).CpuSpan().data();
 }
 
+OgaResult* OGA_API_CALL OgaGenerator_GetNextTokens(const OgaGenerator* oga_generator, const int32_t** out, size_t* count) {
+  OGA_TRY
+  auto& generator = *reinterpret_cast<const Generators::Generator*>(oga_generator);
+  auto tokens = generator.GetNextTokens();
+  *out = tokens.data();
+  *count = tokens.size();
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaModelGetMetrics(const OgaModel* model, const char** out) {
+  OGA_TRY
+  auto& model_ref = *reinterpret_cast<const Generators::Model*>(model);
+  *out = Generators::CopyToOgaString(model_ref.metrics_->ToPrometheus("model", model_ref.Name()));
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaGenerator_GetMetrics(const OgaGenerator* generator, const char** out) {
+  OGA_TRY
+  auto& generator_ref = *reinterpret_cast<const Generators::Generator*>(generator);
+  *out = Generators::CopyToOgaString(generator_ref.metrics_.ToPrometheus("generator", generator_ref.model_->Name()));
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaModelGetPhaseLatency(const OgaModel* model, const char* phase, size_t* count, double* total_seconds, double* max_seconds) {
+  OGA_TRY
+  Generators::GetPhaseLatency(*reinterpret_cast<const Generators::Model*>(model)->metrics_, phase, count, total_seconds, max_seconds);
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaGenerator_GetPhaseLatency(const OgaGenerator* generator, const char* phase, size_t* count, double* total_seconds, double* max_seconds) {
+  OGA_TRY
+  Generators::GetPhaseLatency(reinterpret_cast<const Generators::Generator*>(generator)->metrics_, phase, count, total_seconds, max_seconds);
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaModelGetMemoryUsage(const OgaModel* model, const char* category, size_t* current_bytes, size_t* peak_bytes) {
+  OGA_TRY
+  Generators::GetMemoryUsage(*reinterpret_cast<const Generators::Model*>(model)->memory_usage_, category, current_bytes, peak_bytes);
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaGenerator_GetMemoryUsage(const OgaGenerator* generator, const char* category, size_t* current_bytes, size_t* peak_bytes) {
+  OGA_TRY
+  Generators::GetMemoryUsage(*reinterpret_cast<const Generators::Generator*>(generator)->memory_usage_, category, current_bytes, peak_bytes);
+  return nullptr;
+  OGA_CATCH
+}
+
 OgaResult* OGA_API_CALL OgaCreateTokenizer(const OgaModel* model, OgaTokenizer** out) {
   OGA_TRY
   auto tokenizer = reinterpret_cast<const Generators::Model*>(model)->CreateTokenizer();
@@ -523,6 +698,39 @@ OgaResult* OGA_API_CALL OgaProcessorProcessAudios(const OgaMultiModalProcessor*
   OGA_CATCH
 }
 
+OgaResult* OGA_API_CALL OgaCreateAudioStream(const OgaMultiModalProcessor* p, int64_t num_mels, int64_t window_frames, int64_t overlap_frames, OgaAudioStream** out) {
+  OGA_TRY
+  auto& processor = *reinterpret_cast<const Generators::MultiModalProcessor*>(p);
+
+  if (!processor.audio_processor_)
+    throw std::runtime_error("Audio processor not available for this model.");
+
+  *out = reinterpret_cast<OgaAudioStream*>(processor.audio_processor_->CreateStream(num_mels, window_frames, overlap_frames).release());
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaAudioStreamAppend(OgaAudioStream* p, const float* samples, size_t sample_count) {
+  OGA_TRY
+  reinterpret_cast<Generators::AudioStream*>(p)->Append(std::span<const float>(samples, sample_count));
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaAudioStreamFlush(OgaAudioStream* p) {
+  OGA_TRY
+  reinterpret_cast<Generators::AudioStream*>(p)->Flush();
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaAudioStreamNextWindow(OgaAudioStream* p, OgaNamedTensors** input_tensors) {
+  OGA_TRY
+  *input_tensors = reinterpret_cast<OgaNamedTensors*>(reinterpret_cast<Generators::AudioStream*>(p)->NextWindow().release());
+  return nullptr;
+  OGA_CATCH
+}
+
 OgaResult* OGA_API_CALL OgaCreateStringArray(OgaStringArray** out) {
   OGA_TRY
   *out = reinterpret_cast<OgaStringArray*>(std::make_unique<std::vector<std::string>>().release());
@@ -636,6 +844,10 @@ void OGA_API_CALL OgaDestroyAudios(OgaAudios* p) {
   delete reinterpret_cast<Generators::Audios*>(p);
 }
 
+void OGA_API_CALL OgaDestroyAudioStream(OgaAudioStream* p) {
+  delete reinterpret_cast<Generators::AudioStream*>(p);
+}
+
 void OGA_API_CALL OgaDestroyNamedTensors(OgaNamedTensors* p) {
   delete reinterpret_cast<Generators::NamedTensors*>(p);
 }
@@ -62,6 +62,7 @@ typedef struct OgaImages OgaImages;
 typedef struct OgaNamedTensors OgaNamedTensors;
 typedef struct OgaMultiModalProcessor OgaMultiModalProcessor;
 typedef struct OgaAudios OgaAudios;
+typedef struct OgaAudioStream OgaAudioStream;
 typedef struct OgaStringArray OgaStringArray;
 typedef struct OgaAdapters OgaAdapters;
 
@@ -82,6 +83,27 @@ OGA_EXPORT const char* OGA_API_CALL OgaResultGetError(const OgaResult* result);
 OGA_EXPORT OgaResult* OGA_API_CALL OgaSetLogBool(const char* name, bool value);
 OGA_EXPORT OgaResult* OGA_API_CALL OgaSetLogString(const char* name, const char* value);
 
+/*
+ * \brief Has every session share one onnxruntime intra-op thread pool instead of each creating its own, like setting
+ *        the ORTGENAI_GLOBAL_THREAD_POOL environment variable. The library's own CPU work uses the same thread budget.
+ * \param[in] thread_count The number of threads in the pool, 0 for onnxruntime's default of one per physical core.
+ * \return OgaResult containing the error message if a model was already created.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaSetGlobalThreadPool(int thread_count);
+
+/*
+ * \brief Starts recording a timeline of generation in the Chrome trace event format, viewable in chrome://tracing or
+ *        https://ui.perfetto.dev. Nothing is written until OgaFlushTrace is called.
+ * \param[in] path The trace file, replaced if it exists. nullptr or "" flushes and closes the current trace file.
+ * \return OgaResult containing the error message if the file could not be opened.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaSetTraceFile(const char* path);
+
+/*
+ * \brief Appends everything recorded since the previous flush to the trace file
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaFlushTrace();
+
 /*
  * \param[in] result OgaResult to be destroyed.
  */
@@ -206,6 +228,19 @@ OGA_EXPORT void OGA_API_CALL OgaDestroyModel(OgaModel* model);
  */
 OGA_EXPORT OgaResult* OGA_API_CALL OgaGenerate(const OgaModel* model, const OgaGeneratorParams* generator_params, OgaSequences** out);
 
+/*
+ * \brief Like OgaGenerate, but for a batch of prompts of different lengths, which are taken from 'prompts' instead of the
+ *        input ids of the generator params. Prompts of similar length are batched together so little compute is spent on
+ *        padding, and each of those batches stops as soon as all of its sequences are done.
+ * \param[in] model The model to use for generation.
+ * \param[in] generator_params The search options to use for generation.
+ * \param[in] prompts The prompts, one sequence per prompt.
+ * \param[out] out For every prompt in order, num_return_sequences sequences of the prompt followed by the generated tokens,
+ *             without padding. Must be freed with OgaDestroySequences.
+ * \return OgaResult containing the error message if the generation failed.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaGenerateRagged(const OgaModel* model, const OgaGeneratorParams* generator_params, const OgaSequences* prompts, OgaSequences** out);
+
 /*
  * \brief Creates a OgaGeneratorParams from the given model.
  * \param[in] model The model to use for generation.
@@ -257,6 +292,25 @@ OGA_EXPORT OgaResult* OGA_API_CALL OgaGeneratorParamsSetModelInput(OgaGeneratorP
 
 OGA_EXPORT OgaResult* OGA_API_CALL OgaGeneratorParamsSetWhisperInputFeatures(OgaGeneratorParams*, OgaTensor* tensor);
 
+/*
+ * \brief Adds a stop sequence of token ids. A sequence is done as soon as its generated tokens end with any of the stop
+ *        sequences, which stay in the output like EOS does. Not supported with beam search.
+ * \param[in] generator_params The generator params to add the stop sequence to.
+ * \param[in] tokens The token ids of the stop sequence.
+ * \param[in] token_count The number of token ids, must be greater than 0.
+ * \return OgaResult containing the error message if adding the stop sequence failed.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaGeneratorParamsAddStopTokenSequence(OgaGeneratorParams* generator_params, const int32_t* tokens, size_t token_count);
+
+/*
+ * \brief Adds a stop string. Like OgaGeneratorParamsAddStopTokenSequence, but matched on the detokenized output, so the
+ *        string doesn't have to start or end on a token boundary.
+ * \param[in] generator_params The generator params to add the stop string to.
+ * \param[in] stop_string The UTF-8 stop string, must not be empty.
+ * \return OgaResult containing the error message if adding the stop string failed.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaGeneratorParamsAddStopString(OgaGeneratorParams* generator_params, const char* stop_string);
+
 /*
  * \brief Creates a generator from the given model and generator params.
  * \param[in] model The model to use for generation.
@@ -287,6 +341,51 @@ OGA_EXPORT bool OGA_API_CALL OgaGenerator_IsDone(const OgaGenerator* generator);
 OGA_EXPORT OgaResult* OGA_API_CALL OgaGenerator_ComputeLogits(OgaGenerator* generator);
 OGA_EXPORT OgaResult* OGA_API_CALL OgaGenerator_GenerateNextToken(OgaGenerator* generator);
 
+/*
+ * \brief Continues the sequences with tokens that weren't generated, such as the next user turn of a chat. The next call to
+ *        OgaGenerator_ComputeLogits runs only these tokens through the model, on top of what it already processed.
+ *        Must be called after OgaGenerator_GenerateNextToken, and works whether or not the generator is done.
+ *        Supported for greedy search with decoder only models on CPU. Sequences that already finished continue as well,
+ *        with the pad tokens they got after finishing still in their context (they are not masked out).
+ * \param[in] generator The generator to append the tokens to.
+ * \param[in] tokens The tokens, the same number for every sequence: token_count / batch size tokens per sequence, in order.
+ * \param[in] token_count The total number of tokens.
+ * \return OgaResult containing the error message if the tokens could not be appended.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaGenerator_AppendTokens(OgaGenerator* generator, const int32_t* tokens, size_t token_count);
+
+/*
+ * \brief Rolls the sequences back to their first new_length tokens, without processing them again. Generation continues
+ *        from the last token that is kept, so the next OgaGenerator_ComputeLogits only processes that token.
+ *        Must be called after OgaGenerator_GenerateNextToken. Supported for greedy search with decoder only models on CPU.
+ *        Stop sequences that were partly generated within the kept tokens still match.
+ * \param[in] generator The generator to rewind.
+ * \param[in] new_length The sequence length to go back to, between 2 and the current sequence length.
+ * \return OgaResult containing the error message if the generator could not be rewound.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaGenerator_RewindTo(OgaGenerator* generator, size_t new_length);
+
+/*
+ * \brief Saves what the generator needs to continue later (sequences, KV cache and the other model inputs that carry
+ *        over between steps) to a file, so a session can be evicted from memory or moved to another process.
+ *        Must be called after OgaGenerator_GenerateNextToken. Supported for greedy search with decoder only models on CPU.
+ * \param[in] generator The generator to save.
+ * \param[in] path The file to write, it is replaced if it exists.
+ * \param[in] kv_fp16 Store an fp32 KV cache as fp16, which halves the file at some precision.
+ * \return OgaResult containing the error message if the state could not be saved.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaGenerator_SaveState(const OgaGenerator* generator, const char* path, bool kv_fp16);
+
+/*
+ * \brief Restores a file written by OgaGenerator_SaveState, the next OgaGenerator_ComputeLogits continues where the saved
+ *        generator left off without processing its sequences again.
+ * \param[in] generator A generator that hasn't run yet, created for the same model and batch size. Its input ids are replaced.
+ * \param[in] path The file to read.
+ * \return OgaResult containing the error message if the state could not be loaded, also when the file was saved by a
+ *         different model.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaGenerator_LoadState(OgaGenerator* generator, const char* path);
+
 /*
  * \brief Returns a copy of the model output identified by the given name as an OgaTensor on CPU. The buffer is owned by returned OgaTensor
  *       and will be released when the OgaTensor is destroyed
@@ -312,6 +411,49 @@ OGA_EXPORT size_t OGA_API_CALL OgaGenerator_GetSequenceCount(const OgaGenerator*
  */
 OGA_EXPORT const int32_t* OGA_API_CALL OgaGenerator_GetSequenceData(const OgaGenerator* generator, size_t index);
 
+/*
+ * \brief Returns the tokens the last call to OgaGenerator_GenerateNextToken generated, one per sequence (batch size * number
+ *        of beams). Lets streaming clients fetch only the new tokens instead of copying the whole sequences every step.
+ * \param[in] generator The generator to get the next tokens of.
+ * \param[out] out The tokens. Owned by the OgaGenerator and valid until the next call to OgaGenerator_GenerateNextToken or
+ *             OgaGenerator_GetNextTokens, or until the OgaGenerator is destroyed.
+ * \param[out] count The number of tokens in 'out'.
+ * \return OgaResult containing the error message if getting the tokens failed.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaGenerator_GetNextTokens(const OgaGenerator* generator, const int32_t** out, size_t* count);
+
+/*
+ * \brief Returns latency histograms of the phases of generation in the Prometheus text exposition format. The phases are
+ *        prefill, decode, state_run, kv_cache_update, logits_get, search_set_logits, select_top, sample_top_k, sample_top_p,
+ *        sample_top_k_top_p, tokenizer_encode, tokenizer_decode, tokenizer_stream_decode and session_load. Running the
+ *        tokens added by OgaGenerator_AppendTokens counts as a prefill. A model reports the totals over all of its
+ *        generators and tokenizers, a generator only its own.
+ * \param[out] out The metrics text. Must be freed with OgaDestroyString
+ * \return OgaResult containing the error message if getting the metrics failed.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaModelGetMetrics(const OgaModel* model, const char** out);
+OGA_EXPORT OgaResult* OGA_API_CALL OgaGenerator_GetMetrics(const OgaGenerator* generator, const char** out);
+
+/*
+ * \brief Returns how often a phase of generation ran, its total time and its longest single time.
+ * \param[in] phase One of the phase names listed for OgaModelGetMetrics
+ * \return OgaResult containing the error message if the phase name is unknown.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaModelGetPhaseLatency(const OgaModel* model, const char* phase, size_t* count, double* total_seconds, double* max_seconds);
+OGA_EXPORT OgaResult* OGA_API_CALL OgaGenerator_GetPhaseLatency(const OgaGenerator* generator, const char* phase, size_t* count, double* total_seconds, double* max_seconds);
+
+/*
+ * \brief Returns how many bytes of buffers a generator holds, and the most it has held at any time. A model reports the
+ *        sum over all of its live generators plus the static buffers of its captured graphs. Only buffers allocated by
+ *        genai itself are counted, not the model weights or onnxruntime's own memory.
+ * \param[in] category One of kv_cache, logits, sequences, search, static_buffers, or nullptr for the total over all of them
+ * \param[out] current_bytes The bytes held now
+ * \param[out] peak_bytes The most bytes held at any one time
+ * \return OgaResult containing the error message if the category is unknown.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaModelGetMemoryUsage(const OgaModel* model, const char* category, size_t* current_bytes, size_t* peak_bytes);
+OGA_EXPORT OgaResult* OGA_API_CALL OgaGenerator_GetMemoryUsage(const OgaGenerator* generator, const char* category, size_t* current_bytes, size_t* peak_bytes);
+
 OGA_EXPORT OgaResult* OGA_API_CALL OgaCreateTokenizer(const OgaModel* model, OgaTokenizer** out);
 OGA_EXPORT void OGA_API_CALL OgaDestroyTokenizer(OgaTokenizer*);
 
@@ -337,6 +479,20 @@ OGA_EXPORT OgaResult* OGA_API_CALL OgaProcessorProcessImages(const OgaMultiModal
 
 OGA_EXPORT OgaResult* OGA_API_CALL OgaProcessorProcessAudios(const OgaMultiModalProcessor*, const OgaAudios* audios, OgaNamedTensors** input_tensors);
 
+/* OgaAudioStream computes the log-mel of audio that arrives in chunks and cuts it into encoder windows.
+ * Samples are 16kHz mono PCM in [-1, 1]. Each window is num_mels x window_frames (100 frames per second, stock Whisper
+ * encoders take 80 or 128 mels and 3000 frames) and starts overlap_frames before the end of the previous one.
+ * Run one generator per window. To carry the decoder context across windows, start the next window's decoder prompt
+ * with <|startofprev|> and the tokens transcribed so far.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaCreateAudioStream(const OgaMultiModalProcessor*, int64_t num_mels, int64_t window_frames, int64_t overlap_frames, OgaAudioStream** out);
+OGA_EXPORT void OGA_API_CALL OgaDestroyAudioStream(OgaAudioStream*);
+OGA_EXPORT OgaResult* OGA_API_CALL OgaAudioStreamAppend(OgaAudioStream*, const float* samples, size_t sample_count);
+/* Ends the stream, the last window is padded with silence */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaAudioStreamFlush(OgaAudioStream*);
+/* Sets input_tensors to the next window's input_features, or to null if no window is complete yet */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaAudioStreamNextWindow(OgaAudioStream*, OgaNamedTensors** input_tensors);
+
 /* Decode a single token sequence and returns a null terminated utf8 string. out_string must be freed with OgaDestroyString
  */
 OGA_EXPORT OgaResult* OGA_API_CALL OgaTokenizerDecode(const OgaTokenizer*, const int32_t* tokens, size_t token_count, const char** out_string);
@@ -9,6 +9,7 @@
 #include "../search.h"
 #include "../models/model.h"
 #include "../logging.h"
+#include "../models/utils.h"
 
 using namespace pybind11::literals;
 
@@ -38,11 +39,6 @@ std::span<T> ToSpan(pybind11::array_t<T> v) {
     return {v.mutable_data(), static_cast<size_t>(v.size())};
 }
 
-template <typename T>
-pybind11::array_t<T> ToPython(std::span<T> v) {
-  return pybind11::array_t<T>{{v.size()}, {sizeof(T)}, v.data()};
-}
-
 ONNXTensorElementDataType ToTensorType(const pybind11::dtype& type) {
   switch (type.num()) {
     case pybind11::detail::npy_api::NPY_BOOL_:
@@ -129,6 +125,7 @@ std::unique_ptr<OrtValue> ToOrtValue(pybind11::array& v) {
   return OrtValue::CreateTensor(*p_memory_info, v.mutable_data(), v.nbytes(), shape, type);
 }
 
+// Copies the tensor into a new numpy array, from device memory too
 pybind11::array ToNumpy(OrtValue* v, const Generators::Model& model) {
   if (!v)
     return {};
@@ -203,23 +200,6 @@ struct PyRoamingArray : RoamingArray<T> {
   pybind11::array_t<T> py_cpu_array_;
 };
 
-template <typename T>
-struct PyDeviceMemorySpan {
-  void operator=(DeviceMemorySpan<T> span) {
-    span_ = std::move(span);
-  }
-
-  pybind11::array_t<T> GetNumpy() {
-    auto v = span_.CpuSpan();
-    py_cpu_array_ = pybind11::array_t<T>({v.size()}, {sizeof(T)}, v.data(), pybind11::capsule(v.data(), [](void*) {}));
-    return py_cpu_array_;
-  }
-
- private:
-  DeviceMemorySpan<T> span_;
-  pybind11::array_t<T> py_cpu_array_;
-};
-
 template <typename T>
 void Declare_DeviceArray(pybind11::module& m, const char* name) {
   using Type = PyRoamingArray<T>;
@@ -308,44 +288,117 @@ struct PyNamedTensors {
   std::unique_ptr<NamedTensors> named_tensors_;
 };
 
+// Phase name -> {count, total_seconds, max_seconds}, leaving out phases that never ran
+pybind11::dict MetricsToPython(const Metrics& metrics) {
+  pybind11::dict result;
+  for (size_t i = 0; i < static_cast<size_t>(Phase::Count); i++) {
+    auto& histogram = metrics[static_cast<Phase>(i)];
+    if (histogram.Count() == 0)
+      continue;
+    pybind11::dict entry;
+    entry["count"] = histogram.Count();
+    entry["total_seconds"] = histogram.TotalSeconds();
+    entry["max_seconds"] = histogram.MaxSeconds();
+    result[to_string(static_cast<Phase>(i))] = entry;
+  }
+  return result;
+}
+
+// Category name (and "total") -> {current_bytes, peak_bytes}
+pybind11::dict MemoryUsageToPython(const MemoryUsage& memory_usage) {
+  pybind11::dict result;
+  for (size_t i = 0; i < static_cast<size_t>(MemoryCategory::Count); i++) {
+    auto category = static_cast<MemoryCategory>(i);
+    pybind11::dict entry;
+    entry["current_bytes"] = memory_usage.CurrentBytes(category);
+    entry["peak_bytes"] = memory_usage.PeakBytes(category);
+    result[to_string(category)] = entry;
+  }
+  pybind11::dict total;
+  total["current_bytes"] = memory_usage.CurrentTotalBytes();
+  total["peak_bytes"] = memory_usage.PeakTotalBytes();
+  result["total"] = total;
+  return result;
+}
+
 struct PyGenerator {
   PyGenerator(Model& model, PyGeneratorParams& params) {
     params.Prepare();
+    pybind11::gil_scoped_release release;
     generator_ = CreateGenerator(model, params);
   }
 
+  // A copy, it's only batch sized and the search may replace the buffer behind it (load_state, device searches)
   pybind11::array_t<int32_t> GetNextTokens() {
-    py_tokens_.Assign(generator_->search_->GetNextTokens());
-    return ToPython(py_tokens_.GetCPU());
+    auto next_tokens = generator_->search_->GetNextTokens();
+    auto v = next_tokens.GetCPU();
+    return pybind11::array_t<int32_t>{v.size(), v.data()};
   }
 
   pybind11::array_t<int32_t> GetSequence(int index) {
-    py_sequence_ = generator_->search_->GetSequence(index);
-    return py_sequence_.GetNumpy();
+    auto sequence = generator_->search_->GetSequence(index);
+    auto v = sequence.CpuSpan();
+    return ToNumpyView(v, std::move(sequence));
   }
 
+  // Runs the model without holding the GIL, so other python threads (and their generators) can run meanwhile.
+  // A single Generator still must not be used from more than one thread at a time.
   void ComputeLogits() {
+    pybind11::gil_scoped_release release;
     generator_->ComputeLogits();
   }
 
+  // Outputs and logits are copied, the buffers behind them are freed or reallocated by later steps
   pybind11::array GetOutput(const std::string& name) {
     return ToNumpy(generator_->state_->GetOutput(name.c_str()), *(generator_->model_));
   }
 
   pybind11::array_t<float> GetLogits() {
-    py_logits_.Assign(generator_->search_->GetLogits());
-    return ToPython(py_logits_.GetCPU());
+    auto logits = generator_->search_->GetLogits();  // Owns the CPU copy of device logits
+    auto v = logits.GetCPU();
+    return pybind11::array_t<float>{v.size(), v.data()};
   }
 
   void SetLogits(pybind11::array_t<float> logits) {
+    // The logits cover the whole batch, even once finished rows stopped running through the model
+    auto& params = *generator_->search_->params_;
+    if (static_cast<size_t>(logits.size()) != static_cast<size_t>(params.BatchBeamSize()) * params.config.model.vocab_size)
+      throw std::runtime_error("set_logits expects logits of shape (batch_size * num_beams, vocab_size)");
     logits_ = logits;
     generator_->search_->SetLogits(cpu_span<float>{ToSpan(logits_)});
   }
 
   void GenerateNextToken() {
+    pybind11::gil_scoped_release release;
     generator_->GenerateNextToken();
   }
 
+  void AppendTokens(pybind11::array_t<int32_t> tokens) {
+    auto span = ToSpan(tokens);
+    pybind11::gil_scoped_release release;
+    generator_->AppendTokens(span);
+  }
+
+  void RewindTo(size_t new_length) {
+    pybind11::gil_scoped_release release;
+    generator_->RewindTo(new_length);
+  }
+
+  pybind11::bytes SaveState(bool kv_fp16) const {
+    std::vector<uint8_t> snapshot;
+    {
+      pybind11::gil_scoped_release release;
+      snapshot = generator_->SaveState(kv_fp16);
+    }
+    return pybind11::bytes(reinterpret_cast<const char*>(snapshot.data()), snapshot.size());
+  }
+
+  void LoadState(pybind11::bytes snapshot) {
+    std::string_view data = snapshot;
+    pybind11::gil_scoped_release release;
+    generator_->LoadState(std::span<const uint8_t>{reinterpret_cast<const uint8_t*>(data.data()), data.size()});
+  }
+
   bool IsDone() const {
     return generator_->IsDone();
   }
@@ -354,16 +407,57 @@ struct PyGenerator {
     generator_->state_->SetActiveAdapter(adapters, adapter_name);
   }
 
+  const Metrics& GetMetrics() const {
+    return generator_->metrics_;
+  }
+
+  const Model& GetModel() const {
+    return *generator_->model_;
+  }
+
+  const MemoryUsage& GetMemoryUsage() const {
+    return *generator_->memory_usage_;
+  }
+
  private:
+  // Read only numpy array aliasing v instead of copying it, so per step polling doesn't copy the whole sequence. Only used
+  // for buffers that stay allocated as long as the generator and owner do, which the array keeps alive. Like the native
+  // buffers, the contents are only current until the next generate_next_token.
+  template <typename T, typename Owner>
+  pybind11::array_t<T> ToNumpyView(std::span<T> v, Owner owner) {
+    struct KeepAlive {
+      Owner owner;
+      pybind11::object generator;
+    };
+    auto* keep_alive = new KeepAlive{std::move(owner), pybind11::cast(this, pybind11::return_value_policy::reference)};
+    pybind11::capsule base{keep_alive, [](void* p) { delete static_cast<KeepAlive*>(p); }};
+    pybind11::array_t<T> result{{v.size()}, {sizeof(T)}, v.data(), base};
+    result.attr("setflags")(pybind11::arg("write") = false);
+    return result;
+  }
+
   std::unique_ptr<Generator> generator_;
-  PyRoamingArray<int32_t> py_tokens_;
   PyRoamingArray<int32_t> py_indices_;
-  PyDeviceMemorySpan<int32_t> py_sequence_;
   PyRoamingArray<int32_t> py_sequencelengths_;
-  PyRoamingArray<float> py_logits_;
   pybind11::array_t<float> logits_;  // Logits passed in from python, to keep the memory alive
 };
 
+// Runs Generate for every entry of params on the library's thread pool, with the GIL released. Each generation already
+// runs its sessions on the model's intra-op threads, so only as many run at once as fit in the cores
+std::vector<TokenSequences> GenerateMany(Model& model, const std::vector<PyGeneratorParams*>& params) {
+  for (auto* p : params) {
+    if (!p)
+      throw std::runtime_error("generate_many: GeneratorParams can't be None");
+    p->Prepare();
+  }
+
+  std::vector<TokenSequences> results(params.size());
+  pybind11::gil_scoped_release release;
+  const size_t concurrency = std::max<size_t>(1, std::max(1U, std::thread::hardware_concurrency()) / std::max(1, model.intra_op_thread_count_));
+  GetOrtGlobals()->thread_pool_->Run(params.size(), concurrency, [&](size_t i) { results[i] = Generate(model, *params[i]); });
+  return results;
+}
+
 void SetLogOptions(const pybind11::kwargs& dict) {
   for (auto& entry : dict) {
     auto name = entry.first.cast<std::string>();
@@ -424,6 +518,16 @@ PYBIND11_MODULE(onnxruntime_genai, m) {
       })
       .def("set_model_input", &PyGeneratorParams::SetModelInput)
       .def("set_search_options", &PyGeneratorParams::SetSearchOptions)                                     // See config.h 'struct Search' for the options
+      .def("add_stop_token_sequence", [](PyGeneratorParams& generator_params, std::vector<int32_t> tokens) {
+        if (tokens.empty())
+          throw std::runtime_error("Stop sequences can't be empty");
+        generator_params.params_->stop_token_sequences.push_back(std::move(tokens));
+      })
+      .def("add_stop_string", [](PyGeneratorParams& generator_params, std::string stop_string) {
+        if (stop_string.empty())
+          throw std::runtime_error("Stop strings can't be empty");
+        generator_params.params_->stop_strings.push_back(std::move(stop_string));
+      })
       .def("try_use_cuda_graph_with_max_batch_size", &PyGeneratorParams::TryUseCudaGraphWithMaxBatchSize)  // will be deprecated
       .def("try_graph_capture_with_max_batch_size", &PyGeneratorParams::TryGraphCaptureWithMaxBatchSize);
 
@@ -432,33 +536,49 @@ PYBIND11_MODULE(onnxruntime_genai, m) {
 
   pybind11::class_<Tokenizer, std::shared_ptr<Tokenizer>>(m, "Tokenizer")
       .def(pybind11::init([](Model& model) { return model.CreateTokenizer(); }))
-      .def("encode", &Tokenizer::Encode)
+      .def("encode", &Tokenizer::Encode, pybind11::call_guard<pybind11::gil_scoped_release>())
       .def("to_token_id", &Tokenizer::TokenToTokenId)
       .def("decode", [](const Tokenizer& t, pybind11::array_t<int32_t> tokens) { return t.Decode(ToSpan(tokens)); })
       .def("encode_batch", [](const Tokenizer& t, std::vector<std::string> strings) {
-        auto result = t.EncodeBatch(strings);
+        std::vector<int32_t> result;
+        {
+          pybind11::gil_scoped_release release;
+          result = t.EncodeBatch(strings);
+        }
         return pybind11::array_t<int32_t>({strings.size(), result.size() / strings.size()}, result.data());
       })
       .def("decode_batch", [](const Tokenizer& t, pybind11::array_t<int32_t> tokens) {
-        if (tokens.ndim() == 1) {  // Just a 1D array
-          return t.DecodeBatch(ToSpan(tokens), 1);
-        } else {
-          if (tokens.ndim() != 2)
-            throw std::runtime_error("token shape can only be 1 or 2 dimensional");
-
-          return t.DecodeBatch(ToSpan(tokens), tokens.shape(0));
-        }
+        if (tokens.ndim() != 1 && tokens.ndim() != 2)
+          throw std::runtime_error("token shape can only be 1 or 2 dimensional");
+        const size_t count = tokens.ndim() == 1 ? 1 : tokens.shape(0);  // 1D is just one sequence
+        auto span = ToSpan(tokens);
+        pybind11::gil_scoped_release release;
+        return t.DecodeBatch(span, count);
       })
       .def("create_stream", [](const Tokenizer& t) { return t.CreateStream(); });
 
   pybind11::class_<Model, std::shared_ptr<Model>>(m, "Model")
       .def(pybind11::init([](const std::string& config_path) {
+        pybind11::gil_scoped_release release;
         return CreateModel(GetOrtEnv(), config_path.c_str());
       }))
-      .def("generate", [](Model& model, PyGeneratorParams& params) { params.Prepare(); return Generate(model, params); })
+      .def("generate", [](Model& model, PyGeneratorParams& params) {
+        params.Prepare();
+        pybind11::gil_scoped_release release;
+        return Generate(model, params);
+      })
+      .def("generate_many", &GenerateMany)
+      .def("generate_ragged", [](Model& model, PyGeneratorParams& params, const std::vector<std::vector<int32_t>>& prompts) {
+        std::vector<std::span<const int32_t>> span_prompts(prompts.begin(), prompts.end());
+        pybind11::gil_scoped_release release;
+        return GenerateRagged(model, params, span_prompts);
+      })
       .def_property_readonly(
           "device_type", [](const Model& model) { return to_string(model.device_type_); }, "The device type the model is running on")
-      .def("create_multimodal_processor", [](const Model& model) { return model.CreateMultiModalProcessor(); });
+      .def("create_multimodal_processor", [](const Model& model) { return model.CreateMultiModalProcessor(); })
+      .def("get_metrics", [](const Model& model) { return MetricsToPython(*model.metrics_); })
+      .def("get_metrics_prometheus", [](const Model& model) { return model.metrics_->ToPrometheus("model", model.Name()); })
+      .def("get_memory_usage", [](const Model& model) { return MemoryUsageToPython(*model.memory_usage_); });
 
   pybind11::class_<PyGenerator>(m, "Generator")
       .def(pybind11::init<Model&, PyGeneratorParams&>())
@@ -468,11 +588,18 @@ PYBIND11_MODULE(onnxruntime_genai, m) {
       .def("get_logits", &PyGenerator::GetLogits)
       .def("set_logits", &PyGenerator::SetLogits)
       .def("generate_next_token", &PyGenerator::GenerateNextToken)
+      .def("append_tokens", &PyGenerator::AppendTokens)
+      .def("rewind_to", &PyGenerator::RewindTo)
+      .def("save_state", &PyGenerator::SaveState, pybind11::arg("kv_fp16") = false)
+      .def("load_state", &PyGenerator::LoadState)
       .def("get_next_tokens", &PyGenerator::GetNextTokens)
       .def("get_sequence", &PyGenerator::GetSequence)
       .def("set_active_adapter", [](PyGenerator& generator, Adapters* adapters, const std::string& adapter_name) {
         generator.SetActiveAdapter(adapters, adapter_name);
-      });
+      })
+      .def("get_metrics", [](const PyGenerator& generator) { return MetricsToPython(generator.GetMetrics()); })
+      .def("get_metrics_prometheus", [](const PyGenerator& generator) { return generator.GetMetrics().ToPrometheus("generator", generator.GetModel().Name()); })
+      .def("get_memory_usage", [](const PyGenerator& generator) { return MemoryUsageToPython(generator.GetMemoryUsage()); });
 
   pybind11::class_<Images>(m, "Images")
       .def_static("open", [](pybind11::args image_paths) {
@@ -527,6 +654,20 @@ PYBIND11_MODULE(onnxruntime_genai, m) {
 
   pybind11::class_<PyNamedTensors>(m, "NamedTensors");
 
+  pybind11::class_<AudioStream>(m, "AudioStream")
+      .def("append", [](AudioStream& stream, pybind11::array_t<float, pybind11::array::c_style | pybind11::array::forcecast> samples) {
+        pybind11::gil_scoped_release release;
+        stream.Append(std::span<const float>(samples.data(), samples.size()));
+      })
+      .def("flush", &AudioStream::Flush)
+      .def("next_window", [](AudioStream& stream) -> std::unique_ptr<PyNamedTensors> {
+        auto window = stream.NextWindow();
+        if (!window)
+          return nullptr;
+        return std::make_unique<PyNamedTensors>(std::move(window));
+      })
+      .def_property_readonly("next_window_start", &AudioStream::NextWindowStart);
+
   pybind11::class_<MultiModalProcessor, std::shared_ptr<MultiModalProcessor>>(m, "MultiModalProcessor")
       .def(
           "__call__", [](MultiModalProcessor& processor, const std::optional<std::string>& prompt, const pybind11::kwargs& kwargs) -> std::unique_ptr<PyNamedTensors> {
@@ -549,6 +690,30 @@ PYBIND11_MODULE(onnxruntime_genai, m) {
             }
           },
           pybind11::arg("prompt") = pybind11::none())
+      .def(
+          "process_audio_batches", [](MultiModalProcessor& processor, const Audios* audios, size_t max_batch_size) {
+            if (processor.audio_processor_ == nullptr) {
+              throw std::runtime_error("Audio processor is not available for this model.");
+            }
+            std::vector<AudioBatch> batches;
+            {
+              pybind11::gil_scoped_release release;
+              batches = processor.audio_processor_->ProcessBatches(audios, max_batch_size);
+            }
+            pybind11::list result;
+            for (auto& batch : batches)
+              result.append(pybind11::make_tuple(batch.clip_indices, std::make_unique<PyNamedTensors>(std::move(batch.inputs))));
+            return result;
+          },
+          pybind11::arg("audios"), pybind11::arg("max_batch_size"))
+      .def(
+          "create_audio_stream", [](MultiModalProcessor& processor, int64_t num_mels, int64_t window_frames, int64_t overlap_frames) {
+            if (processor.audio_processor_ == nullptr) {
+              throw std::runtime_error("Audio processor is not available for this model.");
+            }
+            return processor.audio_processor_->CreateStream(num_mels, window_frames, overlap_frames);
+          },
+          pybind11::arg("num_mels") = 80, pybind11::arg("window_frames") = 3000, pybind11::arg("overlap_frames") = 0)
       .def("create_stream", [](MultiModalProcessor& processor) { return processor.tokenizer_->CreateStream(); })
       .def("decode", [](MultiModalProcessor& processor, pybind11::array_t<int32_t> tokens) {
         return processor.tokenizer_->Decode(ToSpan(tokens));
@@ -561,6 +726,10 @@ PYBIND11_MODULE(onnxruntime_genai, m) {
       .def("load", &Adapters::LoadAdapter);
 
   m.def("set_log_options", &SetLogOptions);
+  m.def("set_global_thread_pool", &SetGlobalThreadPool, "Share one intra-op thread pool across all sessions, call before loading a model",
+        pybind11::arg("thread_count") = 0);
+  m.def("set_trace_file", [](const std::string& path) { SetTraceFile(path); });
+  m.def("flush_trace", &FlushTrace);
 
   m.def("is_cuda_available", []() { return USE_CUDA != 0; });
   m.def("is_dml_available", []() { return USE_DML != 0; });
@@ -2,16 +2,143 @@
 #include "softmax.h"
 #include "search.h"
 #include "beam_search_scorer.h"
+#include "models/utils.h"
 #include <queue>
 #include <algorithm>
+#include <numeric>
 
 namespace Generators {
 
+namespace {
+
+// The CPU search can score logits in the type the model produced them. These describe how to compare and upcast each
+// element type. Key() orders raw values without converting them, so only the candidates that are kept get upcast.
+struct Fp32Scores {
+  static float ToFloat(float v) { return v; }
+  static float FromFloat(float v) { return v; }
+  static float Key(float v) { return v; }
+  static float Lowest() { return std::numeric_limits<float>::lowest(); }
+};
+
+// fp16 and bf16 are sign-magnitude, so flipping every bit of negative values and setting the sign bit of positive ones
+// gives integers that sort in the same order as the values they encode
+uint16_t OrderKey16(uint16_t v) {
+  return (v & 0x8000) ? static_cast<uint16_t>(~v) : static_cast<uint16_t>(v | 0x8000);
+}
+
+struct Fp16Scores {
+  // Masked logits are -inf, which FastFloat16ToFloat32 turns into -65536, so Inf and NaN take the exact conversion
+  static float ToFloat(uint16_t v) { return (v & 0x7C00) == 0x7C00 ? Float16ToFloat32(v) : FastFloat16ToFloat32(v); }
+  static uint16_t FromFloat(float v) { return FastFloat32ToFloat16(v); }
+  static uint16_t Key(uint16_t v) { return OrderKey16(v); }
+  static uint16_t Lowest() { return 0xFBFF; }  // -65504
+};
+
+struct Bf16Scores {
+  static float ToFloat(uint16_t v) { return BFloat16ToFloat32(v); }
+  static uint16_t FromFloat(float v) { return Float32ToBFloat16(v); }
+  static uint16_t Key(uint16_t v) { return OrderKey16(v); }
+  static uint16_t Lowest() { return 0xFF7F; }  // -3.39e38
+};
+
+template <typename Traits, typename T>
+int32_t ArgMax(std::span<T> scores) {
+  size_t best = 0;
+  auto best_key = Traits::Key(scores[0]);
+  for (size_t i = 1; i < scores.size(); i++) {
+    auto key = Traits::Key(scores[i]);
+    if (key > best_key) {
+      best = i;
+      best_key = key;
+    }
+  }
+  return static_cast<int32_t>(best);
+}
+
+// Returns the indices of all scores with the highest k of them sorted to the front in descending order
+template <typename Traits, typename T>
+std::vector<int32_t> SortedIndices(std::span<T> scores, size_t k) {
+  std::vector<int32_t> indices(scores.size());
+  std::iota(indices.begin(), indices.end(), 0);
+  auto greater = [scores](int32_t i, int32_t j) { return Traits::Key(scores[i]) > Traits::Key(scores[j]); };
+  if (k < indices.size())
+    std::partial_sort(indices.begin(), indices.begin() + k, indices.end(), greater);
+  else
+    std::sort(indices.begin(), indices.end(), greater);
+  return indices;
+}
+
+// Softmax denominator over a whole row, computed on the fly so 16-bit rows never need an fp32 copy
+template <typename Traits, typename T>
+float ExpSum(std::span<T> scores, float max_score, float temperature) {
+  float exp_sum = 0.0f;
+  for (auto score : scores)
+    exp_sum += std::exp((Traits::ToFloat(score) - max_score) / temperature);
+  return exp_sum;
+}
+
+}  // namespace
+
+template <typename Fn>
+void Search_Cpu::VisitScores(Fn&& fn) {
+  switch (next_token_scores_type_) {
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16:
+      fn(Fp16Scores{}, next_token_scores_16_);
+      break;
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_BFLOAT16:
+      fn(Bf16Scores{}, next_token_scores_16_);
+      break;
+    default:
+      fn(Fp32Scores{}, next_token_scores_);
+      break;
+  }
+}
+
+void Search_Cpu::MaterializeScores() const {
+  if (next_token_scores_type_ != ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT) {
+    converted_scores_.resize(next_token_scores_16_.size());
+    next_token_scores_ = cpu_span<float>{converted_scores_.data(), converted_scores_.size()};
+    if (next_token_scores_type_ == ONNX_TENSOR_ELEMENT_DATA_TYPE_BFLOAT16)
+      ConvertBFloat16ToFloat32(next_token_scores_16_, next_token_scores_);
+    else
+      ConvertFloat16ToFloat32(next_token_scores_16_, next_token_scores_);
+
+    next_token_scores_16_ = {};
+    next_token_scores_type_ = ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT;
+  }
+
+  const size_t vocab_size = params_->config.model.vocab_size;
+  if (softmax_temperature_) {
+    // Sampling used to turn the scores into probabilities in place, GetLogits still returns those after a sampling step
+    for (size_t row = 0; row < next_token_scores_.size() / vocab_size; row++)
+      SoftMax(next_token_scores_.subspan(row * vocab_size, vocab_size), *softmax_temperature_);
+    softmax_temperature_.reset();
+  }
+
+  if (scores_compacted_) {
+    expanded_scores_.resize(params_->BatchBeamSize() * vocab_size);
+    cpu_span<float> scores{expanded_scores_.data(), expanded_scores_.size()};
+    for (int i = 0; i < params_->BatchBeamSize(); i++) {
+      auto target = scores.subspan(i * vocab_size, vocab_size);
+      if (score_rows_[i] < 0)
+        std::fill(target.begin(), target.end(), std::numeric_limits<float>::lowest());
+      else
+        copy(std::span<const float>{next_token_scores_.subspan(score_rows_[i] * vocab_size, vocab_size)}, target);
+    }
+    next_token_scores_ = scores;
+    scores_compacted_ = false;
+  }
+
+  // The buffers are kept between steps, so only their first use allocates
+  next_token_scores_memory_.Set((converted_scores_.capacity() + expanded_scores_.capacity()) * sizeof(float));
+}
+
 Search_Cpu::Search_Cpu(const GeneratorParams& params)
     : Search{params},
       sequences_{params.input_ids, params.batch_size, params.search.num_beams, params_->search.max_length} {
   auto batch_beam_size = params.BatchBeamSize();
   sequence_lengths_buffer_ = AllocateArray<int32_t>(batch_beam_size, &sequence_lengths_);
+  memory_.Set(sequence_lengths_.size_bytes());
 }
 
 GreedySearch_Cpu::GreedySearch_Cpu(const GeneratorParams& params)
@@ -31,6 +158,8 @@ GreedySearch_Cpu::GreedySearch_Cpu(const GeneratorParams& params)
 
   eos_seen_buffer_ = AllocateArray<bool>(params.batch_size, &eos_seen_);
   memset(eos_seen_.data(), 0, eos_seen_.size_bytes());
+  finish_lengths_.resize(params.batch_size);
+  UpdateMemoryUsage();
 }
 
 BeamSearch_Cpu::BeamSearch_Cpu(const GeneratorParams& params)
@@ -42,17 +171,80 @@ BeamSearch_Cpu::BeamSearch_Cpu(const GeneratorParams& params)
 BeamSearch_Cpu::~BeamSearch_Cpu() = default;
 
 RoamingArray<float> Search_Cpu::GetLogits() const {
+  MaterializeScores();
   return next_token_scores_;
 }
 
 void Search_Cpu::SetLogits(RoamingArray<float> logits_unk) {
   next_token_scores_ = logits_unk.GetCPU();
+  next_token_scores_16_ = {};
+  next_token_scores_type_ = ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT;
+  scores_compacted_ = false;
+  softmax_temperature_.reset();
+}
+
+void Search_Cpu::SetLiveLogits(RoamingArray<float> logits) {
+  SetLogits(logits);
+  scores_compacted_ = !live_batch_ids_.empty();
+}
+
+void Search_Cpu::SetLogits16(cpu_span<uint16_t> logits, ONNXTensorElementDataType type) {
+  if (type != ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16 && type != ONNX_TENSOR_ELEMENT_DATA_TYPE_BFLOAT16)
+    throw std::runtime_error("SetLogits16 expects float16 or bfloat16 logits. Actual: " + std::to_string(type));
+
+  next_token_scores_16_ = logits;
+  next_token_scores_type_ = type;
+  next_token_scores_ = {};
+  scores_compacted_ = !live_batch_ids_.empty();
+  softmax_temperature_.reset();
 }
 
 RoamingArray<int32_t> GreedySearch_Cpu::GetNextTokens() {
   return next_tokens_;
 }
 
+bool GreedySearch_Cpu::RemoveFinishedRows(std::vector<int32_t>& rows_to_keep) {
+  const int row_count = live_batch_ids_.empty() ? params_->batch_size : static_cast<int>(live_batch_ids_.size());
+  if (done_ || not_done_count_ == row_count)
+    return false;
+
+  if (live_batch_ids_.empty()) {
+    live_batch_ids_.resize(params_->batch_size);
+    std::iota(live_batch_ids_.begin(), live_batch_ids_.end(), 0);
+    score_rows_.resize(params_->batch_size);
+  }
+
+  // Finished rows only ever get the pad token, which PadIfAlreadyEOS handles without looking at their scores
+  rows_to_keep.clear();
+  std::vector<int32_t> live_batch_ids;
+  for (int row = 0; row < row_count; row++) {
+    const int32_t batch_id = live_batch_ids_[row];
+    if (eos_seen_[batch_id]) {
+      score_rows_[batch_id] = -1;
+      continue;
+    }
+    score_rows_[batch_id] = static_cast<int32_t>(rows_to_keep.size());
+    rows_to_keep.push_back(row);
+    live_batch_ids.push_back(batch_id);
+  }
+  live_batch_ids_ = std::move(live_batch_ids);
+  live_next_tokens_.resize(live_batch_ids_.size());
+  UpdateMemoryUsage();
+
+  if (g_log.enabled && g_log.hit_eos)
+    Log("hit_eos", "Dropped finished rows, " + std::to_string(live_batch_ids_.size()) + " of " + std::to_string(params_->batch_size) + " still generating");
+  return true;
+}
+
+RoamingArray<int32_t> GreedySearch_Cpu::GetLiveNextTokens() {
+  if (live_batch_ids_.empty())
+    return next_tokens_;
+
+  for (size_t row = 0; row < live_batch_ids_.size(); row++)
+    live_next_tokens_[row] = next_tokens_[live_batch_ids_[row]];
+  return cpu_span<int32_t>{live_next_tokens_.data(), live_next_tokens_.size()};
+}
+
 RoamingArray<int32_t> BeamSearch_Cpu::GetNextTokens() {
   return beam_scorer_->GetNextTokens();
 }
@@ -66,6 +258,8 @@ int Search_Cpu::GetSequenceLength() const {
 }
 
 void BeamSearch_Cpu::SelectTop() {
+  MaterializeScores();
+
   // Normalize next token scores
   for (int i = 0; i < params_->BatchBeamSize(); i++) {
     std::span<float> const scores = next_token_scores_.subspan(static_cast<size_t>(i) * static_cast<size_t>(params_->config.model.vocab_size), params_->config.model.vocab_size);
@@ -137,90 +331,119 @@ void BeamSearch_Cpu::SelectTop() {
 }
 
 void GreedySearch_Cpu::SelectTop() {
-  // next_tokens = torch.argmax(scores, dim=-1)
-  for (size_t batch_id = 0; batch_id < params_->batch_size; batch_id++) {
-    if (PadIfAlreadyEOS(batch_id)) {
-      continue;
-    }
+  VisitScores([&](auto traits, auto next_token_scores) {
+    using Traits = decltype(traits);
 
-    std::span<float> const scores = next_token_scores_.subspan(batch_id * params_->config.model.vocab_size, params_->config.model.vocab_size);
-    auto const token = static_cast<int32_t>(std::distance(scores.begin(), std::max_element(scores.begin(), scores.end())));
-    SetNextToken(batch_id, token);
-  }
+    // next_tokens = torch.argmax(scores, dim=-1)
+    for (size_t batch_id = 0; batch_id < params_->batch_size; batch_id++) {
+      if (PadIfAlreadyEOS(batch_id)) {
+        continue;
+      }
+
+      auto const scores = next_token_scores.subspan(ScoreRow(static_cast<int>(batch_id)) * params_->config.model.vocab_size, params_->config.model.vocab_size);
+      SetNextToken(batch_id, ArgMax<Traits>(scores));
+    }
+  });
 
   AppendNextTokensToSequences();
 }
 
 void GreedySearch_Cpu::SampleTopK(int k, float temperature) {
-  for (size_t batch_id = 0; batch_id < params_->batch_size; batch_id++) {
-    std::span<float> const scores = next_token_scores_.subspan(batch_id * params_->config.model.vocab_size, params_->config.model.vocab_size);
-    SoftMax(scores, temperature);
-    // Find the top K scores
-    std::vector<int> indices(scores.size());
-    std::iota(indices.begin(), indices.end(), 0);
-    std::partial_sort(indices.begin(), indices.begin() + k, indices.end(), [scores = scores.data()](int i, int j) { return scores[i] > scores[j]; });
-    // Sample a token from the top K
-    std::discrete_distribution<> dis(scores.begin(), scores.begin() + k);
-    SetNextToken(batch_id, indices[dis(gen_)]);
-  }
+  VisitScores([&](auto traits, auto next_token_scores) {
+    using Traits = decltype(traits);
+
+    for (size_t batch_id = 0; batch_id < params_->batch_size; batch_id++) {
+      if (PadIfAlreadyEOS(batch_id)) {
+        continue;
+      }
+
+      auto const scores = next_token_scores.subspan(ScoreRow(static_cast<int>(batch_id)) * params_->config.model.vocab_size, params_->config.model.vocab_size);
+      const size_t top_k = std::min<size_t>(k, scores.size());
+      // Find the top K scores
+      auto indices = SortedIndices<Traits>(scores, top_k);
+      // Only the top K are upcast. The softmax normalization cancels out, so their relative weights are all that's needed
+      const float max_score = Traits::ToFloat(scores[indices[0]]);
+      std::vector<float> weights(top_k);
+      for (size_t i = 0; i < top_k; i++)
+        weights[i] = std::exp((Traits::ToFloat(scores[indices[i]]) - max_score) / temperature);
+      // Sample a token from the top K
+      std::discrete_distribution<> dis(weights.begin(), weights.end());
+      SetNextToken(batch_id, indices[dis(gen_)]);
+    }
+  });
+
+  softmax_temperature_ = temperature;
   AppendNextTokensToSequences();
 }
 
 void GreedySearch_Cpu::SampleTopP(float p, float temperature) {
   std::uniform_real_distribution<float> dis(0, p);
-  for (size_t batch_id = 0; batch_id < params_->batch_size; batch_id++) {
-    if (PadIfAlreadyEOS(batch_id)) {
-      continue;
-    }
-    std::span<float> const scores = next_token_scores_.subspan(batch_id * params_->config.model.vocab_size, params_->config.model.vocab_size);
-    SoftMax(scores, temperature);
-    // Sort an array of indices into the scores
-    std::vector<int32_t> indices(scores.size());
-    std::iota(indices.begin(), indices.end(), 0);
-    std::sort(indices.begin(), indices.end(), [scores = scores.data()](int32_t i, int32_t j) { return scores[i] > scores[j]; });
-    // Sample a probability threshold
-    float threshold = dis(gen_);
-    int32_t token = 0;
-    // Find the first token where the cumulative probability exceeds the threshold
-    for (int i = 0; i < scores.size(); i++) {
-      threshold -= scores[indices[i]];
-      if (threshold > 0) {
+  VisitScores([&](auto traits, auto next_token_scores) {
+    using Traits = decltype(traits);
+
+    for (size_t batch_id = 0; batch_id < params_->batch_size; batch_id++) {
+      if (PadIfAlreadyEOS(batch_id)) {
         continue;
       }
-      token = indices[i];
-      break;
+
+      auto const scores = next_token_scores.subspan(ScoreRow(static_cast<int>(batch_id)) * params_->config.model.vocab_size, params_->config.model.vocab_size);
+      // Sort an array of indices into the scores
+      auto indices = SortedIndices<Traits>(scores, scores.size());
+      const float max_score = Traits::ToFloat(scores[indices[0]]);
+      const float exp_sum = ExpSum<Traits>(scores, max_score, temperature);
+      // Sample a probability threshold
+      float threshold = dis(gen_);
+      int32_t token = 0;
+      // Find the first token where the cumulative probability exceeds the threshold
+      for (size_t i = 0; i < indices.size(); i++) {
+        threshold -= std::exp((Traits::ToFloat(scores[indices[i]]) - max_score) / temperature) / exp_sum;
+        if (threshold > 0) {
+          continue;
+        }
+        token = indices[i];
+        break;
+      }
+      SetNextToken(batch_id, token);
     }
-    SetNextToken(batch_id, token);
-  }
+  });
+
+  softmax_temperature_ = temperature;
   AppendNextTokensToSequences();
 }
 
 void GreedySearch_Cpu::SampleTopKTopP(int k, float p, float temperature) {
   std::uniform_real_distribution<float> dis(0, p);
-  for (size_t batch_id = 0; batch_id < params_->batch_size; batch_id++) {
-    if (PadIfAlreadyEOS(batch_id)) {
-      continue;
-    }
-    std::span<float> const scores = next_token_scores_.subspan(batch_id * params_->config.model.vocab_size, params_->config.model.vocab_size);
-    SoftMax(scores, temperature);
-    // Find the top K scores
-    std::vector<int> indices(scores.size());
-    std::iota(indices.begin(), indices.end(), 0);
-    std::partial_sort(indices.begin(), indices.begin() + k, indices.end(), [scores = scores.data()](int i, int j) { return scores[i] > scores[j]; });
-    // Sample a probability threshold
-    float threshold = dis(gen_);
-    int32_t token = indices[k - 1];
-    // Find the first token where the cumulative probability exceeds the threshold
-    for (int i = 0; i < k; i++) {
-      threshold -= scores[indices[i]];
-      if (threshold > 0) {
+  VisitScores([&](auto traits, auto next_token_scores) {
+    using Traits = decltype(traits);
+
+    for (size_t batch_id = 0; batch_id < params_->batch_size; batch_id++) {
+      if (PadIfAlreadyEOS(batch_id)) {
         continue;
       }
-      token = indices[i];
-      break;
+
+      auto const scores = next_token_scores.subspan(ScoreRow(static_cast<int>(batch_id)) * params_->config.model.vocab_size, params_->config.model.vocab_size);
+      const size_t top_k = std::min<size_t>(k, scores.size());
+      // Find the top K scores
+      auto indices = SortedIndices<Traits>(scores, top_k);
+      const float max_score = Traits::ToFloat(scores[indices[0]]);
+      const float exp_sum = ExpSum<Traits>(scores, max_score, temperature);
+      // Sample a probability threshold
+      float threshold = dis(gen_);
+      int32_t token = indices[top_k - 1];
+      // Find the first token where the cumulative probability exceeds the threshold
+      for (size_t i = 0; i < top_k; i++) {
+        threshold -= std::exp((Traits::ToFloat(scores[indices[i]]) - max_score) / temperature) / exp_sum;
+        if (threshold > 0) {
+          continue;
+        }
+        token = indices[i];
+        break;
+      }
+      SetNextToken(batch_id, token);
     }
-    SetNextToken(batch_id, token);
-  }
+  });
+
+  softmax_temperature_ = temperature;
   AppendNextTokensToSequences();
 }
 
@@ -237,13 +460,81 @@ bool GreedySearch_Cpu::PadIfAlreadyEOS(size_t batch_id) {
 void GreedySearch_Cpu::SetNextToken(size_t batch_id, int32_t token) {
   next_tokens_[batch_id] = token;
   if (token == params_->config.model.eos_token_id) {
-    eos_seen_[batch_id] = true;
     if (g_log.enabled && g_log.hit_eos)
       Log("hit_eos", "EOS seen on batch " + std::to_string(batch_id));
-    if (--not_done_count_ == 0) {
-      done_ = true;
+    FinishRowAt(batch_id, sequences_.GetSequenceLength() + 1);  // The token is appended after this
+  }
+}
+
+void GreedySearch_Cpu::AppendTokens(std::span<const int32_t> tokens) {
+  if (!live_batch_ids_.empty())
+    throw std::runtime_error("AppendTokens can't be used once the drop_finished_rows search option dropped finished sequences from the batch");
+
+  sequences_.AppendTokens(tokens);
+
+  // Every sequence continues after the appended tokens, including the ones that had seen EOS
+  memset(eos_seen_.data(), 0, eos_seen_.size_bytes());
+  std::fill(finish_lengths_.begin(), finish_lengths_.end(), 0);
+  not_done_count_ = params_->batch_size;
+  done_ = sequences_.GetSequenceLength() == params_->search.max_length;
+}
+
+void GreedySearch_Cpu::RewindTo(size_t new_length) {
+  if (!live_batch_ids_.empty())
+    throw std::runtime_error("RewindTo can't be used once the drop_finished_rows search option dropped finished sequences from the batch");
+
+  sequences_.RewindTo(static_cast<int>(new_length));
+
+  // Entries that finished within the kept tokens stay finished, the rest generate again from their last kept token
+  not_done_count_ = 0;
+  for (size_t batch_id = 0; batch_id < params_->batch_size; batch_id++) {
+    next_tokens_[batch_id] = sequences_.GetSequence(batch_id).CpuSpan()[new_length - 1];
+    eos_seen_[batch_id] = finish_lengths_[batch_id] != 0 && finish_lengths_[batch_id] <= static_cast<int>(new_length);
+    if (!eos_seen_[batch_id]) {
+      finish_lengths_[batch_id] = 0;
+      not_done_count_++;
     }
   }
+  done_ = not_done_count_ == 0;
+}
+
+void GreedySearch_Cpu::SaveState(SnapshotWriter& writer) {
+  if (!live_batch_ids_.empty())
+    throw std::runtime_error("SaveState can't be used once the drop_finished_rows search option dropped finished sequences from the batch");
+
+  sequences_.Save(writer);
+  writer.WriteSpan(std::span<const int>{finish_lengths_.data(), finish_lengths_.size()});
+}
+
+void GreedySearch_Cpu::LoadState(SnapshotReader& reader) {
+  sequences_.Load(reader);
+  auto finish_lengths = reader.ReadVector<int>();
+  if (finish_lengths.size() != finish_lengths_.size())
+    throw std::runtime_error("Generator snapshot doesn't match the batch size");
+  finish_lengths_ = std::move(finish_lengths);
+
+  // Same as rewinding to the saved length: the last token is pending and finished entries stay finished
+  RewindTo(sequences_.GetSequenceLength());
+}
+
+void GreedySearch_Cpu::UpdateMemoryUsage() {
+  memory_.Set(sequence_lengths_.size_bytes() + next_tokens_.size_bytes() + eos_seen_.size_bytes() +
+              (finish_lengths_.capacity() + live_batch_ids_.capacity() + score_rows_.capacity() + live_next_tokens_.capacity()) * sizeof(int32_t));
+}
+
+void GreedySearch_Cpu::FinishRow(size_t batch_id) {
+  // Stop sequences are checked after their last token was appended
+  FinishRowAt(batch_id, sequences_.GetSequenceLength());
+}
+
+void GreedySearch_Cpu::FinishRowAt(size_t batch_id, int sequence_length) {
+  if (eos_seen_[batch_id])
+    return;
+  eos_seen_[batch_id] = true;
+  finish_lengths_[batch_id] = sequence_length;
+  if (--not_done_count_ == 0) {
+    done_ = true;
+  }
 }
 
 void GreedySearch_Cpu::AppendNextTokensToSequences() {
@@ -296,6 +587,7 @@ DeviceMemorySpan<int32_t> BeamSearch_Cpu::GetSequence(size_t batch_id, size_t be
 }
 
 std::span<float> Search_Cpu::GetScores(int batch_beam_index) const {
+  MaterializeScores();
   assert(batch_beam_index >= 0 && batch_beam_index < params_->BatchBeamSize());
   return next_token_scores_.subspan(static_cast<size_t>(batch_beam_index) * params_->config.model.vocab_size, params_->config.model.vocab_size);
 }
@@ -305,36 +597,50 @@ void Search_Cpu::ApplyMinLength(int min_length) {
     return;
   }
 
-  const int batch_beam_size = params_->BatchBeamSize();
-  for (int i = 0; i < batch_beam_size; i++) {
-    std::span<float> const beam_token_scores = GetScores(i);
-    beam_token_scores[params_->config.model.eos_token_id] = std::numeric_limits<float>::lowest();
-  }
+  VisitScores([&](auto traits, auto next_token_scores) {
+    using Traits = decltype(traits);
+
+    const int batch_beam_size = params_->BatchBeamSize();
+    for (int i = 0; i < batch_beam_size; i++) {
+      const int row = ScoreRow(i);
+      if (row < 0)
+        continue;
+      auto const beam_token_scores = next_token_scores.subspan(static_cast<size_t>(row) * params_->config.model.vocab_size, params_->config.model.vocab_size);
+      beam_token_scores[params_->config.model.eos_token_id] = Traits::Lowest();
+    }
+  });
 }
 
 void Search_Cpu::ApplyRepetitionPenalty(float penalty) {
   if (penalty == 1.0f)
     return;
 
-  const int batch_beam_size = params_->BatchBeamSize();
-  for (int i = 0; i < batch_beam_size; i++) {
-    std::span<float> const beam_token_scores = GetScores(i);
-    std::span<const int32_t> const sequence = sequences_.GetSequence(i).CpuSpan();
+  VisitScores([&](auto traits, auto next_token_scores) {
+    using Traits = decltype(traits);
 
-    // Find unique word IDs in sequence.
-    std::unordered_set<int32_t> unique_word_ids;
-    for (const auto& word_id : sequence) {
-      unique_word_ids.insert(word_id);
-    }
+    const int batch_beam_size = params_->BatchBeamSize();
+    for (int i = 0; i < batch_beam_size; i++) {
+      const int row = ScoreRow(i);
+      if (row < 0)
+        continue;
+      auto const beam_token_scores = next_token_scores.subspan(static_cast<size_t>(row) * params_->config.model.vocab_size, params_->config.model.vocab_size);
+      std::span<const int32_t> const sequence = sequences_.GetSequence(i).CpuSpan();
 
-    for (const int32_t word_id : unique_word_ids) {
-      float const score = beam_token_scores[word_id];
+      // Find unique word IDs in sequence.
+      std::unordered_set<int32_t> unique_word_ids;
+      for (const auto& word_id : sequence) {
+        unique_word_ids.insert(word_id);
+      }
 
-      // If score < 0, then repetition penalty > 1.0 has to multiplied to reduce the previous token probability,
-      // This assumes that scores are either positive (like ctrl) or negative (like GPT-2), but not a mixture.
-      beam_token_scores[word_id] = (score < 0 ? score * penalty : score / penalty);
+      for (const int32_t word_id : unique_word_ids) {
+        float const score = Traits::ToFloat(beam_token_scores[word_id]);
+
+        // If score < 0, then repetition penalty > 1.0 has to multiplied to reduce the previous token probability,
+        // This assumes that scores are either positive (like ctrl) or negative (like GPT-2), but not a mixture.
+        beam_token_scores[word_id] = Traits::FromFloat(score < 0 ? score * penalty : score / penalty);
+      }
     }
-  }
+  });
 }
 
-}  // namespace Generators
\ No newline at end of file
+}  // namespace Generators
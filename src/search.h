@@ -16,7 +16,12 @@ struct Search : LeakChecked<Search> {
   virtual DeviceMemorySpan<int32_t> GetSequence(size_t index) = 0;
 
   virtual RoamingArray<float> GetLogits() const = 0;
+  // Logits for the whole batch, e.g. set by the user
   virtual void SetLogits(RoamingArray<float> logits) = 0;
+  // Logits from the model, which only hold the rows given by GetLiveNextTokens()
+  virtual void SetLiveLogits(RoamingArray<float> logits) { SetLogits(logits); }
+  // Same as SetLiveLogits, for fp16/bf16 logits (ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16/BFLOAT16) that are scored without first converting them to fp32
+  virtual void SetLogits16(cpu_span<uint16_t> /*logits*/, ONNXTensorElementDataType /*type*/) { throw std::runtime_error("16-bit logits are not supported by this search"); }
   virtual bool IsDone() const = 0;
 
   virtual void SelectTop() = 0;
@@ -28,6 +33,21 @@ struct Search : LeakChecked<Search> {
   virtual void ApplyMinLength(int min_length) = 0;
   virtual void ApplyRepetitionPenalty(float penalty) = 0;
 
+  // Stops expecting logits for the rows that finished since the last call, filling rows_to_keep with the rows of the
+  // current logits that are still generating (see State::RemoveRows). Returns false if there is nothing to drop
+  virtual bool RemoveFinishedRows(std::vector<int32_t>& /*rows_to_keep*/) { return false; }
+  // The next tokens of only the rows that are still given to the model, GetNextTokens() always covers the whole batch
+  virtual RoamingArray<int32_t> GetLiveNextTokens() { return GetNextTokens(); }
+  // Ends a sequence as if it had generated EOS, it only gets the pad token from now on. Used for stop sequences
+  virtual void FinishRow(size_t /*batch_id*/) { throw std::runtime_error("Ending a single sequence is not supported by this search"); }
+  // Appends tokens ([batch_beam_size, token_count]) to the sequences and starts generating again, see Generator::AppendTokens
+  virtual void AppendTokens(std::span<const int32_t> /*tokens*/) { throw std::runtime_error("AppendTokens is not supported by this search"); }
+  // Shortens the sequences to new_length, the last remaining token becomes the next token again. See Generator::RewindTo
+  virtual void RewindTo(size_t /*new_length*/) { throw std::runtime_error("RewindTo is not supported by this search"); }
+  // Sequences and per sequence state, see Generator::SaveState
+  virtual void SaveState(SnapshotWriter& /*writer*/) { throw std::runtime_error("SaveState is not supported by this search"); }
+  virtual void LoadState(SnapshotReader& /*reader*/) { throw std::runtime_error("LoadState is not supported by this search"); }
+
   std::shared_ptr<const GeneratorParams> params_;
 };
 
@@ -41,6 +61,8 @@ struct Search_Cpu : Search {
   bool IsDone() const override { return done_; }
   RoamingArray<float> GetLogits() const override;
   void SetLogits(RoamingArray<float> logits) override;
+  void SetLiveLogits(RoamingArray<float> logits) override;
+  void SetLogits16(cpu_span<uint16_t> logits, ONNXTensorElementDataType type) override;
 
   void ApplyMinLength(int min_length) override;
   void ApplyRepetitionPenalty(float penalty) override;
@@ -53,10 +75,34 @@ struct Search_Cpu : Search {
 
   cpu_span<int32_t> next_tokens_;  // shape (beam_size*batch_size)
 
-  cpu_span<float> next_token_scores_;  // shape (beam_size*batch_size, vocab_size)
+  mutable cpu_span<float> next_token_scores_;  // shape (beam_size*batch_size, vocab_size)
+  mutable cpu_span<uint16_t> next_token_scores_16_;  // Same shape, used instead of next_token_scores_ when the logits are fp16/bf16
+  mutable ONNXTensorElementDataType next_token_scores_type_{ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT};
+  mutable TrackedMemory next_token_scores_memory_{MemoryCategory::Search};
+  TrackedMemory memory_{MemoryCategory::Search};  // The other buffers, set by each search type
 
   Sequences sequences_;
   bool done_{};
+
+ protected:
+  // Calls fn(traits, scores) with the scores in the element type they were set in (fp32, fp16 or bf16), see search.cpp
+  template <typename Fn>
+  void VisitScores(Fn&& fn);
+
+  // Converts 16-bit scores to fp32 in place of next_token_scores_, for callers that need the full fp32 scores (GetLogits).
+  // Scores that only hold the live rows are spread back out to the whole batch, with the lowest score for dropped rows
+  void MaterializeScores() const;
+
+  mutable std::vector<float> converted_scores_;  // 16-bit scores as fp32, see MaterializeScores
+  mutable std::vector<float> expanded_scores_;   // Compacted scores spread out to the whole batch, see MaterializeScores
+  mutable std::optional<float> softmax_temperature_;  // Set by the sampling functions, MaterializeScores applies the softmax
+
+  // Row of the scores that belongs to batch_beam_index, -1 if that row was dropped from the batch
+  int ScoreRow(int batch_beam_index) const { return scores_compacted_ ? score_rows_[batch_beam_index] : batch_beam_index; }
+
+  std::vector<int32_t> live_batch_ids_;  // Batch index of each row the model still runs, empty until a row is dropped
+  std::vector<int32_t> score_rows_;      // Inverse of live_batch_ids_, shape (batch_size)
+  mutable bool scores_compacted_{};      // True while the scores only hold the rows in live_batch_ids_
 };
 
 struct GreedySearch_Cpu : Search_Cpu {
@@ -65,6 +111,14 @@ struct GreedySearch_Cpu : Search_Cpu {
   RoamingArray<int32_t> GetNextTokens() override;
   RoamingArray<int32_t> GetNextIndices() override { return cpu_span<int32_t>{}; }
 
+  bool RemoveFinishedRows(std::vector<int32_t>& rows_to_keep) override;
+  RoamingArray<int32_t> GetLiveNextTokens() override;
+  void FinishRow(size_t batch_id) override;
+  void AppendTokens(std::span<const int32_t> tokens) override;
+  void RewindTo(size_t new_length) override;
+  void SaveState(SnapshotWriter& writer) override;
+  void LoadState(SnapshotReader& reader) override;
+
   void SelectTop() override;
   void SampleTopK(int k, float temperature) override;
   void SampleTopP(float p, float temperature) override;
@@ -73,14 +127,18 @@ struct GreedySearch_Cpu : Search_Cpu {
  private:
   bool PadIfAlreadyEOS(size_t batch_id);
   void SetNextToken(size_t batch_id, int32_t token);
+  void FinishRowAt(size_t batch_id, int sequence_length);
   void AppendNextTokensToSequences();
+  void UpdateMemoryUsage();  // The batch sized buffers, and the row mapping once rows are dropped
 
   std::unique_ptr<int32_t[]> next_tokens_buffer_;
   std::unique_ptr<int32_t[]> temp_topk_buffer_;
+  std::vector<int32_t> live_next_tokens_;  // See GetLiveNextTokens
 
   std::span<bool> eos_seen_;  // shape (batch_size)
   std::unique_ptr<bool[]> eos_seen_buffer_;
   int not_done_count_{params_->batch_size};  // When zero, every batch entry is done (starts at batch_size_)
+  std::vector<int> finish_lengths_;          // Sequence length that includes the token that finished each entry, so RewindTo knows which entries run again
 
   std::mt19937 gen_;
 };
@@ -18,6 +18,7 @@ Sequences::Sequences(std::span<const int32_t> input_sequences, int batch_size, i
   sequences_ = device.Allocate<int32_t>(sequences_size, true);
   if (beam_size > 1)
     sequences_next_ = device.Allocate<int32_t>(sequences_size, true);
+  memory_.Set(sequences_size * sizeof(int32_t) * (sequences_next_ ? 2 : 1));
 
   // The original inputs are not expanded, this expands them in place into the sequences
   auto span = sequences_->CpuSpan();
@@ -75,4 +76,46 @@ void Sequences::AppendNextTokenToSequences(std::span<const int32_t> next_tokens)
   ++current_length_;
 }
 
+void Sequences::AppendTokens(std::span<const int32_t> tokens) {
+  const int token_count = static_cast<int>(tokens.size()) / batch_beam_size_;
+  if (current_length_ + token_count > max_length_)
+    throw std::runtime_error("Appending " + std::to_string(token_count) + " tokens to sequences of length " + std::to_string(current_length_) + " exceeds max_length (" + std::to_string(max_length_) + ")");
+
+  auto sequences_span = sequences_->CpuSpan();
+  for (int i = 0; i < batch_beam_size_; i++) {
+    copy(tokens.subspan(static_cast<size_t>(i) * token_count, token_count),
+         sequences_span.subspan(static_cast<size_t>(i) * max_length_ + current_length_, token_count));
+  }
+
+  current_length_ += token_count;
+}
+
+void Sequences::Save(SnapshotWriter& writer) {
+  writer.Write<int32_t>(batch_beam_size_);
+  writer.Write<int32_t>(current_length_);
+  auto sequences_span = sequences_->CpuSpan();
+  for (int i = 0; i < batch_beam_size_; i++)
+    writer.Write(sequences_span.data() + static_cast<size_t>(i) * max_length_, current_length_ * sizeof(int32_t));
+}
+
+void Sequences::Load(SnapshotReader& reader) {
+  const auto batch_beam_size = reader.Read<int32_t>();
+  const auto length = reader.Read<int32_t>();
+  if (batch_beam_size != batch_beam_size_)
+    throw std::runtime_error("Generator snapshot has " + std::to_string(batch_beam_size) + " sequences, the generator has " + std::to_string(batch_beam_size_));
+  if (length <= 0 || length >= max_length_)
+    throw std::runtime_error("Generator snapshot sequence length (" + std::to_string(length) + ") leaves no room to generate within max_length (" + std::to_string(max_length_) + ")");
+
+  auto sequences_span = sequences_->CpuSpan();
+  for (int i = 0; i < batch_beam_size_; i++)
+    reader.Read(sequences_span.data() + static_cast<size_t>(i) * max_length_, length * sizeof(int32_t));
+  current_length_ = length;
+}
+
+void Sequences::RewindTo(int new_length) {
+  if (new_length <= 0 || new_length > current_length_)
+    throw std::runtime_error("Can't rewind sequences of length " + std::to_string(current_length_) + " to length " + std::to_string(new_length));
+  current_length_ = new_length;
+}
+
 }  // namespace Generators
@@ -19,6 +19,16 @@ struct Sequences {
   // Used by Greedy search:
   void AppendNextTokenToSequences(std::span<const int32_t> next_tokens);
 
+  // Appends the same number of tokens to every sequence, tokens is (batch_beam_size, token_count)
+  void AppendTokens(std::span<const int32_t> tokens);
+
+  // Forgets every token after the first new_length, the tokens themselves stay in the buffer until overwritten
+  void RewindTo(int new_length);
+
+  // See Generator::SaveState, Load replaces the sequences with the saved ones
+  void Save(SnapshotWriter& writer);
+  void Load(SnapshotReader& reader);
+
  private:
   // Two buffers of shape (batch_size, num_beams, max_seq_length) to store sequences.
   // At each time, there is only one buffer is active. The other one will be active in next token.
@@ -29,6 +39,8 @@ struct Sequences {
   int batch_beam_size_;
   int max_length_;
   int current_length_;
+
+  TrackedMemory memory_{MemoryCategory::Sequences};
 };
 
 }  // namespace Generators
\ No newline at end of file
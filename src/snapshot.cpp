@@ -0,0 +1,25 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "generators.h"
+
+namespace Generators {
+
+void SnapshotWriter::Write(const void* data, size_t size) {
+  auto* bytes = static_cast<const uint8_t*>(data);
+  data_.insert(data_.end(), bytes, bytes + size);
+}
+
+void SnapshotReader::Read(void* data, size_t size) {
+  if (size > data_.size() - offset_)
+    throw std::runtime_error("Generator snapshot is truncated");
+  memcpy(data, data_.data() + offset_, size);
+  offset_ += size;
+}
+
+void SnapshotReader::ExpectEnd() const {
+  if (offset_ != data_.size())
+    throw std::runtime_error("Generator snapshot has " + std::to_string(data_.size() - offset_) + " unexpected trailing bytes");
+}
+
+}  // namespace Generators
@@ -0,0 +1,62 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#pragma once
+/*
+ * Binary streams for Generator::SaveState and Generator::LoadState. Values are stored in native byte order, so a
+ * snapshot is meant to be loaded by the same build of the library on the same kind of machine. Each part of the
+ * generator (sequences, search, model state) writes its own section, and reads it back in the same order.
+ */
+
+namespace Generators {
+
+struct SnapshotWriter {
+  void Write(const void* data, size_t size);
+
+  template <typename T>
+  void Write(T value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    Write(&value, sizeof(value));
+  }
+
+  // Writes the element count first, so ReadVector doesn't need to know it
+  template <typename T>
+  void WriteSpan(std::span<const T> values) {
+    Write<uint64_t>(values.size());
+    Write(values.data(), values.size_bytes());
+  }
+
+  std::vector<uint8_t> data_;
+};
+
+struct SnapshotReader {
+  SnapshotReader(std::span<const uint8_t> data) : data_{data} {}
+
+  void Read(void* data, size_t size);  // Throws if the snapshot ends early
+
+  template <typename T>
+  T Read() {
+    static_assert(std::is_trivially_copyable_v<T>);
+    T value;
+    Read(&value, sizeof(value));
+    return value;
+  }
+
+  template <typename T>
+  std::vector<T> ReadVector() {
+    const auto count = Read<uint64_t>();
+    if (count > (data_.size() - offset_) / sizeof(T))
+      throw std::runtime_error("Generator snapshot is truncated");
+    std::vector<T> values(count);
+    Read(values.data(), count * sizeof(T));
+    return values;
+  }
+
+  // Throws unless the whole snapshot was read
+  void ExpectEnd() const;
+
+ private:
+  std::span<const uint8_t> data_;
+  size_t offset_{};
+};
+
+}  // namespace Generators
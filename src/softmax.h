@@ -2,7 +2,7 @@
 
 namespace Generators {
 
-void SoftMax(std::span<float> scores, float temperature) {
+inline void SoftMax(std::span<float> scores, float temperature) {
   float const max_score = *std::max_element(scores.begin(), scores.end());
 
   // Subtract max score and scale by temperature
@@ -15,7 +15,7 @@ void SoftMax(std::span<float> scores, float temperature) {
   std::transform(scores.begin(), scores.end(), scores.begin(), [exp_sum](float score) { return score / exp_sum; });
 }
 
-void LogSoftMax(std::span<float> scores, float temperature) {
+inline void LogSoftMax(std::span<float> scores, float temperature) {
   float const max_score = *std::max_element(scores.begin(), scores.end());
 
   // Subtract max score and scale by temperature
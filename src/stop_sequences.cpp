@@ -0,0 +1,127 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "generators.h"
+#include "models/model.h"
+#include "stop_sequences.h"
+
+namespace Generators {
+
+template <typename Symbol>
+AhoCorasick<Symbol>::AhoCorasick() : nodes_(1) {}
+
+template <typename Symbol>
+void AhoCorasick<Symbol>::Add(std::span<const Symbol> pattern) {
+  if (pattern.empty())
+    throw std::runtime_error("Stop sequences can't be empty");
+
+  int32_t state = 0;
+  for (auto symbol : pattern) {
+    auto it = nodes_[state].next.find(symbol);
+    if (it == nodes_[state].next.end()) {
+      nodes_[state].next.emplace(symbol, static_cast<int32_t>(nodes_.size()));
+      state = static_cast<int32_t>(nodes_.size());
+      nodes_.emplace_back();
+    } else {
+      state = it->second;
+    }
+  }
+  nodes_[state].match = true;
+}
+
+template <typename Symbol>
+void AhoCorasick<Symbol>::Build() {
+  // Breadth first, so the fail link of a node is always finished before its children need it
+  std::queue<int32_t> queue;
+  for (auto& [symbol, child] : nodes_[0].next)
+    queue.push(child);
+
+  while (!queue.empty()) {
+    const int32_t state = queue.front();
+    queue.pop();
+    for (auto& [symbol, child] : nodes_[state].next) {
+      bool matched{};
+      nodes_[child].fail = Next(nodes_[state].fail, symbol, matched);
+      nodes_[child].match |= nodes_[nodes_[child].fail].match;
+      queue.push(child);
+    }
+  }
+}
+
+template <typename Symbol>
+int32_t AhoCorasick<Symbol>::Next(int32_t state, Symbol symbol, bool& matched) const {
+  for (;;) {
+    auto it = nodes_[state].next.find(symbol);
+    if (it != nodes_[state].next.end()) {
+      state = it->second;
+      break;
+    }
+    if (state == 0)
+      break;
+    state = nodes_[state].fail;
+  }
+  matched |= nodes_[state].match;
+  return state;
+}
+
+template struct AhoCorasick<int32_t>;
+template struct AhoCorasick<char>;
+
+StopSequences::StopSequences(const Model& model, const GeneratorParams& params)
+    : entries_(params.BatchBeamSize()),
+      eos_token_ids_{params.config.model.eos_token_ids.begin(), params.config.model.eos_token_ids.end()} {
+  if (eos_token_ids_.empty())
+    eos_token_ids_.push_back(params.config.model.eos_token_id);
+
+  for (auto& sequence : params.stop_token_sequences)
+    tokens_.Add(std::span<const int32_t>{sequence.data(), sequence.size()});
+  tokens_.Build();
+
+  for (auto& string : params.stop_strings)
+    strings_.Add(std::span<const char>{string.data(), string.size()});
+  strings_.Build();
+
+  if (!strings_.empty()) {
+    tokenizer_ = model.CreateTokenizer();
+    for (auto& entry : entries_)
+      entry.stream = tokenizer_->CreateStream();
+  }
+}
+
+void StopSequences::Reset() {
+  for (size_t batch_id = 0; batch_id < entries_.size(); batch_id++)
+    Restart(batch_id, {});
+}
+
+void StopSequences::Restart(size_t batch_id, std::span<const int32_t> tokens) {
+  auto& entry = entries_[batch_id];
+  entry.token_state = 0;
+  entry.string_state = 0;
+  entry.stopped = false;
+  if (entry.stream)
+    entry.stream = tokenizer_->CreateStream();
+  for (auto token : tokens)
+    Append(batch_id, token);
+}
+
+bool StopSequences::Append(size_t batch_id, int32_t token) {
+  auto& entry = entries_[batch_id];
+  if (entry.stopped)
+    return false;
+  if (std::find(eos_token_ids_.begin(), eos_token_ids_.end(), token) != eos_token_ids_.end()) {
+    entry.stopped = true;
+    return false;
+  }
+
+  bool matched{};
+  entry.token_state = tokens_.Next(entry.token_state, token, matched);
+  if (entry.stream) {
+    for (char c : entry.stream->Decode(token))
+      entry.string_state = strings_.Next(entry.string_state, c, matched);
+  }
+
+  entry.stopped = matched;
+  return matched;
+}
+
+}  // namespace Generators
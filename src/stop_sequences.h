@@ -0,0 +1,66 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#pragma once
+/*
+ * Stop sequences end the generation of a sequence once its output ends with any of them, in addition to EOS and
+ * max_length. Token sequences are matched on the token ids, strings on the detokenized text so they can start or end
+ * in the middle of a token. Both are matched incrementally with an Aho-Corasick automaton, so each new token costs the
+ * same no matter how many stop sequences there are or how long they are.
+ */
+#include <map>
+
+namespace Generators {
+
+// Matches any number of patterns against a stream of symbols, one symbol at a time
+template <typename Symbol>
+struct AhoCorasick {
+  AhoCorasick();
+
+  void Add(std::span<const Symbol> pattern);
+  void Build();  // Call once after adding all of the patterns
+  bool empty() const { return nodes_.size() == 1; }
+
+  // Returns the state after symbol, and sets matched if a pattern ends with it. The initial state is 0
+  int32_t Next(int32_t state, Symbol symbol, bool& matched) const;
+
+ private:
+  struct Node {
+    std::map<Symbol, int32_t> next;
+    int32_t fail{};
+    bool match{};  // A pattern ends here, or at one of the nodes on the fail chain
+  };
+
+  std::vector<Node> nodes_;
+};
+
+struct StopSequences {
+  StopSequences(const Model& model, const GeneratorParams& params);
+
+  // Feeds the token a batch entry generated. Returns true if one of the stop sequences ends with it, after which (or
+  // after EOS) the entry is ignored
+  bool Append(size_t batch_id, int32_t token);
+
+  // Starts matching from scratch, for when the sequences continue after tokens that weren't generated
+  void Reset();
+
+  // Starts matching a batch entry from scratch and feeds it the tokens it generated, for when its sequence was cut back
+  void Restart(size_t batch_id, std::span<const int32_t> tokens);
+
+ private:
+  struct Entry {
+    int32_t token_state{};
+    int32_t string_state{};
+    bool stopped{};
+    std::unique_ptr<TokenizerStream> stream;  // Only when there are stop strings
+  };
+
+  AhoCorasick<int32_t> tokens_;
+  AhoCorasick<char> strings_;
+  std::shared_ptr<Tokenizer> tokenizer_;
+  std::vector<Entry> entries_;
+  // Every EOS id of the config. The logits only let the primary one be generated, but tokens fed back in by Restart and
+  // tokens picked from logits the caller set can be any of them
+  std::vector<int32_t> eos_token_ids_;
+};
+
+}  // namespace Generators
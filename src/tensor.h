@@ -6,6 +6,9 @@ struct Tensor : std::enable_shared_from_this<Tensor>, LeakChecked<Tensor> {
   Tensor() = default;
   Tensor(std::unique_ptr<OrtValue> ort_tensor) : ort_tensor_{std::move(ort_tensor)} {}
 
+  // Keeps memory alive that ort_tensor_ wraps without owning it (e.g. preprocessor outputs). Declared first so it is
+  // destroyed after ort_tensor_
+  std::shared_ptr<void> buffer_owner_;
   std::unique_ptr<OrtValue> ort_tensor_;
   std::shared_ptr<Tensor> external_owner_;  // Set to 'this' when created by the C API to preserve lifetime
 };
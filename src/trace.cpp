@@ -0,0 +1,217 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "filesystem.h"
+#include "trace.h"
+
+namespace Generators {
+
+std::atomic<bool> g_trace_enabled{};
+
+namespace {
+
+struct TraceEvent {
+  std::array<char, 48> name;  // Copied, sub-model names come from a config that may be gone by the time we flush
+  const char* category;
+  int64_t start_ns;
+  int64_t duration_ns;
+};
+
+// A single writer (the owning thread) appends events, a single reader (FlushTrace, under g_trace_mutex) consumes them.
+// Events live in fixed size blocks that are never moved. The writer publishes an event by storing the block's new
+// size, and a new block by storing the old block's next pointer. Once a block is full and has a next block the writer
+// never touches it again, so the reader may free it.
+// A thread holds at most max_blocks blocks (about 4.5MB). When tracing is never flushed, further events are dropped and
+// counted instead of growing without bound, and the next flush records how many were lost.
+struct ThreadTraceBuffer {
+  static constexpr size_t block_size = 1024;
+  static constexpr size_t max_blocks = 64;
+
+  struct Block {
+    std::array<TraceEvent, block_size> events;
+    std::atomic<size_t> size{};
+    std::atomic<Block*> next{};
+  };
+
+  explicit ThreadTraceBuffer(int thread_id) : thread_id_{thread_id}, head_{new Block}, tail_{head_} {}
+
+  ~ThreadTraceBuffer() {
+    for (auto* block = head_; block;) {
+      auto* next = block->next.load(std::memory_order_relaxed);
+      delete block;
+      block = next;
+    }
+  }
+
+  // Writer side
+  void Append(const TraceEvent& event) {
+    auto size = tail_->size.load(std::memory_order_relaxed);
+    if (size == block_size) {
+      if (block_count_.load(std::memory_order_relaxed) >= max_blocks) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      block_count_.fetch_add(1, std::memory_order_relaxed);
+      auto* block = new Block;
+      tail_->next.store(block, std::memory_order_release);
+      tail_ = block;
+      size = 0;
+    }
+    tail_->events[size] = event;
+    tail_->size.store(size + 1, std::memory_order_release);
+  }
+
+  // Reader side, the number of events dropped since the last call
+  size_t TakeDropped() { return dropped_.exchange(0, std::memory_order_relaxed); }
+
+  // Reader side, calls write for every event appended since the last call
+  template <typename Write>
+  void Consume(Write&& write) {
+    while (true) {
+      auto size = head_->size.load(std::memory_order_acquire);
+      for (; consumed_ < size; consumed_++)
+        write(head_->events[consumed_]);
+
+      auto* next = head_->next.load(std::memory_order_acquire);
+      if (size != block_size || !next)
+        return;
+      delete head_;
+      block_count_.fetch_sub(1, std::memory_order_relaxed);
+      head_ = next;
+      consumed_ = 0;
+    }
+  }
+
+  const int thread_id_;
+  std::atomic<bool> thread_exited_{};
+  int named_in_file_{};  // Value of g_trace_file_id when the thread name was last written
+
+ private:
+  Block* head_;  // Reader's block
+  size_t consumed_{};
+  Block* tail_;  // Writer's block
+  std::atomic<size_t> block_count_{1};
+  std::atomic<size_t> dropped_{};
+};
+
+std::mutex g_trace_mutex;  // Guards everything below, never taken while recording an event
+std::vector<std::shared_ptr<ThreadTraceBuffer>> g_trace_buffers;
+std::unique_ptr<std::ofstream> gp_trace_file;
+int g_next_trace_thread_id{1};
+int g_trace_file_id{};
+
+// Hands the thread's buffer to the registry on first use and marks it as exited when the thread ends, so a final
+// flush can still write out the thread's events before the buffer is dropped
+struct ThreadTraceBufferOwner {
+  ~ThreadTraceBufferOwner() {
+    if (buffer_)
+      buffer_->thread_exited_.store(true, std::memory_order_release);
+  }
+
+  ThreadTraceBuffer& Get() {
+    if (!buffer_) {
+      std::lock_guard<std::mutex> lock{g_trace_mutex};
+      buffer_ = std::make_shared<ThreadTraceBuffer>(g_next_trace_thread_id++);
+      g_trace_buffers.push_back(buffer_);
+    }
+    return *buffer_;
+  }
+
+ private:
+  std::shared_ptr<ThreadTraceBuffer> buffer_;
+};
+
+thread_local ThreadTraceBufferOwner tl_trace_buffer;
+
+void WriteJsonString(std::ostream& stream, const char* text) {
+  stream << '"';
+  for (; *text; text++) {
+    if (*text == '"' || *text == '\\')
+      stream << '\\' << *text;
+    else if (static_cast<unsigned char>(*text) >= 0x20)
+      stream << *text;
+  }
+  stream << '"';
+}
+
+void FlushLocked() {
+  if (!gp_trace_file)
+    return;
+
+  auto& stream = *gp_trace_file;
+  for (auto& buffer : g_trace_buffers) {
+    if (buffer->named_in_file_ != g_trace_file_id) {
+      buffer->named_in_file_ = g_trace_file_id;
+      stream << "{\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->thread_id_
+             << ",\"name\":\"thread_name\",\"args\":{\"name\":\"thread " << buffer->thread_id_ << "\"}},\n";
+    }
+    buffer->Consume([&](const TraceEvent& event) {
+      // Chrome trace timestamps are in microseconds
+      stream << "{\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->thread_id_ << ",\"name\":";
+      WriteJsonString(stream, event.name.data());
+      stream << ",\"cat\":\"" << event.category << "\",\"ts\":" << event.start_ns / 1000 << '.'
+             << (event.start_ns % 1000) / 100 << ",\"dur\":" << event.duration_ns / 1000 << '.'
+             << (event.duration_ns % 1000) / 100 << "},\n";
+    });
+    if (auto dropped = buffer->TakeDropped()) {
+      auto now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+      stream << "{\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":" << buffer->thread_id_ << ",\"name\":\"trace_events_dropped\",\"ts\":"
+             << now << ",\"args\":{\"count\":" << dropped << "}},\n";
+    }
+  }
+  stream.flush();
+
+  // A thread that has exited won't append again, and its buffer was just drained
+  g_trace_buffers.erase(std::remove_if(g_trace_buffers.begin(), g_trace_buffers.end(),
+                                       [](const auto& buffer) { return buffer->thread_exited_.load(std::memory_order_acquire); }),
+                        g_trace_buffers.end());
+}
+
+}  // namespace
+
+void SetTraceFile(std::string_view path) {
+  std::lock_guard<std::mutex> lock{g_trace_mutex};
+  g_trace_enabled.store(false, std::memory_order_relaxed);
+  // Spans already in progress may still land in the buffers after this final flush, they go to the next file
+  FlushLocked();
+  gp_trace_file.reset();
+
+  if (path.empty())
+    return;
+
+  fs::path filename{std::string(path)};
+  gp_trace_file = std::make_unique<std::ofstream>(filename.open_for_write());
+  if (!*gp_trace_file) {
+    gp_trace_file.reset();
+    throw std::runtime_error("Unable to open trace file: " + std::string(path));
+  }
+  *gp_trace_file << "[\n";
+  g_trace_file_id++;
+  g_trace_enabled.store(true, std::memory_order_relaxed);
+}
+
+void FlushTrace() {
+  std::lock_guard<std::mutex> lock{g_trace_mutex};
+  FlushLocked();
+}
+
+void RecordTraceSpan(std::string_view name, const char* category, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+  TraceEvent event;
+  auto length = std::min(name.size(), event.name.size() - 1);
+  std::memcpy(event.name.data(), name.data(), length);
+  event.name[length] = '\0';
+  event.category = category;
+  event.start_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(start.time_since_epoch()).count();
+  event.duration_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+  tl_trace_buffer.Get().Append(event);
+}
+
+}  // namespace Generators
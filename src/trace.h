@@ -0,0 +1,56 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#pragma once
+/*
+ * Optional timeline of the steps of generation, in the Chrome trace event format
+ *
+ * SetTraceFile(path) starts recording and FlushTrace() appends everything recorded so far to that file. The file can be
+ * opened in chrome://tracing or https://ui.perfetto.dev while generation is still running, the format allows the
+ * closing ']' of the event array to be missing.
+ *
+ * Spans are recorded by TraceSpan objects on the stack, and by every PhaseTimer (see metrics.h). When tracing is off a
+ * span costs a single relaxed atomic load. When it is on, each thread appends to its own buffer without locking, so
+ * recording never waits on other threads or on a flush in progress. A thread's buffer is capped, events past the cap are
+ * dropped until the next flush and show up in the file as a "trace_events_dropped" event with the count.
+ */
+#include <atomic>
+#include <chrono>
+#include <string_view>
+
+namespace Generators {
+
+// Starts recording spans to be written to path, an empty path flushes the remaining spans and stops recording
+void SetTraceFile(std::string_view path);
+
+// Writes all spans recorded since the previous flush to the trace file
+void FlushTrace();
+
+extern std::atomic<bool> g_trace_enabled;
+
+// Records a completed span, name is copied (and truncated if very long). Only call when g_trace_enabled is set.
+void RecordTraceSpan(std::string_view name, const char* category, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+
+// Records its own lifetime as a span named 'name'. category must be a string literal.
+struct TraceSpan {
+  TraceSpan(std::string_view name, const char* category = "genai")
+      : name_{name}, category_{category}, enabled_{g_trace_enabled.load(std::memory_order_relaxed)} {
+    if (enabled_)
+      start_ = std::chrono::steady_clock::now();
+  }
+
+  ~TraceSpan() {
+    if (enabled_)
+      RecordTraceSpan(name_, category_, start_, std::chrono::steady_clock::now());
+  }
+
+  TraceSpan(const TraceSpan&) = delete;
+  TraceSpan& operator=(const TraceSpan&) = delete;
+
+ private:
+  std::string_view name_;
+  const char* category_;
+  bool enabled_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace Generators
@@ -2,6 +2,8 @@
 #include <generators.h>
 #include <search.h>
 #include <models/model.h>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
 #include <ort_genai.h>
 #include "../src/span.h"
@@ -283,6 +285,222 @@ TEST(CAPITests, GetOutputCAPI) {
   generator->GenerateNextToken();
 }
 
+TEST(CAPITests, MetricsCAPI) {
+  std::vector<int32_t> input_ids{0, 0, 0, 52, 0, 0, 195, 731};
+
+  auto model = OgaModel::Create(MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32");
+
+  auto params = OgaGeneratorParams::Create(*model);
+  params->SetSearchOption("max_length", 14);
+  params->SetInputIDs(input_ids.data(), input_ids.size(), 4, 2);
+
+  auto generator = OgaGenerator::Create(*model, *params);
+  for (int i = 0; i < 3; i++) {
+    generator->ComputeLogits();
+    generator->GenerateNextToken();
+  }
+
+  // The appended tokens run as a prefill
+  std::vector<int32_t> appended{195, 731, 0, 52};
+  generator->AppendTokens(appended.data(), appended.size());
+  generator->ComputeLogits();
+  generator->GenerateNextToken();
+
+  size_t count;
+  double total_seconds, max_seconds;
+  generator->GetPhaseLatency("prefill", count, total_seconds, max_seconds);
+  EXPECT_EQ(count, 2u);
+  EXPECT_GT(total_seconds, 0.0);
+  EXPECT_LE(max_seconds, total_seconds);
+  generator->GetPhaseLatency("decode", count, total_seconds, max_seconds);
+  EXPECT_EQ(count, 2u);
+  generator->GetPhaseLatency("select_top", count, total_seconds, max_seconds);
+  EXPECT_EQ(count, 4u);
+  generator->GetPhaseLatency("sample_top_k", count, total_seconds, max_seconds);
+  EXPECT_EQ(count, 0u);
+
+  // The model's totals include a second generator
+  auto other = OgaGenerator::Create(*model, *params);
+  other->ComputeLogits();
+  other->GenerateNextToken();
+  model->GetPhaseLatency("prefill", count, total_seconds, max_seconds);
+  EXPECT_EQ(count, 3u);
+  model->GetPhaseLatency("session_load", count, total_seconds, max_seconds);
+  EXPECT_GE(count, 1u);
+
+  std::string metrics{generator->GetMetrics()};
+  EXPECT_NE(metrics.find("genai_phase_seconds_count{scope=\"generator\",model=\"tiny-random-gpt2-fp32\",phase=\"prefill\"} 2"), std::string::npos);
+  EXPECT_EQ(metrics.find("phase=\"sample_top_k\""), std::string::npos);  // Phases that never ran are left out
+  std::string model_metrics{model->GetMetrics()};
+  EXPECT_NE(model_metrics.find("genai_phase_seconds_count{scope=\"model\",model=\"tiny-random-gpt2-fp32\",phase=\"prefill\"} 3"), std::string::npos);
+
+  EXPECT_THROW(generator->GetPhaseLatency("not_a_phase", count, total_seconds, max_seconds), std::runtime_error);
+}
+
+TEST(CAPITests, SessionLoadMetricsCAPI) {
+  auto model = OgaModel::Create(MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32");
+
+  // Every session of the model is labeled with its file name as soon as the model is created
+  std::string metrics{model->GetMetrics()};
+  const std::string sample = "genai_session_load_seconds{scope=\"model\",model=\"tiny-random-gpt2-fp32\",session=\"past.onnx\"} ";
+  auto position = metrics.find(sample);
+  ASSERT_NE(position, std::string::npos);
+  EXPECT_GT(std::stod(metrics.substr(position + sample.size())), 0.0);
+
+  size_t count;
+  double total_seconds, max_seconds;
+  model->GetPhaseLatency("session_load", count, total_seconds, max_seconds);
+  EXPECT_EQ(count, 1u);
+}
+
+TEST(CAPITests, MemoryUsageCAPI) {
+  std::vector<int32_t> input_ids{0, 0, 0, 52, 0, 0, 195, 731};
+
+  auto model = OgaModel::Create(MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32");
+  auto params = OgaGeneratorParams::Create(*model);
+  params->SetSearchOption("max_length", 10);
+  params->SetInputIDs(input_ids.data(), input_ids.size(), 4, 2);
+
+  auto generator = OgaGenerator::Create(*model, *params);
+  for (int i = 0; i < 3; i++) {
+    generator->ComputeLogits();
+    generator->GenerateNextToken();
+  }
+
+  size_t current, peak;
+  generator->GetMemoryUsage("kv_cache", current, peak);
+  const size_t kv_cache_bytes = current;
+  EXPECT_GT(current, 0u);
+  EXPECT_GE(peak, current);
+  generator->GetMemoryUsage("logits", current, peak);
+  EXPECT_GE(current, 2 * 1000 * sizeof(float));  // At least the last token logits of both rows
+  EXPECT_GE(peak, current);
+
+  // Rewinding shortens the KV cache. The sequences are allocated at max_length, so rewinding and appending don't
+  // change their size
+  const size_t sequences_bytes = 2 * 10 * sizeof(int32_t);
+  generator->GetMemoryUsage("sequences", current, peak);
+  EXPECT_EQ(current, sequences_bytes);
+  generator->RewindTo(5);
+  generator->GetMemoryUsage("kv_cache", current, peak);
+  EXPECT_LT(current, kv_cache_bytes);
+  EXPECT_GE(peak, kv_cache_bytes);
+  generator->GetMemoryUsage("sequences", current, peak);
+  EXPECT_EQ(current, sequences_bytes);
+
+  std::vector<int32_t> appended{195, 52};
+  generator->AppendTokens(appended.data(), appended.size());
+  generator->ComputeLogits();
+  generator->GenerateNextToken();
+  generator->GetMemoryUsage("sequences", current, peak);
+  EXPECT_EQ(current, sequences_bytes);
+
+  size_t generator_total, model_total;
+  generator->GetMemoryUsage(nullptr, generator_total, peak);
+  EXPECT_GE(peak, generator_total);
+  model->GetMemoryUsage(nullptr, model_total, peak);
+  EXPECT_GE(model_total, generator_total);  // The model also counts static buffers shared by its generators
+
+  // Destroying the generator releases everything it held from the model's total, the model's peak stays
+  generator.reset();
+  size_t model_total_after, model_peak_after;
+  model->GetMemoryUsage(nullptr, model_total_after, model_peak_after);
+  EXPECT_EQ(model_total_after, model_total - generator_total);
+  EXPECT_GE(model_peak_after, model_total);
+
+  EXPECT_THROW(model->GetMemoryUsage("not_a_category", current, peak), std::runtime_error);
+}
+
+TEST(CAPITests, SaveLoadStateCAPI) {
+  std::vector<int32_t> input_ids{0, 0, 0, 52, 0, 0, 195, 731};
+
+  auto model = OgaModel::Create(MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32");
+  auto params = OgaGeneratorParams::Create(*model);
+  params->SetSearchOption("max_length", 10);
+  params->SetInputIDs(input_ids.data(), input_ids.size(), 4, 2);
+
+  auto generator = OgaGenerator::Create(*model, *params);
+  for (int i = 0; i < 3; i++) {
+    generator->ComputeLogits();
+    generator->GenerateNextToken();
+  }
+  const char* snapshot_path = "save_load_state_capi_test.bin";
+  generator->SaveState(snapshot_path);
+  while (!generator->IsDone()) {
+    generator->ComputeLogits();
+    generator->GenerateNextToken();
+  }
+
+  // A new generator continues from the file without running the prompt again
+  auto restored = OgaGenerator::Create(*model, *params);
+  restored->LoadState(snapshot_path);
+  EXPECT_EQ(restored->GetSequenceCount(0), 7u);
+  while (!restored->IsDone()) {
+    restored->ComputeLogits();
+    restored->GenerateNextToken();
+  }
+  for (size_t i = 0; i < 2; i++) {
+    ASSERT_EQ(restored->GetSequenceCount(i), generator->GetSequenceCount(i));
+    EXPECT_TRUE(std::equal(restored->GetSequenceData(i), restored->GetSequenceData(i) + restored->GetSequenceCount(i), generator->GetSequenceData(i)));
+  }
+
+  auto unused = OgaGenerator::Create(*model, *params);
+  EXPECT_THROW(unused->LoadState("missing_save_load_state_capi_test.bin"), std::runtime_error);
+  std::remove(snapshot_path);
+}
+
+TEST(CAPITests, TraceCAPI) {
+  auto read_file = [](const char* path) {
+    std::ifstream file{path};
+    return std::string{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+  };
+  auto count_of = [](const std::string& text, const std::string& pattern) {
+    size_t count = 0;
+    for (auto position = text.find(pattern); position != std::string::npos; position = text.find(pattern, position + 1))
+      count++;
+    return count;
+  };
+
+  const char* trace_path = "trace_capi_test.json";
+  Oga::SetTraceFile(trace_path);
+
+  std::vector<int32_t> input_ids{0, 0, 0, 52};
+  auto model = OgaModel::Create(MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32");
+  auto params = OgaGeneratorParams::Create(*model);
+  params->SetSearchOption("max_length", 6);
+  params->SetInputIDs(input_ids.data(), input_ids.size(), 4, 1);
+  auto generator = OgaGenerator::Create(*model, *params);
+  while (!generator->IsDone()) {
+    generator->ComputeLogits();
+    generator->GenerateNextToken();
+  }
+  Oga::FlushTrace();
+
+  auto trace = read_file(trace_path);
+  EXPECT_EQ(trace.rfind("[\n", 0), 0u);
+  EXPECT_EQ(count_of(trace, "\"name\":\"compute_logits\""), 2u);
+  EXPECT_EQ(count_of(trace, "\"name\":\"prefill\""), 1u);
+  EXPECT_EQ(count_of(trace, "\"name\":\"decode\""), 1u);
+
+  // Without flushing, a thread's buffer stops growing and the flush reports what was dropped
+  constexpr size_t span_count = 100000;
+  auto now = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < span_count; i++)
+    Generators::RecordTraceSpan("filler", "genai", now, now);
+  Oga::FlushTrace();
+  Oga::SetTraceFile(nullptr);
+
+  trace = read_file(trace_path);
+  auto recorded = count_of(trace, "\"name\":\"filler\"");
+  EXPECT_GT(recorded, 0u);
+  EXPECT_LT(recorded, span_count);
+  auto dropped = trace.find("\"name\":\"trace_events_dropped\"");
+  ASSERT_NE(dropped, std::string::npos);
+  EXPECT_NE(trace.find("\"count\":" + std::to_string(span_count - recorded) + "}", dropped), std::string::npos);
+
+  std::remove(trace_path);
+}
+
 #if TEST_PHI2
 
 struct Phi2Test {
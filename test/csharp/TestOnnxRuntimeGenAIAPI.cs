@@ -77,6 +77,13 @@ namespace Microsoft.ML.OnnxRuntimeGenAI.Tests
                         {
                             generator.ComputeLogits();
                             generator.GenerateNextToken();
+
+                            var nextTokens = generator.GetNextTokens().ToArray();
+                            Assert.Equal((int)batchSize, nextTokens.Length);
+                            for (ulong i = 0; i < batchSize; i++)
+                            {
+                                Assert.Equal(new int[] { nextTokens[i] }, generator.GetLastTokens(i, 1).ToArray());
+                            }
                         }
 
                         for (ulong i = 0; i < batchSize; i++)
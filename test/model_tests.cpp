@@ -5,8 +5,11 @@
 #include <generators.h>
 #include <search.h>
 #include <models/model.h>
+#include <models/multi_modal_vision_model.h>
+#include <models/cpu_affinity.h>
 #include <iostream>
 #include <random>
+#include <thread>
 #ifndef MODEL_PATH
 #define MODEL_PATH "../../test/test_models/"
 #endif
@@ -246,4 +249,364 @@ Print all primes between 1 and n
 #endif
 }
 
-#endif
\ No newline at end of file
+#endif
+TEST(ModelTests, AudioStreamWindows) {
+  // 1.5s of a 440Hz tone, appended in chunks like audio arriving from a microphone
+  std::vector<float> samples(24000);
+  for (size_t i = 0; i < samples.size(); i++)
+    samples[i] = 0.5f * std::sin(2.0f * 3.14159265f * 440.0f * static_cast<float>(i) / 16000.0f);
+
+  // 1s windows that overlap by 0.2s
+  Generators::AudioStream stream{80, 100, 20, ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT};
+  std::vector<std::unique_ptr<Generators::NamedTensors>> windows;
+  for (size_t i = 0; i < samples.size(); i += 1000) {
+    stream.Append(std::span<const float>(samples.data() + i, 1000));
+    while (auto window = stream.NextWindow())
+      windows.push_back(std::move(window));
+  }
+  // The second window starts at 0.8s and needs audio up to 1.8s
+  ASSERT_EQ(windows.size(), size_t{1});
+  EXPECT_DOUBLE_EQ(stream.NextWindowStart(), 0.8);
+
+  // Flushing pads the second window with silence. The audio ends within it, so there is no third window
+  stream.Flush();
+  while (auto window = stream.NextWindow())
+    windows.push_back(std::move(window));
+  ASSERT_EQ(windows.size(), size_t{2});
+  EXPECT_THROW(stream.Append(std::span<const float>(samples.data(), 1000)), std::runtime_error);
+
+  for (auto& window : windows) {
+    auto& input_features = window->at(std::string(Generators::Config::Defaults::InputFeaturesName))->ort_tensor_;
+    EXPECT_EQ(input_features->GetTensorTypeAndShapeInfo()->GetShape(), (std::vector<int64_t>{1, 80, 100}));
+
+    // Whisper's normalization keeps every value within 2 (8 in log10 / 4) of the loudest one
+    auto features = std::span<const float>(input_features->GetTensorData<float>(), 80 * 100);
+    const float max_feature = *std::max_element(features.begin(), features.end());
+    for (float feature : features)
+      EXPECT_GE(feature, max_feature - 2.0f - 1e-5f);
+
+    // 440Hz falls in mel bin 11, which should be the loudest one in the middle of the tone
+    const size_t frame = 50;
+    size_t loudest = 0;
+    for (size_t m = 0; m < 80; m++) {
+      if (features[m * 100 + frame] > features[loudest * 100 + frame])
+        loudest = m;
+    }
+    EXPECT_EQ(loudest, size_t{11});
+  }
+}
+
+TEST(ModelTests, AudioStreamInvalidWindows) {
+  EXPECT_THROW(Generators::AudioStream(80, 0, 0, ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT), std::runtime_error);
+  EXPECT_THROW(Generators::AudioStream(80, 100, 100, ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT), std::runtime_error);
+  EXPECT_THROW(Generators::AudioStream(80, 100, 0, ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32), std::runtime_error);
+}
+
+TEST(ModelTests, ParallelForRunsEveryIndexOnce) {
+  Generators::ThreadPool pool{3};
+  std::vector<std::atomic<int>> runs(1000);
+  pool.Run(runs.size(), 0, [&](size_t i) { runs[i]++; });
+  for (auto& count : runs)
+    EXPECT_EQ(count.load(), 1);
+
+  // A nested ParallelFor finishes even when every worker is busy with the outer one
+  std::vector<std::atomic<int>> nested_runs(8 * 8);
+  pool.Run(8, 0, [&](size_t i) {
+    pool.Run(8, 0, [&](size_t j) { nested_runs[i * 8 + j]++; });
+  });
+  for (auto& count : nested_runs)
+    EXPECT_EQ(count.load(), 1);
+
+  // The global pool behind ParallelFor, with more items than threads
+  std::vector<std::atomic<int>> global_runs(257);
+  Generators::ParallelFor(global_runs.size(), [&](size_t i) { global_runs[i]++; });
+  for (auto& count : global_runs)
+    EXPECT_EQ(count.load(), 1);
+}
+
+TEST(ModelTests, ParallelForRethrows) {
+  Generators::ThreadPool pool{3};
+  std::atomic<size_t> finished{};
+  EXPECT_THROW(pool.Run(100, 0, [&](size_t i) {
+    if (i == 42)
+      throw std::runtime_error("item 42 failed");
+    finished++;
+  }),
+               std::runtime_error);
+  // The other items still ran before the exception reached the caller
+  EXPECT_EQ(finished.load(), size_t{99});
+
+  // The pool is still usable afterwards
+  std::atomic<size_t> count{};
+  pool.Run(10, 0, [&](size_t) { count++; });
+  EXPECT_EQ(count.load(), size_t{10});
+}
+
+TEST(ModelTests, AudioBatchOrdering) {
+  // Clips 1, 3 and 4 are 10s, clips 0 and 2 are 30s, clip 5 is 10s but with 128 mels
+  const std::vector<std::vector<int64_t>> shapes{
+      {1, 80, 3000}, {1, 80, 1000}, {1, 80, 3000}, {1, 80, 1000}, {1, 80, 1000}, {1, 128, 1000}};
+  auto batches = Generators::GroupClipsIntoBatches(shapes, 2);
+
+  // Shortest bucket first, clips in their original order within a bucket, and no batch larger than 2
+  const std::vector<std::vector<size_t>> expected{{1, 3}, {4}, {5}, {0, 2}};
+  EXPECT_EQ(batches, expected);
+
+  EXPECT_THROW(Generators::GroupClipsIntoBatches(shapes, 0), std::runtime_error);
+}
+
+TEST(ModelTests, SessionOptionsKeysDontCollide) {
+  using SessionOptions = Generators::Config::SessionOptions;
+  std::vector<SessionOptions> configs(9);
+  configs[1].intra_op_num_threads = 4;
+  configs[2].intra_op_num_threads = 0;  // Set, but to onnxruntime's default
+  configs[3].disable_quant_qdq = false;
+  configs[4].graph_optimization_level = "ORT_ENABLE_BASIC";
+  configs[5].replica_count = 2;
+  configs[6].replica_count = 2;
+  configs[6].replica_index = 1;
+  configs[7].log_id = "a;log_severity_level=1";  // Looks like another option when not escaped
+  configs[8].provider_options.push_back({"cpu", {{"option", "value"}}});
+
+  std::set<std::string> keys;
+  for (auto& config : configs)
+    keys.insert(Generators::SessionOptionsKey(config));
+  EXPECT_EQ(keys.size(), configs.size());
+
+  // The same options always give the same key
+  EXPECT_EQ(Generators::SessionOptionsKey(configs[6]), Generators::SessionOptionsKey(SessionOptions{configs[6]}));
+}
+
+TEST(ModelTests, VisionSessionLazyLoadAndIdleUnload) {
+  auto config = std::make_unique<Generators::Config>(fs::path(MODEL_PATH "vision-preprocessing"),
+                                                     R"({"model": {"vision": {"lazy_load": true, "idle_unload_seconds": 1}}})");
+  auto model = std::make_shared<Generators::MultiModalVisionModel>(std::move(config), Generators::GetOrtEnv());
+
+  // Only the embedding and decoder sessions are created with the model
+  EXPECT_FALSE(model->IsVisionSessionLoaded());
+  EXPECT_EQ((*model->metrics_)[Generators::Phase::SessionLoad].Count(), 2u);
+
+  // The first request with images creates it
+  auto session = model->GetVisionSession();
+  ASSERT_TRUE(session);
+  EXPECT_TRUE(model->IsVisionSessionLoaded());
+  EXPECT_EQ((*model->metrics_)[Generators::Phase::SessionLoad].Count(), 3u);
+
+  // It isn't released while in use, even once it has been idle long enough
+  std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+  model->UnloadIdleVisionSession();
+  EXPECT_TRUE(model->IsVisionSessionLoaded());
+
+  session.reset();
+  model->UnloadIdleVisionSession();
+  EXPECT_FALSE(model->IsVisionSessionLoaded());
+
+  // The next request loads it again, with the same inputs as before
+  session = model->GetVisionSession();
+  ASSERT_TRUE(session);
+  EXPECT_TRUE(model->IsVisionSessionLoaded());
+  EXPECT_EQ((*model->metrics_)[Generators::Phase::SessionLoad].Count(), 4u);
+  auto input_names = session->GetInputNames();
+  EXPECT_NE(std::find(input_names.begin(), input_names.end(), "pixel_values"), input_names.end());
+
+  // Freshly used, so it stays loaded
+  session.reset();
+  model->UnloadIdleVisionSession();
+  EXPECT_TRUE(model->IsVisionSessionLoaded());
+}
+
+TEST(ModelTests, ParseCpuList) {
+  EXPECT_EQ(Generators::ParseCpuList("0-3,8,10-11"), (std::vector<int>{0, 1, 2, 3, 8, 10, 11}));
+  EXPECT_EQ(Generators::ParseCpuList(" 5 , 7-7 ,\n"), (std::vector<int>{5, 7}));
+  EXPECT_EQ(Generators::ParseCpuList(""), std::vector<int>{});
+
+  for (const char* malformed : {"a", "1x", "-1", "3-1", "1-", "1-2-3", "1,,b", "99999999999"})
+    EXPECT_THROW(Generators::ParseCpuList(malformed), std::runtime_error) << malformed;
+}
+
+TEST(ModelTests, GetReplicaCpus) {
+  // Two nodes split into four replicas, each stays on one node
+  const std::vector<std::vector<int>> two_nodes{{0, 1, 2, 3}, {4, 5, 6, 7}};
+  EXPECT_EQ(Generators::GetReplicaCpus(two_nodes, 4, 0), (std::vector<int>{0, 1}));
+  EXPECT_EQ(Generators::GetReplicaCpus(two_nodes, 4, 3), (std::vector<int>{6, 7}));
+  EXPECT_EQ(Generators::GetReplicaCpus(two_nodes, 1, 0), (std::vector<int>{0, 1, 2, 3, 4, 5, 6, 7}));
+
+  // Interleaved processor ids, as many hosts number hyperthreads, keep node order rather than id order
+  const std::vector<std::vector<int>> interleaved{{0, 2, 4, 6}, {1, 3, 5, 7}};
+  EXPECT_EQ(Generators::GetReplicaCpus(interleaved, 2, 1), (std::vector<int>{1, 3, 5, 7}));
+
+  // Three replicas of eight processors get 2, 3 and 3
+  EXPECT_EQ(Generators::GetReplicaCpus(two_nodes, 3, 0), (std::vector<int>{0, 1}));
+  EXPECT_EQ(Generators::GetReplicaCpus(two_nodes, 3, 2), (std::vector<int>{5, 6, 7}));
+
+  EXPECT_THROW(Generators::GetReplicaCpus(two_nodes, 2, 2), std::runtime_error);
+  EXPECT_THROW(Generators::GetReplicaCpus(two_nodes, 0, 0), std::runtime_error);
+  EXPECT_THROW(Generators::GetReplicaCpus(two_nodes, 9, 0), std::runtime_error);
+
+  // The host's own layout, whatever its node ids are, covers every processor once across the replicas
+  auto all = Generators::GetReplicaCpus(1, 0);
+  if (all.size() >= 2) {
+    auto joined = Generators::GetReplicaCpus(2, 0);
+    auto second = Generators::GetReplicaCpus(2, 1);
+    joined.insert(joined.end(), second.begin(), second.end());
+    EXPECT_EQ(joined, all);
+  }
+}
+
+TEST(ModelTests, FormatIntraOpThreadAffinities) {
+  // The first thread is the caller and isn't pinned, the others take the processors in turn with 1-based ids
+  EXPECT_EQ(Generators::FormatIntraOpThreadAffinities({4, 5, 6}, 4), "6;7;5");
+  EXPECT_EQ(Generators::FormatIntraOpThreadAffinities({4, 5, 6}, 1), "");
+  EXPECT_EQ(Generators::FormatIntraOpThreadAffinities({0}, 3), "1;1");
+  EXPECT_EQ(Generators::FormatIntraOpThreadAffinities({}, 3), "");
+}
+
+TEST(ModelTests, AppendTokensAfterARowFinished) {
+  auto model = Generators::CreateModel(Generators::GetOrtEnv(), MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32");
+
+  // The first row generates 204 first, so the stop sequence finishes it right away and it gets pad tokens from then on
+  std::vector<int32_t> input_ids{0, 0, 0, 52, 0, 0, 195, 731};
+  auto params = Generators::CreateGeneratorParams(*model);
+  params->search.max_length = 12;
+  params->batch_size = 2;
+  params->sequence_length = 4;
+  params->input_ids = input_ids;
+  params->stop_token_sequences = {{204}};
+  auto generator = Generators::CreateGenerator(*model, *params);
+  for (int i = 0; i < 3; i++) {
+    generator->ComputeLogits();
+    generator->GenerateNextToken();
+  }
+  const int32_t pad = model->config_->model.pad_token_id;
+  auto finished = generator->GetSequence(0).CpuSpan();
+  ASSERT_EQ(finished.size(), 7u);
+  EXPECT_EQ(finished[4], 204);
+  EXPECT_EQ(finished[5], pad);
+  EXPECT_EQ(finished[6], pad);
+
+  // Both rows continue after the appended tokens. The pad tokens of the finished row aren't masked out
+  std::vector<int32_t> appended{52, 195};
+  generator->AppendTokens(appended);
+  generator->ComputeLogits();
+  auto* attention_mask = generator->state_->GetInput("attention_mask");
+  ASSERT_NE(attention_mask, nullptr);
+  auto mask_info = attention_mask->GetTensorTypeAndShapeInfo();
+  EXPECT_EQ(mask_info->GetShape(), (std::vector<int64_t>{2, 8}));
+  for (size_t i = 0; i < 16; i++) {
+    const int64_t value = mask_info->GetElementType() == Ort::TypeToTensorType<int32_t> ? attention_mask->GetTensorData<int32_t>()[i]
+                                                                                        : attention_mask->GetTensorData<int64_t>()[i];
+    EXPECT_EQ(value, 1) << "position " << i % 8 << " of row " << i / 8;
+  }
+  generator->GenerateNextToken();
+  EXPECT_EQ(generator->GetSequence(0).CpuSpan().size(), 9u);
+}
+
+TEST(ModelTests, GptCanRemoveRows) {
+  auto model = Generators::CreateModel(Generators::GetOrtEnv(), MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32");
+
+  std::vector<int32_t> input_ids{0, 0, 0, 52, 0, 0, 195, 731};
+  auto params = Generators::CreateGeneratorParams(*model);
+  params->search.max_length = 10;
+  params->batch_size = 2;
+  params->sequence_length = 4;
+  params->input_ids = input_ids;
+  EXPECT_TRUE(Generators::CreateGenerator(*model, *params)->state_->CanRemoveRows());
+
+  // Shared past/present buffers are sized for the whole batch, like DecoderOnly_State
+  params->search.past_present_share_buffer = true;
+  EXPECT_FALSE(Generators::CreateGenerator(*model, *params)->state_->CanRemoveRows());
+
+  params->search.past_present_share_buffer = false;
+  params->search.kv_cache_int8 = true;
+  EXPECT_FALSE(Generators::CreateGenerator(*model, *params)->state_->CanRemoveRows());
+}
+
+TEST(ModelTests, LoadStateChecksTheModel) {
+  // Copies of the gpt2 model: one as is, and one with the same weights and shapes but a different bos_token_id
+  auto read_file = [](const fs::path& path) {
+    auto file = path.open(std::ios::binary);
+    return std::string{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+  };
+  const fs::path source{MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32"};
+  const auto config_text = read_file(source / "genai_config.json");
+  auto modified_text = config_text;
+  const std::string bos{"\"bos_token_id\": 98"};
+  ASSERT_NE(modified_text.find(bos), std::string::npos);
+  modified_text.replace(modified_text.find(bos), bos.size(), "\"bos_token_id\": 0");
+  const fs::path same{"load_state_same_model"}, different{"load_state_different_model"};
+  for (auto& [directory, text] : {std::pair{same, config_text}, std::pair{different, modified_text}}) {
+    ASSERT_TRUE(directory.create_directory());
+    directory.join("genai_config.json").open_for_write(std::ios::binary) << text;
+    directory.join("past.onnx").open_for_write(std::ios::binary) << read_file(source / "past.onnx");
+  }
+
+  auto model = Generators::CreateModel(Generators::GetOrtEnv(), source.string().c_str());
+  auto same_model = Generators::CreateModel(Generators::GetOrtEnv(), same.string().c_str());
+  auto different_model = Generators::CreateModel(Generators::GetOrtEnv(), different.string().c_str());
+  EXPECT_EQ(same_model->Identity(), model->Identity());
+  EXPECT_NE(different_model->Identity(), model->Identity());
+
+  std::vector<int32_t> input_ids{0, 0, 0, 52, 0, 0, 195, 731};
+  auto create_generator = [&](const Generators::Model& for_model) {
+    auto params = Generators::CreateGeneratorParams(for_model);
+    params->search.max_length = 10;
+    params->batch_size = 2;
+    params->sequence_length = 4;
+    params->input_ids = input_ids;
+    return Generators::CreateGenerator(for_model, *params);
+  };
+  auto generator = create_generator(*model);
+  generator->ComputeLogits();
+  generator->GenerateNextToken();
+  auto snapshot = generator->SaveState(false);
+
+  // The copy in another directory is still the same model, the one with a different config is not
+  create_generator(*same_model)->LoadState(snapshot);
+  EXPECT_THROW(create_generator(*different_model)->LoadState(snapshot), std::runtime_error);
+
+  for (const auto& directory : {same, different}) {
+    directory.join("genai_config.json").remove();
+    directory.join("past.onnx").remove();
+  }
+}
+
+TEST(ModelTests, PrometheusFormat) {
+  Generators::Metrics metrics;
+  metrics.Record(Generators::Phase::Decode, std::chrono::nanoseconds{1'000'000'001});
+  metrics.Record(Generators::Phase::Decode, std::chrono::milliseconds{2});
+  auto text = metrics.ToPrometheus("generator", "my \"model\"");
+
+  // Counts are integers, seconds keep every digit and the model label is escaped
+  EXPECT_NE(text.find("genai_phase_seconds_bucket{scope=\"generator\",model=\"my \\\"model\\\"\",phase=\"decode\",le=\"+Inf\"} 2\n"), std::string::npos);
+  EXPECT_NE(text.find("genai_phase_seconds_count{scope=\"generator\",model=\"my \\\"model\\\"\",phase=\"decode\"} 2\n"), std::string::npos);
+  EXPECT_NE(text.find("genai_phase_max_seconds{scope=\"generator\",model=\"my \\\"model\\\"\",phase=\"decode\"} 1.000000001"), std::string::npos);
+  EXPECT_EQ(text.find("e+"), std::string::npos);
+}
+
+TEST(ModelTests, ShutdownAndRecreateGlobals) {
+  // Every other test has released its objects by now, so the globals can be torn down mid-run
+  Generators::Shutdown();
+
+  // The globals no longer exist, so the thread pool choice can be made again
+  Generators::SetGlobalThreadPool(2);
+  {
+    auto model = Generators::CreateModel(Generators::GetOrtEnv(), MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32");
+    EXPECT_TRUE(Generators::GetOrtGlobals()->global_thread_pool_);
+    EXPECT_EQ(Generators::GetOrtGlobals()->thread_pool_->WorkerCount(), 1u);
+    EXPECT_THROW(Generators::SetGlobalThreadPool(2), std::runtime_error);
+
+    std::vector<int32_t> input_ids{0, 0, 0, 52, 0, 0, 195, 731};
+    auto params = Generators::CreateGeneratorParams(*model);
+    params->search.max_length = 10;
+    params->batch_size = 2;
+    params->sequence_length = 4;
+    params->input_ids = input_ids;
+    auto result = Generators::Generate(*model, *params);
+    EXPECT_EQ(result.size(), 2u);
+  }
+
+  // Shutdown also forgets the request, the next use gets fresh default globals for the tests that follow
+  Generators::Shutdown();
+  ASSERT_TRUE(Generators::GetOrtGlobals());
+  EXPECT_NE(Generators::GetOrtGlobals()->thread_pool_, nullptr);
+}
@@ -74,6 +74,418 @@ def test_greedy_search(test_data_path, relative_model_path):
     for i in range(len(sequences)):
         assert sequences[i] == expected_sequence[i].tolist()
 
+    # Distinct prompts and lengths, each must match its own generate
+    many_params = []
+    for prompt, max_length in (([0, 0, 0, 52], 10), ([0, 0, 195, 731], 9), ([52, 195], 7), ([731, 52, 0], 12), ([195], 5)):
+        params = og.GeneratorParams(model)
+        params.input_ids = np.array([prompt], dtype=np.int32)
+        params.set_search_options(do_sample=False, max_length=max_length)
+        many_params.append(params)
+    for params, sequences in zip(many_params, model.generate_many(many_params)):
+        assert sequences == model.generate(params)
+    assert model.generate_many([many_params[0]])[0][0] == expected_sequence[0].tolist()
+
+    sequences = model.generate_ragged(search_params, [[0, 0, 0, 52], [0, 0, 195, 731]])
+    assert sequences == expected_sequence.tolist()
+
+    # The second sequence ends once it generated 731, 114 and is padded from then on
+    search_params.add_stop_token_sequence([731, 114])
+    sequences = model.generate(search_params)
+    assert sequences[0] == expected_sequence[0].tolist()
+    assert sequences[1] == [0, 0, 195, 731, 731, 114] + [search_params.pad_token_id] * 4
+
+
+def test_arrays_outlive_steps(test_data_path):
+    model = og.Model(os.fspath(Path(test_data_path) / "hf-internal-testing" / "tiny-random-gpt2-fp32"))
+
+    params = og.GeneratorParams(model)
+    params.input_ids = np.array([[0, 0, 0, 52], [0, 0, 195, 731]], dtype=np.int32)
+    params.set_search_options(do_sample=False, max_length=10)
+    generator = og.Generator(model, params)
+    generator.compute_logits()
+    logits = generator.get_logits()
+    output_logits = generator.get_output("logits")
+    present = generator.get_output("present_0")
+    expected = [np.copy(logits), np.copy(output_logits), np.copy(present)]
+    generator.generate_next_token()
+    snapshot = generator.save_state()
+    next_tokens = generator.get_next_tokens()
+    expected.append(np.copy(next_tokens))
+    sequence = generator.get_sequence(1)
+    expected_sequence = np.copy(sequence)
+
+    # The buffers behind these arrays are reallocated or freed by the next steps, and replaced by load_state
+    for _ in range(2):
+        generator.compute_logits()
+        generator.generate_next_token()
+    generator.load_state(snapshot)
+    for array, expected_array in zip([logits, output_logits, present, next_tokens], expected):
+        assert np.array_equal(array, expected_array)
+    assert np.array_equal(sequence, expected_sequence)  # Loading the state put the same tokens back
+
+    # Arrays that alias the generator's buffers can't be written through
+    with pytest.raises(ValueError):
+        sequence[0] = 1
+    logits[0] = 1  # Copies can
+    next_tokens[0] = 1
+
+
+def test_generate_ragged(test_data_path):
+    model = og.Model(os.fspath(Path(test_data_path) / "hf-internal-testing" / "tiny-random-gpt2-fp32"))
+
+    # Lengths 3, 3 and 7, 7, 8 end up in two batches, the second one padding its shorter prompts
+    prompts = [[52, 195, 731], [412, 7, 7, 303, 52, 195, 731], [731, 114, 52], [5, 6, 7, 8, 9, 10, 11, 12], [600, 1, 2, 3, 4, 5, 6]]
+    params = og.GeneratorParams(model)
+    params.set_search_options(do_sample=False, max_length=14)
+    sequences = model.generate_ragged(params, prompts)
+    assert len(sequences) == len(prompts)
+
+    for prompt, sequence in zip(prompts, sequences):
+        # max_length counts the padded length of the batch, so a prompt gets at most as many tokens as on its own
+        single_params = og.GeneratorParams(model)
+        single_params.input_ids = np.array([prompt], dtype=np.int32)
+        single_params.set_search_options(do_sample=False, max_length=14)
+        single = model.generate(single_params)[0]
+        assert sequence[: len(prompt)] == prompt
+        assert len(prompt) < len(sequence) <= len(single)
+        assert sequence == single[: len(sequence)]
+
+
+def test_append_tokens(test_data_path):
+    model = og.Model(os.fspath(Path(test_data_path) / "hf-internal-testing" / "tiny-random-gpt2-fp32"))
+
+    params = og.GeneratorParams(model)
+    params.input_ids = np.array([0, 0, 0, 52], dtype=np.int32)
+    params.set_search_options(do_sample=False, max_length=12)
+    generator = og.Generator(model, params)
+    generator.compute_logits()
+    generator.generate_next_token()
+    next_token = int(generator.get_next_tokens()[0])
+    generator.append_tokens(np.array([195, 731], dtype=np.int32))
+    generator.compute_logits()
+    appended_logits = np.copy(generator.get_logits())
+
+    # Must match a generator that got the whole conversation as its prompt
+    full_params = og.GeneratorParams(model)
+    full_params.input_ids = np.array([0, 0, 0, 52, next_token, 195, 731], dtype=np.int32)
+    full_params.set_search_options(do_sample=False, max_length=12)
+    full_generator = og.Generator(model, full_params)
+    full_generator.compute_logits()
+    assert np.allclose(appended_logits, full_generator.get_logits(), atol=1e-5)
+
+    while not generator.is_done():
+        generator.generate_next_token()
+        if not generator.is_done():
+            generator.compute_logits()
+    while not full_generator.is_done():
+        full_generator.generate_next_token()
+        if not full_generator.is_done():
+            full_generator.compute_logits()
+    assert np.array_equal(generator.get_sequence(0), full_generator.get_sequence(0))
+
+
+def test_append_tokens_after_finished_row(test_data_path):
+    model = og.Model(os.fspath(Path(test_data_path) / "hf-internal-testing" / "tiny-random-gpt2-fp32"))
+
+    # The second row stops once it generated 731, 114, the first one keeps going
+    params = og.GeneratorParams(model)
+    params.input_ids = np.array([[0, 0, 0, 52], [0, 0, 195, 731]], dtype=np.int32)
+    params.set_search_options(do_sample=False, max_length=14)
+    params.add_stop_token_sequence([731, 114])
+    generator = og.Generator(model, params)
+    for _ in range(2):
+        generator.compute_logits()
+        generator.generate_next_token()
+    sequences = [generator.get_sequence(i).tolist() for i in range(2)]
+    assert sequences[1] == [0, 0, 195, 731, 731, 114]
+
+    # Both rows continue after the appended tokens, like generators that got the whole conversation as their prompt
+    appended = [[195, 731], [0, 52]]
+    generator.append_tokens(np.array(appended, dtype=np.int32))
+    assert not generator.is_done()
+    full_params = og.GeneratorParams(model)
+    full_params.input_ids = np.array([sequences[i] + appended[i] for i in range(2)], dtype=np.int32)
+    full_params.set_search_options(do_sample=False, max_length=14)
+    full_params.add_stop_token_sequence([731, 114])
+    full_generator = og.Generator(model, full_params)
+
+    while not full_generator.is_done():
+        generator.compute_logits()
+        full_generator.compute_logits()
+        assert np.allclose(generator.get_logits(), full_generator.get_logits(), atol=1e-5)
+        generator.generate_next_token()
+        full_generator.generate_next_token()
+    assert generator.is_done()
+    for i in range(2):
+        assert np.array_equal(generator.get_sequence(i), full_generator.get_sequence(i))
+
+
+def test_metrics(test_data_path):
+    model = og.Model(os.fspath(Path(test_data_path) / "hf-internal-testing" / "tiny-random-gpt2-fp32"))
+
+    params = og.GeneratorParams(model)
+    params.input_ids = np.array([[0, 0, 0, 52], [0, 0, 195, 731]], dtype=np.int32)
+    params.set_search_options(do_sample=False, max_length=14)
+    generator = og.Generator(model, params)
+    for _ in range(3):
+        generator.compute_logits()
+        generator.generate_next_token()
+    generator.append_tokens(np.array([[195, 731], [0, 52]], dtype=np.int32))
+    generator.compute_logits()
+    generator.generate_next_token()
+
+    metrics = generator.get_metrics()
+    assert metrics["prefill"]["count"] == 2  # The prompt and the appended tokens
+    assert metrics["decode"]["count"] == 2
+    assert metrics["select_top"]["count"] == 4
+    assert "sample_top_k" not in metrics
+    assert 0 < metrics["prefill"]["max_seconds"] <= metrics["prefill"]["total_seconds"]
+
+    assert model.get_metrics()["prefill"]["count"] == 2
+    assert 'genai_phase_seconds_count{scope="generator",model="tiny-random-gpt2-fp32",phase="decode"} 2' in generator.get_metrics_prometheus()
+    assert 'genai_phase_seconds_count{scope="model",model="tiny-random-gpt2-fp32",phase="prefill"} 2' in model.get_metrics_prometheus()
+
+
+def test_rewind_to(test_data_path):
+    model = og.Model(os.fspath(Path(test_data_path) / "hf-internal-testing" / "tiny-random-gpt2-fp32"))
+
+    params = og.GeneratorParams(model)
+    params.input_ids = np.array([[0, 0, 0, 52], [0, 0, 195, 731]], dtype=np.int32)
+    params.set_search_options(do_sample=False, max_length=10)
+    generator = og.Generator(model, params)
+
+    logits = []
+    while not generator.is_done():
+        generator.compute_logits()
+        logits.append(np.copy(generator.get_logits()))
+        generator.generate_next_token()
+    sequences = [np.copy(generator.get_sequence(i)) for i in range(2)]
+
+    # Greedy search makes the same choices again from the rewound point
+    generator.rewind_to(6)
+    assert not generator.is_done()
+    assert np.array_equal(generator.get_sequence(0), sequences[0][:6])
+    assert np.array_equal(generator.get_next_tokens(), [sequences[0][5], sequences[1][5]])
+
+    step = 2  # The logits that picked the 7th token
+    while not generator.is_done():
+        generator.compute_logits()
+        assert np.allclose(generator.get_logits(), logits[step], atol=1e-5)
+        generator.generate_next_token()
+        step += 1
+    for i in range(2):
+        assert np.array_equal(generator.get_sequence(i), sequences[i])
+
+    # The last kept token is run again on top of the KV cache of the ones before it, so at least two are kept
+    with pytest.raises(Exception):
+        generator.rewind_to(1)
+
+
+def test_rewind_to_stop_sequence(test_data_path):
+    model = og.Model(os.fspath(Path(test_data_path) / "hf-internal-testing" / "tiny-random-gpt2-fp32"))
+
+    params = og.GeneratorParams(model)
+    params.input_ids = np.array([[0, 0, 0, 52], [0, 0, 195, 731]], dtype=np.int32)
+    params.set_search_options(do_sample=False, max_length=10)
+    params.add_stop_token_sequence([731, 114])
+    generator = og.Generator(model, params)
+    while not generator.is_done():
+        generator.compute_logits()
+        generator.generate_next_token()
+    sequences = [np.copy(generator.get_sequence(i)) for i in range(2)]
+    assert sequences[1].tolist() == [0, 0, 195, 731, 731, 114] + [params.pad_token_id] * 4
+
+    # The kept tokens end with the generated 731, so the stop sequence still ends the second row on the next 114
+    generator.rewind_to(5)
+    snapshot = generator.save_state()
+    restored = og.Generator(model, params)
+    restored.load_state(snapshot)  # Picks up the partial match as well
+    for g in (generator, restored):
+        while not g.is_done():
+            g.compute_logits()
+            g.generate_next_token()
+        for i in range(2):
+            assert np.array_equal(g.get_sequence(i), sequences[i])
+
+
+def test_stop_strings(test_data_path):
+    model = og.Model(os.fspath(Path(test_data_path) / "hf-internal-testing" / "tiny-random-gpt2-fp32"))
+    tokenizer = og.Tokenizer(model)
+
+    params = og.GeneratorParams(model)
+    params.input_ids = np.array([[0, 0, 0, 52], [0, 0, 195, 731]], dtype=np.int32)
+    params.set_search_options(do_sample=False, max_length=10)
+    full = model.generate(params)
+
+    # Every row decodes its own generated tokens
+    def generated_text(sequence):
+        stream = tokenizer.create_stream()
+        return [stream.decode(token) for token in sequence[4:]]
+
+    # A row ends on the token that completes the stop string, and is padded from then on. pad is also EOS here
+    def expected_sequence(sequence):
+        text = ""
+        for i, (token, chunk) in enumerate(zip(sequence[4:], generated_text(sequence))):
+            if token == params.pad_token_id:
+                break
+            text += chunk
+            if stop_string in text:
+                return sequence[: 5 + i] + [params.pad_token_id] * (len(sequence) - 5 - i)
+        return sequence
+
+    # Spans the boundary between the first two tokens the second row generates
+    chunks = generated_text(full[1])
+    assert chunks[0] and chunks[1]
+    stop_string = chunks[0][-1] + chunks[1][0]
+
+    params.add_stop_string(stop_string)
+    sequences = model.generate(params)
+    assert sequences[1][6:] == [params.pad_token_id] * 4
+    for i in range(2):
+        assert sequences[i] == expected_sequence(full[i])
+
+
+def test_save_load_state(test_data_path):
+    model = og.Model(os.fspath(Path(test_data_path) / "hf-internal-testing" / "tiny-random-gpt2-fp32"))
+
+    params = og.GeneratorParams(model)
+    params.input_ids = np.array([[0, 0, 0, 52], [0, 0, 195, 731]], dtype=np.int32)
+    params.set_search_options(do_sample=False, max_length=10)
+    generator = og.Generator(model, params)
+    for _ in range(3):
+        generator.compute_logits()
+        generator.generate_next_token()
+    snapshot = generator.save_state()
+    assert len(generator.save_state(kv_fp16=True)) < len(snapshot)
+
+    while not generator.is_done():
+        generator.compute_logits()
+        generator.generate_next_token()
+
+    # A new generator continues from the snapshot without running the prompt again
+    restored = og.Generator(model, params)
+    restored.load_state(snapshot)
+    assert np.array_equal(restored.get_sequence(0), generator.get_sequence(0)[:7])
+    while not restored.is_done():
+        restored.compute_logits()
+        restored.generate_next_token()
+    for i in range(2):
+        assert np.array_equal(restored.get_sequence(i), generator.get_sequence(i))
+
+    # A snapshot that is rejected leaves the generator as it was, so it can still load a good one
+    restored = og.Generator(model, params)
+    for bad_snapshot in (snapshot[:-10], snapshot[:20], snapshot + b"0"):
+        with pytest.raises(Exception):
+            restored.load_state(bad_snapshot)
+    restored.load_state(snapshot)
+    while not restored.is_done():
+        restored.compute_logits()
+        restored.generate_next_token()
+    for i in range(2):
+        assert np.array_equal(restored.get_sequence(i), generator.get_sequence(i))
+
+    # Or still run its own prompt
+    single_params = og.GeneratorParams(model)
+    single_params.input_ids = np.array([[0, 0, 0, 52]], dtype=np.int32)
+    single_params.set_search_options(do_sample=False, max_length=10)
+    single = og.Generator(model, single_params)
+    with pytest.raises(Exception):
+        single.load_state(snapshot)
+    while not single.is_done():
+        single.compute_logits()
+        single.generate_next_token()
+    assert np.array_equal(single.get_sequence(0), generator.get_sequence(0))
+
+
+def check_drop_finished_rows(model, input_ids, max_length):
+    params = og.GeneratorParams(model)
+    params.input_ids = input_ids
+    params.set_search_options(do_sample=False, max_length=max_length)
+    prompt_length = len(input_ids[0])
+    stop_sequence = model.generate(params)[1][prompt_length : prompt_length + 2]
+
+    # The second row stops after its first two generated tokens, so it gets dropped early on
+    generators = []
+    for drop_finished_rows in (False, True):
+        params = og.GeneratorParams(model)
+        params.input_ids = input_ids
+        params.set_search_options(do_sample=False, max_length=max_length, drop_finished_rows=drop_finished_rows)
+        params.add_stop_token_sequence(stop_sequence)
+        generators.append(og.Generator(model, params))
+
+    full, dropping = generators
+    dropped = False
+    while not full.is_done():
+        full.compute_logits()
+        dropping.compute_logits()
+        # Dropped rows get the lowest score for every token, the others must match the full batch
+        full_logits = full.get_logits().reshape(len(input_ids), -1)
+        dropping_logits = dropping.get_logits().reshape(len(input_ids), -1)
+        for row in range(len(input_ids)):
+            if dropping_logits[row].max() == np.finfo(np.float32).min:
+                dropped = True
+            else:
+                assert np.allclose(dropping_logits[row], full_logits[row], atol=1e-4)
+        full.generate_next_token()
+        dropping.generate_next_token()
+    assert dropping.is_done()
+    assert dropped
+    assert dropping.get_memory_usage()["kv_cache"]["current_bytes"] < full.get_memory_usage()["kv_cache"]["current_bytes"]
+    for row in range(len(input_ids)):
+        assert np.array_equal(dropping.get_sequence(row), full.get_sequence(row))
+
+
+def test_drop_finished_rows(test_data_path):
+    model = og.Model(os.fspath(Path(test_data_path) / "hf-internal-testing" / "tiny-random-gpt2-fp32"))
+    check_drop_finished_rows(model, np.array([[0, 0, 0, 52], [0, 0, 195, 731]], dtype=np.int32), 10)
+
+
+# TODO: CUDA pipelines use python3.6 and do not have a way to download models since downloading models
+# requires pytorch and hf transformers. This test should be re-enabled once the pipeline is updated.
+@pytest.mark.skipif(
+    sysconfig.get_platform().endswith("arm64") or sys.version_info.minor < 8,
+    reason="Python 3.8 is required for downloading models.",
+)
+def test_drop_finished_rows_decoder(phi2_for):
+    # A decoder-only model with a padded batch, so the attention mask and position ids get compacted as well
+    model = og.Model(phi2_for("cpu"))
+    tokenizer = og.Tokenizer(model)
+    check_drop_finished_rows(model, tokenizer.encode_batch(["This is a test.", "Rats are awesome pets!"]), 20)
+
+
+def test_kv_cache_int8(test_data_path):
+    model = og.Model(os.fspath(Path(test_data_path) / "hf-internal-testing" / "tiny-random-gpt2-fp32"))
+
+    generators = []
+    for kv_cache_int8 in (False, True):
+        params = og.GeneratorParams(model)
+        params.input_ids = np.array([[0, 0, 0, 52], [0, 0, 195, 731]], dtype=np.int32)
+        params.set_search_options(do_sample=False, max_length=10, kv_cache_int8=kv_cache_int8)
+        generators.append(og.Generator(model, params))
+
+    full, quantized = generators
+    while not full.is_done():
+        full.compute_logits()
+        quantized.compute_logits()
+        assert np.allclose(quantized.get_logits(), full.get_logits(), atol=1e-2)
+        full.generate_next_token()
+        quantized.generate_next_token()
+
+        # Between steps only the int8 copy of the cache is kept
+        assert (
+            quantized.get_memory_usage()["kv_cache"]["current_bytes"]
+            < full.get_memory_usage()["kv_cache"]["current_bytes"] / 2
+        )
+        full.get_output("present_0")
+        with pytest.raises(Exception):
+            quantized.get_output("present_0")
+
+    # The saving is only between steps. While a step runs, the int8 copy is there on top of a full precision cache
+    full_usage = full.get_memory_usage()["kv_cache"]
+    quantized_usage = quantized.get_memory_usage()["kv_cache"]
+    assert full_usage["peak_bytes"] < quantized_usage["peak_bytes"] <= full_usage["peak_bytes"] * 1.5
+    assert quantized_usage["current_bytes"] < quantized_usage["peak_bytes"] / 2
+
 
 # TODO: CUDA pipelines use python3.6 and do not have a way to download models since downloading models
 # requires pytorch and hf transformers. This test should be re-enabled once the pipeline is updated.
@@ -5,6 +5,7 @@
 #include <generators.h>
 #include <search.h>
 #include <models/model.h>
+#include <stop_sequences.h>
 #include <iostream>
 #include <random>
 
@@ -112,6 +113,206 @@ TEST(SamplingTests, BatchedSamplingTopPAndKCpu) {
   }
 }
 
+TEST(SamplingTests, BatchedSamplingFp16LogitsCpu) {
+  auto model = Generators::CreateModel(Generators::GetOrtEnv(), MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32");
+  std::vector<int32_t> input_ids{0, 1, 2, 3};
+  std::vector<float> logits_cpu{2.0f, 1.5f, 1.25f, 0.25f, -0.25f,
+                                -0.25f, 2.0f, 1.25f, 1.5f, 0.25f,
+                                0.25f, 2.0f, -0.25f, 1.5f, 1.25f,
+                                1.25f, -0.25f, 1.5f, 0.25f, 2.0f};
+  std::vector<int32_t> expected_output{0, 1, 1, 4};
+
+  Generators::Config config;
+  config.model.vocab_size = 5;
+
+  int batch_size = 4;
+  for (bool do_sample : {false, true}) {
+    for (auto type : {ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16, ONNX_TENSOR_ELEMENT_DATA_TYPE_BFLOAT16}) {
+      std::vector<uint16_t> logits_16bit;
+      for (auto logit : logits_cpu)
+        logits_16bit.push_back(type == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16 ? Generators::FastFloat32ToFloat16(logit) : Generators::Float32ToBFloat16(logit));
+
+      auto params = Generators::CreateGeneratorParams(config);
+      params->search.max_length = 10;
+      params->search.do_sample = do_sample;
+      params->search.top_k = 2;
+      params->batch_size = batch_size;
+      params->sequence_length = 1;
+      params->input_ids = input_ids;
+      params->device_type = Generators::DeviceType::CPU;
+      auto generator = Generators::CreateGenerator(*model, *params);
+      generator->search_->SetLogits16(Generators::cpu_span<uint16_t>(logits_16bit), type);
+      generator->computed_logits_ = true;
+      // Verify outputs match expected outputs
+      generator->GenerateNextToken();
+      auto next_tokens = generator->search_->GetNextTokens().GetCPU();
+      for (int b = 0; b < batch_size; b++) {
+        if (do_sample)
+          EXPECT_GT(logits_cpu[next_tokens[b] + config.model.vocab_size * b], 1.25f);
+        else
+          EXPECT_EQ(next_tokens[b], expected_output[b]);
+      }
+    }
+  }
+}
+
+TEST(SamplingTests, Fp16MaskedLogitsCpu) {
+  auto model = Generators::CreateModel(Generators::GetOrtEnv(), MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32");
+  std::vector<int32_t> input_ids{0, 1};
+  constexpr uint16_t minus_infinity = 0xFC00;
+  std::vector<float> logits_cpu{2.0f, 1.5f, 0.0f, 0.25f, 0.0f,
+                                0.0f, 0.0f, 1.25f, 1.5f, 0.25f};
+  std::vector<uint16_t> logits_16bit;
+  for (auto logit : logits_cpu)
+    logits_16bit.push_back(logit == 0.0f ? minus_infinity : Generators::FastFloat32ToFloat16(logit));
+
+  Generators::Config config;
+  config.model.vocab_size = 5;
+
+  auto params = Generators::CreateGeneratorParams(config);
+  params->search.max_length = 10;
+  params->search.do_sample = true;
+  params->search.top_k = 5;
+  params->batch_size = 2;
+  params->sequence_length = 1;
+  params->input_ids = input_ids;
+  params->device_type = Generators::DeviceType::CPU;
+  auto generator = Generators::CreateGenerator(*model, *params);
+  generator->search_->SetLogits16(Generators::cpu_span<uint16_t>(logits_16bit), ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16);
+  generator->computed_logits_ = true;
+  generator->GenerateNextToken();
+
+  // Masked tokens are never sampled, and after sampling the logits are the probabilities the tokens were sampled with
+  auto next_tokens = generator->search_->GetNextTokens().GetCPU();
+  auto probabilities = generator->search_->GetLogits().GetCPU();
+  for (int b = 0; b < 2; b++) {
+    EXPECT_NE(logits_cpu[next_tokens[b] + config.model.vocab_size * b], 0.0f);
+    float sum = 0.0f;
+    for (int i = 0; i < config.model.vocab_size; i++) {
+      float probability = probabilities[i + config.model.vocab_size * b];
+      if (logits_cpu[i + config.model.vocab_size * b] == 0.0f)
+        EXPECT_EQ(probability, 0.0f);
+      sum += probability;
+    }
+    EXPECT_NEAR(sum, 1.0f, 1e-5f);
+  }
+
+  // Without sampling the masked logits come back as -inf
+  generator->search_->SetLogits16(Generators::cpu_span<uint16_t>(logits_16bit), ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16);
+  auto logits = generator->search_->GetLogits().GetCPU();
+  EXPECT_EQ(logits[2], -std::numeric_limits<float>::infinity());
+  EXPECT_FLOAT_EQ(logits[0], 2.0f);
+}
+
+TEST(SamplingTests, GreedyRemoveFinishedRowsCpu) {
+  auto model = Generators::CreateModel(Generators::GetOrtEnv(), MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32");
+  std::vector<int32_t> input_ids{0, 1, 2};
+  std::vector<float> logits_cpu{2.0f, 0.5f, 0.5f, 0.5f, 0.5f,
+                                0.5f, 0.5f, 0.5f, 0.5f, 2.0f,
+                                0.5f, 2.0f, 0.5f, 0.5f, 0.5f};
+  Generators::Config config;
+  config.model.vocab_size = 5;
+  config.model.eos_token_id = 4;
+  config.model.pad_token_id = 0;
+
+  auto params = Generators::CreateGeneratorParams(config);
+  params->search.max_length = 10;
+  params->batch_size = 3;
+  params->sequence_length = 1;
+  params->input_ids = input_ids;
+  params->device_type = Generators::DeviceType::CPU;
+  auto generator = Generators::CreateGenerator(*model, *params);
+  generator->search_->SetLogits(Generators::cpu_span<float>(logits_cpu));
+  generator->computed_logits_ = true;
+  generator->GenerateNextToken();
+
+  // Batch entry 1 hit EOS, so only the logits of entries 0 and 2 are expected from here on
+  std::vector<int32_t> rows_to_keep;
+  ASSERT_TRUE(generator->search_->RemoveFinishedRows(rows_to_keep));
+  EXPECT_EQ(rows_to_keep, (std::vector<int32_t>{0, 2}));
+  auto live_next_tokens = generator->search_->GetLiveNextTokens().GetCPU();
+  EXPECT_EQ(std::vector<int32_t>(live_next_tokens.begin(), live_next_tokens.end()), (std::vector<int32_t>{0, 1}));
+
+  std::vector<float> live_logits{0.5f, 0.5f, 2.0f, 0.5f, 0.5f,
+                                 0.5f, 0.5f, 0.5f, 2.0f, 0.5f};
+  generator->search_->SetLiveLogits(Generators::cpu_span<float>(live_logits));
+  generator->computed_logits_ = true;
+  generator->GenerateNextToken();
+  auto next_tokens = generator->search_->GetNextTokens().GetCPU();
+  EXPECT_EQ(std::vector<int32_t>(next_tokens.begin(), next_tokens.end()), (std::vector<int32_t>{2, 0, 3}));
+  EXPECT_FALSE(generator->search_->RemoveFinishedRows(rows_to_keep));
+
+  // The logits are still reported for the whole batch
+  auto logits = generator->search_->GetLogits().GetCPU();
+  ASSERT_EQ(logits.size(), 15);
+  EXPECT_EQ(logits[2], 2.0f);
+  EXPECT_EQ(logits[5], std::numeric_limits<float>::lowest());
+  EXPECT_EQ(logits[13], 2.0f);
+
+  // Logits set from outside cover the whole batch, including the dropped entry
+  std::vector<float> full_logits{0.5f, 0.5f, 0.5f, 2.0f, 0.5f,
+                                 2.0f, 0.5f, 0.5f, 0.5f, 0.5f,
+                                 0.5f, 0.5f, 2.0f, 0.5f, 0.5f};
+  generator->search_->SetLogits(Generators::cpu_span<float>(full_logits));
+  generator->computed_logits_ = true;
+  generator->GenerateNextToken();
+  next_tokens = generator->search_->GetNextTokens().GetCPU();
+  EXPECT_EQ(std::vector<int32_t>(next_tokens.begin(), next_tokens.end()), (std::vector<int32_t>{3, 0, 2}));
+}
+
+TEST(SamplingTests, StopSequenceAutomaton) {
+  Generators::AhoCorasick<int32_t> automaton;
+  for (auto pattern : {std::vector<int32_t>{1, 2, 3, 4}, std::vector<int32_t>{2, 3}, std::vector<int32_t>{3, 5}, std::vector<int32_t>{7}})
+    automaton.Add(pattern);
+  EXPECT_THROW(automaton.Add(std::vector<int32_t>{}), std::runtime_error);
+  automaton.Build();
+
+  // Each stream keeps its own state between steps, like the rows of a batch
+  auto step = [&](int32_t& state, int32_t token) {
+    bool matched{};
+    state = automaton.Next(state, token, matched);
+    return matched;
+  };
+
+  // A shorter pattern ending inside a longer one matches, and the longer one keeps matching after it. Overlapping
+  // patterns ({2, 3} then {3, 5}) both match
+  int32_t state{};
+  std::vector<int32_t> tokens{1, 2, 3, 4, 2, 3, 5, 6, 1, 2, 9, 7};
+  std::vector<bool> expected{false, false, true, true, false, true, true, false, false, false, false, true};
+  for (size_t i = 0; i < tokens.size(); i++)
+    EXPECT_EQ(step(state, tokens[i]), expected[i]) << "token " << i;
+
+  // A partial match survives steps of another stream in between
+  int32_t first{}, second{};
+  EXPECT_FALSE(step(first, 1));
+  EXPECT_FALSE(step(first, 2));
+  EXPECT_FALSE(step(second, 3));
+  EXPECT_TRUE(step(first, 3));
+  EXPECT_TRUE(step(second, 5));
+}
+
+TEST(SamplingTests, StopSequencesEndAtEveryEosId) {
+  auto model = Generators::CreateModel(Generators::GetOrtEnv(), MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32");
+
+  Generators::Config config;
+  config.model.vocab_size = 10;
+  config.model.eos_token_id = 5;
+  config.model.eos_token_ids = {5, 6};
+  auto params = Generators::CreateGeneratorParams(config);
+  params->batch_size = 3;
+  params->stop_token_sequences = {{1, 2}};
+
+  // A row that generated any of the EOS ids is over, a stop sequence after it doesn't match anymore
+  Generators::StopSequences stop_sequences{*model, *params};
+  for (size_t batch_id = 0; batch_id < 2; batch_id++) {
+    EXPECT_FALSE(stop_sequences.Append(batch_id, batch_id == 0 ? 5 : 6));
+    EXPECT_FALSE(stop_sequences.Append(batch_id, 1));
+    EXPECT_FALSE(stop_sequences.Append(batch_id, 2));
+  }
+  EXPECT_FALSE(stop_sequences.Append(2, 1));
+  EXPECT_TRUE(stop_sequences.Append(2, 2));
+}
+
 void CreateRandomLogits(float* logits, int num_large, int vocab_size, int batch_size, std::mt19937& engine) {
   assert(num_large < vocab_size / 2);  // num_large should be much smaller than vocab_size
   std::uniform_real_distribution<float> dist(0.0f, 1.0f);